@@ -53,6 +53,7 @@
 #include "rgy_resource.h"
 #include "rgy_env.h"
 #include "rgy_opencl.h"
+#include "convert_csp_bench.h"
 
 #if ENABLE_AVSW_READER
 extern "C" {
@@ -616,6 +617,10 @@ int parse_print_options(const TCHAR *option_name, const TCHAR *arg1, const QSVDe
         _ftprintf(stdout, _T("%s\n"), str.c_str());
         return 1;
     }
+    if (0 == _tcscmp(option_name, _T("check-convert-csp"))) {
+        tstring options = (arg1[0] != _T('-')) ? arg1 : _T("");
+        return (convert_csp_bench(options) == 0) ? 1 : -1;
+    }
     if (0 == _tcscmp(option_name, _T("check-device"))) {
         auto devs = getDeviceNameList();
         if (devs.size() > 0) {
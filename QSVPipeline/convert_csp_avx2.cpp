@@ -333,6 +333,20 @@ void convert_yuy2_to_nv12_i_avx2(void **dst_array, const void **src_array, int w
     _mm256_zeroupper();
 }
 
+//出力先が32byte境界にそろっている場合は、キャッシュを汚さないようnon-temporal storeで書き込む
+//non-temporal storeを使用した関数の最後では_mm_sfence()を呼ぶこと
+static RGY_FORCEINLINE void avx2_store_nt_if_aligned(bool dst_aligned, __m256i *dst, __m256i y0) {
+    if (dst_aligned) {
+        _mm256_stream_si256(dst, y0);
+    } else {
+        _mm256_storeu_si256(dst, y0);
+    }
+}
+
+static RGY_FORCEINLINE bool avx2_dst_aligned(const void *dst, int dst_pitch_byte) {
+    return (((size_t)dst | (size_t)dst_pitch_byte) & 31) == 0;
+}
+
 #pragma warning (push)
 #pragma warning (disable: 4127)
 template<bool uv_only>
@@ -348,7 +362,7 @@ static void RGY_FORCEINLINE convert_yv12_to_nv12_avx2_base(void **dst, const voi
         uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * y_range.start_dst;
         const int y_width = width - crop_right - crop_left;
         for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
-            avx2_memcpy<false>(dstLine, srcYLine, y_width);
+            avx2_memcpy<true>(dstLine, srcYLine, y_width);
         }
     }
     //UV成分のコピー
@@ -356,6 +370,7 @@ static void RGY_FORCEINLINE convert_yv12_to_nv12_avx2_base(void **dst, const voi
     uint8_t *srcULine = (uint8_t *)src[1] + ((src_uv_pitch_byte * uv_range.start_src) + (crop_left >> 1));
     uint8_t *srcVLine = (uint8_t *)src[2] + ((src_uv_pitch_byte * uv_range.start_src) + (crop_left >> 1));
     uint8_t *dstLine = (uint8_t *)dst[1] + dst_y_pitch_byte * uv_range.start_dst;
+    const bool dst_aligned = avx2_dst_aligned(dst[1], dst_y_pitch_byte);
     for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch_byte, srcVLine += src_uv_pitch_byte, dstLine += dst_y_pitch_byte) {
         const int x_fin = width - crop_right;
         uint8_t *src_u_ptr = srcULine;
@@ -372,10 +387,11 @@ static void RGY_FORCEINLINE convert_yv12_to_nv12_avx2_base(void **dst, const voi
             y2 = _mm256_unpackhi_epi8(y0, y1);
             y0 = _mm256_unpacklo_epi8(y0, y1);
 
-            _mm256_storeu_si256((__m256i *)(dst_ptr +  0), y0);
-            _mm256_storeu_si256((__m256i *)(dst_ptr + 32), y2);
+            avx2_store_nt_if_aligned(dst_aligned, (__m256i *)(dst_ptr +  0), y0);
+            avx2_store_nt_if_aligned(dst_aligned, (__m256i *)(dst_ptr + 32), y2);
         }
     }
+    _mm_sfence();
     _mm256_zeroupper();
 }
 #pragma warning (pop)
@@ -972,6 +988,7 @@ static void RGY_FORCEINLINE convert_yv12_high_to_p010_avx2_base(void **dst, cons
         uint16_t *srcYLine = (uint16_t *)src[0] + src_y_pitch * y_range.start_src + crop_left;
         uint16_t *dstLine = (uint16_t *)dst[0] + dst_y_pitch * y_range.start_dst;
         const int y_width = width - crop_right - crop_left;
+        const bool dst_aligned = avx2_dst_aligned(dst[0], dst_y_pitch_byte);
         for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch, dstLine += dst_y_pitch) {
             if (in_bit_depth == 16) {
                 avx2_memcpy<true>((uint8_t *)dstLine, (uint8_t *)srcYLine, y_width * (int)sizeof(uint16_t));
@@ -981,7 +998,7 @@ static void RGY_FORCEINLINE convert_yv12_high_to_p010_avx2_base(void **dst, cons
                 for (int x = 0; x < y_width; x += 16, dst_ptr += 16, src_ptr += 16) {
                     __m256i y0 = _mm256_loadu_si256((const __m256i *)src_ptr);
                     y0 = _mm256_slli_epi16(y0, 16 - in_bit_depth);
-                    _mm256_storeu_si256((__m256i *)dst_ptr, y0);
+                    avx2_store_nt_if_aligned(dst_aligned, (__m256i *)dst_ptr, y0);
                 }
             }
         }
@@ -992,6 +1009,7 @@ static void RGY_FORCEINLINE convert_yv12_high_to_p010_avx2_base(void **dst, cons
     uint16_t *srcULine = (uint16_t *)src[1] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
     uint16_t *srcVLine = (uint16_t *)src[2] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
     uint16_t *dstLine = (uint16_t *)dst[1] + dst_y_pitch * uv_range.start_dst;;
+    const bool dst_aligned = avx2_dst_aligned(dst[1], dst_y_pitch_byte);
     for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch, srcVLine += src_uv_pitch, dstLine += dst_y_pitch) {
         const int x_fin = width - crop_right;
         uint16_t *src_u_ptr = srcULine;
@@ -1013,10 +1031,11 @@ static void RGY_FORCEINLINE convert_yv12_high_to_p010_avx2_base(void **dst, cons
             y2 = _mm256_unpackhi_epi16(y0, y1);
             y0 = _mm256_unpacklo_epi16(y0, y1);
 
-            _mm256_storeu_si256((__m256i *)(dst_ptr +  0), y0);
-            _mm256_storeu_si256((__m256i *)(dst_ptr + 16), y2);
+            avx2_store_nt_if_aligned(dst_aligned, (__m256i *)(dst_ptr +  0), y0);
+            avx2_store_nt_if_aligned(dst_aligned, (__m256i *)(dst_ptr + 16), y2);
         }
     }
+    _mm_sfence();
 }
 #pragma warning (pop)
 
@@ -1102,9 +1121,9 @@ static void RGY_FORCEINLINE copy_yuv444_high_to_ayuv444_avx2(void **dst, const v
             __m256i pixY0 = _mm256_loadu_si256((const __m256i *)(src_y_ptr + 0)); // 15 -  0
             __m256i pixU0 = _mm256_loadu_si256((const __m256i *)(src_u_ptr + 0)); // 15 -  0
             __m256i pixV0 = _mm256_loadu_si256((const __m256i *)(src_v_ptr + 0)); // 15 -  0
-            __m256i pixY1 = _mm256_loadu_si256((const __m256i *)(src_y_ptr + 8)); // 31 - 16
-            __m256i pixU1 = _mm256_loadu_si256((const __m256i *)(src_u_ptr + 8)); // 31 - 16
-            __m256i pixV1 = _mm256_loadu_si256((const __m256i *)(src_v_ptr + 8)); // 31 - 16
+            __m256i pixY1 = _mm256_loadu_si256((const __m256i *)(src_y_ptr + 16)); // 31 - 16
+            __m256i pixU1 = _mm256_loadu_si256((const __m256i *)(src_u_ptr + 16)); // 31 - 16
+            __m256i pixV1 = _mm256_loadu_si256((const __m256i *)(src_v_ptr + 16)); // 31 - 16
             pixY0 = _mm256_adds_epi16(pixY0, xrsftAdd);
             pixU0 = _mm256_adds_epi16(pixU0, xrsftAdd);
             pixV0 = _mm256_adds_epi16(pixV0, xrsftAdd);
@@ -1181,7 +1200,7 @@ void convert_yuv444_to_y410_avx2(void** dst, const void** src, int width, int sr
         uint8_t* src_u_ptr = srcULine;
         uint8_t* src_v_ptr = srcVLine;
         uint32_t* dst_ptr = dstLine;
-        for (int x = 0; x < y_width; x++, src_y_ptr += 32, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 32) {
+        for (int x = 0; x < y_width; x += 32, src_y_ptr += 32, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 32) {
             __m256i pixY = _mm256_loadu_si256((const __m256i*)(src_y_ptr + 0));
             __m256i pixU = _mm256_loadu_si256((const __m256i*)(src_u_ptr + 0));
             __m256i pixV = _mm256_loadu_si256((const __m256i*)(src_v_ptr + 0));
@@ -1237,13 +1256,13 @@ void convert_yuv444_high_to_y410_avx2(void** dst, const void** src, int width, i
         uint16_t* src_u_ptr = srcULine;
         uint16_t* src_v_ptr = srcVLine;
         uint32_t* dst_ptr = dstLine;
-        for (int x = 0; x < y_width; x++, src_y_ptr += 32, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 32) {
+        for (int x = 0; x < y_width; x += 32, src_y_ptr += 32, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 32) {
             __m256i pixY0 = _mm256_loadu_si256((const __m256i*)(src_y_ptr + 0)); // 15 -  0
-            __m256i pixY1 = _mm256_loadu_si256((const __m256i*)(src_y_ptr + 8)); // 31 - 16
+            __m256i pixY1 = _mm256_loadu_si256((const __m256i*)(src_y_ptr + 16)); // 31 - 16
             __m256i pixU0 = _mm256_loadu_si256((const __m256i*)(src_u_ptr + 0)); // 15 -  0
-            __m256i pixU1 = _mm256_loadu_si256((const __m256i*)(src_u_ptr + 8)); // 31 - 16
+            __m256i pixU1 = _mm256_loadu_si256((const __m256i*)(src_u_ptr + 16)); // 31 - 16
             __m256i pixV0 = _mm256_loadu_si256((const __m256i*)(src_v_ptr + 0)); // 15 -  0
-            __m256i pixV1 = _mm256_loadu_si256((const __m256i*)(src_v_ptr + 8)); // 31 - 16
+            __m256i pixV1 = _mm256_loadu_si256((const __m256i*)(src_v_ptr + 16)); // 31 - 16
 
             if (in_bit_depth > out_bit_depth) {
                 pixY0 = _mm256_srli_epi16(_mm256_add_epi16(pixY0, xrsftAdd), in_bit_depth - out_bit_depth);
@@ -0,0 +1,479 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// -------------------------------------------------------------------------------------------
+
+#if defined(_M_X64) || defined(__x86_64)
+#define USE_SSE2  1
+#define USE_SSSE3 1
+#define USE_SSE41 1
+#define USE_AVX   1
+#define USE_AVX2  1
+#define USE_AVX512 1
+
+#include <immintrin.h>
+#include "rgy_simd.h"
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include "convert_csp.h"
+
+#if _MSC_VER >= 1800 && !defined(__AVX512BW__) && !defined(_DEBUG)
+static_assert(false, "do not forget to set /arch:AVX512 for this file.");
+#endif
+
+#if defined(_MSC_VER) || defined(__AVX512BW__)
+
+//AVX512では端数をマスク付きのload/storeで処理できるので、行末を超えて読み書きしない
+static RGY_FORCEINLINE __mmask64 avx512_mask8(int n) {
+    return (n >= 64) ? (__mmask64)(~0ull) : (__mmask64)((1ull << n) - 1);
+}
+static RGY_FORCEINLINE __mmask32 avx512_mask16(int n) {
+    return (n >= 32) ? (__mmask32)(~0u) : (__mmask32)((1u << n) - 1);
+}
+
+//出力先が64byte境界にそろっている場合は、キャッシュを汚さないようnon-temporal storeで書き込む
+//non-temporal storeを使用した関数の最後では_mm_sfence()を呼ぶこと
+static RGY_FORCEINLINE void avx512_store_nt_if_aligned(bool dst_aligned, void *dst, __m512i z0) {
+    if (dst_aligned) {
+        _mm512_stream_si512((__m512i *)dst, z0);
+    } else {
+        _mm512_storeu_si512(dst, z0);
+    }
+}
+
+static RGY_FORCEINLINE bool avx512_dst_aligned(const void *dst, int dst_pitch_byte) {
+    return (((size_t)dst | (size_t)dst_pitch_byte) & 63) == 0;
+}
+
+static void RGY_FORCEINLINE avx512_memcpy(uint8_t *dst, const uint8_t *src, int size) {
+    //先頭の端数を処理して、出力先を64byte境界にそろえる
+    const int start_align_diff = (int)((64 - ((size_t)dst & 63)) & 63);
+    if (start_align_diff) {
+        const int head = (std::min)(start_align_diff, size);
+        _mm512_mask_storeu_epi8(dst, avx512_mask8(head), _mm512_maskz_loadu_epi8(avx512_mask8(head), src));
+        dst += head;
+        src += head;
+        size -= head;
+    }
+    for (; size >= 256; dst += 256, src += 256, size -= 256) {
+        __m512i z0 = _mm512_loadu_si512((const __m512i *)(src +   0));
+        __m512i z1 = _mm512_loadu_si512((const __m512i *)(src +  64));
+        __m512i z2 = _mm512_loadu_si512((const __m512i *)(src + 128));
+        __m512i z3 = _mm512_loadu_si512((const __m512i *)(src + 192));
+        _mm512_stream_si512((__m512i *)(dst +   0), z0);
+        _mm512_stream_si512((__m512i *)(dst +  64), z1);
+        _mm512_stream_si512((__m512i *)(dst + 128), z2);
+        _mm512_stream_si512((__m512i *)(dst + 192), z3);
+    }
+    for (; size >= 64; dst += 64, src += 64, size -= 64) {
+        _mm512_stream_si512((__m512i *)dst, _mm512_loadu_si512((const __m512i *)src));
+    }
+    if (size > 0) {
+        _mm512_mask_storeu_epi8(dst, avx512_mask8(size), _mm512_maskz_loadu_epi8(avx512_mask8(size), src));
+    }
+}
+
+//並べ替えのインデックスはテーブルから読み込む
+//(_mm512_set_epi64で作るとインライン展開後にg++で-Wmaybe-uninitializedの警告が出るため)
+alignas(64) static const int64_t PERMUTE_FOR_UNPACK[8] = { 0, 4, 1, 5, 2, 6, 3, 7 };
+alignas(64) static const int64_t PERMUTE_AFTER_PACK[8] = { 0, 2, 4, 6, 1, 3, 5, 7 };
+
+//128bitレーンをまたいでunpacklo/unpackhiを行うための並べ替え
+//unpacklo_epi8/epi16の結果が入力の前半、unpackhiの結果が入力の後半になるようにする
+static RGY_FORCEINLINE __m512i avx512_permute_for_unpack(__m512i z0) {
+    return _mm512_permutexvar_epi64(_mm512_load_si512((const __m512i *)PERMUTE_FOR_UNPACK), z0);
+}
+
+//packus_epi16の結果をレーンをまたいで元の順番に並べ替える
+static RGY_FORCEINLINE __m512i avx512_permute_after_pack(__m512i z0) {
+    return _mm512_permutexvar_epi64(_mm512_load_si512((const __m512i *)PERMUTE_AFTER_PACK), z0);
+}
+
+#pragma warning (push)
+#pragma warning (disable: 4100)
+#pragma warning (disable: 4127)
+template<bool highbit_depth>
+void copy_nv12_to_nv12_avx512bw_internal(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int pixel_size = highbit_depth ? 2 : 1;
+    for (int i = 0; i < 2; i++) {
+        const auto y_range = thread_y_range(crop_up >> i, (height - crop_bottom) >> i, thread_id, thread_n);
+        const uint8_t *srcYLine = (const uint8_t *)src[i] + src_y_pitch_byte * y_range.start_src + crop_left;
+        uint8_t *dstLine = (uint8_t *)dst[i] + dst_y_pitch_byte * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
+            avx512_memcpy(dstLine, srcYLine, y_width * pixel_size);
+        }
+    }
+    _mm_sfence();
+}
+
+void copy_nv12_to_nv12_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    copy_nv12_to_nv12_avx512bw_internal<false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void copy_p010_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    copy_nv12_to_nv12_avx512bw_internal<true>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+//YUY2の1行分(64画素)を読み込み、Y成分とUV成分に分離する
+static RGY_FORCEINLINE void separate_yuy2_avx512(const uint8_t *p, int remain, __m512i& zY, __m512i& zC) {
+    __m512i z0, z1;
+    if (remain >= 64) {
+        z0 = _mm512_loadu_si512((const __m512i *)(p +  0));
+        z1 = _mm512_loadu_si512((const __m512i *)(p + 64));
+    } else {
+        z0 = _mm512_maskz_loadu_epi8(avx512_mask8(remain * 2), p);
+        z1 = _mm512_maskz_loadu_epi8(avx512_mask8((std::max)(remain * 2 - 64, 0)), p + 64);
+    }
+    const __m512i zMaskLowByte = _mm512_set1_epi16(0x00ff);
+    zY = _mm512_packus_epi16(_mm512_and_si512(z0, zMaskLowByte), _mm512_and_si512(z1, zMaskLowByte));
+    zC = _mm512_packus_epi16(_mm512_srli_epi16(z0, 8), _mm512_srli_epi16(z1, 8));
+    zY = avx512_permute_after_pack(zY);
+    zC = avx512_permute_after_pack(zC);
+}
+
+void convert_yuy2_to_nv12_avx512bw(void **dst_array, const void **src_array, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const void *src = src_array[0];
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    uint8_t *srcLine = (uint8_t *)src + src_y_pitch_byte * y_range.start_src + crop_left;
+    uint8_t *dstYLine = (uint8_t *)dst_array[0] + dst_y_pitch_byte * y_range.start_dst;
+    uint8_t *dstCLine = (uint8_t *)dst_array[1] + dst_y_pitch_byte * (y_range.start_dst >> 1);
+    for (int y = 0; y < y_range.len; y += 2) {
+        uint8_t *p = srcLine;
+        uint8_t *pw = p + src_y_pitch_byte;
+        const int x_fin = width - crop_right - crop_left;
+        for (int x = 0; x < x_fin; x += 64, p += 128, pw += 128) {
+            const int remain = x_fin - x;
+            __m512i zY0, zC0, zY1, zC1;
+            separate_yuy2_avx512(p,  remain, zY0, zC0);
+            separate_yuy2_avx512(pw, remain, zY1, zC1);
+            zC0 = _mm512_avg_epu8(zC0, zC1); //VUVUVUVUVUVUVUVU
+            if (remain >= 64) {
+                _mm512_storeu_si512((__m512i *)(dstYLine + x), zY0);
+                _mm512_storeu_si512((__m512i *)(dstYLine + dst_y_pitch_byte + x), zY1);
+                _mm512_storeu_si512((__m512i *)(dstCLine + x), zC0);
+            } else {
+                const __mmask64 mask = avx512_mask8(remain);
+                _mm512_mask_storeu_epi8(dstYLine + x, mask, zY0);
+                _mm512_mask_storeu_epi8(dstYLine + dst_y_pitch_byte + x, mask, zY1);
+                _mm512_mask_storeu_epi8(dstCLine + x, avx512_mask8((remain + 1) & ~1), zC0);
+            }
+        }
+        srcLine  += src_y_pitch_byte << 1;
+        dstYLine += dst_y_pitch_byte << 1;
+        dstCLine += dst_y_pitch_byte;
+    }
+    _mm256_zeroupper();
+}
+
+alignas(64) static const uint8_t Array_INTERLACE_WEIGHT_AVX512[2][64] = {
+    {1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3,
+     1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3},
+    {3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1,
+     3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1, 3, 1}
+};
+
+static RGY_FORCEINLINE __m512i yuv422_to_420_i_interpolate_avx512(__m512i z_up, __m512i z_down, int i) {
+    const __m512i zWeight = _mm512_load_si512((const __m512i *)Array_INTERLACE_WEIGHT_AVX512[i]);
+    __m512i z0 = _mm512_unpacklo_epi8(z_down, z_up);
+    __m512i z1 = _mm512_unpackhi_epi8(z_down, z_up);
+    z0 = _mm512_maddubs_epi16(z0, zWeight);
+    z1 = _mm512_maddubs_epi16(z1, zWeight);
+    z0 = _mm512_add_epi16(z0, _mm512_set1_epi16(2));
+    z1 = _mm512_add_epi16(z1, _mm512_set1_epi16(2));
+    z0 = _mm512_srai_epi16(z0, 2);
+    z1 = _mm512_srai_epi16(z1, 2);
+    return _mm512_packus_epi16(z0, z1);
+}
+
+void convert_yuy2_to_nv12_i_avx512bw(void **dst_array, const void **src_array, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const void *src = src_array[0];
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    uint8_t *srcLine = (uint8_t *)src + src_y_pitch_byte * y_range.start_src + crop_left;
+    uint8_t *dstYLine = (uint8_t *)dst_array[0] + dst_y_pitch_byte * y_range.start_dst;
+    uint8_t *dstCLine = (uint8_t *)dst_array[1] + dst_y_pitch_byte * (y_range.start_dst >> 1);
+    for (int y = 0; y < y_range.len; y += 4) {
+        for (int i = 0; i < 2; i++) {
+            uint8_t *p = srcLine;
+            uint8_t *pw = p + (src_y_pitch_byte<<1);
+            const int x_fin = width - crop_right - crop_left;
+            for (int x = 0; x < x_fin; x += 64, p += 128, pw += 128) {
+                const int remain = x_fin - x;
+                __m512i zY0, zC0, zY1, zC1;
+                //1+i行目と3+i行目
+                separate_yuy2_avx512(p,  remain, zY0, zC0);
+                separate_yuy2_avx512(pw, remain, zY1, zC1);
+                zC0 = yuv422_to_420_i_interpolate_avx512(zC0, zC1, i);
+                if (remain >= 64) {
+                    _mm512_storeu_si512((__m512i *)(dstYLine + x), zY0);
+                    _mm512_storeu_si512((__m512i *)(dstYLine + (dst_y_pitch_byte<<1) + x), zY1);
+                    _mm512_storeu_si512((__m512i *)(dstCLine + x), zC0);
+                } else {
+                    const __mmask64 mask = avx512_mask8(remain);
+                    _mm512_mask_storeu_epi8(dstYLine + x, mask, zY0);
+                    _mm512_mask_storeu_epi8(dstYLine + (dst_y_pitch_byte<<1) + x, mask, zY1);
+                    _mm512_mask_storeu_epi8(dstCLine + x, avx512_mask8((remain + 1) & ~1), zC0);
+                }
+            }
+            srcLine  += src_y_pitch_byte;
+            dstYLine += dst_y_pitch_byte;
+            dstCLine += dst_y_pitch_byte;
+        }
+        srcLine  += src_y_pitch_byte << 1;
+        dstYLine += dst_y_pitch_byte << 1;
+    }
+    _mm256_zeroupper();
+}
+
+template<bool uv_only>
+static void RGY_FORCEINLINE convert_yv12_to_nv12_avx512bw_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    //Y成分のコピー
+    if (!uv_only) {
+        const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+        uint8_t *srcYLine = (uint8_t *)src[0] + src_y_pitch_byte * y_range.start_src + crop_left;
+        uint8_t *dstLine = (uint8_t *)dst[0] + dst_y_pitch_byte * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
+            avx512_memcpy(dstLine, srcYLine, y_width);
+        }
+    }
+    //UV成分のコピー
+    const auto uv_range = thread_y_range(crop_up >> 1, (height - crop_bottom) >> 1, thread_id, thread_n);
+    uint8_t *srcULine = (uint8_t *)src[1] + ((src_uv_pitch_byte * uv_range.start_src) + (crop_left >> 1));
+    uint8_t *srcVLine = (uint8_t *)src[2] + ((src_uv_pitch_byte * uv_range.start_src) + (crop_left >> 1));
+    uint8_t *dstLine = (uint8_t *)dst[1] + dst_y_pitch_byte * uv_range.start_dst;
+    const bool dst_aligned = avx512_dst_aligned(dst[1], dst_y_pitch_byte);
+    for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch_byte, srcVLine += src_uv_pitch_byte, dstLine += dst_y_pitch_byte) {
+        const int x_fin = width - crop_right;
+        uint8_t *src_u_ptr = srcULine;
+        uint8_t *src_v_ptr = srcVLine;
+        uint8_t *dst_ptr = dstLine;
+        for (int x = crop_left; x < x_fin; x += 128, src_u_ptr += 64, src_v_ptr += 64, dst_ptr += 128) {
+            const int remain = (x_fin - x + 1) & ~1; //出力するバイト数
+            __m512i z0, z1, z2;
+            if (remain >= 128) {
+                z0 = _mm512_loadu_si512((const __m512i *)src_u_ptr);
+                z1 = _mm512_loadu_si512((const __m512i *)src_v_ptr);
+            } else {
+                z0 = _mm512_maskz_loadu_epi8(avx512_mask8(remain >> 1), src_u_ptr);
+                z1 = _mm512_maskz_loadu_epi8(avx512_mask8(remain >> 1), src_v_ptr);
+            }
+            z0 = avx512_permute_for_unpack(z0);
+            z1 = avx512_permute_for_unpack(z1);
+
+            z2 = _mm512_unpackhi_epi8(z0, z1);
+            z0 = _mm512_unpacklo_epi8(z0, z1);
+
+            if (remain >= 128) {
+                avx512_store_nt_if_aligned(dst_aligned, dst_ptr +  0, z0);
+                avx512_store_nt_if_aligned(dst_aligned, dst_ptr + 64, z2);
+            } else {
+                _mm512_mask_storeu_epi8(dst_ptr +  0, avx512_mask8(remain), z0);
+                _mm512_mask_storeu_epi8(dst_ptr + 64, avx512_mask8((std::max)(remain - 64, 0)), z2);
+            }
+        }
+    }
+    _mm_sfence();
+    _mm256_zeroupper();
+}
+
+void convert_yv12_to_nv12_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_to_nv12_avx512bw_base<false>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_uv_yv12_to_nv12_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_to_nv12_avx512bw_base<true>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+//16bit単位で左シフトしながらコピーする
+template<int in_bit_depth>
+static void RGY_FORCEINLINE copy_line_shift_to_16bit_avx512(uint16_t *dst_ptr, const uint16_t *src_ptr, int y_width, bool dst_aligned) {
+    if (in_bit_depth == 16) {
+        avx512_memcpy((uint8_t *)dst_ptr, (const uint8_t *)src_ptr, y_width * (int)sizeof(uint16_t));
+        return;
+    }
+    int x = 0;
+    for (; x <= y_width - 32; x += 32, dst_ptr += 32, src_ptr += 32) {
+        __m512i z0 = _mm512_loadu_si512((const __m512i *)src_ptr);
+        z0 = _mm512_slli_epi16(z0, 16 - in_bit_depth);
+        avx512_store_nt_if_aligned(dst_aligned, dst_ptr, z0);
+    }
+    if (x < y_width) {
+        const __mmask32 mask = avx512_mask16(y_width - x);
+        __m512i z0 = _mm512_maskz_loadu_epi16(mask, src_ptr);
+        z0 = _mm512_slli_epi16(z0, 16 - in_bit_depth);
+        _mm512_mask_storeu_epi16(dst_ptr, mask, z0);
+    }
+}
+
+template<int in_bit_depth>
+static void RGY_FORCEINLINE convert_yv12_high_to_p010_avx512bw_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    static_assert(8 < in_bit_depth && in_bit_depth <= 16, "in_bit_depth must be 9-16.");
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int src_y_pitch = src_y_pitch_byte >> 1;
+    const int dst_y_pitch = dst_y_pitch_byte >> 1;
+    //Y成分のコピー
+    {
+        const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+        uint16_t *srcYLine = (uint16_t *)src[0] + src_y_pitch * y_range.start_src + crop_left;
+        uint16_t *dstLine = (uint16_t *)dst[0] + dst_y_pitch * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        const bool dst_aligned = avx512_dst_aligned(dst[0], dst_y_pitch_byte);
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch, dstLine += dst_y_pitch) {
+            copy_line_shift_to_16bit_avx512<in_bit_depth>(dstLine, srcYLine, y_width, dst_aligned);
+        }
+    }
+    //UV成分のコピー
+    const auto uv_range = thread_y_range(crop_up >> 1, (height - crop_bottom) >> 1, thread_id, thread_n);
+    const int src_uv_pitch = src_uv_pitch_byte >> 1;
+    uint16_t *srcULine = (uint16_t *)src[1] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
+    uint16_t *srcVLine = (uint16_t *)src[2] + ((src_uv_pitch * uv_range.start_src) + (crop_left >> 1));
+    uint16_t *dstLine = (uint16_t *)dst[1] + dst_y_pitch * uv_range.start_dst;
+    const bool dst_aligned = avx512_dst_aligned(dst[1], dst_y_pitch_byte);
+    for (int y = 0; y < uv_range.len; y++, srcULine += src_uv_pitch, srcVLine += src_uv_pitch, dstLine += dst_y_pitch) {
+        const int x_fin = width - crop_right;
+        uint16_t *src_u_ptr = srcULine;
+        uint16_t *src_v_ptr = srcVLine;
+        uint16_t *dst_ptr = dstLine;
+        for (int x = crop_left; x < x_fin; x += 64, src_u_ptr += 32, src_v_ptr += 32, dst_ptr += 64) {
+            const int remain = (x_fin - x + 1) & ~1; //出力する画素数
+            __m512i z0, z1, z2;
+            if (remain >= 64) {
+                z0 = _mm512_loadu_si512((const __m512i *)src_u_ptr);
+                z1 = _mm512_loadu_si512((const __m512i *)src_v_ptr);
+            } else {
+                z0 = _mm512_maskz_loadu_epi16(avx512_mask16(remain >> 1), src_u_ptr);
+                z1 = _mm512_maskz_loadu_epi16(avx512_mask16(remain >> 1), src_v_ptr);
+            }
+            if (in_bit_depth < 16) {
+                z0 = _mm512_slli_epi16(z0, 16 - in_bit_depth);
+                z1 = _mm512_slli_epi16(z1, 16 - in_bit_depth);
+            }
+            z0 = avx512_permute_for_unpack(z0);
+            z1 = avx512_permute_for_unpack(z1);
+
+            z2 = _mm512_unpackhi_epi16(z0, z1);
+            z0 = _mm512_unpacklo_epi16(z0, z1);
+
+            if (remain >= 64) {
+                avx512_store_nt_if_aligned(dst_aligned, dst_ptr +  0, z0);
+                avx512_store_nt_if_aligned(dst_aligned, dst_ptr + 32, z2);
+            } else {
+                _mm512_mask_storeu_epi16(dst_ptr +  0, avx512_mask16(remain), z0);
+                _mm512_mask_storeu_epi16(dst_ptr + 32, avx512_mask16((std::max)(remain - 32, 0)), z2);
+            }
+        }
+    }
+    _mm_sfence();
+    _mm256_zeroupper();
+}
+
+void convert_yv12_16_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512bw_base<16>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_14_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512bw_base<14>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_12_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512bw_base<12>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_10_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512bw_base<10>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yv12_09_to_p010_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yv12_high_to_p010_avx512bw_base<9>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+template<int in_bit_depth>
+static void RGY_FORCEINLINE convert_yuv444_high_to_yuv444_16_avx512bw_base(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    static_assert(8 < in_bit_depth && in_bit_depth <= 16, "in_bit_depth must be 9-16.");
+    const int crop_left   = crop[0];
+    const int crop_up     = crop[1];
+    const int crop_right  = crop[2];
+    const int crop_bottom = crop[3];
+    const int src_y_pitch = src_y_pitch_byte >> 1;
+    const int dst_y_pitch = dst_y_pitch_byte >> 1;
+    const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
+    for (int i = 0; i < 3; i++) {
+        const uint16_t *srcYLine = (const uint16_t *)src[i] + src_y_pitch * y_range.start_src + crop_left;
+        uint16_t *dstLine = (uint16_t *)dst[i] + dst_y_pitch * y_range.start_dst;
+        const int y_width = width - crop_right - crop_left;
+        const bool dst_aligned = avx512_dst_aligned(dst[i], dst_y_pitch_byte);
+        for (int y = 0; y < y_range.len; y++, srcYLine += src_y_pitch, dstLine += dst_y_pitch) {
+            copy_line_shift_to_16bit_avx512<in_bit_depth>(dstLine, srcYLine, y_width, dst_aligned);
+        }
+    }
+    _mm_sfence();
+    _mm256_zeroupper();
+}
+
+void convert_yuv444_16_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512bw_base<16>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_14_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512bw_base<14>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_12_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512bw_base<12>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_10_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512bw_base<10>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+
+void convert_yuv444_09_to_yuv444_16_avx512bw(void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int thread_id, int thread_n, int *crop) {
+    convert_yuv444_high_to_yuv444_16_avx512bw_base<9>(dst, src, width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height, dst_height, thread_id, thread_n, crop);
+}
+#pragma warning (pop)
+
+#endif //#if defined(_MSC_VER) || defined(__AVX512BW__)
+
+#endif //#if defined(_M_X64) || defined(__x86_64)
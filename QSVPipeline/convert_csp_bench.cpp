@@ -0,0 +1,458 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// -------------------------------------------------------------------------------------------
+
+
+#include <vector>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_simd.h"
+#include "rgy_frame_info.h"
+#include "rgy_thread_pool.h"
+#include "rgy_input.h"
+#include "cpu_info.h"
+#include "convert_csp.h"
+#include "convert_csp_bench.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define CONVERT_CSP_BENCH_TSC 1
+#else
+#define CONVERT_CSP_BENCH_TSC 0
+#endif
+
+static const int CONVERT_CSP_BENCH_PAD_ROWS = 16; //フレームをはみ出して読み書きする関数のための余白 (行数)
+static const int CONVERT_CSP_BENCH_ALIGN_ROWS = 4; //変換関数は4行単位で処理するので、各平面の行数をエンコーダのフレームと同様に切り上げておく
+static const int CONVERT_CSP_BENCH_CROP[4] = { 8, 4, 8, 4 }; //crop=onのときのcrop (左, 上, 右, 下)
+
+struct ConvertCSPBenchPrm {
+    RGY_CSP csp_from;
+    RGY_CSP csp_to;
+    std::vector<std::pair<int, int>> resolutions;
+    std::vector<int> threads;
+    bool crop;
+    double time; //1条件あたりの計測時間 (秒)
+
+    ConvertCSPBenchPrm() :
+        csp_from(RGY_CSP_NA),
+        csp_to(RGY_CSP_NA),
+        resolutions({ { 1920, 1080 } }),
+        threads(),
+        crop(false),
+        time(0.05) {
+        threads.push_back(1);
+        const int cores = (int)get_cpu_info().physical_cores;
+        if (cores > 1) {
+            threads.push_back(cores);
+        }
+    };
+};
+
+//平面を連続して配置したフレーム
+//入力側はRGYInputRawと同じく色差のpitchを縮めて配置し、出力側はすべての平面を同じpitchで配置する
+struct ConvertCSPBenchFrame {
+    std::unique_ptr<uint8_t, aligned_malloc_deleter> buf;
+    void *ptr[RGY_MAX_PLANES];
+    int pitch;
+    int uv_pitch;
+    size_t bufSize;
+
+    ConvertCSPBenchFrame(RGY_CSP csp, int width, int height, bool input) : buf(), ptr(), pitch(0), uv_pitch(0), bufSize(0) {
+        pitch = ALIGN(width * std::max(bytesPerPix(csp), 1) + 256, 256);
+        uv_pitch = pitch;
+        const size_t frameSize = (size_t)pitch * ALIGN(height, CONVERT_CSP_BENCH_ALIGN_ROWS);
+        size_t offset[RGY_MAX_PLANES] = { 0, frameSize, frameSize * 2, frameSize * 3 };
+        if (input) {
+            switch (RGY_CSP_CHROMA_FORMAT[csp]) {
+            case RGY_CHROMAFMT_YUV420: uv_pitch = pitch >> 1; offset[2] = offset[1] + frameSize / 4; break;
+            case RGY_CHROMAFMT_YUV422: uv_pitch = pitch >> 1; offset[2] = offset[1] + frameSize / 2; break;
+            default: break;
+            }
+            offset[3] = offset[2] + frameSize;
+        }
+        bufSize = offset[3] + frameSize + (size_t)pitch * CONVERT_CSP_BENCH_PAD_ROWS;
+        buf.reset((uint8_t *)_aligned_malloc(bufSize, 256));
+        memset(buf.get(), 0, bufSize);
+        for (int i = 0; i < RGY_MAX_PLANES; i++) {
+            ptr[i] = buf.get() + offset[i];
+        }
+    }
+    void clear() {
+        memset(buf.get(), 0, bufSize);
+    }
+};
+
+static RGY_CSP convert_csp_bench_csp_from_str(const tstring& str) {
+    for (int i = 1; i < RGY_CSP_COUNT; i++) {
+        if (tolowercase(str) == tolowercase(tstring(RGY_CSP_NAMES[i]))) {
+            return (RGY_CSP)i;
+        }
+    }
+    return RGY_CSP_NA;
+}
+
+static int convert_csp_bench_parse(ConvertCSPBenchPrm& prm, const tstring& options) {
+    for (const auto& param : split(options, _T(","), true)) {
+        if (param.length() == 0) continue;
+        const auto pos = param.find(_T('='));
+        if (pos == tstring::npos) {
+            _ftprintf(stderr, _T("invalid parameter for --check-convert-csp: %s\n"), param.c_str());
+            return 1;
+        }
+        const auto name = tolowercase(param.substr(0, pos));
+        const auto value = param.substr(pos + 1);
+        if (name == _T("csp")) {
+            const auto csps = split(value, _T(":"), true);
+            prm.csp_from = (csps.size() > 0 && csps[0].length() > 0) ? convert_csp_bench_csp_from_str(csps[0]) : RGY_CSP_NA;
+            prm.csp_to   = (csps.size() > 1 && csps[1].length() > 0) ? convert_csp_bench_csp_from_str(csps[1]) : RGY_CSP_NA;
+            if ((csps.size() > 0 && csps[0].length() > 0 && prm.csp_from == RGY_CSP_NA)
+                || (csps.size() > 1 && csps[1].length() > 0 && prm.csp_to == RGY_CSP_NA)) {
+                _ftprintf(stderr, _T("unknown csp for --check-convert-csp: %s\n"), value.c_str());
+                return 1;
+            }
+        } else if (name == _T("res")) {
+            prm.resolutions.clear();
+            for (const auto& res : split(value, _T(":"), true)) {
+                int w = 0, h = 0;
+                if (2 != _stscanf_s(res.c_str(), _T("%dx%d"), &w, &h) || w <= 0 || h <= 0) {
+                    _ftprintf(stderr, _T("invalid resolution for --check-convert-csp: %s\n"), res.c_str());
+                    return 1;
+                }
+                prm.resolutions.push_back({ w, h });
+            }
+        } else if (name == _T("threads")) {
+            prm.threads.clear();
+            for (const auto& thread : split(value, _T(":"), true)) {
+                int n = 0;
+                if (1 != _stscanf_s(thread.c_str(), _T("%d"), &n) || n <= 0) {
+                    _ftprintf(stderr, _T("invalid thread count for --check-convert-csp: %s\n"), thread.c_str());
+                    return 1;
+                }
+                prm.threads.push_back(n);
+            }
+        } else if (name == _T("crop")) {
+            const auto v = tolowercase(value);
+            prm.crop = (v == _T("on") || v == _T("true") || v == _T("1"));
+        } else if (name == _T("time")) {
+            double t = 0.0;
+            if (1 != _stscanf_s(value.c_str(), _T("%lf"), &t) || t <= 0.0) {
+                _ftprintf(stderr, _T("invalid time for --check-convert-csp: %s\n"), value.c_str());
+                return 1;
+            }
+            prm.time = t;
+        } else {
+            _ftprintf(stderr, _T("unknown parameter for --check-convert-csp: %s\n"), name.c_str());
+            return 1;
+        }
+    }
+    if (prm.resolutions.size() == 0 || prm.threads.size() == 0) {
+        _ftprintf(stderr, _T("invalid parameter for --check-convert-csp: %s\n"), options.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+//入力フレームを乱数で埋める
+//SIMD版とC版の比較のため、値は各色空間の有効な範囲におさめる
+static void convert_csp_bench_fill(ConvertCSPBenchFrame& frame, RGY_CSP csp) {
+    std::mt19937 mt(1234);
+    const auto dataType = RGY_CSP_DATA_TYPE[csp];
+    uint8_t *buf = frame.buf.get();
+    if (csp == RGY_CSP_YC48) {
+        int16_t *ptr = (int16_t *)buf;
+        for (size_t i = 0; i < frame.bufSize / 2; i++) {
+            ptr[i] = (int16_t)((i % 3 == 0) ? (mt() & 4095) : (int)(mt() & 4095) - 2048);
+        }
+    } else if (dataType == RGY_DATA_TYPE_U16) {
+        const uint32_t mask = (1u << std::min<int>(RGY_CSP_BIT_DEPTH[csp], 16)) - 1;
+        uint16_t *ptr = (uint16_t *)buf;
+        for (size_t i = 0; i < frame.bufSize / 2; i++) {
+            ptr[i] = (uint16_t)(mt() & mask);
+        }
+    } else if (dataType == RGY_DATA_TYPE_FP16) {
+        uint16_t *ptr = (uint16_t *)buf;
+        for (size_t i = 0; i < frame.bufSize / 2; i++) {
+            ptr[i] = (uint16_t)(0x3800 | (mt() & 0x3ff)); //0.5 - 1.0
+        }
+    } else if (dataType == RGY_DATA_TYPE_FP32) {
+        std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+        float *ptr = (float *)buf;
+        for (size_t i = 0; i < frame.bufSize / 4; i++) {
+            ptr[i] = dist(mt);
+        }
+    } else {
+        for (size_t i = 0; i < frame.bufSize; i++) {
+            buf[i] = (uint8_t)mt();
+        }
+    }
+}
+
+//出力の有効な領域を比較し、最大の差 (整数ならLSB単位、浮動小数点ならULP単位) を返す
+static int64_t convert_csp_bench_compare(const ConvertCSPBenchFrame& a, const ConvertCSPBenchFrame& b, RGY_CSP csp, bool uv_only, int width, int height) {
+    RGYFrameInfo frameInfo;
+    frameInfo.csp = csp;
+    frameInfo.width = width;
+    frameInfo.height = height;
+    for (int i = 0; i < RGY_MAX_PLANES; i++) {
+        frameInfo.ptr[i] = (uint8_t *)a.ptr[i];
+        frameInfo.pitch[i] = a.pitch;
+    }
+    const auto dataType = RGY_CSP_DATA_TYPE[csp];
+    int64_t maxDiff = 0;
+    for (int iplane = (uv_only) ? 1 : 0; iplane < std::max<int>(RGY_CSP_PLANES[csp], 1); iplane++) {
+        const auto plane = getPlane(&frameInfo, (RGY_PLANE)iplane);
+        const int validBytes = plane.width * std::max(bytesPerPix(csp), 1);
+        for (int y = 0; y < plane.height; y++) {
+            const size_t offset = (size_t)a.pitch * y;
+            const uint8_t *lineA = (const uint8_t *)a.ptr[iplane] + offset;
+            const uint8_t *lineB = (const uint8_t *)b.ptr[iplane] + offset;
+            if (memcmp(lineA, lineB, validBytes) == 0) {
+                continue;
+            }
+            if (dataType == RGY_DATA_TYPE_FP32) {
+                for (int x = 0; x < validBytes / 4; x++) {
+                    maxDiff = std::max<int64_t>(maxDiff, std::abs((int64_t)((const int32_t *)lineA)[x] - (int64_t)((const int32_t *)lineB)[x]));
+                }
+            } else if (dataType == RGY_DATA_TYPE_U16 || dataType == RGY_DATA_TYPE_FP16) {
+                for (int x = 0; x < validBytes / 2; x++) {
+                    maxDiff = std::max<int64_t>(maxDiff, std::abs((int64_t)((const uint16_t *)lineA)[x] - (int64_t)((const uint16_t *)lineB)[x]));
+                }
+            } else {
+                for (int x = 0; x < validBytes; x++) {
+                    maxDiff = std::max<int64_t>(maxDiff, std::abs((int64_t)lineA[x] - (int64_t)lineB[x]));
+                }
+            }
+        }
+    }
+    return maxDiff;
+}
+
+static void convert_csp_bench_run(RGYThreadPool *pool, funcConvertCSP func, ConvertCSPBenchFrame& dst, const ConvertCSPBenchFrame& src, int width, int height, int threads, int *crop) {
+    const void *srcPtr[RGY_MAX_PLANES] = { src.ptr[0], src.ptr[1], src.ptr[2], src.ptr[3] };
+    if (threads <= 1 || !pool) {
+        func(dst.ptr, srcPtr, width, src.pitch, src.uv_pitch, dst.pitch, height, height, 0, 1, crop);
+        return;
+    }
+    pool->parallel_for(threads, [&](int ithId) {
+        func(dst.ptr, srcPtr, width, src.pitch, src.uv_pitch, dst.pitch, height, height, ithId, threads, crop);
+    }, threads);
+}
+
+//プログレッシブ/インタレースのそれぞれについて、targetの結果とref(シングルスレッド)の結果の最大の差を求める
+static void convert_csp_bench_diff(int64_t maxDiff[2], RGYThreadPool *pool, const ConvertCSP *target, const ConvertCSP *ref, ConvertCSPBenchFrame& dst, ConvertCSPBenchFrame& dstRef, const ConvertCSPBenchFrame& src, int width, int height, int threads, int *crop, int outWidth, int outHeight) {
+    for (int interlaced = 0; interlaced < 2; interlaced++) {
+        dst.clear();
+        dstRef.clear();
+        convert_csp_bench_run(pool, target->func[interlaced], dst, src, width, height, threads, crop);
+        convert_csp_bench_run(nullptr, ref->func[interlaced], dstRef, src, width, height, 1, crop);
+        maxDiff[interlaced] = convert_csp_bench_compare(dst, dstRef, target->csp_to, target->uv_only, outWidth, outHeight);
+    }
+}
+
+//RGYConvertCSP::run()によるタイル分割した変換の結果が、分割せずに変換した結果と一致するかを確認する
+//一致すれば0、一致しなければ最大の差、targetがrun()で選択されない場合は-1を返す
+static int64_t convert_csp_bench_check_tile(const ConvertCSP *target, ConvertCSPBenchFrame& dst, ConvertCSPBenchFrame& dstRef, const ConvertCSPBenchFrame& src, int width, int height, int threads, int *crop, int outWidth, int outHeight) {
+    RGYConvertCSP convert(threads, RGYParamThread());
+    if (convert.getFunc(target->csp_from, target->csp_to, target->uv_only, target->simd) != target) {
+        return -1;
+    }
+    const void *srcPtr[RGY_MAX_PLANES] = { src.ptr[0], src.ptr[1], src.ptr[2], src.ptr[3] };
+    int64_t maxDiff = 0;
+    for (int interlaced = 0; interlaced < 2; interlaced++) {
+        dst.clear();
+        dstRef.clear();
+        convert.run(interlaced, dst.ptr, srcPtr, width, src.pitch, src.uv_pitch, dst.pitch, height, height, crop);
+        convert_csp_bench_run(nullptr, target->func[interlaced], dstRef, src, width, height, 1, crop);
+        maxDiff = std::max(maxDiff, convert_csp_bench_compare(dst, dstRef, target->csp_to, target->uv_only, outWidth, outHeight));
+    }
+    return maxDiff;
+}
+
+static bool convert_csp_bench_same_conv(const ConvertCSP *a, const ConvertCSP *b) {
+    return a->csp_from == b->csp_from
+        && a->csp_to == b->csp_to
+        && a->uv_only == b->uv_only;
+}
+
+//比較の基準とするC版の関数 (get_convert_csp_funcで選択される最初のC版)
+static const ConvertCSP *convert_csp_bench_find_ref(const std::vector<const ConvertCSP *>& list, const ConvertCSP *target) {
+    for (const auto& conv : list) {
+        if (convert_csp_bench_same_conv(conv, target) && conv->simd == RGY_SIMD::NONE) {
+            return conv;
+        }
+    }
+    return nullptr;
+}
+
+//SIMD版同士の比較の基準とする関数 (この環境で実行できるSIMD版のうち、最も後に登録された(要求する命令セットの少ない)もの)
+static const ConvertCSP *convert_csp_bench_find_ref_simd(const std::vector<const ConvertCSP *>& list, const ConvertCSP *target, const RGY_SIMD availableSIMD) {
+    const ConvertCSP *ref = nullptr;
+    for (const auto& conv : list) {
+        if (convert_csp_bench_same_conv(conv, target) && conv->simd != RGY_SIMD::NONE && conv->simd == (availableSIMD & conv->simd)) {
+            ref = conv;
+        }
+    }
+    return ref;
+}
+
+//より前に登録された関数が常に優先され、get_convert_csp_funcで選択されることのない関数かどうか
+static bool convert_csp_bench_is_shadowed(const std::vector<const ConvertCSP *>& list, const ConvertCSP *target) {
+    for (const auto& conv : list) {
+        if (conv == target) {
+            return false;
+        }
+        if (convert_csp_bench_same_conv(conv, target) && conv->simd == (target->simd & conv->simd)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int convert_csp_bench(const tstring& options) {
+    ConvertCSPBenchPrm prm;
+    if (convert_csp_bench_parse(prm, options)) {
+        return -1;
+    }
+    const auto availableSIMD = get_availableSIMD();
+    const auto list = get_convert_csp_func_list();
+    std::shared_ptr<RGYThreadPool> pool;
+    if (*std::max_element(prm.threads.begin(), prm.threads.end()) > 1) {
+        pool = RGYThreadPool::get(RGYParamThread());
+    }
+
+    _ftprintf(stdout, _T("%-14s %-14s %-2s %-9s %-10s %4s %4s %9s %11s %s\n"),
+        _T("from"), _T("to"), _T("uv"), _T("simd"), _T("resolution"), _T("thrd"), _T("crop"), _T("GB/s"), _T("cycles/pix"), _T("check"));
+    int mismatch = 0;
+    int diffFromC = 0;
+    for (const auto& conv : list) {
+        if (prm.csp_from != RGY_CSP_NA && conv->csp_from != prm.csp_from) continue;
+        if (prm.csp_to   != RGY_CSP_NA && conv->csp_to   != prm.csp_to)   continue;
+        if (conv->simd != (availableSIMD & conv->simd)) continue; //この環境では実行できない
+        const auto ref = convert_csp_bench_find_ref(list, conv);
+        const auto refSIMD = convert_csp_bench_find_ref_simd(list, conv, availableSIMD);
+        const bool shadowed = convert_csp_bench_is_shadowed(list, conv);
+        for (const auto& res : prm.resolutions) {
+            const int width = res.first;
+            const int height = res.second;
+            ConvertCSPBenchFrame src(conv->csp_from, width, height, true);
+            ConvertCSPBenchFrame dst(conv->csp_to, width, height, false);
+            std::unique_ptr<ConvertCSPBenchFrame> dstRef;
+            if (!shadowed) {
+                dstRef = std::make_unique<ConvertCSPBenchFrame>(conv->csp_to, width, height, false);
+            }
+            convert_csp_bench_fill(src, conv->csp_from);
+            for (int icrop = 0; icrop < (prm.crop ? 2 : 1); icrop++) {
+                int crop[4] = { 0 };
+                if (icrop) {
+                    memcpy(crop, CONVERT_CSP_BENCH_CROP, sizeof(crop));
+                }
+                const int outWidth  = width  - crop[0] - crop[2];
+                const int outHeight = height - crop[1] - crop[3];
+                for (const auto threads : prm.threads) {
+                    //Cの関数との比較 (プログレッシブ/インタレース)
+                    //C版とSIMD版とで丸めや飽和の扱いが異なる関数があるので、結果は参考として表示するのみとする
+                    tstring check = _T("-");
+                    if (ref == conv) {
+                        check = _T("ref");
+                    } else if (shadowed) {
+                        check = _T("unused");
+                    } else if (ref) {
+                        int64_t maxDiff[2] = { 0 };
+                        convert_csp_bench_diff(maxDiff, pool.get(), conv, ref, dst, *dstRef, src, width, height, threads, crop, outWidth, outHeight);
+                        if (maxDiff[0] == 0 && maxDiff[1] == 0) {
+                            check = _T("ok");
+                        } else {
+                            check = strsprintf(_T("diff %lld/%lld(i)"), (long long)maxDiff[0], (long long)maxDiff[1]);
+                            diffFromC++;
+                        }
+                    }
+                    //SIMD版同士の比較 (同じ変換のSIMD版は、1までの差で一致する必要がある)
+                    if (dstRef && conv->simd != RGY_SIMD::NONE && refSIMD && refSIMD != conv) {
+                        int64_t maxDiff[2] = { 0 };
+                        convert_csp_bench_diff(maxDiff, pool.get(), conv, refSIMD, dst, *dstRef, src, width, height, threads, crop, outWidth, outHeight);
+                        if (maxDiff[0] > 1 || maxDiff[1] > 1) {
+                            check += strsprintf(_T(" simd diff %lld/%lld(i) NG"), (long long)maxDiff[0], (long long)maxDiff[1]);
+                            mismatch++;
+                        }
+                    }
+                    //タイル分割した変換との比較 (完全に一致する必要がある)
+                    if (dstRef) {
+                        const auto tileDiff = convert_csp_bench_check_tile(conv, dst, *dstRef, src, width, height, threads, crop, outWidth, outHeight);
+                        if (tileDiff > 0) {
+                            check += strsprintf(_T(" tile diff %lld NG"), (long long)tileDiff);
+                            mismatch++;
+                        }
+                    }
+                    //速度の計測 (プログレッシブ)
+                    convert_csp_bench_run(pool.get(), conv->func[0], dst, src, width, height, threads, crop); //ウォームアップ
+                    int64_t loops = 0;
+                    const auto timeStart = std::chrono::high_resolution_clock::now();
+#if CONVERT_CSP_BENCH_TSC
+                    const uint64_t tscStart = __rdtsc();
+#endif
+                    double elapsed = 0.0;
+                    do {
+                        convert_csp_bench_run(pool.get(), conv->func[0], dst, src, width, height, threads, crop);
+                        loops++;
+                        elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - timeStart).count();
+                    } while (elapsed < prm.time);
+#if CONVERT_CSP_BENCH_TSC
+                    const double cyclesPerPix = (double)(__rdtsc() - tscStart) / ((double)loops * outWidth * outHeight);
+                    const tstring cyclesStr = strsprintf(_T("%11.3f"), cyclesPerPix);
+#else
+                    const tstring cyclesStr = strsprintf(_T("%11s"), _T("-"));
+#endif
+                    const double bytesPerFrame = (double)outWidth * outHeight * (RGY_CSP_BIT_PER_PIXEL[conv->csp_from] + RGY_CSP_BIT_PER_PIXEL[conv->csp_to]) / 8.0;
+                    const double gbps = bytesPerFrame * loops / elapsed * 1e-9;
+                    _ftprintf(stdout, _T("%-14s %-14s %-2s %-9s %4dx%-5d %4d %4s %9.2f %s %s\n"),
+                        RGY_CSP_NAMES[conv->csp_from], RGY_CSP_NAMES[conv->csp_to], conv->uv_only ? _T("o") : _T(""),
+                        (conv->simd == RGY_SIMD::NONE) ? _T("C") : get_simd_str(conv->simd),
+                        width, height, threads, icrop ? _T("on") : _T("off"),
+                        gbps, cyclesStr.c_str(), check.c_str());
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+    if (diffFromC > 0) {
+        _ftprintf(stdout, _T("\n%d result(s) differ from the C functions (for reference only).\n"), diffFromC);
+    }
+    if (mismatch > 0) {
+        _ftprintf(stdout, _T("\n%d result(s) differ between SIMD levels by more than 1, or differ when tiled.\n"), mismatch);
+        return 1;
+    }
+    return 0;
+}
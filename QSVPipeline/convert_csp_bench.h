@@ -0,0 +1,42 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// -------------------------------------------------------------------------------------------
+
+
+#pragma once
+#ifndef __CONVERT_CSP_BENCH_H__
+#define __CONVERT_CSP_BENCH_H__
+
+#include "rgy_tchar.h"
+
+//convert_cspの変換関数テーブルの各関数について速度を計測し、
+//同じ変換のSIMD版同士で出力が一致するか、RGYConvertCSP::run()でタイル分割した場合に結果が変わらないかを確認する (--check-convert-csp)
+//Cの関数の出力との差は参考として表示する
+//結果は標準出力に表示する
+//戻り値 : 0 ... すべて一致, 1 ... 不一致あり, -1 ... オプションエラー
+int convert_csp_bench(const tstring& options);
+
+#endif //__CONVERT_CSP_BENCH_H__
@@ -444,8 +444,8 @@ static void RGY_FORCEINLINE convert_rgb24r_to_rgb32_simd(void **dst, const void
     const int crop_right  = crop[2];
     const int crop_bottom = crop[3];
     const auto y_range = thread_y_range(crop_up, height - crop_bottom, thread_id, thread_n);
-    uint8_t *srcLine = (uint8_t *)src[0] + (src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1)) + crop_left * 3;;
-    uint8_t *dstLine = (uint8_t *)dst[0] + (dst_y_pitch_byte * y_range.start_dst);
+    uint8_t *srcLine = (uint8_t *)src[0] + (src_y_pitch_byte * ((y_range.start_src + y_range.len) - 1)) + crop_left * 3;
+    uint8_t *dstLine = (uint8_t *)dst[0] + (dst_y_pitch_byte * (height - (y_range.start_dst + y_range.len)));
     alignas(16) const char MASK_RGB3_TO_RGB4[] = { 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1 };
     __m128i xMask = _mm_load_si128((__m128i*)MASK_RGB3_TO_RGB4);
     for (int y = 0; y  < y_range.len; y++, srcLine -= src_y_pitch_byte, dstLine += dst_y_pitch_byte) {
@@ -1154,7 +1154,7 @@ static void RGY_FORCEINLINE convert_yuv422_to_p210_simd(void **dst, const void *
         uint8_t *src_v_ptr = srcVLine;
         uint16_t *dst_ptr = dstLine;
         __m128i x0, x1, x2, x3, x4;
-        for (int x = crop_left; x < x_fin; x += 16, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 32) {
+        for (int x = crop_left; x < x_fin; x += 32, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 32) {
             x0 = _mm_loadu_si128((const __m128i *)src_u_ptr);
             x1 = _mm_loadu_si128((const __m128i *)src_v_ptr);
             x2 = _mm_unpackhi_epi8(_mm_setzero_si128(), x0);
@@ -1351,7 +1351,7 @@ static void RGY_FORCEINLINE convert_yuv444_to_y410_simd(void** dst, const void**
         uint8_t* src_u_ptr = srcULine;
         uint8_t* src_v_ptr = srcVLine;
         uint32_t* dst_ptr = dstLine;
-        for (int x = 0; x < y_width; x++, src_y_ptr += 16, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 16) {
+        for (int x = 0; x < y_width; x += 16, src_y_ptr += 16, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 16) {
             __m128i pixY = _mm_loadu_si128((const __m128i*)(src_y_ptr + 0));
             __m128i pixU = _mm_loadu_si128((const __m128i*)(src_u_ptr + 0));
             __m128i pixV = _mm_loadu_si128((const __m128i*)(src_v_ptr + 0));
@@ -1407,7 +1407,7 @@ void convert_yuv444_high_to_y410_simd(void** dst, const void** src, int width, i
         uint16_t* src_u_ptr = srcULine;
         uint16_t* src_v_ptr = srcVLine;
         uint32_t* dst_ptr = dstLine;
-        for (int x = 0; x < y_width; x++, src_y_ptr += 16, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 16) {
+        for (int x = 0; x < y_width; x += 16, src_y_ptr += 16, src_u_ptr += 16, src_v_ptr += 16, dst_ptr += 16) {
             __m128i pixY0 = _mm_loadu_si128((const __m128i*)(src_y_ptr + 0));
             __m128i pixY1 = _mm_loadu_si128((const __m128i*)(src_y_ptr + 8));
             __m128i pixU0 = _mm_loadu_si128((const __m128i*)(src_u_ptr + 0));
@@ -34,6 +34,7 @@
 #include <chrono>
 #include <thread>
 #include <map>
+#include <mutex>
 #include "rgy_tchar.h"
 #if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
 #ifdef _MSC_VER
@@ -79,10 +80,10 @@ static inline int CountSetBits(size_t bits_) {
 
 #if (defined(_M_ARM64) || defined(__aarch64__) || defined(__arm64__) || defined(__ARM_ARCH))
 
-std::map<uint32_t, uint64_t> getCPUPartARM() {
-    std::map<int, uint64_t> cpu_architecture;
-    std::map<uint32_t, uint64_t> cpu_variant;
-    std::map<uint32_t, uint64_t> cpu_part;
+std::map<uint32_t, RGYCPUSet> getCPUPartARM() {
+    std::map<int, RGYCPUSet> cpu_architecture;
+    std::map<uint32_t, RGYCPUSet> cpu_variant;
+    std::map<uint32_t, RGYCPUSet> cpu_part;
     
     std::ifstream inputFile("/proc/cpuinfo");
     std::istreambuf_iterator<char> data_begin(inputFile);
@@ -106,9 +107,9 @@ std::map<uint32_t, uint64_t> getCPUPartARM() {
             int i = 0;
             if (1 == sscanf(line.substr(line.find(":") + 1).c_str(), " %d", &i)) {
                 if (cpu_architecture.count(i) == 0) {
-                    cpu_architecture[i] = 0;
+                    cpu_architecture[i] = RGYCPUSet::none();
                 }
-                cpu_architecture[i] |= (1llu << processorID);
+                cpu_architecture[i].set(processorID);
             }
             continue;
         }
@@ -117,9 +118,9 @@ std::map<uint32_t, uint64_t> getCPUPartARM() {
             uint32_t i = 0;
             if (1 == sscanf(line.substr(line.find(":") + 1).c_str(), " 0x%x", &i)) {
                 if (cpu_variant.count(i) == 0) {
-                    cpu_variant[i] = 0;
+                    cpu_variant[i] = RGYCPUSet::none();
                 }
-                cpu_variant[i] |= (1llu << processorID);
+                cpu_variant[i].set(processorID);
             }
             continue;
         }
@@ -128,9 +129,9 @@ std::map<uint32_t, uint64_t> getCPUPartARM() {
             uint32_t i = 0;
             if (1 == sscanf(line.substr(line.find(":") + 1).c_str(), " 0x%x", &i)) {
                 if (cpu_part.count(i) == 0) {
-                    cpu_part[i] = 0;
+                    cpu_part[i] = RGYCPUSet::none();
                 }
-                cpu_part[i] |= (1llu << processorID);
+                cpu_part[i].set(processorID);
             }
             continue;
         }
@@ -324,54 +325,62 @@ int getCPUName(char *buffer, size_t nSize) {
 }
 
 bool getCPUHybridMasks(cpu_info_t *info) {
-    info->maskSystem = 0;
-    info->maskCoreP = 0;
-    info->maskCoreE = 0;
+    info->maskSystem = RGYCPUSet::none();
+    info->maskCoreP = RGYCPUSet::none();
+    info->maskCoreE = RGYCPUSet::none();
 #if _MSC_VER
     DWORD_PTR maskProcess = 0;
     DWORD_PTR maskSysAff = 0;
     if (GetProcessAffinityMask(GetCurrentProcess(), &maskProcess, &maskSysAff) == 0) {
-        info->maskSystem = 0;
-        info->maskCoreP = 0;
-        info->maskCoreE = 0;
-        for (uint64_t i = 0; i < info->logical_cores; i++) {
-            info->maskSystem |= (1llu << i);
+        for (int i = 0; i < info->logical_cores; i++) {
+            info->maskSystem.set(i);
         }
         return false;
     }
-    info->maskSystem = maskSysAff;
-    const auto threadCount = CountSetBits(info->maskSystem);
+    info->maskSystem = RGYCPUSet::fromMask(maskSysAff);
 #else
-    const auto threadCount = info->physical_cores;
+    for (int i = 0; i < info->physical_cores; i++) {
+        info->maskSystem |= info->proc_list[i].mask;
+    }
 #endif
 #if defined(__x86__) || defined(__x86_64__) || defined(_M_X86) || defined(_M_IX86) || defined(_M_X64)
-    const auto hThread = GetCurrentThread();
-    size_t maskOriginal = 0;
-    for (int ith = 0; ith < threadCount; ith++) {
-        const auto maskTarget = (size_t)1u << ith;
-        auto maskPrev = SetThreadAffinityMask(hThread, maskTarget);
-        if (maskOriginal == 0) {
-            maskOriginal = maskPrev;
+    int CPUInfo[4] = { 0 };
+    __cpuid(CPUInfo, 0x00);
+    const int maxLeaf = CPUInfo[0];
+    if (maxLeaf >= 0x07) {
+        __cpuid(CPUInfo, 0x07);
+    }
+    // hybridアーキテクチャでなければ、論理コアごとにスレッドを移動して確認する必要はない
+    // (論理コア数の多いサーバーでは起動が遅くなる)
+    const bool isHybrid = maxLeaf >= 0x1A && (CPUInfo[3 /*EDX*/] & (1 << 15)) != 0;
+    if (isHybrid) {
+        const auto hThread = GetCurrentThread();
+        auto maskOriginal = RGYCPUSet::none();
+        for (int ith = info->maskSystem.next(-1); ith >= 0; ith = info->maskSystem.next(ith)) {
+            auto maskTarget = RGYCPUSet::none();
+            maskTarget.set(ith);
+            RGYSetThreadAffinity(hThread, maskTarget, (maskOriginal.empty()) ? &maskOriginal : nullptr);
+            std::this_thread::sleep_for(std::chrono::microseconds(0));
+            __cpuid(CPUInfo, 0x1A);
+            const auto hybridInfo = CPUInfo[0 /*EAX*/] >> 24;
+            if (hybridInfo == 0x20) {
+                info->maskCoreE |= maskTarget;
+            } else if (hybridInfo == 0x40) {
+                info->maskCoreP |= maskTarget;
+            }
         }
-        std::this_thread::sleep_for(std::chrono::microseconds(0));
-        int CPUInfo[4] = { 0 };
-        __cpuid(CPUInfo, 0x1A);
-        const auto hybridInfo = CPUInfo[0 /*EAX*/] >> 24;
-        if (hybridInfo == 0x20) {
-            info->maskCoreE |= maskTarget;
-        } else if (hybridInfo == 0x40) {
-            info->maskCoreP |= maskTarget;
+        if (!maskOriginal.empty()) {
+            RGYSetThreadAffinity(hThread, maskOriginal); // 元に戻す
         }
     }
-    SetThreadAffinityMask(hThread, maskOriginal); // 元に戻す
 
     info->physical_cores_e = 0;
     info->physical_cores_p = 0;
     for (int i = 0; i < info->physical_cores; i++) {
-        const auto maskTarget = info->proc_list[i].mask;
-        if (info->maskCoreP & maskTarget) {
+        const auto& maskTarget = info->proc_list[i].mask;
+        if (info->maskCoreP.intersects(maskTarget)) {
             info->physical_cores_p++;
-        } else if (info->maskCoreE & maskTarget) {
+        } else if (info->maskCoreE.intersects(maskTarget)) {
             info->physical_cores_e++;
         }
     }
@@ -391,10 +400,10 @@ bool getCPUHybridMasks(cpu_info_t *info) {
     info->physical_cores_e = 0;
     info->physical_cores_p = 0;
     for (int i = 0; i < info->physical_cores; i++) {
-        const auto maskTarget = info->proc_list[i].mask;
-        if (info->maskCoreP & maskTarget) {
+        const auto& maskTarget = info->proc_list[i].mask;
+        if (info->maskCoreP.intersects(maskTarget)) {
             info->physical_cores_p++;
-        } else if (info->maskCoreE & maskTarget) {
+        } else if (info->maskCoreE.intersects(maskTarget)) {
             info->physical_cores_e++;
         }
     }
@@ -450,7 +459,7 @@ bool get_cpu_info(cpu_info_t *cpu_info) {
         return true;
     }
 
-    s_cpu_info = cpu_info_t({ 0 });
+    memset(&s_cpu_info, 0, sizeof(s_cpu_info));
 
     LPFN_GLPI glpi = (LPFN_GLPI)GetProcAddress(GetModuleHandle(_T("kernel32")), "GetLogicalProcessorInformation");
     if (nullptr == glpi)
@@ -474,14 +483,18 @@ bool get_cpu_info(cpu_info_t *cpu_info) {
         switch (ptr->Relationship) {
         case RelationNumaNode:
             // Non-NUMA systems report a single record of this type.
-            s_cpu_info.nodes[s_cpu_info.node_count++].mask = ptr->ProcessorMask;
+            if (s_cpu_info.node_count < MAX_NODE_COUNT) {
+                s_cpu_info.nodes[s_cpu_info.node_count].id = (int)ptr->NumaNode.NodeNumber;
+                s_cpu_info.nodes[s_cpu_info.node_count].mask = RGYCPUSet::fromMask(ptr->ProcessorMask);
+                s_cpu_info.node_count++;
+            }
             break;
         case RelationProcessorCore: {
             auto& proc = s_cpu_info.proc_list[s_cpu_info.physical_cores];
             proc.core_id = s_cpu_info.physical_cores;
             proc.processor_id = s_cpu_info.physical_cores;
             proc.logical_cores = CountSetBits(ptr->ProcessorMask);
-            proc.mask = ptr->ProcessorMask;
+            proc.mask = RGYCPUSet::fromMask(ptr->ProcessorMask);
             // A hyperthreaded core supplies more than one logical processor.
             s_cpu_info.logical_cores += proc.logical_cores;
             s_cpu_info.physical_cores++;
@@ -498,7 +511,7 @@ bool get_cpu_info(cpu_info_t *cpu_info) {
                 cache->linesize = Cache->LineSize;
                 cache->size = Cache->Size;
                 cache->associativity = Cache->Associativity;
-                cache->mask = ptr->ProcessorMask;
+                cache->mask = RGYCPUSet::fromMask(ptr->ProcessorMask);
                 s_cpu_info.max_cache_level = (std::max)(s_cpu_info.max_cache_level, (int)cache->level);
             }
             break;
@@ -526,6 +539,29 @@ bool get_cpu_info(cpu_info_t *cpu_info) {
 #include <iostream>
 #include <fstream>
 
+// sysfsのcpulist形式 ("0-3,8,10-11") を読み込む
+static RGYCPUSet read_cpu_list(const char *filename) {
+    auto mask = RGYCPUSet::none();
+    FILE *fp = fopen(filename, "r");
+    if (fp) {
+        char buffer[4096];
+        while (fgets(buffer, _countof(buffer), fp) != NULL) {
+            for (auto numstr : split(buffer, ",")) {
+                int value0 = 0, value1 = 0;
+                if (sscanf_s(numstr.c_str(), "%d-%d", &value0, &value1) == 2) {
+                    for (int iv = value0; iv <= value1; iv++) {
+                        mask.set(iv);
+                    }
+                } else if (sscanf_s(numstr.c_str(), "%d", &value0) == 1) {
+                    mask.set(value0);
+                }
+            }
+        }
+        fclose(fp);
+    }
+    return mask;
+}
+
 bool get_cpu_info(cpu_info_t *cpu_info) {
     memset(cpu_info, 0, sizeof(cpu_info[0]));
     std::ifstream inputFile("/proc/cpuinfo");
@@ -596,12 +632,16 @@ bool get_cpu_info(cpu_info_t *cpu_info) {
             && prevCore->core_id   == processor_list[ip].core_id) {
             // 同じソケットの同じコアならそれは論理コア
             prevCore->logical_cores++;
-            prevCore->mask |= 1llu << processor_list[ip].processor_id;
+            prevCore->mask.set(processor_list[ip].processor_id);
         } else {
+            if (cpu_info->physical_cores >= MAX_CORE_COUNT) {
+                break;
+            }
             auto targetCore = &cpu_info->proc_list[cpu_info->physical_cores];
             *targetCore = processor_list[ip];
             targetCore->logical_cores = 1;
-            targetCore->mask = 1llu << processor_list[ip].processor_id;
+            targetCore->mask = RGYCPUSet::none();
+            targetCore->mask.set(processor_list[ip].processor_id);
             cpu_info->physical_cores++;
             prevCore = targetCore;
         }
@@ -611,7 +651,7 @@ bool get_cpu_info(cpu_info_t *cpu_info) {
     std::vector<cache_info_t> caches;
     for (int ip = 0; ip < cpu_info->physical_cores; ip++) {
         const auto& targetCore = &cpu_info->proc_list[ip];
-        uint64_t mask = 0;
+        auto mask = RGYCPUSet::none();
         for (int index = 0; ; index++) {
             cache_info_t cacheinfo;
 
@@ -621,26 +661,11 @@ bool get_cpu_info(cpu_info_t *cpu_info) {
             if (stat(buffer, &st) != 0) break;
 
             sprintf_s(buffer, "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", targetCore->processor_id, index);
-            FILE *fp = fopen(buffer, "r");
-            if (fp) {
-                while (fgets(buffer, _countof(buffer), fp) != NULL) {
-                    for (auto numstr : split(buffer, ",")) {
-                        int value0 = 0, value1 = 0;
-                        if (sscanf_s(numstr.c_str(), "%d-%d", &value0, &value1) == 2) {
-                            for (int iv = value0; iv <= value1; iv++) {
-                                mask |= 1llu << iv;
-                            }
-                        } else if (sscanf_s(numstr.c_str(), "%d", &value0) == 1) {
-                            mask |= 1llu << value0;
-                        }
-                    }
-                }
-                fclose(fp);
-            }
+            mask |= read_cpu_list(buffer);
             cacheinfo.mask = mask;
 
             sprintf_s(buffer, "/sys/devices/system/cpu/cpu%d/cache/index%d/level", targetCore->processor_id, index);
-            fp = fopen(buffer, "r");
+            FILE *fp = fopen(buffer, "r");
             if (fp) {
                 while (fgets(buffer, _countof(buffer), fp) != NULL) {
                     int value = 0;
@@ -702,7 +727,7 @@ bool get_cpu_info(cpu_info_t *cpu_info) {
             auto sameCache = std::find_if(caches.begin(), caches.end(), [&cacheinfo](const cache_info_t& c){
                 return cacheinfo.type == c.type
                     && cacheinfo.level == c.level
-                    && ((cacheinfo.mask & c.mask) != 0);
+                    && cacheinfo.mask.intersects(c.mask);
             });
             if (sameCache != caches.end()) {
                 sameCache->mask |= cacheinfo.mask;
@@ -727,14 +752,33 @@ bool get_cpu_info(cpu_info_t *cpu_info) {
     }
 
     //ノードの情報を作る
-    cpu_info->node_count = processor_list.back().socket_id + 1;
-    //初期化
-    for (int in = 0; in < cpu_info->node_count; in++) {
-        cpu_info->nodes[in].mask = 0;
+    //NUMAノードの情報があればそれを使用する (1ソケットに複数ノードがある場合やその逆もある)
+    cpu_info->node_count = 0;
+    const auto nodeOnline = read_cpu_list("/sys/devices/system/node/online"); // ノード番号のリスト (cpulistと同じ形式、連続とは限らない)
+    for (int inode = nodeOnline.next(-1); inode >= 0 && cpu_info->node_count < MAX_NODE_COUNT; inode = nodeOnline.next(inode)) {
+        char buffer[256];
+        sprintf_s(buffer, "/sys/devices/system/node/node%d/cpulist", inode);
+        const auto mask = read_cpu_list(buffer);
+        if (!mask.empty()) { // CPUのないメモリだけのノードは除く
+            cpu_info->nodes[cpu_info->node_count].id = inode;
+            cpu_info->nodes[cpu_info->node_count].mask = mask;
+            cpu_info->node_count++;
+        }
     }
-    for (int ip = 0; ip < cpu_info->physical_cores; ip++) {
-        auto& targetCore = cpu_info->proc_list[ip];
-        cpu_info->nodes[targetCore.socket_id].mask |= targetCore.mask;
+    if (cpu_info->node_count == 0) {
+        //NUMAノードの情報がなければ、ソケットごとにまとめる
+        cpu_info->node_count = std::min(processor_list.back().socket_id + 1, MAX_NODE_COUNT);
+        //初期化
+        for (int in = 0; in < cpu_info->node_count; in++) {
+            cpu_info->nodes[in].id = -1;
+            cpu_info->nodes[in].mask = RGYCPUSet::none();
+        }
+        for (int ip = 0; ip < cpu_info->physical_cores; ip++) {
+            auto& targetCore = cpu_info->proc_list[ip];
+            if (targetCore.socket_id < cpu_info->node_count) {
+                cpu_info->nodes[targetCore.socket_id].mask |= targetCore.mask;
+            }
+        }
     }
 
     getCPUHybridMasks(cpu_info);
@@ -747,9 +791,8 @@ const processor_info_t *get_core_info(const cpu_info_t *cpu_info, RGYCoreType ty
     switch (type) {
     case RGYCoreType::Physical: return (id < cpu_info->physical_cores) ? &cpu_info->proc_list[id] : nullptr;
     case RGYCoreType::Logical: {
-        const uint64_t mask = 1llu << id;
         for (int i = 0; i < cpu_info->physical_cores; i++) {
-            if (mask & cpu_info->proc_list[i].mask) {
+            if (cpu_info->proc_list[i].mask.test(id)) {
                 return &cpu_info->proc_list[i];
             }
         }
@@ -758,9 +801,9 @@ const processor_info_t *get_core_info(const cpu_info_t *cpu_info, RGYCoreType ty
     default: return nullptr;
     }
 }
-uint64_t get_core_mask(const cpu_info_t *cpu_info, RGYCoreType type, int id) {
+RGYCPUSet get_core_mask(const cpu_info_t *cpu_info, RGYCoreType type, int id) {
     auto ptr = get_core_info(cpu_info, type, id);
-    return (ptr) ? ptr->mask : 0;
+    return (ptr) ? ptr->mask : RGYCPUSet::none();
 }
 const cache_info_t *get_cache_info(const cpu_info_t *cpu_info, RGYCacheLevel level, int id) {
     if (RGYCacheLevel::L1 <= level && level <= RGYCacheLevel::L4) {
@@ -768,23 +811,26 @@ const cache_info_t *get_cache_info(const cpu_info_t *cpu_info, RGYCacheLevel lev
     }
     return nullptr;
 }
-uint64_t get_cache_mask(const cpu_info_t *cpu_info, RGYCacheLevel level, int id) {
+RGYCPUSet get_cache_mask(const cpu_info_t *cpu_info, RGYCacheLevel level, int id) {
     auto ptr = get_cache_info(cpu_info, level, id);
-    return (ptr) ? ptr->mask : 0;
+    return (ptr) ? ptr->mask : RGYCPUSet::none();
 }
-uint64_t get_mask(const cpu_info_t *cpu_info, RGYUnitType unit_type, int level, int id) {
+RGYCPUSet get_mask(const cpu_info_t *cpu_info, RGYUnitType unit_type, int level, int id) {
     switch (unit_type) {
     case RGYUnitType::Core:  return get_core_mask(cpu_info, (RGYCoreType)level, id);
     case RGYUnitType::Cache: return get_cache_mask(cpu_info, (RGYCacheLevel)level, id);
-    case RGYUnitType::Node:  return cpu_info->nodes[id].mask;
-    default: return 0;
+    case RGYUnitType::Node:  return (0 <= id && id < cpu_info->node_count) ? cpu_info->nodes[id].mask : RGYCPUSet::none();
+    default: return RGYCPUSet::none();
     }
 }
 
-cpu_info_t get_cpu_info() {
-    cpu_info_t cpu;
-    get_cpu_info(&cpu);
-    return cpu;
+const cpu_info_t& get_cpu_info() {
+    static cpu_info_t s_cpu;
+    static std::once_flag s_cpu_once;
+    std::call_once(s_cpu_once, []() {
+        get_cpu_info(&s_cpu);
+    });
+    return s_cpu;
 }
 
 #if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
@@ -896,8 +942,8 @@ int getCPUInfo(TCHAR *buffer, size_t nSize
 ) {
     int ret = 0;
     buffer[0] = _T('\0');
-    cpu_info_t cpu_info;
-    if (getCPUName(buffer, nSize) || !get_cpu_info(&cpu_info)) {
+    const auto& cpu_info = get_cpu_info();
+    if (getCPUName(buffer, nSize) || cpu_info.physical_cores == 0) {
         buffer[0] = _T('\0');
         ret = 1;
     } else {
@@ -918,7 +964,7 @@ int getCPUInfo(TCHAR *buffer, size_t nSize
         }
 #endif //#if defined(_WIN32) || defined(_WIN64)
         _tcscpy_s(buffer + _tcslen(buffer), nSize - _tcslen(buffer), _T(" ("));
-        if (cpu_info.maskCoreP != 0 && cpu_info.maskCoreE != 0 && cpu_info.physical_cores <= 64) {
+        if (!cpu_info.maskCoreP.empty() && !cpu_info.maskCoreE.empty() && cpu_info.physical_cores <= 64) {
             _stprintf_s(buffer + _tcslen(buffer), nSize - _tcslen(buffer), _T("%dP+%dE,"), cpu_info.physical_cores_p, cpu_info.physical_cores_e);
         }
         _stprintf_s(buffer + _tcslen(buffer), nSize - _tcslen(buffer), _T("%dC/%dT)"), cpu_info.physical_cores, cpu_info.logical_cores);
@@ -962,10 +1008,10 @@ BOOL GetProcessTime(PROCESS_TIME *time) {
 
 double GetProcessAvgCPUUsage(HANDLE hProcess, PROCESS_TIME *start) {
     PROCESS_TIME current = { 0 };
-    cpu_info_t cpu_info;
+    const auto& cpu_info = get_cpu_info();
     double result = 0;
     if (NULL != hProcess
-        && get_cpu_info(&cpu_info)
+        && cpu_info.logical_cores > 0
         && GetProcessTime(hProcess, &current)) {
         uint64_t current_total_time = current.kernel + current.user;
         uint64_t start_total_time = (nullptr == start) ? 0 : start->kernel + start->user;
@@ -1010,8 +1056,7 @@ tstring print_cpu_info(const cpu_info_t *cpu_info) {
         }
         str += _T(" : ");
         for (int il = 0; il < cpu_info->logical_cores; il++) {
-            const auto mask = 1llu << il;
-            str += (mask & targetCore.mask) ? _T("*") : _T("-");
+            str += (targetCore.mask.test(il)) ? _T("*") : _T("-");
         }
         str += _T("\n");
     }
@@ -1023,8 +1068,7 @@ tstring print_cpu_info(const cpu_info_t *cpu_info) {
                 auto& targetCache = cpu_info->caches[icache_level][ic];
                 str += strsprintf(_T("  cache L%d%s : "), icache_level + 1, RGYCacheTypeToStr(targetCache.type));
                 for (int il = 0; il < cpu_info->logical_cores; il++) {
-                    const auto mask = 1llu << il;
-                    str += (mask & targetCache.mask) ? _T("*") : _T("-");
+                    str += (targetCache.mask.test(il)) ? _T("*") : _T("-");
                 }
                 str += strsprintf(_T(" : %2dway %6dKB\n"), targetCache.associativity, targetCache.size / 1024);
             }
@@ -32,10 +32,11 @@
 #include "rgy_tchar.h"
 #include "rgy_osdep.h"
 #include "rgy_version.h"
+#include "rgy_thread_affinity.h"
 
 static const int MAX_CACHE_LEVEL = 4;
 static const int MAX_CORE_COUNT = 512;
-static const int MAX_NODE_COUNT = 8;
+static const int MAX_NODE_COUNT = 64;
 
 enum class RGYCacheLevel {
     L0,
@@ -64,7 +65,8 @@ enum class RGYCoreType {
 };
 
 typedef struct node_info_t {
-    size_t mask;
+    int id;         // OS上のノード番号 (NUMAノードの情報がない場合は-1)
+    RGYCPUSet mask;
 } node_info_t;
 
 typedef struct cache_info_t {
@@ -73,7 +75,7 @@ typedef struct cache_info_t {
     int associativity;
     int linesize;
     int size;
-    size_t mask;
+    RGYCPUSet mask;
 } cache_info_t;
 
 typedef struct {
@@ -81,11 +83,11 @@ typedef struct {
     int core_id;        // コアID
     int socket_id;      // ソケットID
     int logical_cores;  // 論理コア数
-    size_t mask;        // 対応する物理コアのマスク
+    RGYCPUSet mask;     // 対応する物理コアのマスク
 } processor_info_t;     // 物理コアの情報
 
 typedef struct {
-    int node_count;           // ノード数
+    int node_count;           // ノード数 (LinuxではNUMAノード、取得できない場合はソケット)
     node_info_t nodes[MAX_NODE_COUNT];
     int physical_cores;  // 物理コア数
     int physical_cores_p; // 物理コア数
@@ -95,16 +97,17 @@ typedef struct {
     int cache_count[MAX_CACHE_LEVEL];       // 各階層のキャッシュの数
     cache_info_t caches[MAX_CACHE_LEVEL][MAX_CORE_COUNT]; // 各階層のキャッシュの情報
     processor_info_t proc_list[MAX_CORE_COUNT]; // 物理コアの情報
-    size_t maskCoreP;  // Performanceコアのマスク
-    size_t maskCoreE;  // Efficiencyコアのマスク
-    size_t maskSystem; // システム全体のマスク
+    RGYCPUSet maskCoreP;  // Performanceコアのマスク
+    RGYCPUSet maskCoreE;  // Efficiencyコアのマスク
+    RGYCPUSet maskSystem; // システム全体のマスク
 } cpu_info_t;
 
 
 int getCPUName(char *buffer, size_t nSize);
 bool get_cpu_info(cpu_info_t *cpu_info);
-cpu_info_t get_cpu_info();
-uint64_t get_mask(const cpu_info_t *cpu_info, RGYUnitType unit_type, int level, int id);
+// cpu_info_tは大きいので、値のコピーを避けて初回取得時の結果を参照で返す
+const cpu_info_t& get_cpu_info();
+RGYCPUSet get_mask(const cpu_info_t *cpu_info, RGYUnitType unit_type, int level, int id);
 
 tstring print_cpu_info(const cpu_info_t *cpu_info);
 
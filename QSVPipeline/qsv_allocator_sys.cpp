@@ -27,6 +27,8 @@
 
 #include "qsv_allocator_sys.h"
 #include "qsv_util.h"
+#include "rgy_thread_affinity.h"
+#include "rgy_frame_pool.h"
 
 #pragma warning(disable : 4100)
 
@@ -45,7 +47,8 @@ mfxStatus QSVBufferAllocatorSys::Alloc(mfxU32 nbytes, mfxU16 type, mfxMemId *mid
         return MFX_ERR_UNSUPPORTED;
 
     mfxU32 header_size = ALIGN32(sizeof(sBuffer));
-    void *buffer_ptr = _aligned_malloc(header_size + nbytes, 32);
+    //再初期化や並列エンコードの各チャンクで同じサイズのサーフェスを再利用できるよう、プールから確保する
+    void *buffer_ptr = RGYSysFramePool::get().alloc(header_size + nbytes);
     if (!buffer_ptr) {
         return MFX_ERR_MEMORY_ALLOC;
     }
@@ -85,7 +88,8 @@ mfxStatus QSVBufferAllocatorSys::Free(mfxMemId mid) {
     if (!bs || ID_BUFFER != bs->id) {
         return MFX_ERR_INVALID_HANDLE;
     }
-    _aligned_free(bs);
+    bs->id = 0;
+    RGYSysFramePool::get().release(bs);
     return MFX_ERR_NONE;
 }
 
@@ -350,7 +354,8 @@ mfxStatus QSVAllocatorSys::AllocImpl(mfxFrameAllocRequest *request, mfxFrameAllo
         return MFX_ERR_MEMORY_ALLOC;
     }
 
-    AddMessage(RGY_LOG_DEBUG, _T("QSVAllocatorSys::AllocImpl allocating %d frames...\n"), request->NumFrameSuggested);
+    AddMessage(RGY_LOG_DEBUG, _T("QSVAllocatorSys::AllocImpl allocating %d frames%s...\n"), request->NumFrameSuggested,
+        (RGYNumaGetProcessNode() >= 0) ? strsprintf(_T(" on NUMA node %d"), RGYNumaGetProcessNode()).c_str() : _T(""));
     mfxU32 numAllocated = 0;
     for (numAllocated = 0; numAllocated < request->NumFrameSuggested; numAllocated++) {
         mfxStatus sts = m_pBufferAllocator->Alloc(nbytes + ALIGN32(sizeof(sFrame)), request->Type, &(mids.get()[numAllocated]));
@@ -401,6 +406,10 @@ mfxStatus QSVAllocatorSys::ReleaseResponse(mfxFrameAllocResponse *response) {
         delete [] response->mids;
     }
     response->mids = 0;
-    AddMessage(RGY_LOG_DEBUG, _T("QSVAllocatorSys::ReleaseResponse Success.\n"));
+    const auto poolStats = RGYSysFramePool::get().stats();
+    AddMessage(RGY_LOG_DEBUG, _T("QSVAllocatorSys::ReleaseResponse Success (frame pool: reused %lld/%lld, used %lld MB, cached %lld MB, peak %lld MB, huge pages %lld/%lld).\n"),
+        (long long)poolStats.reuseCount, (long long)poolStats.allocCount,
+        (long long)(poolStats.usedBytes >> 20), (long long)(poolStats.cachedBytes >> 20), (long long)(poolStats.peakBytes >> 20),
+        (long long)(poolStats.hugeTLBCount + poolStats.thpCount), (long long)poolStats.blockCount);
     return MFX_ERR_NONE;
 }
@@ -214,6 +214,15 @@ tstring encoder_help() {
         _T("   --check-environment          check environment info\n")
         _T("   --check-device               check device available\n")
         _T("   --check-clinfo               check OpenCL info\n")
+        _T("   --check-convert-csp [<param1>=<value1>][,<param2>=<value2>][...]\n")
+        _T("                                benchmark colorspace conversion functions and\n")
+        _T("                                 check SIMD results against the C functions.\n")
+        _T("    params\n")
+        _T("      csp=<string>:<string>      input:output colorspace to check (default: all)\n")
+        _T("      res=<int>x<int>[:...]      resolutions (default: 1920x1080)\n")
+        _T("      threads=<int>[:...]        thread counts (default: 1:<physical cores>)\n")
+        _T("      crop=<bool>                also check with crop (default: off)\n")
+        _T("      time=<float>               seconds to measure per setting (default: 0.05)\n")
 #if ENABLE_AVSW_READER
         _T("   --check-avversion            show dll version\n")
         _T("   --check-codecs               show codecs available\n")
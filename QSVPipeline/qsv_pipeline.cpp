@@ -1532,6 +1532,21 @@ RGY_ERR CQSVPipeline::ResetDevice() {
     return RGY_ERR_NONE;
 }
 
+bool CQSVPipeline::pipelineStageInputEnabled() const {
+    // 入力スレッドはPipelineTaskInput(デコーダを使用しない場合)のみを担当する
+    return m_pipelineThread >= 2 && m_pipelineTasks.size() > 1 && m_pipelineTasks.front()->taskType() == PipelineTaskType::INPUT;
+}
+
+bool CQSVPipeline::pipelineStageOutputEnabled() const {
+    // 出力スレッドはビットストリームの書き出しのみを担当する
+    // フレームの出力(raw出力)はallocatorのLockやOpenCLのmapを伴うので、メインスレッドで行う
+    // また、音声と同じwriterに書き込む場合やvideo quality metricを使用する場合も、メインスレッドとの競合を避けるため使用しない
+    if (m_pipelineThread < 1 || !m_pFileWriter || m_pFileWriter->getOutType() != OUT_TYPE_BITSTREAM || m_videoQualityMetric) {
+        return false;
+    }
+    return std::find(m_pFileWriterListAudio.begin(), m_pFileWriterListAudio.end(), m_pFileWriter) == m_pFileWriterListAudio.end();
+}
+
 RGY_ERR CQSVPipeline::AllocFrames() {
     if (m_pipelineTasks.size() == 0) {
         PrintMes(RGY_LOG_ERROR, _T("allocFrames: pipeline not defined!\n"));
@@ -1597,6 +1612,10 @@ RGY_ERR CQSVPipeline::AllocFrames() {
             PrintMes(RGY_LOG_ERROR, _T("AllocFrames: invalid pipeline: cannot get request from either t0 or t1!\n"));
             return RGY_ERR_UNSUPPORTED;
         }
+        if (t0 == m_pipelineTasks.front().get() && pipelineStageInputEnabled()) {
+            // 入力スレッドのキューに積まれている分と、入力スレッドが読み込み中の分を追加で確保する
+            t0RequestNumFrame += PIPELINE_STAGE_INPUT_QUEUE_SIZE + 1;
+        }
         const int requestNumFrames = std::max(1, t0RequestNumFrame + t1RequestNumFrame + m_nAsyncDepth + 1);
         if (allocateOpenCLFrame) { // OpenCLフレームを介してやり取りする場合
             const RGYFrameInfo frame(allocRequest.Info.CropW, allocRequest.Info.CropH,
@@ -1696,6 +1715,9 @@ CQSVPipeline::CQSVPipeline() :
     m_sessionParams(),
     m_nProcSpeedLimit(0),
     m_taskPerfMonitor(false),
+    m_taskPerfTraceFile(),
+    m_pipelineThread(0),
+    m_pipelineThreadParams(),
     m_dummyLoad(),
     m_pAbortByUser(nullptr),
     m_heAbort(),
@@ -3276,6 +3298,13 @@ RGY_ERR CQSVPipeline::InitFilters(sInputParams *inputParam) {
                 m_encFps = param->baseFps;
                 //登録
                 vppOpenCLFilters.push_back(std::move(filterCrop));
+                if (inputParam->vpp.fusion) {
+                    //画素単位で完結するフィルタを前後のフィルタに取り込む
+                    auto err = fusePointwiseFilters(vppOpenCLFilters, m_pQSVLog);
+                    if (err != RGY_ERR_NONE) {
+                        return err;
+                    }
+                }
                 // ブロックに追加する
                 m_vpFilters.push_back(VppVilterBlock(vppOpenCLFilters));
                 vppOpenCLFilters.clear();
@@ -3834,14 +3863,40 @@ RGY_ERR CQSVPipeline::Init(sInputParams *pParams) {
     m_pPerfMonitor->runCounterThread();
 #endif
 
+    if (pParams->ctrl.numaNode != RGY_NUMA_NODE_DISABLED) {
+        // スレッドとシステムメモリ上のバッファを同じNUMAノードに割り当てる
+        // (thread-affinityでprocessが指定されていれば、そちらで上書きされる)
+        const auto& cpu_info = get_cpu_info();
+        const int node = RGYNumaSetProcessNode(pParams->ctrl.numaNode);
+        if (node < 0) {
+            PrintMes(RGY_LOG_WARN, _T("Failed to bind process to NUMA node %s (%d nodes found).\n"),
+                (pParams->ctrl.numaNode == RGY_NUMA_NODE_AUTO) ? _T("auto") : strsprintf(_T("%d"), pParams->ctrl.numaNode).c_str(), cpu_info.node_count);
+        } else {
+            PrintMes(RGY_LOG_DEBUG, _T("Bind process to NUMA node %d/%d: cpus %s, memory %s.\n"), node, cpu_info.node_count,
+                cpu_info.nodes[node].mask.to_string().c_str(),
+                (cpu_info.nodes[node].id >= 0) ? strsprintf(_T("preferred node %d"), cpu_info.nodes[node].id).c_str() : _T("first-touch"));
+        }
+    }
+    if (pParams->ctrl.hugePages != RGYHugePageMode::Disabled) {
+        RGYSysFramePool::get().setHugePageMode(pParams->ctrl.hugePages);
+        PrintMes(RGY_LOG_DEBUG, _T("Allocate frame and bitstream buffers with huge pages: %s.\n"), get_chr_from_value(list_huge_pages, (int)pParams->ctrl.hugePages));
+    }
+    if (pParams->ctrl.framePoolCacheMB >= 0) {
+        RGYSysFramePool::get().setMaxCacheBytes((size_t)pParams->ctrl.framePoolCacheMB * 1024 * 1024);
+        PrintMes(RGY_LOG_DEBUG, _T("Set max size of unused frame buffers kept in the pool: %d MB.\n"), pParams->ctrl.framePoolCacheMB);
+    }
     if (const auto affinity = pParams->ctrl.threadParams.get(RGYThreadType::PROCESS).affinity; affinity.mode != RGYThreadAffinityMode::ALL) {
-        SetProcessAffinityMask(GetCurrentProcess(), affinity.getMask());
-        PrintMes(RGY_LOG_DEBUG, _T("Set Process Affinity Mask: %s (0x%llx).\n"), affinity.to_string().c_str(), affinity.getMask());
+        RGYSetProcessAffinity(affinity.getMask());
+        PrintMes(RGY_LOG_DEBUG, _T("Set Process Affinity Mask: %s (%s).\n"), affinity.to_string().c_str(), affinity.getMask().to_string().c_str());
     }
     if (const auto priority = pParams->ctrl.threadParams.get(RGYThreadType::PROCESS).priority; priority != RGYThreadPriority::Normal) {
         SetPriorityClass(GetCurrentProcess(), pParams->ctrl.threadParams.get(RGYThreadType::PROCESS).getPriorityCalss());
         PrintMes(RGY_LOG_DEBUG, _T("Set Process priority: %s.\n"), rgy_thread_priority_mode_to_str(priority));
     }
+    if (pParams->ctrl.threadPool > 0) {
+        RGYThreadPool::setMaxThreads(pParams->ctrl.threadPool);
+        PrintMes(RGY_LOG_DEBUG, _T("Set max threads of thread pool: %d.\n"), pParams->ctrl.threadPool);
+    }
 
     RGYParamThread threadParamThrottleDsiabled;
     threadParamThrottleDsiabled.set(pParams->ctrl.threadParams.get(RGYThreadType::PROCESS).affinity, RGYThreadPriority::Normal, RGYThreadPowerThrottlingMode::Disabled);
@@ -3934,6 +3989,9 @@ RGY_ERR CQSVPipeline::Init(sInputParams *pParams) {
     sts = InitOpenCL(pParams->ctrl.enableOpenCL, pParams->vpp.checkPerformance);
     if (sts < RGY_ERR_NONE) return sts;
     PrintMes(RGY_LOG_DEBUG, _T("InitOpenCL: Success.\n"));
+    if (m_cl && pParams->ctrl.clProgramCache) {
+        m_cl->setProgramCacheDir((pParams->ctrl.clProgramCacheDir.length() > 0) ? pParams->ctrl.clProgramCacheDir : getOpenCLProgramCacheDefaultDir());
+    }
 
     sts = input_ret.get();
     if (sts < RGY_ERR_NONE) return sts;
@@ -3986,6 +4044,9 @@ RGY_ERR CQSVPipeline::Init(sInputParams *pParams) {
 
     m_nProcSpeedLimit = pParams->ctrl.procSpeedLimit;
     m_taskPerfMonitor = pParams->ctrl.taskPerfMonitor;
+    m_taskPerfTraceFile = pParams->ctrl.taskPerfTraceFile;
+    m_pipelineThread = pParams->ctrl.threadPipeline;
+    m_pipelineThreadParams = pParams->ctrl.threadParams;
     m_nAsyncDepth = clamp_param_int((pParams->ctrl.lowLatency) ? 1 : pParams->nAsyncDepth, 0, QSV_ASYNC_DEPTH_MAX, _T("async-depth"));
     if (m_nAsyncDepth == 0) {
         m_nAsyncDepth = QSV_DEFAULT_ASYNC_DEPTH;
@@ -4029,7 +4090,7 @@ RGY_ERR CQSVPipeline::Init(sInputParams *pParams) {
         const TCHAR* target_dll = check_lib_version(m_mfxVer, MFX_LIB_VERSION_2_0) ? dll_vpl_platform : dll_mfx_platform;
         if (const auto affinity = threadParam.affinity; affinity.mode != RGYThreadAffinityMode::ALL) {
             SetThreadAffinityForModule(GetCurrentProcessId(), target_dll, affinity.getMask());
-            PrintMes(RGY_LOG_DEBUG, _T("Set mfx thread Affinity Mask: %s (0x%llx).\n"), affinity.to_string().c_str(), affinity.getMask());
+            PrintMes(RGY_LOG_DEBUG, _T("Set mfx thread Affinity Mask: %s (%s).\n"), affinity.to_string().c_str(), affinity.getMask().to_string().c_str());
         }
         if (threadParam.priority != RGYThreadPriority::Normal) {
             SetThreadPriorityForModule(GetCurrentProcessId(), target_dll, threadParam.priority);
@@ -4133,12 +4194,24 @@ void CQSVPipeline::Close() {
     m_nAVSyncMode = RGY_AVSYNC_AUTO;
     m_nProcSpeedLimit = 0;
     m_taskPerfMonitor = false;
+    m_taskPerfTraceFile.clear();
+    m_pipelineThread = 0;
 #if ENABLE_AVSW_READER
     av_qsv_log_free();
 #endif //#if ENABLE_AVSW_READER
+    const auto poolStats = RGYSysFramePool::get().stats();
+    PrintMes(RGY_LOG_DEBUG, _T("Frame pool: reused %lld/%lld, buffers %lld, huge pages %lld (hugetlb %lld, thp %lld).\n"),
+        (long long)poolStats.reuseCount, (long long)poolStats.allocCount, (long long)poolStats.blockCount,
+        (long long)(poolStats.hugeTLBCount + poolStats.thpCount), (long long)poolStats.hugeTLBCount, (long long)poolStats.thpCount);
+    const auto bsPoolStats = RGYBitstreamBufPool::get().stats();
+    PrintMes(RGY_LOG_DEBUG, _T("Bitstream pool: reused %lld/%lld, returned to frame pool %lld.\n"),
+        (long long)bsPoolStats.hitCount, (long long)(bsPoolStats.hitCount + bsPoolStats.missCount), (long long)bsPoolStats.spillCount);
     PrintMes(RGY_LOG_DEBUG, _T("Closed pipeline.\n"));
     if (m_pQSVLog.get() != nullptr) {
         m_pQSVLog->writeFileFooter();
+        // ログファイルへの書き込みはスレッドで行っているので、終了前に書き出しておく
+        // (エラー終了時もデストラクタからClose()が呼ばれる)
+        m_pQSVLog->flush();
         m_pQSVLog.reset();
     }
 }
@@ -4428,6 +4501,9 @@ RGY_ERR CQSVPipeline::RunEncode2() {
     for (auto& task : m_pipelineTasks) {
         if (m_taskPerfMonitor) {
             task->setStopWatch();
+            if (m_taskPerfTraceFile.length() > 0) {
+                task->enableStopWatchTrace(PIPELINE_TASK_TRACE_MAX_EVENTS);
+            }
         }
     }
 
@@ -4465,6 +4541,67 @@ RGY_ERR CQSVPipeline::RunEncode2() {
         PipelineTaskData(size_t t, std::unique_ptr<PipelineTaskOutput>& d) : task(t), data(std::move(d)) {};
     };
     std::deque<PipelineTaskData> dataqueue;
+    auto isErrorExit = [](RGY_ERR err) {
+        return err < RGY_ERR_NONE && err != RGY_ERR_MORE_DATA && err != RGY_ERR_MORE_SURFACE && err != RGY_ERR_MORE_BITSTREAM;
+        };
+    // --pipeline-thread 指定時は入力/出力のステージを別スレッドで実行する
+    // 入力スレッドはPipelineTaskInput(デコーダを使用しない場合)のみを担当し、読み込んだフレームをキュー経由でメインスレッドに渡す
+    // 入力taskのフレームは、キューに積まれる分を加えてAllocFramesで確保してある
+    std::unique_ptr<PipelineStageThread> stageInput;
+    if (pipelineStageInputEnabled()) {
+        stageInput = std::make_unique<PipelineStageThread>(_T("input"), PIPELINE_STAGE_INPUT_QUEUE_SIZE);
+        stageInput->start([this, &speedCtrl, &requireSync](PipelineStageThread *stage) {
+            auto& task = m_pipelineTasks.front();
+            RGY_ERR err = RGY_ERR_NONE;
+            while (err == RGY_ERR_NONE) {
+                speedCtrl.wait(task->outputFrames());
+                auto frame = std::unique_ptr<PipelineTaskOutput>();
+                if ((err = task->sendFrame(frame)) != RGY_ERR_NONE) {
+                    break;
+                }
+                for (auto& output : task->getOutput(requireSync(0))) {
+                    if (!stage->push(output)) {
+                        return RGY_ERR_ABORTED;
+                    }
+                }
+            }
+            return err;
+        }, m_pipelineThreadParams.get(RGYThreadType::INPUT));
+        PrintMes(RGY_LOG_DEBUG, _T("Started pipeline %s thread.\n"), stageInput->name().c_str());
+    }
+    // 出力スレッドはパイプラインの最終的なデータ(ビットストリーム)の書き出しを担当する
+    std::unique_ptr<PipelineStageThread> stageOutput;
+    if (m_pipelineThread >= 1 && !pipelineStageOutputEnabled()) {
+        PrintMes(RGY_LOG_DEBUG, _T("Pipeline output thread disabled: output is not a bitstream, or the writer is shared with the main thread.\n"));
+    }
+    if (pipelineStageOutputEnabled()) {
+        stageOutput = std::make_unique<PipelineStageThread>(_T("output"), PIPELINE_STAGE_OUTPUT_QUEUE_SIZE);
+        stageOutput->start([this](PipelineStageThread *stage) {
+            auto data = std::unique_ptr<PipelineTaskOutput>();
+            while (stage->pop(data)) {
+                auto err = data->write(m_pFileWriter.get(), m_device->allocator(), (m_cl) ? &m_cl->queue() : nullptr, m_videoQualityMetric.get());
+                data.reset();
+                if (err != RGY_ERR_NONE) {
+                    PrintMes(RGY_LOG_ERROR, _T("failed to write output: %s.\n"), get_err_mes(err));
+                    return err;
+                }
+            }
+            return RGY_ERR_NONE;
+        }, m_pipelineThreadParams.get(RGYThreadType::OUTPUT));
+        PrintMes(RGY_LOG_DEBUG, _T("Started pipeline %s thread.\n"), stageOutput->name().c_str());
+    }
+    // pipelineの最終的なデータを出力
+    auto writeOutput = [this, &stageOutput](std::unique_ptr<PipelineTaskOutput>& data) {
+        if (stageOutput) {
+            // 出力スレッドが処理しきれない場合はここで待機する
+            return (stageOutput->push(data)) ? RGY_ERR_NONE : stageOutput->join();
+        }
+        auto err = data->write(m_pFileWriter.get(), m_device->allocator(), (m_cl) ? &m_cl->queue() : nullptr, m_videoQualityMetric.get());
+        if (err != RGY_ERR_NONE) {
+            PrintMes(RGY_LOG_ERROR, _T("failed to write output: %s.\n"), get_err_mes(err));
+        }
+        return err;
+        };
     {
         auto checkContinue = [&checkAbort](RGY_ERR& err) {
             if (checkAbort() || stdInAbort()) { err = RGY_ERR_ABORTED; return false; }
@@ -4472,8 +4609,18 @@ RGY_ERR CQSVPipeline::RunEncode2() {
             };
         while (checkContinue(err)) {
             if (dataqueue.empty()) {
-                speedCtrl.wait(m_pipelineTasks.front()->outputFrames());
-                dataqueue.push_back(PipelineTaskData(0)); // デコード実行用
+                if (stageInput) {
+                    auto frame = std::unique_ptr<PipelineTaskOutput>();
+                    if (!stageInput->pop(frame)) { // 入力スレッドが終了した
+                        err = stageInput->join();
+                        PrintMes(setloglevel(err), _T("Break in task %s: %s.\n"), m_pipelineTasks.front()->print().c_str(), get_err_mes(err));
+                        break;
+                    }
+                    dataqueue.push_back(PipelineTaskData(1, frame));
+                } else {
+                    speedCtrl.wait(m_pipelineTasks.front()->outputFrames());
+                    dataqueue.push_back(PipelineTaskData(0)); // デコード実行用
+                }
             }
             while (!dataqueue.empty()) {
                 auto d = std::move(dataqueue.front());
@@ -4495,15 +4642,15 @@ RGY_ERR CQSVPipeline::RunEncode2() {
                             });
                     }
                 } else { // pipelineの最終的なデータを出力
-                    if ((err = d.data->write(m_pFileWriter.get(), m_device->allocator(), (m_cl) ? &m_cl->queue() : nullptr, m_videoQualityMetric.get())) != RGY_ERR_NONE) {
-                        PrintMes(RGY_LOG_ERROR, _T("failed to write output: %s.\n"), get_err_mes(err));
+                    if ((err = writeOutput(d.data)) != RGY_ERR_NONE) {
                         break;
                     }
                 }
             }
             if (dataqueue.empty()) {
                 // taskを前方からひとつづつ出力が残っていないかチェック(主にcheckptsの処理のため)
-                for (size_t itask = 0; itask < m_pipelineTasks.size(); itask++) {
+                // 入力スレッドを使用する場合、入力taskの出力は入力スレッドが回収する
+                for (size_t itask = (stageInput) ? 1 : 0; itask < m_pipelineTasks.size(); itask++) {
                     auto& task = m_pipelineTasks[itask];
                     auto output = task->getOutput(requireSync(itask));
                     if (output.size() > 0) {
@@ -4518,6 +4665,17 @@ RGY_ERR CQSVPipeline::RunEncode2() {
             }
         }
     }
+    if (stageInput) {
+        // 入力スレッドがフレームの空きを待っている可能性があるので、エラー終了時は先にフレームを解放する
+        if (err != RGY_ERR_MORE_BITSTREAM) {
+            dataqueue.clear();
+        }
+        stageInput->abort();
+        stageInput->clear(); // メインスレッドが取り出す側なので、ここでキューのフレームを解放できる
+        stageInput->join();
+        stageInput.reset();
+        PrintMes(RGY_LOG_DEBUG, _T("Finished pipeline input thread.\n"));
+    }
     // flush
     if (err == RGY_ERR_MORE_BITSTREAM) { // 読み込みの完了を示すフラグ
         err = RGY_ERR_NONE;
@@ -4552,8 +4710,7 @@ RGY_ERR CQSVPipeline::RunEncode2() {
                         });
                     RGY_IGNORE_STS(err, RGY_ERR_MORE_DATA); //VPPなどでsendFrameがRGY_ERR_MORE_DATAだったが、フレームが出てくる場合がある
                 } else { // pipelineの最終的なデータを出力
-                    if ((err = d.data->write(m_pFileWriter.get(), m_device->allocator(), (m_cl) ? &m_cl->queue() : nullptr, m_videoQualityMetric.get())) != RGY_ERR_NONE) {
-                        PrintMes(RGY_LOG_ERROR, _T("failed to write output: %s.\n"), get_err_mes(err));
+                    if ((err = writeOutput(d.data)) != RGY_ERR_NONE) {
                         break;
                     }
                 }
@@ -4577,6 +4734,20 @@ RGY_ERR CQSVPipeline::RunEncode2() {
             }
         }
     }
+    if (stageOutput) {
+        // 正常終了時は出力スレッドに渡したデータをすべて書き出してから終了させる
+        if (isErrorExit(err)) {
+            stageOutput->abort();
+        } else {
+            stageOutput->close();
+        }
+        const auto errOutput = stageOutput->join();
+        if (errOutput != RGY_ERR_NONE && !isErrorExit(err)) {
+            err = errOutput;
+        }
+        stageOutput.reset();
+        PrintMes(RGY_LOG_DEBUG, _T("Finished pipeline output thread.\n"));
+    }
     // エラー終了の場合も含めキューをすべて開放する (m_pipelineTasksを解放する前に行う)
     dataqueue.clear();
 
@@ -4621,6 +4792,21 @@ RGY_ERR CQSVPipeline::RunEncode2() {
                 task->printStopWatch(totalTicks, maxWorkStrLenLen + maxTaskStrLen - _tcslen(getPipelineTaskTypeName(task->taskType())));
             }
         }
+        if (m_taskPerfTraceFile.length() > 0) {
+            FILE *fp = nullptr;
+            if (_tfopen_s(&fp, m_taskPerfTraceFile.c_str(), _T("w")) != 0 || fp == nullptr) {
+                PrintMes(RGY_LOG_WARN, _T("Failed to open task trace file \"%s\".\n"), m_taskPerfTraceFile.c_str());
+            } else {
+                bool firstEvent = true;
+                fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+                for (size_t itask = 0; itask < m_pipelineTasks.size(); itask++) {
+                    m_pipelineTasks[itask]->writeStopWatchTrace(fp, (int)itask, firstEvent);
+                }
+                fprintf(fp, "\n]}\n");
+                fclose(fp);
+                PrintMes(RGY_LOG_INFO, _T("Task trace written to \"%s\".\n"), m_taskPerfTraceFile.c_str());
+            }
+        }
     }
     //この中でフレームの解放がなされる
     PrintMes(RGY_LOG_DEBUG, _T("Clear pipeline tasks and allocated frames...\n"));
@@ -4630,7 +4816,10 @@ RGY_ERR CQSVPipeline::RunEncode2() {
     }
     m_pipelineTasks.clear();
     PrintMes(RGY_LOG_DEBUG, _T("Waiting for writer to finish...\n"));
-    m_pFileWriter->WaitFin();
+    if (const auto errWriter = m_pFileWriter->WaitFin(); errWriter != RGY_ERR_NONE && !isErrorExit(err)) {
+        PrintMes(RGY_LOG_ERROR, _T("Error in writer: %s.\n"), get_err_mes(errWriter));
+        err = errWriter;
+    }
     PrintMes(RGY_LOG_DEBUG, _T("Write results...\n"));
     if (m_videoQualityMetric) {
         PrintMes(RGY_LOG_DEBUG, _T("Write video quality metric results...\n"));
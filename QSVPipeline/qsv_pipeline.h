@@ -168,6 +168,9 @@ protected:
     MFXVideoSession2Params m_sessionParams;
     uint32_t m_nProcSpeedLimit;
     bool m_taskPerfMonitor;
+    tstring m_taskPerfTraceFile;
+    int m_pipelineThread;
+    RGYParamThreads m_pipelineThreadParams;
     std::unique_ptr<RGYDummyLoadCL> m_dummyLoad;
 
     bool *m_pAbortByUser;
@@ -220,6 +223,9 @@ protected:
     virtual RGY_ERR InitOpenCL(const bool enableOpenCL, const bool checkVppPerformance);
 
     virtual RGY_ERR AllocFrames();
+    //--pipeline-threadで入力/出力のステージを別スレッドで実行するか
+    bool pipelineStageInputEnabled() const;
+    bool pipelineStageOutputEnabled() const;
 
     virtual RGY_ERR AllocateSufficientBuffer(mfxBitstream* pBS);
 
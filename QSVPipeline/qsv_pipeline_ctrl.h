@@ -36,6 +36,10 @@
 #include <deque>
 #include <set>
 #include <optional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cmath>
 #include "qsv_hw_device.h"
 #include "rgy_opencl.h"
 #include "qsv_opencl.h"
@@ -62,6 +66,9 @@ const uint32_t MSDK_WAIT_INTERVAL = MSDK_DEC_WAIT_INTERVAL + 3 * MSDK_VPP_WAIT_I
 
 const uint32_t MSDK_INVALID_SURF_IDX = 0xFFFF;
 
+const int PIPELINE_STAGE_INPUT_QUEUE_SIZE = 2;   // 入力スレッドから先読みするフレーム数
+const int PIPELINE_STAGE_OUTPUT_QUEUE_SIZE = 16; // 出力スレッドに渡して書き出しを待つ最大数
+
 static void copy_crop_info(mfxFrameSurface1 *dst, const mfxFrameInfo *src) {
     if (dst != nullptr) {
         dst->Info.CropX = src->CropX;
@@ -93,26 +100,135 @@ enum class PipelineTaskSurfaceType {
     MFX
 };
 
+static const size_t PIPELINE_TASK_TRACE_MAX_EVENTS = 256 * 1024; // トレース出力時に各タスクで保持する処理の記録の数
+
+// 処理時間のヒストグラム (1/8オクターブ刻みの対数ヒストグラム、誤差6%程度)
+class PipelineTaskLatencyHistogram {
+    static const int SUB_BUCKET_BITS = 3;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    std::array<uint32_t, 64 * SUB_BUCKETS> m_count;
+    uint64_t m_total;
+
+    static int bucketIndex(const uint64_t ns) {
+        int shift = 0;
+        while ((ns >> shift) >= (SUB_BUCKETS << 1)) {
+            shift++;
+        }
+        return shift * SUB_BUCKETS + (int)(ns >> shift);
+    }
+    static double bucketValue(const int idx) {
+        if (idx < (SUB_BUCKETS << 1)) {
+            return (double)idx;
+        }
+        const int shift = idx / SUB_BUCKETS - 1;
+        const uint64_t lower = (uint64_t)(idx % SUB_BUCKETS + SUB_BUCKETS) << shift;
+        return (double)lower + (double)((uint64_t)1 << shift) * 0.5; // 区間の中央値
+    }
+public:
+    PipelineTaskLatencyHistogram() : m_count(), m_total(0) { m_count.fill(0); };
+    void add(const int64_t ns) {
+        m_count[bucketIndex((uint64_t)std::max<int64_t>(ns, 0))]++;
+        m_total++;
+    }
+    uint64_t count() const { return m_total; }
+    // パーセンタイル値 (ns)
+    double percentile(const double p) const {
+        if (m_total == 0) {
+            return 0.0;
+        }
+        const uint64_t target = std::max<uint64_t>((uint64_t)std::ceil(m_total * p * 0.01), 1);
+        uint64_t sum = 0;
+        for (int i = 0; i < (int)m_count.size(); i++) {
+            sum += m_count[i];
+            if (sum >= target) {
+                return bucketValue(i);
+            }
+        }
+        return bucketValue((int)m_count.size() - 1);
+    }
+};
+
 class PipelineTaskStopWatch {
+    // トレース出力用の記録 (リングバッファに保持)
+    struct TraceEvent {
+        int64_t start;    // traceBase()からの経過時間 (ns)
+        int64_t duration; // ns
+        uint32_t seq;     // その処理の何回目か
+        uint8_t type;
+        uint8_t idx;
+    };
     std::array<std::vector<std::pair<tstring, int64_t>>, 2> m_ticks;
+    std::array<std::vector<PipelineTaskLatencyHistogram>, 2> m_hist;
     std::array<std::chrono::high_resolution_clock::time_point, 2> m_prevTimepoints;
+    std::vector<TraceEvent> m_trace;
+    uint64_t m_traceCount;
 public:
-    PipelineTaskStopWatch(const std::vector<tstring>& tickSend, const std::vector<tstring>& tickGet) : m_ticks(), m_prevTimepoints() {
+    PipelineTaskStopWatch(const std::vector<tstring>& tickSend, const std::vector<tstring>& tickGet) : m_ticks(), m_hist(), m_prevTimepoints(), m_trace(), m_traceCount(0) {
         for (size_t i = 0; i < tickSend.size(); i++) {
             m_ticks[0].push_back({ tickSend[i], 0 });
         }
         for (size_t i = 0; i < tickGet.size(); i++) {
             m_ticks[1].push_back({ tickGet[i], 0 });
         }
+        for (size_t itype = 0; itype < m_ticks.size(); itype++) {
+            m_hist[itype].resize(m_ticks[itype].size());
+        }
     };
+    // 全タスクで共通のトレースの時刻の基準
+    static std::chrono::high_resolution_clock::time_point traceBase() {
+        static const auto base = std::chrono::high_resolution_clock::now();
+        return base;
+    }
+    // 直近maxEvents回分の処理の記録を保持する
+    void enableTrace(const size_t maxEvents) {
+        traceBase();
+        m_trace.resize(maxEvents);
+        m_traceCount = 0;
+    }
     void set(const int type) {
         m_prevTimepoints[type] = std::chrono::high_resolution_clock::now();
     }
     void add(const int type, const int idx) {
         auto now = std::chrono::high_resolution_clock::now();
-        m_ticks[type][idx].second += std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_prevTimepoints[type]).count();
+        const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_prevTimepoints[type]).count();
+        m_ticks[type][idx].second += duration;
+        auto& hist = m_hist[type][idx];
+        if (m_trace.size() > 0) {
+            auto& ev = m_trace[m_traceCount % m_trace.size()];
+            ev.start = std::chrono::duration_cast<std::chrono::nanoseconds>(m_prevTimepoints[type] - traceBase()).count();
+            ev.duration = duration;
+            ev.seq = (uint32_t)hist.count();
+            ev.type = (uint8_t)type;
+            ev.idx = (uint8_t)idx;
+            m_traceCount++;
+        }
+        hist.add(duration);
         m_prevTimepoints[type] = now;
     }
+    // Chrome trace event形式 (chrome://tracing, Perfettoで読み込み可能) でイベントを出力する
+    void writeTrace(FILE *fp, const int tid, const TCHAR *taskName, bool& firstEvent) const {
+        const char *type[] = { "send", "get" };
+        const auto taskNameA = tchar_to_string(taskName);
+        fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%d:%s\"}}",
+            (firstEvent) ? "" : ",", tid, tid, taskNameA.c_str());
+        firstEvent = false;
+        if (m_trace.size() == 0) {
+            return;
+        }
+        std::array<std::vector<std::string>, 2> workNames;
+        for (size_t itype = 0; itype < m_ticks.size(); itype++) {
+            for (const auto& tick : m_ticks[itype]) {
+                workNames[itype].push_back(tchar_to_string(tick.first));
+            }
+        }
+        const uint64_t count = std::min<uint64_t>(m_traceCount, m_trace.size());
+        for (uint64_t i = m_traceCount - count; i < m_traceCount; i++) {
+            const auto& ev = m_trace[i % m_trace.size()];
+            const auto& workName = workNames[ev.type][ev.idx];
+            fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"n\":%u}}",
+                (workName.length() > 0) ? workName.c_str() : type[ev.type], type[ev.type], tid, ev.start * 1e-3, ev.duration * 1e-3, ev.seq);
+        }
+    }
     int64_t totalTicks() const {
         int64_t total = 0;
         for (int itype = 0; itype < 2; itype++) {
@@ -140,7 +256,12 @@ public:
                 str += type[itype] + tstring(_T(":"));
                 str += m_ticks[itype][i].first;
                 str += tstring(maxLen - m_ticks[itype][i].first.length(), _T(' '));
-                str += strsprintf(_T(" : %8d ms [%5.1f]\n"), ((m_ticks[itype][i].second + 500000) / 1000000), m_ticks[itype][i].second * 100.0 / totalTicks);
+                str += strsprintf(_T(" : %8d ms [%5.1f]"), ((m_ticks[itype][i].second + 500000) / 1000000), m_ticks[itype][i].second * 100.0 / totalTicks);
+                const auto& hist = m_hist[itype][i];
+                if (hist.count() > 0) {
+                    str += strsprintf(_T(", p50 %8.3f, p95 %8.3f, p99 %8.3f ms"), hist.percentile(50.0) * 1e-6, hist.percentile(95.0) * 1e-6, hist.percentile(99.0) * 1e-6);
+                }
+                str += _T("\n");
                 total += m_ticks[itype][i].second;
             }
             if (m_ticks[itype].size() > 1) {
@@ -217,15 +338,20 @@ private:
         }
     };
     std::vector<std::unique_ptr<PipelineTaskSurfacesPair>> m_surfaces; // フレームと参照カウンタ
+    // --pipeline-threadの入力スレッドとメインスレッドから同時にアクセスされる場合があるので、
+    // 空きフレームのチェックと参照の取得を一体で行うよう保護する
+    mutable std::mutex m_mtx;
 public:
-    PipelineTaskSurfaces() : m_surfaces() {};
+    PipelineTaskSurfaces() : m_surfaces(), m_mtx() {};
     ~PipelineTaskSurfaces() { }
 
     void clear() {
+        std::lock_guard<std::mutex> lock(m_mtx);
         m_surfaces.clear();
     }
     void setSurfaces(std::vector<mfxFrameSurface1>& surfs) {
         clear();
+        std::lock_guard<std::mutex> lock(m_mtx);
         m_surfaces.resize(surfs.size());
         for (size_t i = 0; i < m_surfaces.size(); i++) {
             m_surfaces[i] = std::make_unique<PipelineTaskSurfacesPair>(std::move(std::make_unique<RGYFrameMFXSurf>(surfs[i])));
@@ -233,6 +359,7 @@ public:
     }
     void setSurfaces(std::vector<std::unique_ptr<RGYCLFrame>>& surfs) {
         clear();
+        std::lock_guard<std::mutex> lock(m_mtx);
         m_surfaces.resize(surfs.size());
         for (size_t i = 0; i < m_surfaces.size(); i++) {
             m_surfaces[i] = std::make_unique<PipelineTaskSurfacesPair>(std::move(surfs[i]));
@@ -240,6 +367,7 @@ public:
     }
 
     PipelineTaskSurface getFreeSurf() {
+        std::lock_guard<std::mutex> lock(m_mtx);
         for (auto& s : m_surfaces) {
             if (s->isFree()) {
                 return s->getRef();
@@ -248,6 +376,7 @@ public:
         return PipelineTaskSurface();
     }
     PipelineTaskSurface get(mfxFrameSurface1 *surf) {
+        std::lock_guard<std::mutex> lock(m_mtx);
         for (auto& s : m_surfaces) {
             if (auto mfx = dynamic_cast<RGYFrameMFXSurf*>(s->surf()); mfx != nullptr) {
                 if (mfx->surf() == surf) {
@@ -260,6 +389,7 @@ public:
     size_t bufCount() const { return m_surfaces.size(); }
 
     bool isAllFree() const {
+        std::lock_guard<std::mutex> lock(m_mtx);
         for (const auto& s : m_surfaces) {
             if (!s->isFree()) {
                 return false;
@@ -429,6 +559,80 @@ public:
     }
 };
 
+// RunEncode2の一部のステージ(入力/出力)を別スレッドで実行するためのクラス
+// メインスレッドとの間は上限付きのキューで接続し、
+// キューが一杯になった場合は追加する側を待機させる (back-pressure)
+class PipelineStageThread {
+public:
+    using StageFunc = std::function<RGY_ERR(PipelineStageThread *stage)>;
+protected:
+    tstring m_name;
+    std::thread m_thread;
+    RGYQueueBoundedSPSC<std::unique_ptr<PipelineTaskOutput>> m_queue; // スレッド間の受け渡し用 (追加側/取り出し側はそれぞれひとつのスレッド、close()で待機中のスレッドを起こす)
+    std::atomic<bool> m_abort; // 中断された
+    RGY_ERR m_err;  // スレッドの終了コード
+public:
+    PipelineStageThread(const tstring& name, size_t maxQueueSize) :
+        m_name(name), m_thread(), m_queue(), m_abort(false), m_err(RGY_ERR_NONE) {
+        m_queue.init((std::max<size_t>)(maxQueueSize, 1));
+    };
+    ~PipelineStageThread() {
+        abort();
+        join();
+    }
+    const tstring& name() const { return m_name; }
+    void start(StageFunc func, const RGYParamThread& threadParam) {
+        m_thread = std::thread([this, func, threadParam]() {
+            threadParam.apply(GetCurrentThread());
+            m_err = func(this);
+            // スレッドの終了後は、pushは失敗し、popは残りのデータを取り出した後に失敗する
+            m_queue.close();
+        });
+    }
+    // キューに空きができるまで待機してからデータを追加する
+    // 中断されたか、取り出す側のスレッドが終了していればfalseを返す
+    bool push(std::unique_ptr<PipelineTaskOutput>& data) {
+        if (m_abort) {
+            return false;
+        }
+        return m_queue.push(std::move(data));
+    }
+    // データが来るまで待機して取り出す
+    // 中断されたか、キューが空かつ追加側が終了していればfalseを返す
+    bool pop(std::unique_ptr<PipelineTaskOutput>& data) {
+        if (m_abort) {
+            return false;
+        }
+        return m_queue.pop(&data);
+    }
+    // メインスレッドからのデータの追加が終了したことを通知する
+    void close() {
+        m_queue.close();
+    }
+    // スレッドに終了を通知する
+    // キューに残ったデータは、clear()を呼ぶかjoin()でスレッドが終了した後に破棄される
+    void abort() {
+        m_abort = true;
+        m_queue.close();
+    }
+    // キューのデータを破棄する (SPSCキューなので、取り出す側のスレッドからのみ呼ぶこと)
+    void clear() {
+        m_queue.clear([](std::unique_ptr<PipelineTaskOutput> *data) { data->reset(); });
+    }
+    // スレッドの終了を待機し、スレッドの終了コードを返す
+    RGY_ERR join() {
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        // スレッドの終了後は他にキューにアクセスするスレッドはないので、残ったデータを破棄する
+        clear();
+        return m_err;
+    }
+    size_t size() {
+        return m_queue.size();
+    }
+};
+
 enum class PipelineTaskType {
     UNKNOWN,
     MFXVPP,
@@ -528,6 +732,12 @@ public:
     virtual size_t getStopWatchMaxWorkStrLen() const {
         return (m_stopwatch) ? m_stopwatch->maxWorkStrLen() : 0u;
     }
+    void enableStopWatchTrace(const size_t maxEvents) {
+        if (m_stopwatch) m_stopwatch->enableTrace(maxEvents);
+    }
+    void writeStopWatchTrace(FILE *fp, const int tid, bool& firstEvent) const {
+        if (m_stopwatch) m_stopwatch->writeTrace(fp, tid, getPipelineTaskTypeName(m_type), firstEvent);
+    }
     virtual bool isPassThrough() const { return false; }
     virtual tstring print() const { return getPipelineTaskTypeName(m_type); }
     virtual std::optional<mfxFrameAllocRequest> requiredSurfIn() = 0;
@@ -1528,8 +1738,8 @@ protected:
     }
 
     RGY_ERR openNextFile() {
-        if (m_currentChunk >= 0 && m_parallelEnc->cacheMode(m_currentChunk) == RGYParamParallelEncCache::Mem) {
-            // メモリモードの場合は、まだそのエンコーダの戻り値をチェックしていないので、ここでチェック
+        if (m_currentChunk >= 0 && m_parallelEnc->cacheMode(m_currentChunk) != RGYParamParallelEncCache::File) {
+            // メモリ/hybridモードの場合は、まだそのエンコーダの戻り値をチェックしていないので、ここでチェック
             auto procsts = checkEncodeResult();
             if (procsts != RGY_ERR_NONE) {
                 PrintMes(RGY_LOG_ERROR, _T("Error in parallel enc %d: %s\n"), m_currentChunk, get_err_mes(procsts));
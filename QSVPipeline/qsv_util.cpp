@@ -378,11 +378,12 @@ std::vector<RGYFrameData *> RGYBitstream::getFrameDataList() {
 mfxStatus mfxBitstreamInit(mfxBitstream *pBitstream, uint32_t nSize) {
     mfxBitstreamClear(pBitstream);
 
-    if (nullptr == (pBitstream->Data = (uint8_t *)_aligned_malloc(nSize, 32))) {
+    size_t capacity = 0;
+    if (nullptr == (pBitstream->Data = (uint8_t *)RGYBitstreamBufPool::get().alloc(nSize, &capacity))) {
         return MFX_ERR_NULL_PTR;
     }
 
-    pBitstream->MaxLength = nSize;
+    pBitstream->MaxLength = (uint32_t)capacity;
     return MFX_ERR_NONE;
 }
 
@@ -400,7 +401,8 @@ mfxStatus mfxBitstreamCopy(mfxBitstream *pBitstreamCopy, const mfxBitstream *pBi
 }
 
 mfxStatus mfxBitstreamExtend(mfxBitstream *pBitstream, uint32_t nSize) {
-    uint8_t *pData = (uint8_t *)_aligned_malloc(nSize, 32);
+    size_t capacity = 0;
+    uint8_t *pData = (uint8_t *)RGYBitstreamBufPool::get().alloc(nSize, &capacity);
     if (nullptr == pData) {
         return MFX_ERR_NULL_PTR;
     }
@@ -415,14 +417,14 @@ mfxStatus mfxBitstreamExtend(mfxBitstream *pBitstream, uint32_t nSize) {
     pBitstream->Data       = pData;
     pBitstream->DataOffset = 0;
     pBitstream->DataLength = nDataLen;
-    pBitstream->MaxLength  = nSize;
+    pBitstream->MaxLength  = (uint32_t)capacity;
 
     return MFX_ERR_NONE;
 }
 
 void mfxBitstreamClear(mfxBitstream *pBitstream) {
     if (pBitstream->Data) {
-        _aligned_free(pBitstream->Data);
+        RGYBitstreamBufPool::get().release(pBitstream->Data);
     }
     memset(pBitstream, 0, sizeof(pBitstream[0]));
 }
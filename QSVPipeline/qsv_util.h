@@ -46,6 +46,7 @@
 #include "qsv_prm.h"
 #include "rgy_err.h"
 #include "rgy_frame_info.h"
+#include "rgy_frame_pool.h"
 #include "rgy_opencl.h"
 
 using std::vector;
@@ -302,7 +303,7 @@ public:
 
     void free_mem() {
         if (m_bitstream.Data) {
-            _aligned_free(m_bitstream.Data);
+            RGYBitstreamBufPool::get().release(m_bitstream.Data);
             m_bitstream.Data = nullptr;
         }
     }
@@ -316,11 +317,12 @@ public:
         free_mem();
 
         if (nSize > 0) {
-            if (nullptr == (m_bitstream.Data = (uint8_t *)_aligned_malloc(nSize, 32))) {
+            size_t capacity = 0;
+            if (nullptr == (m_bitstream.Data = (uint8_t *)RGYBitstreamBufPool::get().alloc(nSize, &capacity))) {
                 return RGY_ERR_NULL_PTR;
             }
 
-            m_bitstream.MaxLength = (uint32_t)nSize;
+            m_bitstream.MaxLength = (uint32_t)capacity;
         }
         return RGY_ERR_NONE;
     }
@@ -381,7 +383,8 @@ public:
 
     RGY_ERR resize(size_t nNewSize) {
         if (m_bitstream.MaxLength < nNewSize) {
-            uint8_t *pData = (uint8_t *)_aligned_malloc(nNewSize, 32);
+            size_t capacity = 0;
+            uint8_t *pData = (uint8_t *)RGYBitstreamBufPool::get().alloc(nNewSize, &capacity);
             if (pData == nullptr) {
                 return RGY_ERR_NULL_PTR;
             }
@@ -393,7 +396,7 @@ public:
             m_bitstream.Data = pData;
             m_bitstream.DataOffset = 0;
             m_bitstream.DataLength = (uint32_t)nNewSize;
-            m_bitstream.MaxLength = (uint32_t)nNewSize;
+            m_bitstream.MaxLength = (uint32_t)capacity;
             return RGY_ERR_NONE;
         }
         if (m_bitstream.DataLength > 0 && m_bitstream.MaxLength < nNewSize + m_bitstream.DataOffset) {
@@ -411,7 +414,8 @@ public:
     }
 
     RGY_ERR changeSize(size_t nNewSize) {
-        uint8_t *pData = (uint8_t *)_aligned_malloc(nNewSize, 32);
+        size_t capacity = 0;
+        uint8_t *pData = (uint8_t *)RGYBitstreamBufPool::get().alloc(nNewSize, &capacity);
         if (pData == nullptr) {
             return RGY_ERR_NULL_PTR;
         }
@@ -425,7 +429,7 @@ public:
         m_bitstream.Data       = pData;
         m_bitstream.DataOffset = 0;
         m_bitstream.DataLength = (uint32_t)nDataLen;
-        m_bitstream.MaxLength  = (uint32_t)nNewSize;
+        m_bitstream.MaxLength  = (uint32_t)capacity;
 
         return RGY_ERR_NONE;
     }
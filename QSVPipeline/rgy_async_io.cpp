@@ -0,0 +1,1179 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// -------------------------------------------------------------------------------------------
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include "rgy_async_io.h"
+#include "rgy_util.h"
+#if defined(_WIN32) || defined(_WIN64)
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+#if ENABLE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif //#if ENABLE_IO_URING
+
+#if ENABLE_IO_URING
+static int rgy_io_uring_setup(uint32_t entries, io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int rgy_io_uring_enter(int fd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+RGYIOUring::RGYIOUring() :
+    m_fd(-1),
+    m_pending(0),
+    m_sqRing(nullptr),
+    m_sqRingSize(0),
+    m_cqRing(nullptr),
+    m_cqRingSize(0),
+    m_sqes(nullptr),
+    m_sqesSize(0),
+    m_sqHead(nullptr),
+    m_sqTail(nullptr),
+    m_sqMask(0),
+    m_sqEntries(0),
+    m_sqArray(nullptr),
+    m_cqHead(nullptr),
+    m_cqTail(nullptr),
+    m_cqMask(0),
+    m_cqes(nullptr) {
+}
+
+RGYIOUring::~RGYIOUring() {
+    close();
+}
+
+RGY_ERR RGYIOUring::init(uint32_t entries) {
+    close();
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    //コンテナ等でio_uringが禁止されている場合はENOSYS/EPERMとなる
+    m_fd = rgy_io_uring_setup(entries, &params);
+    if (m_fd < 0) {
+        m_fd = -1;
+        return RGY_ERR_UNSUPPORTED;
+    }
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+        m_sqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+        m_cqRingSize = m_sqRingSize;
+    }
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED) {
+        m_sqRing = nullptr;
+        close();
+        return RGY_ERR_NULL_PTR;
+    }
+    if (singleMmap) {
+        m_cqRing = m_sqRing;
+    } else {
+        m_cqRing = mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED) {
+            m_cqRing = nullptr;
+            close();
+            return RGY_ERR_NULL_PTR;
+        }
+    }
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        close();
+        return RGY_ERR_NULL_PTR;
+    }
+    m_sqes = (io_uring_sqe *)sqes;
+    auto sq = (uint8_t *)m_sqRing;
+    auto cq = (uint8_t *)m_cqRing;
+    m_sqHead    = (uint32_t *)(sq + params.sq_off.head);
+    m_sqTail    = (uint32_t *)(sq + params.sq_off.tail);
+    m_sqMask    = *(uint32_t *)(sq + params.sq_off.ring_mask);
+    m_sqEntries = *(uint32_t *)(sq + params.sq_off.ring_entries);
+    m_sqArray   = (uint32_t *)(sq + params.sq_off.array);
+    m_cqHead    = (uint32_t *)(cq + params.cq_off.head);
+    m_cqTail    = (uint32_t *)(cq + params.cq_off.tail);
+    m_cqMask    = *(uint32_t *)(cq + params.cq_off.ring_mask);
+    m_cqes      = (io_uring_cqe *)(cq + params.cq_off.cqes);
+    m_pending = 0;
+    return RGY_ERR_NONE;
+}
+
+void RGYIOUring::close() {
+    if (m_sqes) {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = nullptr;
+    }
+    if (m_cqRing && m_cqRing != m_sqRing) {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    m_cqRing = nullptr;
+    if (m_sqRing) {
+        munmap(m_sqRing, m_sqRingSize);
+        m_sqRing = nullptr;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    m_pending = 0;
+}
+
+bool RGYIOUring::prep(uint8_t opcode, int fd, const void *buf, uint32_t size, uint64_t offset, uint64_t userData) {
+    const uint32_t tail = *m_sqTail;
+    const uint32_t head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if (tail - head >= m_sqEntries) {
+        return false;
+    }
+    const uint32_t idx = tail & m_sqMask;
+    io_uring_sqe *sqe = &m_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(size_t)buf;
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    m_sqArray[idx] = idx;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    m_pending++;
+    return true;
+}
+
+bool RGYIOUring::prepRead(int fd, void *buf, uint32_t size, uint64_t offset, uint64_t userData) {
+    return prep(IORING_OP_READ, fd, buf, size, offset, userData);
+}
+
+bool RGYIOUring::prepWrite(int fd, const void *buf, uint32_t size, uint64_t offset, uint64_t userData) {
+    return prep(IORING_OP_WRITE, fd, buf, size, offset, userData);
+}
+
+int RGYIOUring::submit() {
+    int submitted = 0;
+    while (m_pending > 0) {
+        const int ret = rgy_io_uring_enter(m_fd, m_pending, 0, 0);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        m_pending -= std::min<uint32_t>(ret, m_pending);
+        submitted += ret;
+        if (ret == 0) break;
+    }
+    return submitted;
+}
+
+int RGYIOUring::complete(uint64_t *userData, int32_t *res, bool wait) {
+    for (;;) {
+        const uint32_t head = *m_cqHead;
+        const uint32_t tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        if (head != tail) {
+            const io_uring_cqe *cqe = &m_cqes[head & m_cqMask];
+            *userData = cqe->user_data;
+            *res = cqe->res;
+            __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+            return 1;
+        }
+        if (!wait) {
+            return 0;
+        }
+        if (rgy_io_uring_enter(m_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            return -errno;
+        }
+    }
+}
+#endif //#if ENABLE_IO_URING
+
+int64_t rgy_pread(RGYFileHandle fh, void *buf, uint32_t size, int64_t offset) {
+#if defined(_WIN32) || defined(_WIN64)
+    //同期ハンドルでもOVERLAPPEDで位置を指定すれば、ファイルポインタを共有せずに読み込める
+    OVERLAPPED ov = { 0 };
+    ov.Offset = (DWORD)(offset & 0xffffffff);
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD readBytes = 0;
+    if (!ReadFile(fh, buf, size, &readBytes, &ov)) {
+        const auto err = GetLastError();
+        return (err == ERROR_HANDLE_EOF) ? 0 : -EIO;
+    }
+    return readBytes;
+#else
+    uint32_t total = 0;
+    while (total < size) {
+        const auto ret = pread(fh, (uint8_t *)buf + total, size - total, offset + total);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return (total > 0) ? total : -errno;
+        }
+        if (ret == 0) break;
+        total += (uint32_t)ret;
+    }
+    return total;
+#endif
+}
+
+int64_t rgy_pwrite(RGYFileHandle fh, const void *buf, uint32_t size, int64_t offset) {
+#if defined(_WIN32) || defined(_WIN64)
+    OVERLAPPED ov = { 0 };
+    ov.Offset = (DWORD)(offset & 0xffffffff);
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD writtenBytes = 0;
+    if (!WriteFile(fh, buf, size, &writtenBytes, &ov)) {
+        const auto err = GetLastError();
+        if (err == ERROR_DISK_FULL || err == ERROR_HANDLE_DISK_FULL) {
+            return -ENOSPC;
+        }
+        return (err == ERROR_INVALID_PARAMETER) ? -EINVAL : -EIO;
+    }
+    return (writtenBytes == size) ? (int64_t)size : -ENOSPC;
+#else
+    uint32_t total = 0;
+    while (total < size) {
+        const auto ret = pwrite(fh, (const uint8_t *)buf + total, size - total, offset + total);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        if (ret == 0) {
+            return -EIO;
+        }
+        total += (uint32_t)ret;
+    }
+    return total;
+#endif
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static const RGYFileHandle RGY_INVALID_FILE_HANDLE = INVALID_HANDLE_VALUE;
+#else
+static const RGYFileHandle RGY_INVALID_FILE_HANDLE = -1;
+#endif
+
+RGYFileReadAhead::RGYFileReadAhead() :
+    m_fh(RGY_INVALID_FILE_HANDLE),
+    m_fileSize(0),
+    m_pos(0),
+    m_nextOffset(0),
+    m_blockSize(0),
+    m_inFlight(0),
+    m_blocks(),
+    m_buffer(nullptr, _aligned_free),
+#if ENABLE_IO_URING
+    m_ring(),
+#endif //#if ENABLE_IO_URING
+    m_threads(),
+    m_mtx(),
+    m_cvRequest(),
+    m_cvDone(),
+    m_requests(),
+    m_done(),
+    m_abort(false),
+    m_bytesRead(0),
+    m_readCount(0),
+    m_latencyMicroSec(0),
+    m_waitMicroSec(0),
+    m_waitCount(0) {
+}
+
+RGYFileReadAhead::~RGYFileReadAhead() {
+    close();
+}
+
+RGY_ERR RGYFileReadAhead::open(const TCHAR *filename, int depth, size_t blockSize) {
+    close();
+    depth = clamp(depth, 1, 32);
+    //O_DIRECTの有無によらず扱いやすいよう、ブロックサイズはページサイズの倍数とする
+    m_blockSize = ALIGN(std::max<size_t>(blockSize, 64 * 1024), 4096);
+#if defined(_WIN32) || defined(_WIN64)
+    m_fh = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_fh == INVALID_HANDLE_VALUE) {
+        return RGY_ERR_FILE_OPEN;
+    }
+    LARGE_INTEGER filesize = { 0 };
+    if (!GetFileSizeEx(m_fh, &filesize)) {
+        close();
+        return RGY_ERR_FILE_OPEN;
+    }
+    m_fileSize = filesize.QuadPart;
+#else
+    m_fh = ::open(tchar_to_string(filename).c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fh < 0) {
+        m_fh = RGY_INVALID_FILE_HANDLE;
+        return RGY_ERR_FILE_OPEN;
+    }
+    struct stat st;
+    if (fstat(m_fh, &st) != 0 || !S_ISREG(st.st_mode)) {
+        //パイプやデバイスは対象外
+        close();
+        return RGY_ERR_UNSUPPORTED;
+    }
+    m_fileSize = st.st_size;
+    posix_fadvise(m_fh, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    m_buffer.reset((uint8_t *)_aligned_malloc(m_blockSize * depth, 4096));
+    if (!m_buffer) {
+        close();
+        return RGY_ERR_NULL_PTR;
+    }
+    m_blocks.resize(depth);
+    for (int i = 0; i < depth; i++) {
+        auto& blk = m_blocks[i];
+        blk.ptr = m_buffer.get() + m_blockSize * i;
+        blk.offset = 0;
+        blk.size = 0;
+        blk.result = 0;
+        blk.state = BlockState::Free;
+        blk.stale = false;
+    }
+    m_pos = 0;
+    m_nextOffset = 0;
+    m_inFlight = 0;
+    m_abort = false;
+#if ENABLE_IO_URING
+    m_ring = std::make_unique<RGYIOUring>();
+    if (m_ring->init(depth) != RGY_ERR_NONE) {
+        m_ring.reset();
+    }
+    if (!m_ring)
+#endif //#if ENABLE_IO_URING
+    {
+        for (int i = 0; i < depth; i++) {
+            m_threads.push_back(std::thread(&RGYFileReadAhead::threadFunc, this));
+        }
+    }
+    schedule();
+    return RGY_ERR_NONE;
+}
+
+void RGYFileReadAhead::close() {
+    if (m_threads.size() > 0) {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_abort = true;
+            m_requests.clear();
+        }
+        m_cvRequest.notify_all();
+        for (auto& th : m_threads) {
+            th.join();
+        }
+        m_threads.clear();
+    }
+#if ENABLE_IO_URING
+    if (m_ring) {
+        //カーネルがバッファに書き込み中のまま解放しないよう、発行済みの読み込みの完了を待つ
+        while (m_inFlight > 0 && reap(true)) {
+        }
+        m_ring.reset();
+    }
+#endif //#if ENABLE_IO_URING
+    m_requests.clear();
+    m_done.clear();
+    m_blocks.clear();
+    m_buffer.reset();
+    m_inFlight = 0;
+    if (m_fh != RGY_INVALID_FILE_HANDLE) {
+#if defined(_WIN32) || defined(_WIN64)
+        CloseHandle(m_fh);
+#else
+        ::close(m_fh);
+#endif
+        m_fh = RGY_INVALID_FILE_HANDLE;
+    }
+}
+
+const TCHAR *RGYFileReadAhead::engine() const {
+#if ENABLE_IO_URING
+    if (m_ring) {
+        return _T("io_uring");
+    }
+#endif //#if ENABLE_IO_URING
+    return _T("thread");
+}
+
+RGYFileReadAhead::Stats RGYFileReadAhead::stats() const {
+    Stats stats;
+    stats.bytesRead = m_bytesRead.load(std::memory_order_relaxed);
+    stats.readCount = m_readCount.load(std::memory_order_relaxed);
+    stats.latencyMicroSec = m_latencyMicroSec.load(std::memory_order_relaxed);
+    stats.waitMicroSec = m_waitMicroSec.load(std::memory_order_relaxed);
+    stats.waitCount = m_waitCount.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void RGYFileReadAhead::threadFunc() {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    for (;;) {
+        m_cvRequest.wait(lock, [&]() { return m_abort || !m_requests.empty(); });
+        if (m_abort) {
+            break;
+        }
+        const int idx = m_requests.front();
+        m_requests.pop_front();
+        //ブロックの情報は要求の登録前に設定済みで、完了を通知するまで呼び出し側は変更しない
+        auto ptr = m_blocks[idx].ptr;
+        const auto size = m_blocks[idx].size;
+        const auto offset = m_blocks[idx].offset;
+        lock.unlock();
+        const auto ret = rgy_pread(m_fh, ptr, size, offset);
+        lock.lock();
+        m_done.push_back(std::make_pair(idx, (int32_t)ret));
+        m_cvDone.notify_one();
+    }
+}
+
+int RGYFileReadAhead::findBlock(int64_t pos) const {
+    for (int i = 0; i < (int)m_blocks.size(); i++) {
+        const auto& blk = m_blocks[i];
+        if (blk.state != BlockState::Free && !blk.stale
+            && blk.offset <= pos && pos < blk.offset + blk.size) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int RGYFileReadAhead::getFreeBlock() {
+    int idx = -1;
+    for (int i = 0; i < (int)m_blocks.size(); i++) {
+        const auto& blk = m_blocks[i];
+        if (blk.state == BlockState::Free) {
+            return i;
+        }
+        //読み終わったブロックのうち、最も古いものを再利用する
+        //すぐに再利用せず残しておくことで、少しだけ戻るseekでは再読み込みしなくて済む
+        if (blk.state == BlockState::Done
+            && (blk.stale || blk.offset + blk.size <= m_pos)
+            && (idx < 0 || blk.offset < m_blocks[idx].offset)) {
+            idx = i;
+        }
+    }
+    if (idx >= 0) {
+        m_blocks[idx].state = BlockState::Free;
+    }
+    return idx;
+}
+
+void RGYFileReadAhead::submitBlock(int idx) {
+    auto& blk = m_blocks[idx];
+    blk.state = BlockState::InFlight;
+    blk.stale = false;
+    blk.result = 0;
+    blk.submitTime = std::chrono::steady_clock::now();
+    m_inFlight++;
+#if ENABLE_IO_URING
+    if (m_ring) {
+        //エントリ数はブロック数と同じなので、空きがないことはない
+        m_ring->prepRead(m_fh, blk.ptr, blk.size, blk.offset, idx);
+        return;
+    }
+#endif //#if ENABLE_IO_URING
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_requests.push_back(idx);
+    m_cvRequest.notify_one();
+}
+
+void RGYFileReadAhead::schedule() {
+    //完了済みのものを回収してから、空いたブロックで次の読み込みを発行する
+    while (reap(false)) {
+    }
+#if ENABLE_IO_URING
+    bool submitted = false;
+#endif //#if ENABLE_IO_URING
+    while (m_nextOffset < m_fileSize) {
+        const int idx = getFreeBlock();
+        if (idx < 0) {
+            break;
+        }
+        auto& blk = m_blocks[idx];
+        blk.offset = m_nextOffset;
+        blk.size = (uint32_t)std::min<int64_t>(m_blockSize, m_fileSize - m_nextOffset);
+        submitBlock(idx);
+        m_nextOffset += blk.size;
+#if ENABLE_IO_URING
+        submitted = true;
+#endif //#if ENABLE_IO_URING
+    }
+#if ENABLE_IO_URING
+    if (submitted && m_ring) {
+        m_ring->submit();
+    }
+#endif //#if ENABLE_IO_URING
+}
+
+bool RGYFileReadAhead::reap(bool wait) {
+    if (m_inFlight <= 0) {
+        return false;
+    }
+#if ENABLE_IO_URING
+    if (m_ring) {
+        uint64_t userData = 0;
+        int32_t res = 0;
+        const int ret = m_ring->complete(&userData, &res, wait);
+        if (ret <= 0) {
+            return false;
+        }
+        onComplete((int)userData, res);
+        return true;
+    }
+#endif //#if ENABLE_IO_URING
+    std::deque<std::pair<int, int32_t>> done;
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        if (wait) {
+            m_cvDone.wait(lock, [&]() { return !m_done.empty(); });
+        }
+        done.swap(m_done);
+    }
+    for (const auto& d : done) {
+        onComplete(d.first, d.second);
+    }
+    return !done.empty();
+}
+
+void RGYFileReadAhead::onComplete(int idx, int32_t result) {
+    auto& blk = m_blocks[idx];
+    m_inFlight--;
+#if ENABLE_IO_URING
+    if (result < 0 && m_ring && result != -ECANCELED) {
+        //古いカーネルでIORING_OP_READが使用できない場合等は、同期読み込みでやり直す
+        result = (int32_t)rgy_pread(m_fh, blk.ptr, blk.size, blk.offset);
+    }
+#endif //#if ENABLE_IO_URING
+    blk.result = result;
+    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - blk.submitTime).count();
+    m_latencyMicroSec.fetch_add(latency, std::memory_order_relaxed);
+    m_readCount.fetch_add(1, std::memory_order_relaxed);
+    if (result > 0) {
+        m_bytesRead.fetch_add(result, std::memory_order_relaxed);
+    }
+    blk.state = (blk.stale) ? BlockState::Free : BlockState::Done;
+}
+
+void RGYFileReadAhead::restart(int64_t pos) {
+    for (auto& blk : m_blocks) {
+        if (blk.state == BlockState::Done) {
+            blk.state = BlockState::Free;
+        } else if (blk.state == BlockState::InFlight) {
+            blk.stale = true; //完了したら解放する
+        }
+    }
+    m_nextOffset = pos;
+}
+
+void RGYFileReadAhead::updateFileSize() {
+    //書き込み中のファイルを読んでいる場合に備え、終端に達したらサイズを取り直す
+#if defined(_WIN32) || defined(_WIN64)
+    LARGE_INTEGER filesize = { 0 };
+    if (GetFileSizeEx(m_fh, &filesize)) {
+        m_fileSize = filesize.QuadPart;
+    }
+#else
+    struct stat st;
+    if (fstat(m_fh, &st) == 0) {
+        m_fileSize = st.st_size;
+    }
+#endif
+}
+
+int64_t RGYFileReadAhead::read(void *buf, size_t size) {
+    auto dst = (uint8_t *)buf;
+    size_t copied = 0;
+    while (copied < size) {
+        if (m_pos >= m_fileSize) {
+            updateFileSize();
+            if (m_pos >= m_fileSize) {
+                break;
+            }
+        }
+        int idx = findBlock(m_pos);
+        if (idx < 0) {
+            //seekにより先読みの範囲外に出たので、現在位置から読み込みをやり直す
+            restart(m_pos);
+            schedule();
+            while ((idx = findBlock(m_pos)) < 0) {
+                //すべてのブロックが不要になった読み込みで埋まっているので、空くのを待つ
+                if (!reap(true)) {
+                    return (copied > 0) ? (int64_t)copied : -EIO;
+                }
+                schedule();
+            }
+        }
+        auto& blk = m_blocks[idx];
+        if (blk.state == BlockState::InFlight) {
+            const auto start = std::chrono::steady_clock::now();
+            while (blk.state == BlockState::InFlight) {
+                if (!reap(true)) {
+                    return (copied > 0) ? (int64_t)copied : -EIO;
+                }
+            }
+            m_waitMicroSec.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+            m_waitCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (blk.result < 0) {
+            const int64_t err = blk.result;
+            blk.stale = true;
+            return (copied > 0) ? (int64_t)copied : err;
+        }
+        const int64_t avail = blk.offset + blk.result - m_pos;
+        if (avail <= 0) {
+            //ファイルが途中で短くなった場合、読めた位置までを終端とみなす
+            blk.stale = true;
+            m_fileSize = std::min(m_fileSize, blk.offset + blk.result);
+            continue;
+        }
+        const size_t copySize = (size_t)std::min<int64_t>(avail, size - copied);
+        memcpy(dst + copied, blk.ptr + (m_pos - blk.offset), copySize);
+        copied += copySize;
+        m_pos += copySize;
+        schedule();
+    }
+    return (int64_t)copied;
+}
+
+int64_t RGYFileReadAhead::seek(int64_t offset, int whence) {
+    int64_t newPos = 0;
+    switch (whence) {
+    case SEEK_SET: newPos = offset; break;
+    case SEEK_CUR: newPos = m_pos + offset; break;
+    case SEEK_END: updateFileSize(); newPos = m_fileSize + offset; break;
+    default: return -EINVAL;
+    }
+    if (newPos < 0) {
+        return -EINVAL;
+    }
+    //実際の読み込みのやり直しは、必要になったときにread()で行う
+    m_pos = newPos;
+    return m_pos;
+}
+
+RGYFileWriteAsync::RGYFileWriteAsync() :
+    m_fh(RGY_INVALID_FILE_HANDLE),
+    m_fhDirect(RGY_INVALID_FILE_HANDLE),
+    m_directFailed(false),
+    m_pos(0),
+    m_fileEnd(0),
+    m_blockSize(0),
+    m_depth(0),
+    m_tail(-1),
+    m_patch(-1),
+    m_inFlight(0),
+    m_error(0),
+    m_sync(false),
+    m_blocks(),
+    m_buffer(nullptr, _aligned_free),
+#if ENABLE_IO_URING
+    m_ring(),
+#endif //#if ENABLE_IO_URING
+    m_threads(),
+    m_mtx(),
+    m_cvRequest(),
+    m_cvDone(),
+    m_requests(),
+    m_done(),
+    m_abort(false),
+    m_bytesWritten(0),
+    m_writeCount(0),
+    m_directCount(0),
+    m_latencyMicroSec(0),
+    m_waitMicroSec(0),
+    m_waitCount(0) {
+}
+
+RGYFileWriteAsync::~RGYFileWriteAsync() {
+    close();
+}
+
+RGY_ERR RGYFileWriteAsync::open(const TCHAR *filename, int depth, size_t blockSize, bool direct) {
+    close();
+    m_depth = clamp(depth, 2, 32);
+    m_blockSize = ALIGN(std::max<size_t>(blockSize, 256 * 1024), DIRECT_ALIGN);
+#if defined(_WIN32) || defined(_WIN64)
+    //FILE_FLAG_NO_BUFFERING用に同じファイルを別のハンドルでも開くため、その場合は書き込みも共有する
+    //"movflags:faststart"では書き込み中のファイルを別途読み込みで開くので、読み込みは共有する
+    m_fh = CreateFile(filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | ((direct) ? FILE_SHARE_WRITE : 0), nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_fh == INVALID_HANDLE_VALUE) {
+        return RGY_ERR_FILE_OPEN;
+    }
+    if (GetFileType(m_fh) != FILE_TYPE_DISK) {
+        close();
+        return RGY_ERR_UNSUPPORTED;
+    }
+    if (direct) {
+        //開けなければ通常の書き込みのみとする
+        m_fhDirect = CreateFile(filename, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+    }
+#else
+    const auto filenameStr = tchar_to_string(filename);
+    m_fh = ::open(filenameStr.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (m_fh < 0) {
+        m_fh = RGY_INVALID_FILE_HANDLE;
+        return RGY_ERR_FILE_OPEN;
+    }
+    struct stat st;
+    if (fstat(m_fh, &st) != 0 || !S_ISREG(st.st_mode)) {
+        //パイプやデバイスは対象外
+        close();
+        return RGY_ERR_UNSUPPORTED;
+    }
+#if defined(O_DIRECT)
+    if (direct) {
+        //tmpfs等、O_DIRECTに対応しないファイルシステムでは開けないので、通常の書き込みのみとする
+        m_fhDirect = ::open(filenameStr.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+        if (m_fhDirect < 0) {
+            m_fhDirect = RGY_INVALID_FILE_HANDLE;
+        }
+    }
+#endif //#if defined(O_DIRECT)
+#endif
+    //終端への追記用のm_depth個に加え、終端以外への書き込み用に1つ確保する
+    const int blockCount = m_depth + 1;
+    m_buffer.reset((uint8_t *)_aligned_malloc(m_blockSize * blockCount, DIRECT_ALIGN));
+    if (!m_buffer) {
+        close();
+        return RGY_ERR_NULL_PTR;
+    }
+    m_blocks.resize(blockCount);
+    for (int i = 0; i < blockCount; i++) {
+        auto& blk = m_blocks[i];
+        blk.ptr = m_buffer.get() + m_blockSize * i;
+        blk.offset = 0;
+        blk.size = 0;
+        blk.state = BlockState::Free;
+        blk.direct = false;
+    }
+    m_directFailed = false;
+    m_pos = 0;
+    m_fileEnd = 0;
+    m_tail = -1;
+    m_patch = -1;
+    m_inFlight = 0;
+    m_error = 0;
+    m_sync = false;
+    m_abort = false;
+#if ENABLE_IO_URING
+    m_ring = std::make_unique<RGYIOUring>();
+    if (m_ring->init(blockCount) != RGY_ERR_NONE) {
+        m_ring.reset();
+    }
+    if (!m_ring)
+#endif //#if ENABLE_IO_URING
+    {
+        for (int i = 0; i < m_depth; i++) {
+            m_threads.push_back(std::thread(&RGYFileWriteAsync::threadFunc, this));
+        }
+    }
+    return RGY_ERR_NONE;
+}
+
+int RGYFileWriteAsync::close() {
+    int err = 0;
+    if (m_fh != RGY_INVALID_FILE_HANDLE && m_blocks.size() > 0) {
+        err = flush();
+    }
+    if (m_threads.size() > 0) {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_abort = true;
+            m_requests.clear();
+        }
+        m_cvRequest.notify_all();
+        for (auto& th : m_threads) {
+            th.join();
+        }
+        m_threads.clear();
+    }
+#if ENABLE_IO_URING
+    if (m_ring) {
+        //カーネルがバッファを読み込み中のまま解放しないよう、発行済みの書き込みの完了を待つ
+        while (m_inFlight > 0 && reap(true)) {
+        }
+        m_ring.reset();
+    }
+#endif //#if ENABLE_IO_URING
+    m_requests.clear();
+    m_done.clear();
+    m_blocks.clear();
+    m_buffer.reset();
+    m_inFlight = 0;
+    m_tail = -1;
+    m_patch = -1;
+    if (m_fhDirect != RGY_INVALID_FILE_HANDLE) {
+#if defined(_WIN32) || defined(_WIN64)
+        CloseHandle(m_fhDirect);
+#else
+        ::close(m_fhDirect);
+#endif
+        m_fhDirect = RGY_INVALID_FILE_HANDLE;
+    }
+    if (m_fh != RGY_INVALID_FILE_HANDLE) {
+#if defined(_WIN32) || defined(_WIN64)
+        CloseHandle(m_fh);
+#else
+        ::close(m_fh);
+#endif
+        m_fh = RGY_INVALID_FILE_HANDLE;
+    }
+    return err;
+}
+
+bool RGYFileWriteAsync::direct() const {
+    return m_fhDirect != RGY_INVALID_FILE_HANDLE && !m_directFailed;
+}
+
+const TCHAR *RGYFileWriteAsync::engine() const {
+#if ENABLE_IO_URING
+    if (m_ring) {
+        return _T("io_uring");
+    }
+#endif //#if ENABLE_IO_URING
+    return _T("thread");
+}
+
+RGYFileWriteAsync::Stats RGYFileWriteAsync::stats() const {
+    Stats stats;
+    stats.bytesWritten = m_bytesWritten.load(std::memory_order_relaxed);
+    stats.writeCount = m_writeCount.load(std::memory_order_relaxed);
+    stats.directCount = m_directCount.load(std::memory_order_relaxed);
+    stats.latencyMicroSec = m_latencyMicroSec.load(std::memory_order_relaxed);
+    stats.waitMicroSec = m_waitMicroSec.load(std::memory_order_relaxed);
+    stats.waitCount = m_waitCount.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void RGYFileWriteAsync::threadFunc() {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    for (;;) {
+        m_cvRequest.wait(lock, [&]() { return m_abort || !m_requests.empty(); });
+        if (m_abort) {
+            break;
+        }
+        const int idx = m_requests.front();
+        m_requests.pop_front();
+        //ブロックの情報は要求の登録前に設定済みで、完了を通知するまで呼び出し側は変更しない
+        const auto& blk = m_blocks[idx];
+        const auto fh = (blk.direct) ? m_fhDirect : m_fh;
+        auto ptr = blk.ptr;
+        const auto size = blk.size;
+        const auto offset = blk.offset;
+        lock.unlock();
+        const auto ret = rgy_pwrite(fh, ptr, size, offset);
+        lock.lock();
+        m_done.push_back(std::make_pair(idx, (int32_t)ret));
+        m_cvDone.notify_one();
+    }
+}
+
+bool RGYFileWriteAsync::inBlock(int idx, int64_t pos) const {
+    const auto& blk = m_blocks[idx];
+    return blk.offset <= pos && pos <= blk.offset + blk.size && pos < blk.offset + (int64_t)m_blockSize;
+}
+
+bool RGYFileWriteAsync::reap(bool wait) {
+    if (m_inFlight <= 0) {
+        return false;
+    }
+#if ENABLE_IO_URING
+    if (m_ring) {
+        uint64_t userData = 0;
+        int32_t res = 0;
+        const int ret = m_ring->complete(&userData, &res, wait);
+        if (ret <= 0) {
+            return false;
+        }
+        onComplete((int)userData, res);
+        return true;
+    }
+#endif //#if ENABLE_IO_URING
+    std::deque<std::pair<int, int32_t>> done;
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        if (wait) {
+            m_cvDone.wait(lock, [&]() { return !m_done.empty(); });
+        }
+        done.swap(m_done);
+    }
+    for (const auto& d : done) {
+        onComplete(d.first, d.second);
+    }
+    return !done.empty();
+}
+
+void RGYFileWriteAsync::onComplete(int idx, int32_t result) {
+    auto& blk = m_blocks[idx];
+    m_inFlight--;
+    bool direct = blk.direct;
+    if (result >= 0 && (uint32_t)result < blk.size) {
+        //途中までしか書き込まれなかった場合は、残りを同期で書き込む
+        const auto ret = rgy_pwrite(m_fh, blk.ptr + result, blk.size - result, blk.offset + result);
+        result = (ret < 0) ? (int32_t)ret : (int32_t)blk.size;
+        direct = false;
+    } else if (result < 0 && result != -ENOSPC) {
+        //O_DIRECTに対応しないファイルシステムや、古いカーネルでIORING_OP_WRITEが使用できない場合等は、
+        //通常の同期書き込みでやり直す
+        if (blk.direct) {
+            m_directFailed = true;
+        }
+        const auto ret = rgy_pwrite(m_fh, blk.ptr, blk.size, blk.offset);
+        result = (ret < 0) ? (int32_t)ret : (int32_t)blk.size;
+        direct = false;
+    }
+    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - blk.submitTime).count();
+    m_latencyMicroSec.fetch_add(latency, std::memory_order_relaxed);
+    m_writeCount.fetch_add(1, std::memory_order_relaxed);
+    if (result > 0) {
+        m_bytesWritten.fetch_add(result, std::memory_order_relaxed);
+        if (direct) {
+            m_directCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    } else if (result < 0 && m_error == 0) {
+        m_error = result;
+    }
+    blk.state = BlockState::Free;
+}
+
+void RGYFileWriteAsync::waitOverlap(int64_t start, int64_t end) {
+    //範囲の重なる書き込みが同時に発行されると順序が保証されないので、先に発行したものの完了を待つ
+    for (;;) {
+        bool overlap = false;
+        for (const auto& blk : m_blocks) {
+            if (blk.state == BlockState::InFlight
+                && blk.offset < end && start < blk.offset + blk.size) {
+                overlap = true;
+                break;
+            }
+        }
+        if (!overlap || !reap(true)) {
+            break;
+        }
+    }
+}
+
+void RGYFileWriteAsync::submitBlock(int idx) {
+    auto& blk = m_blocks[idx];
+    if (blk.size == 0) {
+        blk.state = BlockState::Free;
+        return;
+    }
+    waitOverlap(blk.offset, blk.offset + blk.size);
+    blk.direct = direct()
+        && (blk.offset % DIRECT_ALIGN) == 0
+        && (blk.size % DIRECT_ALIGN) == 0;
+    blk.state = BlockState::InFlight;
+    blk.submitTime = std::chrono::steady_clock::now();
+    m_inFlight++;
+#if ENABLE_IO_URING
+    if (m_ring) {
+        //エントリ数はブロック数と同じなので、空きがないことはない
+        m_ring->prepWrite((blk.direct) ? m_fhDirect : m_fh, blk.ptr, blk.size, blk.offset, idx);
+        m_ring->submit();
+        return;
+    }
+#endif //#if ENABLE_IO_URING
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_requests.push_back(idx);
+    m_cvRequest.notify_one();
+}
+
+void RGYFileWriteAsync::submitFilling() {
+    if (m_patch >= 0) {
+        submitBlock(m_patch);
+        m_patch = -1;
+    }
+    if (m_tail >= 0) {
+        submitBlock(m_tail);
+        m_tail = -1;
+    }
+}
+
+int RGYFileWriteAsync::acquireBlock(int64_t pos, bool alignStart) {
+    int idx = -1;
+    bool waited = false;
+    std::chrono::steady_clock::time_point waitStart;
+    for (;;) {
+        for (int i = 0; i < (int)m_blocks.size(); i++) {
+            if (m_blocks[i].state == BlockState::Free) {
+                idx = i;
+                break;
+            }
+        }
+        if (idx >= 0) {
+            break;
+        }
+        //すべてのブロックが書き込み中なので、どれかが完了するのを待つ
+        if (!waited) {
+            waitStart = std::chrono::steady_clock::now();
+            waited = true;
+        }
+        if (!reap(true)) {
+            return -1;
+        }
+    }
+    if (waited) {
+        m_waitMicroSec.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - waitStart).count(), std::memory_order_relaxed);
+        m_waitCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    auto& blk = m_blocks[idx];
+    blk.state = BlockState::Filling;
+    blk.offset = pos;
+    blk.size = 0;
+    if (alignStart && (pos % DIRECT_ALIGN) != 0 && pos <= m_fileEnd) {
+        //書き戻しの後に追記を再開する場合など、アラインされていない位置から追記を始めると
+        //以降の書き込みがすべてO_DIRECTを使用できなくなってしまう
+        //ブロックの先頭をアラインされた位置とし、そこからの既存のデータを読み込んでおく
+        const int64_t start = pos & ~(int64_t)(DIRECT_ALIGN - 1);
+        const uint32_t len = (uint32_t)(pos - start);
+        if (m_patch >= 0 && m_blocks[m_patch].offset < pos && start < m_blocks[m_patch].offset + m_blocks[m_patch].size) {
+            submitBlock(m_patch);
+            m_patch = -1;
+        }
+        waitOverlap(start, pos);
+        if (rgy_pread(m_fh, blk.ptr, len, start) == len) {
+            blk.offset = start;
+            blk.size = len;
+        }
+    }
+    return idx;
+}
+
+int64_t RGYFileWriteAsync::write(const void *buf, size_t size) {
+    if (m_error < 0) {
+        return m_error;
+    }
+    if (m_sync) {
+        const auto ret = rgy_pwrite(m_fh, buf, (uint32_t)size, m_pos);
+        if (ret < 0) {
+            m_error = (int)ret;
+            return ret;
+        }
+        m_pos += size;
+        m_fileEnd = std::max(m_fileEnd, m_pos);
+        return (int64_t)size;
+    }
+    auto src = (const uint8_t *)buf;
+    size_t remain = size;
+    while (remain > 0) {
+        int idx = -1;
+        if (m_tail >= 0 && inBlock(m_tail, m_pos)) {
+            idx = m_tail;
+        } else if (m_pos >= m_fileEnd) {
+            //終端への追記
+            if (m_tail >= 0) {
+                submitBlock(m_tail);
+                m_tail = -1;
+            }
+            idx = m_tail = acquireBlock(m_pos, direct());
+        } else {
+            //ヘッダの書き戻し等、終端以外への書き込み
+            if (m_patch >= 0 && !inBlock(m_patch, m_pos)) {
+                submitBlock(m_patch);
+                m_patch = -1;
+            }
+            if (m_patch < 0) {
+                m_patch = acquireBlock(m_pos, false);
+            }
+            idx = m_patch;
+        }
+        if (idx < 0) {
+            return (m_error < 0) ? m_error : -EIO;
+        }
+        auto& blk = m_blocks[idx];
+        const size_t offsetInBlock = (size_t)(m_pos - blk.offset);
+        size_t copySize = std::min(remain, m_blockSize - offsetInBlock);
+        if (idx == m_patch && m_tail >= 0 && m_pos < m_blocks[m_tail].offset) {
+            //追記用のブロックの範囲に入る分は、追記用のブロックに書き込む
+            copySize = std::min<size_t>(copySize, (size_t)(m_blocks[m_tail].offset - m_pos));
+        }
+        memcpy(blk.ptr + offsetInBlock, src, copySize);
+        blk.size = (uint32_t)std::max<size_t>(blk.size, offsetInBlock + copySize);
+        src += copySize;
+        remain -= copySize;
+        m_pos += copySize;
+        m_fileEnd = std::max(m_fileEnd, m_pos);
+        if (offsetInBlock + copySize >= m_blockSize) {
+            //ブロックが埋まったので書き込みを発行し、完了を待たずに次のブロックへ進む
+            submitBlock(idx);
+            if (idx == m_tail) {
+                m_tail = -1;
+            } else {
+                m_patch = -1;
+            }
+        }
+    }
+    //完了済みの書き込みを回収して、ブロックを空けておく
+    while (reap(false)) {
+    }
+    return (m_error < 0) ? m_error : (int64_t)size;
+}
+
+int RGYFileWriteAsync::flush() {
+    submitFilling();
+    while (m_inFlight > 0 && reap(true)) {
+    }
+    return m_error;
+}
+
+int RGYFileWriteAsync::setSync(bool sync) {
+    const int err = flush();
+    m_sync = sync;
+    return err;
+}
+
+int64_t RGYFileWriteAsync::read(void *buf, size_t size) {
+    const int err = flush();
+    if (err < 0) {
+        return err;
+    }
+    const auto ret = rgy_pread(m_fh, buf, (uint32_t)std::min<size_t>(size, UINT32_MAX), m_pos);
+    if (ret > 0) {
+        m_pos += ret;
+    }
+    return ret;
+}
+
+int64_t RGYFileWriteAsync::seek(int64_t offset, int whence) {
+    int64_t newPos = 0;
+    switch (whence) {
+    case SEEK_SET: newPos = offset; break;
+    case SEEK_CUR: newPos = m_pos + offset; break;
+    case SEEK_END: newPos = m_fileEnd + offset; break;
+    default: return -EINVAL;
+    }
+    if (newPos < 0) {
+        return -EINVAL;
+    }
+    //ブロックの切り替えは、必要になったときにwrite()で行う
+    m_pos = newPos;
+    return m_pos;
+}
@@ -0,0 +1,294 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// -------------------------------------------------------------------------------------------
+
+#pragma once
+#ifndef __RGY_ASYNC_IO_H__
+#define __RGY_ASYNC_IO_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <memory>
+#include "rgy_osdep.h"
+#include "rgy_tchar.h"
+#include "rgy_err.h"
+#include "rgy_version.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+using RGYFileHandle = HANDLE;
+#else
+using RGYFileHandle = int;
+#endif
+
+#if ENABLE_IO_URING
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+//liburingを使わず、システムコールを直接呼んでio_uringを使用する最小限のラッパー
+//submit/completeは同じスレッドから呼ぶこと
+class RGYIOUring {
+public:
+    RGYIOUring();
+    ~RGYIOUring();
+    RGY_ERR init(uint32_t entries);
+    void close();
+    bool initialized() const { return m_fd >= 0; }
+
+    //読み込み/書き込みの要求を登録する (submit()を呼ぶまで発行されない)
+    //空きがなければfalseを返す
+    bool prepRead(int fd, void *buf, uint32_t size, uint64_t offset, uint64_t userData);
+    bool prepWrite(int fd, const void *buf, uint32_t size, uint64_t offset, uint64_t userData);
+    //登録済みの要求を発行する、戻り値は発行した数 (エラー時は-errno)
+    int submit();
+    //完了した要求を1つ取り出す
+    //waitがtrueなら完了するまで待機する、取り出せたら1、なければ0、エラー時は-errno
+    int complete(uint64_t *userData, int32_t *res, bool wait);
+protected:
+    bool prep(uint8_t opcode, int fd, const void *buf, uint32_t size, uint64_t offset, uint64_t userData);
+
+    int m_fd;
+    uint32_t m_pending;     //登録済みで未発行の要求数
+    void *m_sqRing;
+    size_t m_sqRingSize;
+    void *m_cqRing;
+    size_t m_cqRingSize;
+    io_uring_sqe *m_sqes;
+    size_t m_sqesSize;
+    uint32_t *m_sqHead;
+    uint32_t *m_sqTail;
+    uint32_t m_sqMask;
+    uint32_t m_sqEntries;
+    uint32_t *m_sqArray;
+    uint32_t *m_cqHead;
+    uint32_t *m_cqTail;
+    uint32_t m_cqMask;
+    io_uring_cqe *m_cqes;
+};
+#endif //#if ENABLE_IO_URING
+
+//ファイルの位置を指定した読み込み (pread相当)、読み込んだバイト数を返す (エラー時は-errno)
+int64_t rgy_pread(RGYFileHandle fh, void *buf, uint32_t size, int64_t offset);
+//ファイルの位置を指定した書き込み (pwrite相当)、すべて書き込めたらsizeを返す (エラー時は-errno)
+int64_t rgy_pwrite(RGYFileHandle fh, const void *buf, uint32_t size, int64_t offset);
+
+//ローカルファイルを大きなブロック単位で先読みするリーダー
+//常に最大depth個の読み込みを発行しておき、NAS等の遅延の大きいストレージでも
+//読み込みの待ち時間が直列に積み重ならないようにする
+//io_uringが使用可能ならそれを使用し、使用できなければdepth個のスレッドでpreadを行う
+//read/seekは単一のスレッドから呼ぶこと
+class RGYFileReadAhead {
+public:
+    static const int DEFAULT_DEPTH = 4;
+    static const size_t DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024;
+
+    struct Stats {
+        uint64_t bytesRead;        //ストレージから読み込んだバイト数
+        uint64_t readCount;        //完了した読み込みの数
+        uint64_t latencyMicroSec;  //読み込みの発行から完了までの時間の合計
+        uint64_t waitMicroSec;     //read()が読み込みの完了を待った時間の合計
+        uint64_t waitCount;        //read()が読み込みの完了を待った回数
+    };
+
+    RGYFileReadAhead();
+    ~RGYFileReadAhead();
+    RGY_ERR open(const TCHAR *filename, int depth, size_t blockSize);
+    void close();
+
+    //読み込んだバイト数を返す、0なら終端、エラー時は-errno
+    int64_t read(void *buf, size_t size);
+    //SEEK_SET/SEEK_CUR/SEEK_ENDに従って読み込み位置を変更し、新しい位置を返す
+    int64_t seek(int64_t offset, int whence);
+    int64_t size() const { return m_fileSize; }
+    int64_t pos() const { return m_pos; }
+    int depth() const { return (int)m_blocks.size(); }
+    size_t blockSize() const { return m_blockSize; }
+    const TCHAR *engine() const;
+    Stats stats() const;
+protected:
+    enum class BlockState : uint8_t {
+        Free,
+        InFlight,
+        Done,
+    };
+    struct Block {
+        uint8_t *ptr;
+        int64_t offset;
+        uint32_t size;
+        int32_t result;       //読み込んだバイト数 (エラー時は-errno)
+        BlockState state;
+        bool stale;           //seekにより不要になったブロック
+        std::chrono::steady_clock::time_point submitTime;
+    };
+    int findBlock(int64_t pos) const;
+    int getFreeBlock();
+    void restart(int64_t pos);
+    void schedule();
+    void submitBlock(int idx);
+    bool reap(bool wait);
+    void onComplete(int idx, int32_t result);
+    void updateFileSize();
+    void threadFunc();
+
+    RGYFileHandle m_fh;
+    int64_t m_fileSize;
+    int64_t m_pos;
+    int64_t m_nextOffset;  //次に読み込みを発行する位置
+    size_t m_blockSize;
+    int m_inFlight;
+    std::vector<Block> m_blocks;
+    std::unique_ptr<uint8_t, decltype(&_aligned_free)> m_buffer;
+#if ENABLE_IO_URING
+    std::unique_ptr<RGYIOUring> m_ring;
+#endif //#if ENABLE_IO_URING
+    //io_uringが使用できない場合の読み込みスレッド
+    std::vector<std::thread> m_threads;
+    std::mutex m_mtx;
+    std::condition_variable m_cvRequest;
+    std::condition_variable m_cvDone;
+    std::deque<int> m_requests;
+    std::deque<std::pair<int, int32_t>> m_done;
+    bool m_abort;
+
+    std::atomic<uint64_t> m_bytesRead;
+    std::atomic<uint64_t> m_readCount;
+    std::atomic<uint64_t> m_latencyMicroSec;
+    std::atomic<uint64_t> m_waitMicroSec;
+    std::atomic<uint64_t> m_waitCount;
+};
+
+//出力ファイルへの書き込みを非同期で行うライター
+//ブロック単位でバッファリングし、埋まったブロックは書き込みを発行して次のブロックへ書き込みを続ける
+//すべてのブロックが書き込み中になったときのみ、呼び出し側を待機させる
+//mp4/mkvのヘッダの書き戻しのような終端以外への書き込みは別のブロックで扱い、
+//範囲の重なる書き込みは前の書き込みの完了を待ってから発行することで順序を保つ
+//directが指定された場合、位置とサイズがDIRECT_ALIGNの倍数の書き込みのみ
+//O_DIRECT(FILE_FLAG_NO_BUFFERING)で行い、それ以外は通常の書き込みとする
+//write/read/seekは単一のスレッドから呼ぶこと
+class RGYFileWriteAsync {
+public:
+    static const int DEFAULT_DEPTH = 2;
+    static const size_t DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024;
+    static const size_t DIRECT_ALIGN = 4096;
+
+    struct Stats {
+        uint64_t bytesWritten;     //ストレージに書き込んだバイト数
+        uint64_t writeCount;       //完了した書き込みの数
+        uint64_t directCount;      //そのうちO_DIRECTで書き込んだ数
+        uint64_t latencyMicroSec;  //書き込みの発行から完了までの時間の合計
+        uint64_t waitMicroSec;     //write()が空きブロックを待った時間の合計
+        uint64_t waitCount;        //write()が空きブロックを待った回数
+    };
+
+    RGYFileWriteAsync();
+    ~RGYFileWriteAsync();
+    RGY_ERR open(const TCHAR *filename, int depth, size_t blockSize, bool direct);
+    //すべての書き込みの完了を待ってファイルを閉じる、戻り値は0またはそれまでに発生したエラー(-errno)
+    int close();
+
+    //書き込んだバイト数を返す、エラー時は-errno
+    //書き込みは非同期に行われるため、発行済みの書き込みのエラーは以降のwrite/flush/closeで返される
+    int64_t write(const void *buf, size_t size);
+    //書き込みをすべて完了させたうえで、現在位置から読み込む
+    int64_t read(void *buf, size_t size);
+    //SEEK_SET/SEEK_CUR/SEEK_ENDに従って書き込み位置を変更し、新しい位置を返す
+    int64_t seek(int64_t offset, int whence);
+    //バッファ中のデータを含め、すべての書き込みの完了を待つ
+    int flush();
+    //trueにすると、以降の書き込みはバッファリングせず同期で行う
+    //別のハンドルで書き込み中のファイルを読む場合 (mp4のfaststart等) に使用する
+    int setSync(bool sync);
+    int64_t size() const { return m_fileEnd; }
+    int64_t pos() const { return m_pos; }
+    int depth() const { return m_depth; }
+    size_t blockSize() const { return m_blockSize; }
+    bool direct() const;
+    const TCHAR *engine() const;
+    Stats stats() const;
+protected:
+    enum class BlockState : uint8_t {
+        Free,
+        Filling,
+        InFlight,
+    };
+    struct Block {
+        uint8_t *ptr;
+        int64_t offset;
+        uint32_t size;
+        BlockState state;
+        bool direct;          //O_DIRECTのハンドルで書き込んだブロック
+        std::chrono::steady_clock::time_point submitTime;
+    };
+    bool inBlock(int idx, int64_t pos) const;
+    int acquireBlock(int64_t pos, bool alignStart);
+    void submitBlock(int idx);
+    void submitFilling();
+    void waitOverlap(int64_t start, int64_t end);
+    bool reap(bool wait);
+    void onComplete(int idx, int32_t result);
+    void threadFunc();
+
+    RGYFileHandle m_fh;
+    RGYFileHandle m_fhDirect;
+    bool m_directFailed;   //O_DIRECTでの書き込みに失敗したので、以降は使用しない
+    int64_t m_pos;
+    int64_t m_fileEnd;     //書き込んだ範囲の終端
+    size_t m_blockSize;
+    int m_depth;
+    int m_tail;            //終端への追記用のブロック
+    int m_patch;           //終端以外への書き込み用のブロック
+    int m_inFlight;
+    int m_error;           //最初に発生したエラー (-errno)
+    bool m_sync;
+    std::vector<Block> m_blocks;
+    std::unique_ptr<uint8_t, decltype(&_aligned_free)> m_buffer;
+#if ENABLE_IO_URING
+    std::unique_ptr<RGYIOUring> m_ring;
+#endif //#if ENABLE_IO_URING
+    //io_uringが使用できない場合の書き込みスレッド
+    std::vector<std::thread> m_threads;
+    std::mutex m_mtx;
+    std::condition_variable m_cvRequest;
+    std::condition_variable m_cvDone;
+    std::deque<int> m_requests;
+    std::deque<std::pair<int, int32_t>> m_done;
+    bool m_abort;
+
+    std::atomic<uint64_t> m_bytesWritten;
+    std::atomic<uint64_t> m_writeCount;
+    std::atomic<uint64_t> m_directCount;
+    std::atomic<uint64_t> m_latencyMicroSec;
+    std::atomic<uint64_t> m_waitMicroSec;
+    std::atomic<uint64_t> m_waitCount;
+};
+
+#endif //__RGY_ASYNC_IO_H__
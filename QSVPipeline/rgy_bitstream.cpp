@@ -854,10 +854,11 @@ decltype(find_header_c)* get_find_header_func() {
     return find_header_c;
 }
 
-static std::unique_ptr<unit_info> get_unit(const uint8_t *data, const size_t size) {
-    std::unique_ptr<unit_info> unit;
+//OBUのヘッダを解析し、unit_dataを除く各フィールドを設定する
+//戻り値はOBU全体のサイズ (解析できない場合は0)
+static size_t get_unit_header(unit_info *unit, const uint8_t *data, const size_t size) {
     if (size <= 1) {
-        return unit;
+        return 0;
     }
     const uint8_t *const start_pos = data;
     const uint8_t firstbyte = *data++;
@@ -865,7 +866,6 @@ static std::unique_ptr<unit_info> get_unit(const uint8_t *data, const size_t siz
     const uint8_t extension_flag = (firstbyte & 0x04) >> 2;
     const uint8_t has_size_flag = (firstbyte & 0x02) >> 1;
 
-    unit = std::make_unique<unit_info>();
     unit->type = type;
     unit->extension_flag = extension_flag;
     unit->has_size_flag = has_size_flag;
@@ -876,9 +876,9 @@ static std::unique_ptr<unit_info> get_unit(const uint8_t *data, const size_t siz
         unit->temporal_id = (byte2 & (0xE0)) >> 5;
         unit->spatial_id = (byte2 & (0x18)) >> 3;
     }
+    size_t ret = 0;
     if (!has_size_flag) {
-        size_t ret = size - 1 - extension_flag;
-        unit->unit_data.resize(ret);
+        ret = size - 1 - extension_flag;
     } else {
         size_t obu_size = 0;
         for (int i = 0; i < 8; i++) {
@@ -888,12 +888,22 @@ static std::unique_ptr<unit_info> get_unit(const uint8_t *data, const size_t siz
                 break;
         }
 
-        const size_t ret = obu_size + (data - start_pos);
-        unit->unit_data.resize(ret);
+        ret = obu_size + (data - start_pos);
     }
     unit->obu_offset = (int)(data - start_pos);
+    return ret;
+}
+
+static std::unique_ptr<unit_info> get_unit(const uint8_t *data, const size_t size) {
+    std::unique_ptr<unit_info> unit;
+    if (size <= 1) {
+        return unit;
+    }
+    unit = std::make_unique<unit_info>();
+    const auto unit_size = get_unit_header(unit.get(), data, size);
+    unit->unit_data.resize(unit_size);
     if (unit->unit_data.size() > 0) {
-        memcpy(unit->unit_data.data(), start_pos, unit->unit_data.size());
+        memcpy(unit->unit_data.data(), data, unit->unit_data.size());
     }
     return unit;
 }
@@ -903,6 +913,9 @@ std::deque<std::unique_ptr<unit_info>> parse_unit_av1(const uint8_t *data, const
     int64_t size_remain = (int64_t)size;
     while (size_remain > 0) {
         auto unit = get_unit(data, size_remain);
+        if (!unit) {
+            break;
+        }
         const auto unit_size = unit->unit_data.size();
         if (unit_size == 0) {
             break;
@@ -914,6 +927,29 @@ std::deque<std::unique_ptr<unit_info>> parse_unit_av1(const uint8_t *data, const
     return list;
 }
 
+std::vector<nal_info> parse_unit_av1_ref(const uint8_t *data, const size_t size) {
+    std::vector<nal_info> list;
+    int64_t size_remain = (int64_t)size;
+    while (size_remain > 0) {
+        unit_info unit = {};
+        //壊れたOBUでバッファの外を参照しないよう、残りのサイズに制限する
+        const auto unit_size = std::min<size_t>(get_unit_header(&unit, data, size_remain), (size_t)size_remain);
+        if (unit_size == 0) {
+            break;
+        }
+        nal_info info;
+        info.ptr = data;
+        info.type = unit.type;
+        info.size = unit_size;
+        info.nuh_layer_id = unit.spatial_id;
+        info.temporal_id = unit.temporal_id;
+        list.push_back(info);
+        data += unit_size;
+        size_remain -= unit_size;
+    }
+    return list;
+}
+
 #if 0
 
 
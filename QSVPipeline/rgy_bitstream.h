@@ -230,6 +230,9 @@ size_t find_header_avx512bw(const uint8_t *data, size_t size);
 decltype(find_header_c)* get_find_header_func();
 
 std::deque<std::unique_ptr<unit_info>> parse_unit_av1(const uint8_t *data, const size_t size);
+//parse_unit_av1と同様にOBUに分割するが、データはコピーせず元のバッファを参照する
+//(nal_info::typeにOBUの種類、nuh_layer_idにspatial_idを格納する)
+std::vector<nal_info> parse_unit_av1_ref(const uint8_t *data, const size_t size);
 
 uint8_t gen_obu_header(const uint8_t obu_type);
 size_t get_av1_uleb_size_bytes(uint64_t value);
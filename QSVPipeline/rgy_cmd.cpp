@@ -4443,6 +4443,14 @@ int parse_one_vpp_option(const TCHAR *option_name, const TCHAR *strInput[], int
         }
         return 0;
     }
+    if (IS_OPTION("vpp-fusion")) {
+        vpp->fusion = true;
+        return 0;
+    }
+    if (IS_OPTION("no-vpp-fusion")) {
+        vpp->fusion = false;
+        return 0;
+    }
     if (IS_OPTION("vpp-perf-monitor")) {
         vpp->checkPerformance = true;
         return 0;
@@ -4893,6 +4901,19 @@ int parse_one_common_option(const TCHAR *option_name, const TCHAR *strInput[], i
         }
         return 0;
     }
+    if (IS_OPTION("input-read-ahead")) {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            print_cmd_error_invalid_value(option_name, strInput[i]);
+            return 1;
+        } else if (value < 0 || value > 32) {
+            print_cmd_error_invalid_value(option_name, strInput[i], _T("input-read-ahead should be in range of 0 - 32."));
+            return 1;
+        }
+        common->inputReadAhead = value;
+        return 0;
+    }
     if (IS_OPTION("input-pixel-format")) {
         i++;
         common->inputPixFmtStr = strInput[i];
@@ -6624,6 +6645,11 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
     }
     if (IS_OPTION("task-perf-monitor") && ENCODER_QSV) {
         ctrl->taskPerfMonitor = true;
+        if (i + 1 >= nArgNum || strInput[i + 1][0] == _T('-')) {
+            return 0;
+        }
+        i++;
+        ctrl->taskPerfTraceFile = strInput[i];
         return 0;
     }
     if (IS_OPTION("lowlatency")) {
@@ -6648,6 +6674,20 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
         ctrl->threadOutput = 0;
         return 0;
     }
+    if ((IS_OPTION("pipeline-thread") || IS_OPTION("thread-pipeline")) && ENCODER_QSV) {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            print_cmd_error_invalid_value(option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0 || value >= 3) {
+            print_cmd_error_invalid_value(option_name, strInput[i], _T("should be in range: 0 - 2"));
+            return 1;
+        }
+        ctrl->threadPipeline = value;
+        return 0;
+    }
     if (IS_OPTION("output-thread") || IS_OPTION("thread-output")) {
         i++;
         int value = 0;
@@ -6692,30 +6732,35 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
 
         auto parse_val = [option_name, &list_thread_affinity_mode](RGYThreadAffinity& affinity, const tstring& param_arg, const tstring& param_val) {
             if (param_val.substr(0, 2) == _T("0x")) {
-                try {
-                    uint64_t affintyValue = std::strtoull(tchar_to_string(param_val).c_str(), nullptr, 16);
-                    affinity = RGYThreadAffinity(RGYThreadAffinityMode::CUSTOM, affintyValue);
-                    return 0;
-                } catch (...) {
+                RGYCPUSet affintyValue;
+                if (!RGYCPUSet::fromString(affintyValue, param_val)) {
                     print_cmd_error_invalid_value(tstring(option_name) + _T(" ") + param_arg + _T("="), param_val);
                     return 1;
                 }
+                affinity = RGYThreadAffinity(RGYThreadAffinityMode::CUSTOM, affintyValue);
+                return 0;
             }
 
-            uint64_t affintyValue = std::numeric_limits<decltype(affintyValue)>::max();
+            auto affintyValue = RGYCPUSet::all();
             auto mode = param_val;
             auto pos = param_val.find_first_of(_T("#"));
             if (pos != std::string::npos) {
                 mode = param_val.substr(0, pos);
-                affintyValue = 0u;
+                affintyValue = RGYCPUSet::none();
                 for (auto item : split(param_val.substr(pos + 1), _T(":"))) {
                     int v0 = 0, v1 = 0;
                     if (_stscanf_s(item.c_str(), _T("%d-%d"), &v0, &v1) == 2) {
+                        if (v0 < 0 || v1 >= RGY_MAX_CPU_COUNT) {
+                            return 1;
+                        }
                         for (int id = v0; id <= v1; id++) {
-                            affintyValue |= (1llu << id);
+                            affintyValue.set(id);
                         }
                     } else if (_stscanf_s(item.c_str(), _T("%d"), &v0) == 1) {
-                        affintyValue |= (1llu << v0);
+                        if (v0 < 0 || v0 >= RGY_MAX_CPU_COUNT) {
+                            return 1;
+                        }
+                        affintyValue.set(v0);
                     } else {
                         return 1;
                     }
@@ -6893,6 +6938,17 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
         ctrl->outputBufSizeMB = (std::min)(value, RGY_OUTPUT_BUF_MB_MAX);
         return 0;
     }
+    if (IS_OPTION("output-async-io")) {
+        i++;
+        int value = 0;
+        if (get_list_value(list_output_async_io, strInput[i], &value)) {
+            ctrl->outputAsyncIO = (RGYOutputAsyncIO)value;
+        } else {
+            print_cmd_error_invalid_value(option_name, strInput[i], list_output_async_io);
+            return 1;
+        }
+        return 0;
+    }
     if (IS_OPTION("thread-csp")) {
         i++;
         int value = 0;
@@ -6907,6 +6963,60 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
         ctrl->threadCsp = value;
         return 0;
     }
+    if (IS_OPTION("thread-pool")) {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            print_cmd_error_invalid_value(option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0) {
+            print_cmd_error_invalid_value(option_name, strInput[i]);
+            return 1;
+        }
+        ctrl->threadPool = value;
+        return 0;
+    }
+    if (IS_OPTION("numa")) {
+        i++;
+        int value = 0;
+        if (_tcsicmp(strInput[i], _T("off")) == 0) {
+            ctrl->numaNode = RGY_NUMA_NODE_DISABLED;
+        } else if (_tcsicmp(strInput[i], _T("auto")) == 0) {
+            ctrl->numaNode = RGY_NUMA_NODE_AUTO;
+        } else if (1 == _stscanf_s(strInput[i], _T("%d"), &value) && value >= 0) {
+            ctrl->numaNode = value;
+        } else {
+            print_cmd_error_invalid_value(option_name, strInput[i]);
+            return 1;
+        }
+        return 0;
+    }
+    if (IS_OPTION("huge-pages")) {
+        i++;
+        int value = 0;
+        if (get_list_value(list_huge_pages, strInput[i], &value)) {
+            ctrl->hugePages = (RGYHugePageMode)value;
+        } else {
+            print_cmd_error_invalid_value(option_name, strInput[i], list_huge_pages);
+            return 1;
+        }
+        return 0;
+    }
+    if (IS_OPTION("frame-pool-cache")) {
+        i++;
+        int value = 0;
+        if (1 != _stscanf_s(strInput[i], _T("%d"), &value)) {
+            print_cmd_error_invalid_value(option_name, strInput[i]);
+            return 1;
+        }
+        if (value < 0) {
+            print_cmd_error_invalid_value(option_name, strInput[i]);
+            return 1;
+        }
+        ctrl->framePoolCacheMB = value;
+        return 0;
+    }
     if (IS_OPTION("simd-csp")) {
         i++;
         uint64_t value = 0;
@@ -7062,6 +7172,16 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
         return 0;
     }
 #endif
+    if (IS_OPTION("opencl-cache-dir")) {
+        i++;
+        ctrl->clProgramCache = true;
+        ctrl->clProgramCacheDir = strInput[i];
+        return 0;
+    }
+    if (IS_OPTION("no-opencl-cache")) {
+        ctrl->clProgramCache = false;
+        return 0;
+    }
     if (IS_OPTION("disable-vulkan")) {
         ctrl->enableVulkan = RGYParamInitVulkan::Disable;
         return 0;
@@ -7127,6 +7247,19 @@ int parse_one_ctrl_option(const TCHAR *option_name, const TCHAR *strInput[], int
                     }
                     continue;
                 }
+                if (param_arg == _T("cache-mem")) {
+                    try {
+                        ctrl->parallelEnc.cacheMemMB = std::stoi(param_val);
+                    } catch (...) {
+                        print_cmd_error_invalid_value(tstring(option_name) + _T(" ") + param_arg + _T("="), param_val);
+                        return 1;
+                    }
+                    if (ctrl->parallelEnc.cacheMemMB <= 0) {
+                        print_cmd_error_invalid_value(tstring(option_name) + _T(" ") + param_arg + _T("="), param_val);
+                        return 1;
+                    }
+                    continue;
+                }
                 print_cmd_error_unknown_opt_param(option_name, param_arg, paramList);
                 return 1;
             } else {
@@ -8012,6 +8145,7 @@ tstring gen_cmd(const RGYParamVpp *param, const RGYParamVpp *defaultPrm, bool sa
             cmd << _T(" --vpp-fruc");
         }
     }
+    OPT_BOOL(_T("--vpp-fusion"), _T("--no-vpp-fusion"), fusion);
     OPT_BOOL(_T("--vpp-perf-monitor"), _T("--no-vpp-perf-monitor"), checkPerformance);
     return cmd.str();
 }
@@ -8026,6 +8160,7 @@ tstring gen_cmd(const RGYParamCommon *param, const RGYParamCommon *defaultPrm, b
 
     OPT_FLOAT(_T("--input-analyze"), demuxAnalyzeSec, 6);
     OPT_NUM(_T("--input-probesize"), demuxProbesize);
+    OPT_NUM(_T("--input-read-ahead"), inputReadAhead);
     OPT_TSTR(_T("--input-pixel-format"), inputPixFmtStr);
     OPT_NUM(_T("--input-retry"), inputRetry);
     if (param->nTrimCount > 0) {
@@ -8449,10 +8584,24 @@ tstring gen_cmd(const RGYParamCommon *param, const RGYParamCommon *defaultPrm, b
 tstring gen_cmd(const RGYParamControl *param, const RGYParamControl *defaultPrm, bool save_disabled_prm) {
     std::basic_stringstream<TCHAR> cmd;
     OPT_NUM(_T("--output-buf"), outputBufSizeMB);
+    OPT_LST(_T("--output-async-io"), outputAsyncIO, list_output_async_io);
     OPT_NUM(_T("--thread-output"), threadOutput);
     OPT_NUM(_T("--thread-input"), threadInput);
+    OPT_NUM(_T("--thread-pipeline"), threadPipeline);
     OPT_NUM(_T("--thread-audio"), threadAudio);
     OPT_NUM(_T("--thread-csp"), threadCsp);
+    OPT_NUM(_T("--thread-pool"), threadPool);
+    if (param->numaNode != defaultPrm->numaNode) {
+        if (param->numaNode == RGY_NUMA_NODE_AUTO) {
+            cmd << _T(" --numa auto");
+        } else if (param->numaNode == RGY_NUMA_NODE_DISABLED) {
+            cmd << _T(" --numa off");
+        } else {
+            cmd << _T(" --numa ") << param->numaNode;
+        }
+    }
+    OPT_LST(_T("--huge-pages"), hugePages, list_huge_pages);
+    OPT_NUM(_T("--frame-pool-cache"), framePoolCacheMB);
     if (param->threadParams != defaultPrm->threadParams) {
         cmd << _T(" --thread-affinity ")    << param->threadParams.to_string(RGYParamThreadType::affinity);
         cmd << _T(" --thread-priority ")    << param->threadParams.to_string(RGYParamThreadType::priority);
@@ -8467,7 +8616,12 @@ tstring gen_cmd(const RGYParamControl *param, const RGYParamControl *defaultPrm,
             cmd << _T("=") << std::setprecision(2) << param->avoidIdleClock.loadPercent;
         }
     }
-    OPT_BOOL(_T("--task-perf-monitor"), _T(""), taskPerfMonitor);
+    if (param->taskPerfMonitor) {
+        cmd << _T(" --task-perf-monitor");
+        if (param->taskPerfTraceFile.length() > 0) {
+            cmd << _T(" \"") << param->taskPerfTraceFile << _T("\"");
+        }
+    }
     OPT_BOOL(_T("--lowlatency"), _T(""), lowLatency);
     OPT_STR_PATH(_T("--log"), logfile);
     if (param->loglevel != defaultPrm->loglevel) {
@@ -8541,6 +8695,11 @@ tstring gen_cmd(const RGYParamControl *param, const RGYParamControl *defaultPrm,
 #if ENCODER_QSV || ENCODER_VCEENC || ENCODER_MPP
     OPT_BOOL(_T("--enable-opencl"), _T("--disable-opencl"), enableOpenCL);
 #endif
+    if (!param->clProgramCache) {
+        cmd << _T(" --no-opencl-cache");
+    } else {
+        OPT_STR_PATH(_T("--opencl-cache-dir"), clProgramCacheDir);
+    }
     if (param->enableVulkan != defaultPrm->enableVulkan) {
         if (param->enableVulkan == RGYParamInitVulkan::Disable) {
             cmd << _T(" --disable-vulkan");
@@ -8559,6 +8718,7 @@ tstring gen_cmd(const RGYParamControl *param, const RGYParamControl *defaultPrm,
         ADD_NUM(_T("mp"), parallelEnc.parallelCount);
         ADD_NUM(_T("id"), parallelEnc.parallelId);
         ADD_LST(_T("cache"), parallelEnc.cacheMode, list_parallel_enc_cache);
+        ADD_NUM(_T("cache-mem"), parallelEnc.cacheMemMB);
         if (!tmp.str().empty()) {
             cmd << _T(" --parallel ") << tmp.str().substr(1);
         }
@@ -8695,6 +8855,10 @@ tstring gen_cmd_help_common() {
         _T("                                 could be only used with avhw/avsw reader.\n")
         _T("                                 use if reader fails to detect audio stream.\n")
         _T("   --input-probesize <int>      set size in bytes which reader analyze input file.\n")
+        _T("   --input-read-ahead <int>     read local input file by large blocks, keeping\n")
+        _T("                                 <int> reads in flight (io_uring on Linux).\n")
+        _T("                                 could be only used with avhw/avsw reader.\n")
+        _T("                                  default: 0 (disabled), max: 32.\n")
         //_T("   --input-retry <int>          set retry count for openning input file.\n")
         //_T("                                 could useful for streaming input.\n")
         //_T("                                  default: disabled.\n")
@@ -9584,6 +9748,9 @@ tstring gen_cmd_help_vpp() {
         _T("      double                     double frame rate (fast)\n")
         _T("      fps=<int>/<int> or <float> target frame rate\n"));
 #endif
+    str += strsprintf(_T("\n")
+        _T("   --vpp-fusion                 fuse pixel-wise filters (tweak) into the kernels\n")
+        _T("                                  of the neighboring filters (edgelevel, pad).\n"));
     str += strsprintf(_T("\n")
         _T("   --vpp-perf-monitor           check vpp perfromance (for debug)\n")
     );
@@ -9591,10 +9758,19 @@ tstring gen_cmd_help_vpp() {
 }
 
 tstring gen_cmd_help_ctrl() {
-    tstring str = strsprintf(_T("\n")
+    tstring str = _T("\n");
 #if ENABLE_PARALLEL_ENC
+    str += strsprintf(
         _T("   --parallel <int> or auto     Enable parallel encoding by file splitting.\n")
+        _T("   --parallel [<param1>=<value1>][,<param2>=<value2>]...\n")
+        _T("    params\n")
+        _T("      mp=<int>                   number of parallel encoding.\n")
+        _T("      cache=<string>             cache mode for encoded chunks.\n")
+        _T("                                   mem(default), file, hybrid\n")
+        _T("      cache-mem=<int>            memory limit in MB for cache=hybrid (default %d)\n"),
+        DEFAULT_PARALLEL_ENC_CACHE_MEM_MB);
 #endif
+    str += strsprintf(
         _T("   --log <string>               set log file name\n")
         _T("   --log-level <string>         set log level\n")
         _T("                                  debug, info(default), warn, error, quiet\n")
@@ -9621,7 +9797,14 @@ tstring gen_cmd_help_ctrl() {
         DEFAULT_DUMMY_LOAD_PERCENT);
     str += strsprintf(_T("")
 #if ENCODER_QSV
-        _T("   --task-perf-monitor          enable task performance monitoring.\n")
+        _T("   --task-perf-monitor [<string>]\n")
+        _T("                                enable task performance monitoring.\n")
+        _T("                                 if filename is set, per-frame timing of each task\n")
+        _T("                                 is written in Chrome trace event format (json).\n")
+        _T("   --pipeline-thread <int>      run stages of the pipeline on separate threads.\n")
+        _T("                                  0: disable (default)\n")
+        _T("                                  1: use separate thread for output\n")
+        _T("                                  2: use separate threads for input and output\n")
 #endif
         _T("   --lowlatency                 minimize latency (might have lower throughput).\n"));
     str += strsprintf(_T("")
@@ -9629,6 +9812,34 @@ tstring gen_cmd_help_ctrl() {
         _T("                                 default %d MB (0-%d)\n"),
         RGY_OUTPUT_BUF_MB_DEFAULT, RGY_OUTPUT_BUF_MB_MAX
     );
+    str += strsprintf(_T("")
+        _T("   --output-async-io <string>   write output file asynchronously.\n")
+        _T("                                  off    ... write synchronously (default).\n")
+        _T("                                  on     ... write asynchronously.\n")
+        _T("                                  direct ... write asynchronously,\n")
+        _T("                                             bypassing the page cache if possible.\n"));
+    str += strsprintf(_T("")
+        _T("   --thread-pool <int>          max threads of the thread pool shared in the process\n")
+        _T("                                 used for colorspace conversion.\n")
+        _T("                                  0: number of logical cores (default)\n"));
+    str += strsprintf(_T("")
+        _T("   --numa <string> or <int>     bind threads and system memory buffers\n")
+        _T("                                 to the specified NUMA node.\n")
+        _T("                                  off  ... disabled (default)\n")
+        _T("                                  auto ... node of the cpu starting the process\n")
+        _T("                                  <int> ... NUMA node index (0, 1, ...)\n"));
+    str += strsprintf(_T("")
+        _T("   --huge-pages <string>        back frame and bitstream buffers (2MB or larger)\n")
+        _T("                                 with huge pages.\n")
+        _T("                                  off     ... disabled (default)\n")
+        _T("                                  thp     ... transparent huge pages (Linux only)\n")
+        _T("                                  hugetlb ... reserved huge pages (Linux) / large pages (Windows),\n")
+        _T("                                              fallback to thp if not available\n"));
+    str += strsprintf(_T("")
+        _T("   --frame-pool-cache <int>     max size of unused frame buffers [MB]\n")
+        _T("                                 kept in the process for reuse.\n")
+        _T("                                  0: release buffers immediately (default: %d)\n"),
+        (int)(RGYSysFramePool::MAX_CACHE_BYTES_DEFAULT / (1024 * 1024)));
 #if ENABLE_AVCODEC_OUT_THREAD
     str += strsprintf(_T("")
         _T("   --output-thread <int>        set output thread num\n")
@@ -9718,6 +9929,9 @@ tstring gen_cmd_help_ctrl() {
     str += strsprintf(_T("\n")
         _T("   --disable-opencl             disable opencl features.\n"));
 #endif
+    str += strsprintf(_T("\n")
+        _T("   --opencl-cache-dir <string>  set directory to cache built OpenCL programs.\n")
+        _T("   --no-opencl-cache            disable cache of built OpenCL programs.\n"));
     str += strsprintf(_T("\n")
         _T("   --disable-vulkan             disable vulkan features.\n"));
     str += strsprintf(_T("\n")
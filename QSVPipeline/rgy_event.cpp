@@ -144,3 +144,48 @@ unique_event CreateEventUnique(void* pDummy, int bManualReset, int bInitialState
 
 #endif //#if !(defined(_WIN32) || defined(_WIN64))
 
+#if defined(_WIN32) || defined(_WIN64)
+#pragma comment(lib, "Synchronization.lib")
+
+bool RGYWaitOnAddress(std::atomic<uint32_t> *addr, uint32_t expected, uint32_t millisec) {
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "std::atomic<uint32_t> must be lock-free and same size as uint32_t");
+    if (addr->load(std::memory_order_acquire) != expected) {
+        return true;
+    }
+    return WaitOnAddress((volatile void *)addr, &expected, sizeof(expected), millisec) != FALSE
+        || GetLastError() != ERROR_TIMEOUT;
+}
+
+void RGYWakeByAddressAll(std::atomic<uint32_t> *addr) {
+    WakeByAddressAll((void *)addr);
+}
+
+#else
+#include <unistd.h>
+#include <cerrno>
+#include <ctime>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+bool RGYWaitOnAddress(std::atomic<uint32_t> *addr, uint32_t expected, uint32_t millisec) {
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "std::atomic<uint32_t> must be lock-free and same size as uint32_t");
+    if (addr->load(std::memory_order_acquire) != expected) {
+        return true;
+    }
+    struct timespec ts;
+    struct timespec *pts = nullptr;
+    if (millisec != INFINITE) {
+        ts.tv_sec = millisec / 1000;
+        ts.tv_nsec = (long)(millisec % 1000) * 1000000;
+        pts = &ts;
+    }
+    //値がexpectedと異なっていれば、futexは即座にEAGAINで戻る
+    const long ret = syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAIT_PRIVATE, expected, pts, nullptr, 0);
+    return !(ret != 0 && errno == ETIMEDOUT);
+}
+
+void RGYWakeByAddressAll(std::atomic<uint32_t> *addr) {
+    syscall(SYS_futex, (uint32_t *)addr, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#endif //#if defined(_WIN32) || defined(_WIN64)
@@ -31,6 +31,7 @@
 
 #include <cstdint>
 #include <climits>
+#include <atomic>
 #include <memory>
 #include "rgy_osdep.h"
 
@@ -68,4 +69,13 @@ unique_event CreateEventUnique(void *pDummy, int bManualReset, int bInitialState
 unique_event CreateEventUnique(void *pDummy, int bManualReset, int bInitialState, const wchar_t* name);
 unique_event CreateEventUnique(void *pDummy, int bManualReset, int bInitialState);
 
+//*addrの値がexpectedのままである間、RGYWakeByAddressAllで起こされるか、タイムアウトするまで待機する
+//(Linuxではfutex、WindowsではWaitOnAddressを使用し、ロックなしで待機する)
+//値が変化していた場合は即座に戻る、起床は偽起床を含むので、呼び出し側で条件を再確認すること
+//タイムアウトした場合はfalseを返す
+bool RGYWaitOnAddress(std::atomic<uint32_t> *addr, uint32_t expected, uint32_t millisec);
+
+//RGYWaitOnAddressで*addrを待機しているスレッドをすべて起こす
+void RGYWakeByAddressAll(std::atomic<uint32_t> *addr);
+
 #endif //__RGY_EVENT_H__
@@ -43,7 +43,9 @@ RGYFilter::RGYFilter(shared_ptr<RGYOpenCLContext> context) :
     m_cl(context),
     m_frameBuf(),
     m_pFieldPairIn(),
-    m_pFieldPairOut() {
+    m_pFieldPairOut(),
+    m_fusedPrologue(),
+    m_fusedEpilogue() {
 
 }
 
@@ -142,6 +144,106 @@ void RGYFilter::setCheckPerformance(const bool check) {
     else       m_perfMonitor.reset();
 }
 
+bool RGYFilter::getPointwiseStage(RGYFilterPointwiseStage& stage, const std::string& prefix) const {
+    UNREFERENCED_PARAMETER(stage);
+    UNREFERENCED_PARAMETER(prefix);
+    return false;
+}
+
+RGY_ERR RGYFilter::fusePointwiseStage(const RGYFilterPointwiseStage& stage, bool prologue) {
+    UNREFERENCED_PARAMETER(stage);
+    UNREFERENCED_PARAMETER(prologue);
+    return RGY_ERR_UNSUPPORTED;
+}
+
+std::string RGYFilter::getFusedPointwiseSource() const {
+    if (m_fusedPrologue.empty() && m_fusedEpilogue.empty()) {
+        return "";
+    }
+    std::string source;
+    source += "#ifndef clamp\n";
+    source += "#define clamp(x, low, high) (((x) <= (high)) ? (((x) >= (low)) ? (x) : (low)) : (high))\n";
+    source += "#endif\n";
+    for (const auto& stage : m_fusedPrologue) {
+        source += stage.source;
+    }
+    for (const auto& stage : m_fusedEpilogue) {
+        source += stage.source;
+    }
+    auto genFunc = [](const char *funcName, const char *macroName, const std::vector<RGYFilterPointwiseStage>& stages) {
+        std::string func = strsprintf("Type %s(Type v, const int plane) {\n", funcName);
+        for (int iplane = 0; iplane < 3; iplane++) {
+            std::string body;
+            for (const auto& stage : stages) {
+                if (stage.func[iplane].length() > 0) {
+                    body += strsprintf("        v = %s(v);\n", stage.func[iplane].c_str());
+                }
+            }
+            if (body.length() > 0) {
+                func += strsprintf("    if (plane == %d) {\n", iplane) + body + "    }\n";
+            }
+        }
+        func += "    return v;\n";
+        func += "}\n";
+        func += strsprintf("#define %s(v, plane) %s(v, plane)\n", macroName, funcName);
+        return func;
+    };
+    if (!m_fusedPrologue.empty()) {
+        source += genFunc("rgy_fused_prologue", "RGY_FUSED_PROLOGUE", m_fusedPrologue);
+    }
+    if (!m_fusedEpilogue.empty()) {
+        source += genFunc("rgy_fused_epilogue", "RGY_FUSED_EPILOGUE", m_fusedEpilogue);
+    }
+    return source;
+}
+
+tstring RGYFilter::getFusedPointwiseInfo() const {
+    tstring info;
+    for (const auto& stage : m_fusedPrologue) {
+        info += _T("\n") + stage.info;
+    }
+    for (const auto& stage : m_fusedEpilogue) {
+        info += _T("\n") + stage.info;
+    }
+    return info;
+}
+
+RGY_ERR fusePointwiseFilters(std::vector<std::unique_ptr<RGYFilter>>& filters, std::shared_ptr<RGYLog> log) {
+    int fusedCount = 0;
+    for (size_t i = 0; i < filters.size();) {
+        RGYFilterPointwiseStage stage;
+        if (!filters[i]->getPointwiseStage(stage, strsprintf("rgy_fused%d", fusedCount))) {
+            i++;
+            continue;
+        }
+        //直前のフィルタの出力時に適用できればそちらを優先し、できなければ直後のフィルタの入力時に適用する
+        RGYFilter *target = nullptr;
+        for (const auto prologue : { false, true }) {
+            if ((prologue) ? (i + 1 >= filters.size()) : (i == 0)) {
+                continue;
+            }
+            const size_t targetIdx = (prologue) ? i + 1 : i - 1;
+            auto err = filters[targetIdx]->fusePointwiseStage(stage, prologue);
+            if (err == RGY_ERR_NONE) {
+                target = filters[targetIdx].get();
+                break;
+            } else if (err != RGY_ERR_UNSUPPORTED) {
+                log->write(RGY_LOG_ERROR, RGY_LOGT_VPP, _T("failed to fuse %s into %s: %s.\n"),
+                    filters[i]->name().c_str(), filters[targetIdx]->name().c_str(), get_err_mes(err));
+                return err;
+            }
+        }
+        if (target) {
+            log->write(RGY_LOG_DEBUG, RGY_LOGT_VPP, _T("fused %s into %s.\n"), filters[i]->name().c_str(), target->name().c_str());
+            filters.erase(filters.begin() + i);
+            fusedCount++;
+        } else {
+            i++;
+        }
+    }
+    return RGY_ERR_NONE;
+}
+
 RGY_ERR RGYFilter::filter_as_interlaced_pair(const RGYFrameInfo *pInputFrame, RGYFrameInfo *pOutputFrame) {
 #if 0
     if (!m_pFieldPairIn) {
@@ -30,6 +30,7 @@
 #define __RGY_FILTER_CL_H__
 
 #include <cstdint>
+#include <array>
 #include "rgy_util.h"
 #include "rgy_log.h"
 #include "rgy_filter.h"
@@ -46,6 +47,16 @@ public:
 protected:
 };
 
+//--vpp-fusion用: 画素単位で完結する処理を、前後のフィルタのカーネルに埋め込むためのOpenCLのソース片
+//関数はいずれも "Type func(Type v)" の形式とし、Type, bit_depthは埋め込み先のカーネル側の定義を使用する
+struct RGYFilterPointwiseStage {
+    std::string source;              //関数の定義
+    std::array<std::string, 3> func; //各プレーンに適用する関数名 (空ならそのプレーンは処理しない)
+    tstring info;                    //埋め込み先のフィルタ情報に追記する文字列
+
+    RGYFilterPointwiseStage() : source(), func(), info() {};
+};
+
 class RGYFilter : public RGYFilterBase {
 public:
     RGYFilter(shared_ptr<RGYOpenCLContext> context);
@@ -56,8 +67,19 @@ public:
     RGY_ERR filter(RGYFrameInfo *pInputFrame, RGYFrameInfo **ppOutputFrames, int *pOutputFrameNum, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event = nullptr);
 
     virtual void setCheckPerformance(const bool check) override;
+
+    //画素単位で完結する処理のみを行うフィルタの場合、その処理をstageに出力してtrueを返す
+    //prefixは生成する関数名の先頭に付与し、埋め込み先での名前の衝突を避ける
+    virtual bool getPointwiseStage(RGYFilterPointwiseStage& stage, const std::string& prefix) const;
+    //画素単位の処理を自身のカーネルに取り込む
+    //prologue=trueなら入力画素の読み込み時に、falseなら出力画素の書き込み時に適用する
+    //取り込めない場合はRGY_ERR_UNSUPPORTEDを返す
+    virtual RGY_ERR fusePointwiseStage(const RGYFilterPointwiseStage& stage, bool prologue);
 protected:
     virtual RGY_ERR AllocFrameBuf(const RGYFrameInfo &frame, int frames) override;
+    //取り込んだ処理をRGY_FUSED_PROLOGUE(v, plane)/RGY_FUSED_EPILOGUE(v, plane)として定義するソースを生成する
+    std::string getFusedPointwiseSource() const;
+    tstring getFusedPointwiseInfo() const;
     RGY_ERR filter_as_interlaced_pair(const RGYFrameInfo *pInputFrame, RGYFrameInfo *pOutputFrame);
     virtual RGY_ERR run_filter(const RGYFrameInfo *pInputFrame, RGYFrameInfo **ppOutputFrames, int *pOutputFrameNum, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event) = 0;
 
@@ -65,8 +87,15 @@ protected:
     std::vector<unique_ptr<RGYCLFrame>> m_frameBuf;
     std::unique_ptr<RGYCLFrame> m_pFieldPairIn;
     std::unique_ptr<RGYCLFrame> m_pFieldPairOut;
+    std::vector<RGYFilterPointwiseStage> m_fusedPrologue;
+    std::vector<RGYFilterPointwiseStage> m_fusedEpilogue;
 };
 
+//--vpp-fusion: 画素単位で完結するフィルタを前後のフィルタのカーネルに取り込み、
+//フレームの読み書きの往復とカーネルの起動回数を削減する
+//取り込まれたフィルタはfiltersから取り除かれる
+RGY_ERR fusePointwiseFilters(std::vector<std::unique_ptr<RGYFilter>>& filters, std::shared_ptr<RGYLog> log);
+
 class RGYFilterDisabled : public RGYFilter {
 public:
     RGYFilterDisabled(shared_ptr<RGYOpenCLContext> context) : RGYFilter(context) {};
@@ -117,11 +146,12 @@ public:
     RGYFilterPad(shared_ptr<RGYOpenCLContext> context);
     virtual ~RGYFilterPad();
     virtual RGY_ERR init(shared_ptr<RGYFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) override;
+    virtual RGY_ERR fusePointwiseStage(const RGYFilterPointwiseStage& stage, bool prologue) override;
 protected:
     virtual RGY_ERR run_filter(const RGYFrameInfo *pInputFrame, RGYFrameInfo **ppOutputFrames, int *pOutputFrameNum, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event) override;
     virtual void close() override;
 
-    virtual RGY_ERR procPlane(RGYFrameInfo *pOutputPlane, const RGYFrameInfo *pInputPlane, int pad_color, const VppPad &pad, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event);
+    virtual RGY_ERR procPlane(RGYFrameInfo *pOutputPlane, const RGYFrameInfo *pInputPlane, int pad_color, const VppPad &pad, const int plane, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event);
     virtual RGY_ERR procFrame(RGYFrameInfo *pOutputFrame, const RGYFrameInfo *pInputFrame, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event);
 
     RGYOpenCLProgramAsync m_pad;
@@ -299,6 +299,9 @@ RGY_ERR RGYFilterCurves::createLUT(const VppCurveParams& prm, const RGY_CSP csp)
         AddMessage(RGY_LOG_ERROR, _T("Failed to create LUT(b): %s.\n"), get_err_mes(sts));
         return sts;
     }
+    m_lut.host[RGY_PLANE_R] = std::vector<int>(lutR.begin(), lutR.end());
+    m_lut.host[RGY_PLANE_G] = std::vector<int>(lutG.begin(), lutG.end());
+    m_lut.host[RGY_PLANE_B] = std::vector<int>(lutB.begin(), lutB.end());
     if ((sts = sendLUTToGPU<Type>(m_lut.r, lutR)) != RGY_ERR_NONE) {
         AddMessage(RGY_LOG_ERROR, _T("Failed to send LUT(r) to GPU: %s.\n"), get_err_mes(sts));
         return sts;
@@ -485,6 +488,38 @@ RGY_ERR RGYFilterCurves::run_filter(const RGYFrameInfo *pInputFrame, RGYFrameInf
     return sts;
 }
 
+bool RGYFilterCurves::getPointwiseStage(RGYFilterPointwiseStage& stage, const std::string& prefix) const {
+    auto prm = std::dynamic_pointer_cast<RGYFilterParamCurves>(m_param);
+    if (!prm
+        || RGY_CSP_CHROMA_FORMAT[prm->frameIn.csp] != RGY_CHROMAFMT_RGB
+        || m_convIn || m_convOut) {
+        return false; //YUVの場合はRGBへの変換を伴い、プレーン単位に分解できないので対象外
+    }
+    if (RGY_CSP_BIT_DEPTH[prm->frameIn.csp] > 8) {
+        return false; //LUTが__constantに収まらないので対象外
+    }
+    //LUTを__constantの配列として埋め込み、各プレーンで参照する
+    stage = RGYFilterPointwiseStage();
+    for (const auto plane : { RGY_PLANE_R, RGY_PLANE_G, RGY_PLANE_B }) {
+        const auto& lut = m_lut.host[plane];
+        if (lut.empty()) {
+            continue;
+        }
+        const auto func = prefix + "_curves_" + "rgb"[plane];
+        std::string table;
+        for (size_t i = 0; i < lut.size(); i++) {
+            table += strsprintf((i % 16 == 0) ? "\n    %d," : " %d,", lut[i]);
+        }
+        stage.source += strsprintf("__constant Type %s_lut[%d] = {", func.c_str(), (int)lut.size()) + table + "\n};\n";
+        stage.source += "Type " + func + "(Type v) {\n";
+        stage.source += "    return " + func + "_lut[v];\n";
+        stage.source += "}\n";
+        stage.func[plane] = func;
+    }
+    stage.info = GetInputMessage();
+    return true;
+}
+
 void RGYFilterCurves::close() {
     m_convIn.reset();
     m_convOut.reset();
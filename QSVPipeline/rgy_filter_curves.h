@@ -47,13 +47,15 @@ public:
 class RGYFilterCurves : public RGYFilter {
     struct RGYFilterCurvesLUT {
         std::unique_ptr<RGYCLBuf> r, g, b, master;
+        std::array<std::vector<int>, 3> host; //--vpp-fusion用にCPU側にも保持する (R, G, B の順、空ならそのプレーンは処理しない)
 
-        RGYFilterCurvesLUT() : r(), g(), b(), master() {};
+        RGYFilterCurvesLUT() : r(), g(), b(), master(), host() {};
     };
 public:
     RGYFilterCurves(std::shared_ptr<RGYOpenCLContext> context);
     virtual ~RGYFilterCurves();
     virtual RGY_ERR init(shared_ptr<RGYFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) override;
+    virtual bool getPointwiseStage(RGYFilterPointwiseStage& stage, const std::string& prefix) const override;
 protected:
     virtual RGY_ERR run_filter(const RGYFrameInfo *pInputFrame, RGYFrameInfo **ppOutputFrames, int *pOutputFrameNum, RGYOpenCLQueue& queue_main, const std::vector<RGYOpenCLEvent>& wait_events, RGYOpenCLEvent *event) override;
     virtual void close() override;
@@ -1,5 +1,10 @@
 ﻿// Type
 // bit_depth
+// RGY_FUSED_EPILOGUE (--vpp-fusion)
+
+#ifndef RGY_FUSED_EPILOGUE
+#define RGY_FUSED_EPILOGUE(v, plane) (v)
+#endif
 
 #ifndef clamp
 #define clamp(x, low, high) (((x) <= (high)) ? (((x) >= (low)) ? (x) : (low)) : (high))
@@ -14,7 +19,8 @@ __kernel void kernel_edgelevel(
     __global uchar *restrict pDst,
     const int dstPitch, const int dstWidth, const int dstHeight,
     __read_only image2d_t src,
-    const float strength, const float threshold, const float black, const float white) {
+    const float strength, const float threshold, const float black, const float white,
+    const int plane) {
     const int ix = get_global_id(0);
     const int iy = get_global_id(1);
     const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
@@ -52,6 +58,6 @@ __kernel void kernel_edgelevel(
         }
 
         __global Type *ptr = (__global Type *)(pDst + iy * dstPitch + ix * sizeof(Type));
-        ptr[0] = (Type)(clamp(center, 0.0f, 1.0f - 1e-6f) * ((1 << (bit_depth))-1));
+        ptr[0] = RGY_FUSED_EPILOGUE((Type)(clamp(center, 0.0f, 1.0f - 1e-6f) * ((1 << (bit_depth))-1)), plane);
     }
 }
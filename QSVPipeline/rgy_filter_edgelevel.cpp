@@ -31,8 +31,9 @@
 #include <map>
 #include <array>
 #include "rgy_filter_edgelevel.h"
+#include "rgy_resource.h"
 
-RGY_ERR RGYFilterEdgelevel::procPlane(RGYFrameInfo *pOutputPlane, const RGYFrameInfo *pInputPlane, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event) {
+RGY_ERR RGYFilterEdgelevel::procPlane(RGYFrameInfo *pOutputPlane, const RGYFrameInfo *pInputPlane, const int plane, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event) {
     auto prm = std::dynamic_pointer_cast<RGYFilterParamEdgelevel>(m_param);
     if (!prm) {
         AddMessage(RGY_LOG_ERROR, _T("Invalid parameter type.\n"));
@@ -49,7 +50,7 @@ RGY_ERR RGYFilterEdgelevel::procPlane(RGYFrameInfo *pOutputPlane, const RGYFrame
         auto err = m_edgelevel.get()->kernel(kernel_name).config(queue, local, global, wait_events, event).launch(
             (cl_mem)pOutputPlane->ptr[0], pOutputPlane->pitch[0], pOutputPlane->width, pOutputPlane->height,
             (cl_mem)pInputPlane->ptr[0],
-            strength, threshold, black, white);
+            strength, threshold, black, white, plane);
         if (err != RGY_ERR_NONE) {
             AddMessage(RGY_LOG_ERROR, _T("error at %s (procPlane(%s)): %s.\n"),
                 char_to_tstring(kernel_name).c_str(), RGY_CSP_NAMES[pInputPlane->csp], get_err_mes(err));
@@ -70,7 +71,7 @@ RGY_ERR RGYFilterEdgelevel::procFrame(RGYFrameInfo *pOutputFrame, const RGYFrame
         auto planeSrc = getPlane(&srcImage->frame, (RGY_PLANE)i);
         const std::vector<RGYOpenCLEvent> &plane_wait_event = (i == 0) ? wait_events : std::vector<RGYOpenCLEvent>();
         RGYOpenCLEvent *plane_event = (i == RGY_CSP_PLANES[pOutputFrame->csp] - 1) ? event : nullptr;
-        auto err = procPlane(&planeDst, &planeSrc, queue, plane_wait_event, plane_event);
+        auto err = procPlane(&planeDst, &planeSrc, i, queue, plane_wait_event, plane_event);
         if (err != RGY_ERR_NONE) {
             AddMessage(RGY_LOG_ERROR, _T("Failed to denoise(edgelevel) frame(%d) %s: %s\n"), i, cl_errmes(err));
             return err_cl_to_rgy(err);
@@ -123,7 +124,12 @@ RGY_ERR RGYFilterEdgelevel::init(shared_ptr<RGYFilterParam> pParam, shared_ptr<R
         const auto options = strsprintf("-D Type=%s -D bit_depth=%d",
             RGY_CSP_BIT_DEPTH[prm->frameOut.csp] > 8 ? "ushort" : "uchar",
             RGY_CSP_BIT_DEPTH[prm->frameOut.csp]);
-        m_edgelevel.set(m_cl->buildResourceAsync(_T("RGY_FILTER_EDGELEVEL_CL"), _T("EXE_DATA"), options.c_str()));
+        if (m_fusedEpilogue.empty()) {
+            m_edgelevel.set(m_cl->buildResourceAsync(_T("RGY_FILTER_EDGELEVEL_CL"), _T("EXE_DATA"), options.c_str()));
+        } else {
+            const auto edgelevel_cl = getEmbeddedResourceStr(_T("RGY_FILTER_EDGELEVEL_CL"), _T("EXE_DATA"), m_cl->getModuleHandle());
+            m_edgelevel.set(m_cl->buildAsync(getFusedPointwiseSource() + edgelevel_cl, options.c_str()));
+        }
     }
 
     auto err = AllocFrameBuf(prm->frameOut, 1);
@@ -136,11 +142,21 @@ RGY_ERR RGYFilterEdgelevel::init(shared_ptr<RGYFilterParam> pParam, shared_ptr<R
     }
 
     //コピーを保存
-    setFilterInfo(prm->print());
+    setFilterInfo(prm->print() + getFusedPointwiseInfo());
     m_param = prm;
     return sts;
 }
 
+RGY_ERR RGYFilterEdgelevel::fusePointwiseStage(const RGYFilterPointwiseStage& stage, bool prologue) {
+    //近傍の画素を参照するため、入力側には取り込めない
+    if (prologue || !m_param) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    m_fusedEpilogue.push_back(stage);
+    m_edgelevel.clear();
+    return init(m_param, m_pLog);
+}
+
 RGY_ERR RGYFilterEdgelevel::run_filter(const RGYFrameInfo *pInputFrame, RGYFrameInfo **ppOutputFrames, int *pOutputFrameNum, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event) {
     RGY_ERR sts = RGY_ERR_NONE;
     if (pInputFrame->ptr[0] == nullptr) {
@@ -227,8 +227,7 @@ RGY_ERR RGYFilterOverlay::initInput(RGYFilterParamOverlay *prm) {
         AddMessage(RGY_LOG_ERROR, _T("failed to set codec param to context for decoder: %s.\n"), qsv_av_err2str(ret).c_str());
         return RGY_ERR_UNKNOWN;
     }
-    cpu_info_t cpu_info;
-    if (get_cpu_info(&cpu_info)) {
+    if (const auto& cpu_info = get_cpu_info(); cpu_info.logical_cores > 0) {
         AVDictionary *pDict = nullptr;
         av_dict_set_int(&pDict, "threads", std::min(cpu_info.logical_cores, 16), 0);
         if (0 > (ret = av_opt_set_dict(m_codecCtxDec.get(), &pDict))) {
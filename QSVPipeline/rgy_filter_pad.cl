@@ -1,4 +1,14 @@
 ﻿// Type
+// bit_depth
+// RGY_FUSED_PROLOGUE (--vpp-fusion)
+// RGY_FUSED_EPILOGUE (--vpp-fusion)
+
+#ifndef RGY_FUSED_PROLOGUE
+#define RGY_FUSED_PROLOGUE(v, plane) (v)
+#endif
+#ifndef RGY_FUSED_EPILOGUE
+#define RGY_FUSED_EPILOGUE(v, plane) (v)
+#endif
 
 __kernel void kernel_pad(
     __global uchar *__restrict__ ptrDst,
@@ -6,7 +16,7 @@ __kernel void kernel_pad(
     const __global uchar *__restrict__ ptrSrc,
     const int srcPitch, const int srcWidth, const int srcHeight,
     const int pad_left, const int pad_up,
-    const int pad_color) {
+    const int pad_color, const int plane) {
     const int ox = get_global_id(0);
     const int oy = get_global_id(1);
 
@@ -17,10 +27,10 @@ __kernel void kernel_pad(
         Type out_color = (Type)pad_color;
         if (0 <= ix && ix < srcWidth && 0 <= iy && iy < srcHeight) {
             const __global Type *ptrSrcPix = (const __global Type *)(ptrSrc + iy * srcPitch + ix * sizeof(Type));
-            out_color = ptrSrcPix[0];
+            out_color = RGY_FUSED_PROLOGUE(ptrSrcPix[0], plane);
         }
 
         __global Type *ptrDstPix = (__global Type *)(ptrDst + oy * dstPitch + ox * sizeof(Type));
-        ptrDstPix[0] = out_color;
+        ptrDstPix[0] = RGY_FUSED_EPILOGUE(out_color, plane);
     }
 }
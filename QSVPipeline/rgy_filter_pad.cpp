@@ -27,6 +27,7 @@
 // ------------------------------------------------------------------------------------------
 
 #include "rgy_filter_cl.h"
+#include "rgy_resource.h"
 
 tstring RGYFilterParamPad::print() const {
     return strsprintf(_T("pad: [%dx%d]->[%dx%d] "),
@@ -35,7 +36,7 @@ tstring RGYFilterParamPad::print() const {
         + pad.print();
 }
 
-RGY_ERR RGYFilterPad::procPlane(RGYFrameInfo *pOutputPlane, const RGYFrameInfo *pInputPlane, int pad_color, const VppPad& pad, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event) {
+RGY_ERR RGYFilterPad::procPlane(RGYFrameInfo *pOutputPlane, const RGYFrameInfo *pInputPlane, int pad_color, const VppPad& pad, const int plane, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event) {
     {
         const char *kernel_name = "kernel_pad";
         RGYWorkSize local(32, 8);
@@ -43,7 +44,7 @@ RGY_ERR RGYFilterPad::procPlane(RGYFrameInfo *pOutputPlane, const RGYFrameInfo *
         auto err = m_pad.get()->kernel(kernel_name).config(queue, local, global, wait_events, event).launch(
             (cl_mem)pOutputPlane->ptr[0], pOutputPlane->pitch[0], pOutputPlane->width, pOutputPlane->height,
             (cl_mem)pInputPlane->ptr[0], pInputPlane->pitch[0], pInputPlane->width, pInputPlane->height,
-            pad.left, pad.top, pad_color);
+            pad.left, pad.top, pad_color, plane);
         if (err != RGY_ERR_NONE) {
             AddMessage(RGY_LOG_ERROR, _T("error at %s (procPlane(%s)): %s.\n"),
                 char_to_tstring(kernel_name).c_str(), RGY_CSP_NAMES[pInputPlane->csp], get_err_mes(err));
@@ -70,7 +71,7 @@ RGY_ERR RGYFilterPad::procFrame(RGYFrameInfo *pOutputFrame, const RGYFrameInfo *
     const int padColorY = (RGY_CSP_CHROMA_FORMAT[prm->frameIn.csp] == RGY_CHROMAFMT_RGB) ? 0 : (uint16_t)(16 << (RGY_CSP_BIT_DEPTH[prm->frameIn.csp] - 8));
     const int padColorC = (RGY_CSP_CHROMA_FORMAT[prm->frameIn.csp] == RGY_CHROMAFMT_RGB) ? 0 : (uint16_t)(128 << (RGY_CSP_BIT_DEPTH[prm->frameIn.csp] - 8));
 
-    auto sts = procPlane(&planeOutputY, &planeInputY, padColorY, prm->pad, queue, wait_events, nullptr);
+    auto sts = procPlane(&planeOutputY, &planeInputY, padColorY, prm->pad, RGY_PLANE_Y, queue, wait_events, nullptr);
     if (sts != RGY_ERR_NONE) return sts;
 
     auto uvPad = prm->pad;
@@ -86,10 +87,10 @@ RGY_ERR RGYFilterPad::procFrame(RGYFrameInfo *pOutputFrame, const RGYFrameInfo *
         sts = RGY_ERR_UNSUPPORTED;
     }
 
-    sts = procPlane(&planeOutputU, &planeInputU, padColorC, uvPad, queue, {}, nullptr);
+    sts = procPlane(&planeOutputU, &planeInputU, padColorC, uvPad, RGY_PLANE_U, queue, {}, nullptr);
     if (sts != RGY_ERR_NONE) return sts;
 
-    sts = procPlane(&planeOutputV, &planeInputV, padColorC, uvPad, queue, {}, event);
+    sts = procPlane(&planeOutputV, &planeInputV, padColorC, uvPad, RGY_PLANE_V, queue, {}, event);
     if (sts != RGY_ERR_NONE) return sts;
 
     return sts;
@@ -136,8 +137,15 @@ RGY_ERR RGYFilterPad::init(shared_ptr<RGYFilterParam> pParam, shared_ptr<RGYLog>
     if (!m_pad.get()
         || !prmPrev
         || RGY_CSP_BIT_DEPTH[prmPrev->frameOut.csp] != RGY_CSP_BIT_DEPTH[pParam->frameOut.csp]) {
-        const auto options = strsprintf("-D Type=%s", RGY_CSP_BIT_DEPTH[prm->frameOut.csp] > 8 ? "ushort" : "uchar");
-        m_pad.set(m_cl->buildResourceAsync(_T("RGY_FILTER_PAD_CL"), _T("EXE_DATA"), options.c_str()));
+        const auto options = strsprintf("-D Type=%s -D bit_depth=%d",
+            RGY_CSP_BIT_DEPTH[prm->frameOut.csp] > 8 ? "ushort" : "uchar",
+            RGY_CSP_BIT_DEPTH[prm->frameOut.csp]);
+        if (m_fusedPrologue.empty() && m_fusedEpilogue.empty()) {
+            m_pad.set(m_cl->buildResourceAsync(_T("RGY_FILTER_PAD_CL"), _T("EXE_DATA"), options.c_str()));
+        } else {
+            const auto pad_cl = getEmbeddedResourceStr(_T("RGY_FILTER_PAD_CL"), _T("EXE_DATA"), m_cl->getModuleHandle());
+            m_pad.set(m_cl->buildAsync(getFusedPointwiseSource() + pad_cl, options.c_str()));
+        }
     }
 
     sts = AllocFrameBuf(prm->frameOut, 1);
@@ -150,11 +158,26 @@ RGY_ERR RGYFilterPad::init(shared_ptr<RGYFilterParam> pParam, shared_ptr<RGYLog>
     }
 
     //コピーを保存
-    setFilterInfo(prm->print());
+    setFilterInfo(prm->print() + getFusedPointwiseInfo());
     m_param = prm;
     return sts;
 }
 
+RGY_ERR RGYFilterPad::fusePointwiseStage(const RGYFilterPointwiseStage& stage, bool prologue) {
+    auto prm = std::dynamic_pointer_cast<RGYFilterParamPad>(m_param);
+    if (!prm) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    //画素単位の処理なので、入力側・出力側のどちらにも取り込める
+    if (prologue) {
+        m_fusedPrologue.push_back(stage);
+    } else {
+        m_fusedEpilogue.push_back(stage);
+    }
+    m_pad.clear();
+    return init(m_param, m_pLog);
+}
+
 RGY_ERR RGYFilterPad::run_filter(const RGYFrameInfo *pInputFrame, RGYFrameInfo **ppOutputFrames, int *pOutputFrameNum, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event) {
     RGY_ERR sts = RGY_ERR_NONE;
     if (pInputFrame->ptr[0] == nullptr) {
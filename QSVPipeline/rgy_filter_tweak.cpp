@@ -465,6 +465,72 @@ RGY_ERR RGYFilterTweak::run_filter(const RGYFrameInfo *pInputFrame, RGYFrameInfo
     return sts;
 }
 
+static std::string clFloat(const float value) {
+    return strsprintf("(%.9ef)", value);
+}
+
+bool RGYFilterTweak::getPointwiseStage(RGYFilterPointwiseStage& stage, const std::string& prefix) const {
+    auto prm = std::dynamic_pointer_cast<RGYFilterParamTweak>(m_param);
+    if (!prm
+        || RGY_CSP_CHROMA_FORMAT[prm->frameIn.csp] == RGY_CHROMAFMT_RGB
+        || prm->tweak.rgb_filter_enabled()
+        || m_convA || m_convB || m_convC) {
+        return false; //RGBでの処理が必要な場合は色空間の変換を伴うので対象外
+    }
+    if (prm->tweak.hue != 0.0f || prm->tweak.swapuv) {
+        return false; //U/Vの両方を参照する処理はプレーン単位に分解できないので対象外
+    }
+    const float contrast   = prm->tweak.contrast;
+    const float brightness = prm->tweak.brightness;
+    const float saturation = prm->tweak.saturation;
+    const float gamma      = prm->tweak.gamma;
+
+    //procFrame()およびrgy_filter_tweak.clと同じ演算順序で生成する
+    const char *toType = "(Type)clamp((int)(pixel * (1 << (bit_depth))), 0, (1 << (bit_depth)) - 1)";
+    stage = RGYFilterPointwiseStage();
+    if (   contrast   != 1.0f
+        || brightness != 0.0f
+        || gamma      != 1.0f
+        || prm->tweak.y.enabled()) {
+        stage.func[RGY_PLANE_Y] = prefix + "_tweak_y";
+        stage.source += "Type " + stage.func[RGY_PLANE_Y] + "(Type v) {\n";
+        stage.source += "    float pixel = (float)v * (1.0f / (1 << bit_depth));\n";
+        stage.source += "    pixel = " + clFloat(contrast) + " * (pixel - 0.5f) + 0.5f + " + clFloat(brightness) + ";\n";
+        stage.source += "    pixel = pow(pixel, " + clFloat(1.0f / gamma) + ");\n";
+        stage.source += std::string("    v = ") + toType + ";\n";
+        if (prm->tweak.y.enabled()) {
+            stage.source += "    pixel = (float)v * (1.0f / (1 << bit_depth));\n";
+            stage.source += "    pixel = " + clFloat(prm->tweak.y.gain) + " * (pixel - 0.5f) + 0.5f + " + clFloat(prm->tweak.y.offset) + ";\n";
+            stage.source += std::string("    v = ") + toType + ";\n";
+        }
+        stage.source += "    return v;\n";
+        stage.source += "}\n";
+    }
+    if (   saturation != 1.0f
+        || prm->tweak.cb.enabled()
+        || prm->tweak.cr.enabled()) {
+        //hue = 0 のとき、hue_sin = 0, hue_cos = saturation
+        for (const auto plane : { RGY_PLANE_U, RGY_PLANE_V }) {
+            const auto& prmCbCr = (plane == RGY_PLANE_U) ? prm->tweak.cb : prm->tweak.cr;
+            stage.func[plane] = prefix + ((plane == RGY_PLANE_U) ? "_tweak_u" : "_tweak_v");
+            stage.source += "Type " + stage.func[plane] + "(Type v) {\n";
+            stage.source += "    float pixel = (float)v * (1.0f / (1 << bit_depth));\n";
+            stage.source += "    pixel = " + clFloat(saturation) + " * (pixel - 0.5f) + 0.5f;\n";
+            stage.source += "    pixel = (" + clFloat(saturation) + " * (pixel - 0.5f)) + 0.5f;\n";
+            stage.source += std::string("    v = ") + toType + ";\n";
+            if (prmCbCr.enabled()) {
+                stage.source += "    pixel = (float)v * (1.0f / (1 << bit_depth));\n";
+                stage.source += "    pixel = " + clFloat(prmCbCr.gain) + " * pixel + " + clFloat(prmCbCr.offset) + ";\n";
+                stage.source += std::string("    v = ") + toType + ";\n";
+            }
+            stage.source += "    return v;\n";
+            stage.source += "}\n";
+        }
+    }
+    stage.info = GetInputMessage();
+    return true;
+}
+
 void RGYFilterTweak::close() {
     m_convA.reset();
     m_convB.reset();
@@ -44,6 +44,7 @@ public:
     RGYFilterTweak(shared_ptr<RGYOpenCLContext> context);
     virtual ~RGYFilterTweak();
     virtual RGY_ERR init(shared_ptr<RGYFilterParam> pParam, shared_ptr<RGYLog> pPrintMes) override;
+    virtual bool getPointwiseStage(RGYFilterPointwiseStage& stage, const std::string& prefix) const override;
 protected:
     virtual RGY_ERR run_filter(const RGYFrameInfo *pInputFrame, RGYFrameInfo **ppOutputFrames, int *pOutputFrameNum, RGYOpenCLQueue &queue, const std::vector<RGYOpenCLEvent> &wait_events, RGYOpenCLEvent *event) override;
     virtual void close() override;
@@ -28,6 +28,7 @@
 #include "rgy_util.h"
 #include "rgy_frame.h"
 #include "rgy_log.h"
+#include "rgy_frame_pool.h"
 #if !CLFILTERS_AUF
 #include "rgy_bitstream.h"
 #endif
@@ -286,11 +287,11 @@ RGY_ERR RGYSysFrame::allocate(const RGYFrameInfo &info) {
         const int widthByte = plane.width * pixsize;
         const int memPitch = ALIGN(widthByte, image_pitch_alignment);
         const int size = memPitch * plane.height;
-        auto mem = _aligned_malloc(size, image_pitch_alignment);
+        auto mem = RGYSysFramePool::get().alloc(size);
         if (mem == nullptr) {
             for (int j = i-1; j >= 0; j--) {
                 if (frame.ptr[j] != nullptr) {
-                    _aligned_free(frame.ptr[j]);
+                    RGYSysFramePool::get().release(frame.ptr[j]);
                     frame.ptr[j] = nullptr;
                 }
             }
@@ -304,7 +305,7 @@ RGY_ERR RGYSysFrame::allocate(const RGYFrameInfo &info) {
 void RGYSysFrame::deallocate() {
     for (int i = 0; i < ((frame.singleAlloc) ? 1 : _countof(frame.ptr)); i++) {
         if (frame.ptr[i] != nullptr) {
-            _aligned_free(frame.ptr[i]);
+            RGYSysFramePool::get().release(frame.ptr[i]);
             frame.ptr[i] = nullptr;
         }
     }
@@ -0,0 +1,399 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// -------------------------------------------------------------------------------------------
+
+
+#include <cstring>
+#include <algorithm>
+#include "rgy_frame_pool.h"
+#include "rgy_osdep.h"
+#include "rgy_util.h"
+#include "rgy_thread_affinity.h"
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <sys/mman.h>
+#endif
+
+//バッファの確保方法
+enum class RGYFramePoolBackend : uint32_t {
+    Malloc,  //_aligned_malloc
+    Mmap,    //mmap (THPを要求したがmadviseに失敗したもの、通常のページとして使用する)
+    THP,     //mmap + madvise(MADV_HUGEPAGE)
+    HugeTLB, //mmap(MAP_HUGETLB) / VirtualAlloc(MEM_LARGE_PAGES)
+};
+
+//確保したバッファの直前に置くヘッダ (64byte)
+struct RGYSysFramePool::BlockHeader {
+    uint64_t magic;
+    size_t   classSize;  //サイズクラス (利用可能なサイズ)
+    void    *base;       //実際に確保したメモリの先頭
+    size_t   mapSize;    //実際に確保したメモリのサイズ
+    RGYFramePoolBackend backend;
+    uint8_t  reserved[64 - sizeof(uint64_t) - sizeof(size_t) * 2 - sizeof(void *) - sizeof(RGYFramePoolBackend)];
+};
+static const uint64_t RGY_FRAME_POOL_MAGIC        = 0x4c4f4f50454d5246ull; // "FRMEPOOL" 使用中
+static const uint64_t RGY_FRAME_POOL_MAGIC_CACHED = 0x484341434d505246ull; // "FRPMCACH" プールで保持中
+static const size_t RGY_FRAME_POOL_HEADER_SIZE = 64;
+static const size_t RGY_FRAME_POOL_PAGE_SIZE = 4096;
+static const size_t RGY_FRAME_POOL_LARGE_BLOCK = 1024 * 1024;
+static const size_t RGY_FRAME_POOL_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+#if defined(_WIN32) || defined(_WIN64)
+//ラージページの使用にはSeLockMemoryPrivilegeが必要 (ユーザー権利の割り当てで「メモリ内のページのロック」の許可が必要)
+static size_t rgy_large_page_size() {
+    static size_t pageSize = 0;
+    static std::once_flag initFlag;
+    std::call_once(initFlag, []() {
+        HANDLE token = NULL;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+            return;
+        }
+        TOKEN_PRIVILEGES tp = { 0 };
+        tp.PrivilegeCount = 1;
+        tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        if (LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &tp.Privileges[0].Luid)
+            && AdjustTokenPrivileges(token, FALSE, &tp, 0, NULL, NULL)
+            && GetLastError() == ERROR_SUCCESS) {
+            pageSize = GetLargePageMinimum();
+        }
+        CloseHandle(token);
+    });
+    return pageSize;
+}
+
+static void *rgy_huge_page_alloc(size_t size, RGYHugePageMode mode, size_t& mapSize, RGYFramePoolBackend& backend) {
+    const size_t pageSize = (mode == RGYHugePageMode::HugeTLB) ? rgy_large_page_size() : 0;
+    if (pageSize == 0) {
+        return nullptr; //THPに相当するものはないので、通常のメモリで確保する
+    }
+    mapSize = ALIGN(size, pageSize);
+    auto ptr = VirtualAlloc(NULL, mapSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if (ptr != nullptr) {
+        backend = RGYFramePoolBackend::HugeTLB;
+    }
+    return ptr;
+}
+
+static void rgy_huge_page_free(void *ptr, size_t mapSize) {
+    UNREFERENCED_PARAMETER(mapSize);
+    VirtualFree(ptr, 0, MEM_RELEASE);
+}
+#else
+static void *rgy_huge_page_alloc(size_t size, RGYHugePageMode mode, size_t& mapSize, RGYFramePoolBackend& backend) {
+    mapSize = ALIGN(size, RGY_FRAME_POOL_HUGE_PAGE_SIZE);
+    if (mode == RGYHugePageMode::HugeTLB) {
+        //予約されたhugetlbfsのページが足りなければ失敗するので、THPにフォールバックする
+        auto ptr = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            backend = RGYFramePoolBackend::HugeTLB;
+            return ptr;
+        }
+    }
+    //huge pageの境界に合わせるため、余分に確保してから前後を解放する
+    auto map = (uint8_t *)mmap(nullptr, mapSize + RGY_FRAME_POOL_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return nullptr;
+    }
+    auto ptr = (uint8_t *)ALIGN((size_t)map, RGY_FRAME_POOL_HUGE_PAGE_SIZE);
+    if (ptr > map) {
+        munmap(map, ptr - map);
+    }
+    if (ptr + mapSize < map + mapSize + RGY_FRAME_POOL_HUGE_PAGE_SIZE) {
+        munmap(ptr + mapSize, (map + mapSize + RGY_FRAME_POOL_HUGE_PAGE_SIZE) - (ptr + mapSize));
+    }
+    //THPが無効 (never) の場合は失敗するが、通常のページとしてそのまま使用する
+    //mmapで確保しているので、解放時にmunmapされるようMallocとは区別する
+    backend = (madvise(ptr, mapSize, MADV_HUGEPAGE) == 0) ? RGYFramePoolBackend::THP : RGYFramePoolBackend::Mmap;
+    return ptr;
+}
+
+static void rgy_huge_page_free(void *ptr, size_t mapSize) {
+    munmap(ptr, mapSize);
+}
+#endif
+
+RGYSysFramePool& RGYSysFramePool::get() {
+    //静的オブジェクトのデストラクタの後にフレームが解放される場合があるので、意図的に破棄しない
+    static RGYSysFramePool *pool = new RGYSysFramePool();
+    return *pool;
+}
+
+size_t RGYSysFramePool::capacity(const void *ptr) {
+    if (ptr == nullptr) {
+        return 0;
+    }
+    auto block = (const BlockHeader *)((const uint8_t *)ptr - RGY_FRAME_POOL_HEADER_SIZE);
+    return (block->magic == RGY_FRAME_POOL_MAGIC) ? block->classSize : 0;
+}
+
+RGYSysFramePool::RGYSysFramePool() :
+    m_mtx(),
+    m_free(),
+    m_maxCacheBytes(MAX_CACHE_BYTES_DEFAULT),
+    m_hugePageMode(RGYHugePageMode::Disabled),
+    m_stats() {
+    static_assert(sizeof(BlockHeader) == RGY_FRAME_POOL_HEADER_SIZE, "sizeof(BlockHeader) must be 64.");
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+RGYSysFramePool::~RGYSysFramePool() {
+    trim();
+}
+
+size_t RGYSysFramePool::sizeClass(size_t size) {
+    //大きなバッファはページ単位より粗く丸めて、わずかなサイズの違いでも再利用できるようにする
+    const size_t align = (size >= RGY_FRAME_POOL_LARGE_BLOCK) ? 64 * 1024 : RGY_FRAME_POOL_PAGE_SIZE;
+    return ((std::max)(size, (size_t)1) + align - 1) & ~(align - 1);
+}
+
+RGYSysFramePool::BlockHeader *RGYSysFramePool::allocBlock(size_t classSize, RGYHugePageMode hugePageMode) {
+    //大きなバッファはデータ部分がページ境界から始まるようにする (NUMAノードの割り当てをバッファ全体に適用するため)
+    const size_t offset = (classSize >= RGY_FRAME_POOL_LARGE_BLOCK) ? RGY_FRAME_POOL_PAGE_SIZE : RGY_FRAME_POOL_HEADER_SIZE;
+    size_t mapSize = offset + classSize;
+    auto backend = RGYFramePoolBackend::Malloc;
+    uint8_t *base = nullptr;
+    if (hugePageMode != RGYHugePageMode::Disabled && classSize >= RGY_FRAME_POOL_HUGE_PAGE_SIZE) {
+        base = (uint8_t *)rgy_huge_page_alloc(offset + classSize, hugePageMode, mapSize, backend);
+    }
+    if (base == nullptr) {
+        mapSize = offset + classSize;
+        backend = RGYFramePoolBackend::Malloc;
+        base = (uint8_t *)_aligned_malloc(mapSize, offset);
+        if (base == nullptr) {
+            return nullptr;
+        }
+    }
+    auto ptr = base + offset;
+    RGYNumaBindMemory(ptr, classSize);
+    auto block = (BlockHeader *)(ptr - RGY_FRAME_POOL_HEADER_SIZE);
+    block->magic = RGY_FRAME_POOL_MAGIC;
+    block->classSize = classSize;
+    block->base = base;
+    block->mapSize = mapSize;
+    block->backend = backend;
+    return block;
+}
+
+void RGYSysFramePool::freeBlock(BlockHeader *block) {
+    block->magic = 0;
+    if (block->backend == RGYFramePoolBackend::Malloc) {
+        _aligned_free(block->base);
+    } else {
+        rgy_huge_page_free(block->base, block->mapSize);
+    }
+}
+
+void *RGYSysFramePool::alloc(size_t size) {
+    const auto classSize = sizeClass(size);
+    BlockHeader *block = nullptr;
+    RGYHugePageMode hugePageMode = RGYHugePageMode::Disabled;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        hugePageMode = m_hugePageMode;
+        m_stats.allocCount++;
+        auto it = m_free.find(classSize);
+        if (it != m_free.end() && !it->second.empty()) {
+            block = it->second.back();
+            it->second.pop_back();
+            block->magic = RGY_FRAME_POOL_MAGIC;
+            m_stats.reuseCount++;
+            m_stats.cachedBytes -= classSize;
+            m_stats.usedBytes += classSize;
+            return (uint8_t *)block + RGY_FRAME_POOL_HEADER_SIZE;
+        }
+    }
+    //新規の確保はロックの外で行う
+    block = allocBlock(classSize, hugePageMode);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_stats.blockCount++;
+    m_stats.hugeTLBCount += (block->backend == RGYFramePoolBackend::HugeTLB) ? 1 : 0;
+    m_stats.thpCount     += (block->backend == RGYFramePoolBackend::THP) ? 1 : 0;
+    m_stats.usedBytes += classSize;
+    m_stats.peakBytes = (std::max)(m_stats.peakBytes, m_stats.usedBytes + m_stats.cachedBytes);
+    return (uint8_t *)block + RGY_FRAME_POOL_HEADER_SIZE;
+}
+
+void RGYSysFramePool::release(void *ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    auto block = (BlockHeader *)((uint8_t *)ptr - RGY_FRAME_POOL_HEADER_SIZE);
+    if (block->magic != RGY_FRAME_POOL_MAGIC) {
+        //二重解放、またはプール以外で確保されたバッファ
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_stats.usedBytes -= block->classSize;
+        if (m_stats.cachedBytes + block->classSize <= m_maxCacheBytes) {
+            block->magic = RGY_FRAME_POOL_MAGIC_CACHED;
+            m_free[block->classSize].push_back(block);
+            m_stats.cachedBytes += block->classSize;
+            return;
+        }
+    }
+    freeBlock(block);
+}
+
+void RGYSysFramePool::trim() {
+    std::unordered_map<size_t, std::vector<BlockHeader *>> blocks;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        std::swap(blocks, m_free);
+        m_stats.cachedBytes = 0;
+    }
+    for (auto& list : blocks) {
+        for (auto block : list.second) {
+            freeBlock(block);
+        }
+    }
+}
+
+void RGYSysFramePool::setMaxCacheBytes(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_maxCacheBytes = bytes;
+        if (m_stats.cachedBytes <= m_maxCacheBytes) {
+            return;
+        }
+    }
+    trim();
+}
+
+void RGYSysFramePool::setHugePageMode(RGYHugePageMode mode) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_hugePageMode = mode;
+}
+
+RGYSysFramePool::Stats RGYSysFramePool::stats() const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_stats;
+}
+
+RGYBitstreamBufPool& RGYBitstreamBufPool::get() {
+    //RGYSysFramePoolと同様に、意図的に破棄しない
+    static RGYBitstreamBufPool *pool = new RGYBitstreamBufPool();
+    return *pool;
+}
+
+RGYBitstreamBufPool::RGYBitstreamBufPool() :
+    m_slots(),
+    m_hitCount(0),
+    m_missCount(0),
+    m_spillCount(0) {
+    for (auto& slots : m_slots) {
+        for (auto& slot : slots) {
+            slot.store(nullptr);
+        }
+    }
+}
+
+RGYBitstreamBufPool::~RGYBitstreamBufPool() {
+    for (auto& slots : m_slots) {
+        for (auto& slot : slots) {
+            if (auto ptr = slot.exchange(nullptr); ptr != nullptr) {
+                auto block = (RGYSysFramePool::BlockHeader *)((uint8_t *)ptr - RGY_FRAME_POOL_HEADER_SIZE);
+                block->magic = RGY_FRAME_POOL_MAGIC;
+                RGYSysFramePool::get().release(ptr);
+            }
+        }
+    }
+}
+
+int RGYBitstreamBufPool::classBits(size_t size) {
+    int bits = MIN_CLASS_BITS;
+    while (bits <= MAX_CLASS_BITS && ((size_t)1 << bits) < size) {
+        bits++;
+    }
+    return bits; //MAX_CLASS_BITSを超える場合は範囲外
+}
+
+size_t RGYBitstreamBufPool::allocSize(size_t size) {
+    const int bits = classBits(size);
+    return (bits > MAX_CLASS_BITS) ? RGYSysFramePool::sizeClass(size) : (size_t)1 << bits;
+}
+
+void *RGYBitstreamBufPool::alloc(size_t size, size_t *capacity) {
+    const int bits = classBits(size);
+    if (bits > MAX_CLASS_BITS) {
+        m_missCount.fetch_add(1, std::memory_order_relaxed);
+        auto ptr = RGYSysFramePool::get().alloc(size);
+        if (capacity) *capacity = RGYSysFramePool::capacity(ptr);
+        return ptr;
+    }
+    const size_t classSize = (size_t)1 << bits;
+    for (auto& slot : m_slots[bits - MIN_CLASS_BITS]) {
+        if (slot.load(std::memory_order_relaxed) == nullptr) {
+            continue;
+        }
+        //取り出しはexchangeで所有権ごと移すので、ABAの問題は生じない
+        if (auto ptr = slot.exchange(nullptr, std::memory_order_acquire); ptr != nullptr) {
+            auto block = (RGYSysFramePool::BlockHeader *)((uint8_t *)ptr - RGY_FRAME_POOL_HEADER_SIZE);
+            block->magic = RGY_FRAME_POOL_MAGIC;
+            m_hitCount.fetch_add(1, std::memory_order_relaxed);
+            if (capacity) *capacity = classSize;
+            return ptr;
+        }
+    }
+    m_missCount.fetch_add(1, std::memory_order_relaxed);
+    auto ptr = RGYSysFramePool::get().alloc(classSize);
+    if (capacity) *capacity = (ptr) ? classSize : 0;
+    return ptr;
+}
+
+void RGYBitstreamBufPool::release(void *ptr) {
+    const auto classSize = RGYSysFramePool::capacity(ptr);
+    if (classSize == 0) {
+        //nullptr、二重解放、またはプール以外で確保されたバッファ
+        return;
+    }
+    const int bits = classBits(classSize);
+    if (bits <= MAX_CLASS_BITS && ((size_t)1 << bits) == classSize) {
+        auto block = (RGYSysFramePool::BlockHeader *)((uint8_t *)ptr - RGY_FRAME_POOL_HEADER_SIZE);
+        //保持中は二重解放を検出できるよう、プールで保持中の印をつけておく
+        block->magic = RGY_FRAME_POOL_MAGIC_CACHED;
+        for (auto& slot : m_slots[bits - MIN_CLASS_BITS]) {
+            void *expected = nullptr;
+            if (slot.load(std::memory_order_relaxed) == nullptr
+                && slot.compare_exchange_strong(expected, ptr, std::memory_order_release, std::memory_order_relaxed)) {
+                return;
+            }
+        }
+        block->magic = RGY_FRAME_POOL_MAGIC;
+        m_spillCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    RGYSysFramePool::get().release(ptr);
+}
+
+RGYBitstreamBufPool::Stats RGYBitstreamBufPool::stats() const {
+    Stats stats;
+    stats.hitCount   = m_hitCount.load(std::memory_order_relaxed);
+    stats.missCount  = m_missCount.load(std::memory_order_relaxed);
+    stats.spillCount = m_spillCount.load(std::memory_order_relaxed);
+    return stats;
+}
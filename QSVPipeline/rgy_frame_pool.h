@@ -0,0 +1,144 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// -------------------------------------------------------------------------------------------
+
+
+#pragma once
+#ifndef __RGY_FRAME_POOL_H__
+#define __RGY_FRAME_POOL_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <array>
+#include <atomic>
+#include <vector>
+#include <unordered_map>
+
+//フレームバッファをhuge pageで確保するかどうか
+enum class RGYHugePageMode {
+    Disabled, //通常のページ
+    THP,      //Transparent Huge Page (madvise(MADV_HUGEPAGE))
+    HugeTLB,  //hugetlbfsの予約ページ / Windowsのラージページ (確保できなければTHP→通常のページにフォールバック)
+};
+
+//プロセス全体で共有するシステムメモリ上のフレームバッファのプール
+//MFXの再初期化やtrimによる再起動、並列エンコードの各チャンクの開始のたびに
+//同じサイズのフレームバッファの確保・解放が繰り返され、ページフォールトが集中して処理が止まるのを防ぐ
+//解放されたバッファはサイズクラスごとに保持しておき、次に同じサイズクラスの確保があった場合に再利用する
+//(同じ解像度・色空間・ビット深度のフレームは同じサイズとなるので、サイズクラスで管理すれば
+// MFXのサーフェスとRGYSysFrameとの間でもバッファを共有できる)
+class RGYSysFramePool {
+public:
+    struct Stats {
+        uint64_t allocCount;    //alloc()の呼び出し回数
+        uint64_t reuseCount;    //そのうちプールのバッファを再利用した回数
+        size_t   usedBytes;     //現在使用中のバッファのサイズ
+        size_t   cachedBytes;   //現在プールに保持しているバッファのサイズ
+        size_t   peakBytes;     //使用中 + 保持しているバッファのサイズの最大値
+        uint64_t blockCount;    //新規に確保したバッファの数
+        uint64_t hugeTLBCount;  //そのうちhugetlbfs/ラージページで確保したバッファの数
+        uint64_t thpCount;      //そのうちTHPを要求したバッファの数
+    };
+    static const size_t MAX_CACHE_BYTES_DEFAULT = (size_t)1024 * 1024 * 1024;
+
+    //プロセス全体で共有されるプールを取得する
+    static RGYSysFramePool& get();
+    //alloc()で確保したバッファの利用可能なサイズ (サイズクラス) を返す (alloc()で確保したもの以外の場合は0)
+    static size_t capacity(const void *ptr);
+
+    //64byteアラインされたバッファを確保する (失敗した場合はnullptr)
+    void *alloc(size_t size);
+    //alloc()で確保したバッファをプールに返却する (alloc()で確保したもの以外を渡してはならない)
+    //保持しているバッファがmaxCacheBytesを超える場合は即座に解放する
+    void release(void *ptr);
+    //プールに保持しているバッファをすべて解放する
+    void trim();
+    //プールに保持するバッファのサイズの上限を設定する (0 = 保持しない)
+    void setMaxCacheBytes(size_t bytes);
+    //以降に新規に確保する2MB以上のバッファをhuge pageで確保するかを設定する
+    void setHugePageMode(RGYHugePageMode mode);
+    Stats stats() const;
+
+    RGYSysFramePool(const RGYSysFramePool&) = delete;
+    RGYSysFramePool& operator=(const RGYSysFramePool&) = delete;
+protected:
+    friend class RGYBitstreamBufPool;
+    struct BlockHeader;
+    RGYSysFramePool();
+    ~RGYSysFramePool();
+    static size_t sizeClass(size_t size);
+    BlockHeader *allocBlock(size_t classSize, RGYHugePageMode hugePageMode);
+    void freeBlock(BlockHeader *block);
+
+    mutable std::mutex m_mtx;
+    std::unordered_map<size_t, std::vector<BlockHeader *>> m_free; //サイズクラスごとの未使用のバッファ
+    size_t m_maxCacheBytes;
+    RGYHugePageMode m_hugePageMode;
+    Stats m_stats;
+};
+
+//エンコード結果(ビットストリーム)のバッファのプール
+//ビットストリームのサイズはフレームごとに大きく変動するので、2のべき乗のサイズクラスに丸めて確保し、
+//大きなIフレームのために拡張したバッファも、後続のフレームで再利用できるようにする
+//サイズクラスごとに少数のバッファをロックなしで保持しておき、
+//あふれた分や範囲外のサイズのバッファはRGYSysFramePoolで確保・解放する
+class RGYBitstreamBufPool {
+public:
+    struct Stats {
+        uint64_t hitCount;   //ロックなしで保持しているバッファを再利用した回数
+        uint64_t missCount;  //RGYSysFramePoolから確保した回数
+        uint64_t spillCount; //保持しきれずにRGYSysFramePoolに返却した回数
+    };
+    //プロセス全体で共有されるプールを取得する
+    static RGYBitstreamBufPool& get();
+
+    //size以上のバッファを確保し、実際に利用可能なサイズをcapacityに返す (失敗した場合はnullptr)
+    void *alloc(size_t size, size_t *capacity);
+    //alloc()で確保したバッファを返却する
+    void release(void *ptr);
+    //alloc(size)で確保されるバッファの利用可能なサイズ (サイズクラス) を返す
+    static size_t allocSize(size_t size);
+    Stats stats() const;
+
+    RGYBitstreamBufPool(const RGYBitstreamBufPool&) = delete;
+    RGYBitstreamBufPool& operator=(const RGYBitstreamBufPool&) = delete;
+protected:
+    static const int MIN_CLASS_BITS = 12; //4KB
+    static const int MAX_CLASS_BITS = 30; //1GB
+    static const int SLOT_COUNT = 8;      //サイズクラスごとに保持するバッファの数
+    RGYBitstreamBufPool();
+    ~RGYBitstreamBufPool();
+    static int classBits(size_t size);
+
+    //サイズクラスごとの未使用のバッファ (空きはnullptr)
+    std::array<std::array<std::atomic<void *>, SLOT_COUNT>, MAX_CLASS_BITS - MIN_CLASS_BITS + 1> m_slots;
+    std::atomic<uint64_t> m_hitCount;
+    std::atomic<uint64_t> m_missCount;
+    std::atomic<uint64_t> m_spillCount;
+};
+
+#endif //__RGY_FRAME_POOL_H__
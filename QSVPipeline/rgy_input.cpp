@@ -79,22 +79,6 @@ const char *csp_rgy_to_y4mheader(const RGY_CSP csp) {
     return nullptr;
 }
 
-RGYConvertCSPPrm::RGYConvertCSPPrm() :
-    abort(false),
-    dst(nullptr),
-    src(nullptr),
-    interlaced(false),
-    width(0),
-    src_y_pitch_byte(0),
-    src_uv_pitch_byte(0),
-    dst_y_pitch_byte(0),
-    height(0),
-    dst_height(0),
-    crop(nullptr) {
-
-}
-
-
 RGYConvertCSP::RGYConvertCSP() : RGYConvertCSP(0, RGYParamThread()) {
 }
 
@@ -105,22 +89,13 @@ RGYConvertCSP::RGYConvertCSP(int threads, RGYParamThread threadParam) :
     m_uv_only(false),
     m_alpha(nullptr),
     m_threads(threads),
-    m_th(), m_heStart(), m_heFin(), m_heFinCopy(),
-    m_threadParam(threadParam), m_prm() {
+    m_pool(),
+    m_tileBytes(0),
+    m_threadParam(threadParam) {
 };
 
 RGYConvertCSP::~RGYConvertCSP() {
-    m_prm.abort = true;
-    for (size_t i = 0; i < m_heStart.size(); i++) {
-        SetEvent(m_heStart[i].get());
-    }
-    for (size_t i = 0; i < m_th.size(); i++) {
-        m_th[i].join();
-    }
-    m_heFinCopy.clear();
-    m_heStart.clear();
-    m_heFin.clear();
-    m_th.clear();
+    m_pool.reset();
 };
 const ConvertCSP *RGYConvertCSP::getFunc(RGY_CSP csp_from, RGY_CSP csp_to, bool uv_only, RGY_SIMD simd) {
     if (m_csp == nullptr
@@ -138,72 +113,56 @@ const ConvertCSP *RGYConvertCSP::getFunc(RGY_CSP csp_from, RGY_CSP csp_to, RGY_S
     return getFunc(csp_from, csp_to, m_uv_only, simd);
 }
 
+int RGYConvertCSP::getTileCount(int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height) {
+    if (m_tileBytes == 0) {
+        // L2キャッシュの半分をひとつのタイルの作業領域とする
+        const auto& cpu = get_cpu_info();
+        const int cacheL2 = (cpu.cache_count[(int)RGYCacheLevel::L2 - 1] > 0) ? cpu.caches[(int)RGYCacheLevel::L2 - 1][0].size : 0;
+        m_tileBytes = (cacheL2 > 0) ? cacheL2 / 2 : CONVERT_CSP_TILE_BYTES_DEFAULT;
+    }
+    // 1行あたりの読み書きの量 (UV成分は4:4:4の場合も考慮して多めに見積もる)
+    const int64_t rowBytes = (int64_t)src_y_pitch_byte + 2 * (int64_t)src_uv_pitch_byte + 2 * (int64_t)dst_y_pitch_byte;
+    const int tileRows = (int)clamp(m_tileBytes / std::max<int64_t>(rowBytes, 1), (int64_t)CONVERT_CSP_TILE_ROWS_MIN, (int64_t)height);
+    const int tileCount = (height + tileRows - 1) / tileRows;
+    // 少なくともスレッド数分には分割する
+    return std::max(tileCount, m_threads);
+}
+
 int RGYConvertCSP::run(int interlaced, void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int *crop) {
     if (m_threads == 0) {
         const int div = (m_csp->simd == RGY_SIMD::NONE) ? 2 : 4;
         const int max = (m_csp->simd == RGY_SIMD::NONE) ? 8 : 4;
         m_threads = (dst_y_pitch_byte % 128 != 0) ? 1 : std::min(max, ((int)get_cpu_info().physical_cores + div) / div);
     }
-    if (m_threads > 1 && m_th.size() == 0) {
-        m_heFinCopy.clear();
-        m_heStart.clear();
-        m_heFin.clear();
-        for (int ith = 0; ith < m_threads; ith++) {
-            auto heStart = std::unique_ptr<void, handle_deleter>(CreateEvent(nullptr, false, false, nullptr), handle_deleter());
-            auto heFin = std::unique_ptr<void, handle_deleter>(CreateEvent(nullptr, false, false, nullptr), handle_deleter());
-            m_th.push_back(std::thread([heStart = heStart.get(), heFin = heFin.get(), ithId = ith, threadN = m_threads, threadParam = m_threadParam,
-                prm = &m_prm, cspfunc = &m_csp, alphafunc = m_alpha, csp_from = m_csp_from, csp_to = m_csp_to]() {
-                threadParam.apply(GetCurrentThread());
-                WaitForSingleObject((HANDLE)heStart, INFINITE);
-                while (!prm->abort) {
-                    (*cspfunc)->func[prm->interlaced](prm->dst, prm->src,
-                        prm->width, prm->src_y_pitch_byte, prm->src_uv_pitch_byte, prm->dst_y_pitch_byte,
-                        prm->height, prm->dst_height, ithId, threadN, prm->crop);
-                    if (alphafunc) {
-                        const int dstPlaneOffset = RGY_CSP_PLANES[csp_from] - 1;
-                        const int srcPlaneOffset = RGY_CSP_PLANES[csp_to] - 1;
-                        alphafunc(prm->dst + dstPlaneOffset, prm->src + srcPlaneOffset,
-                            prm->width, prm->src_y_pitch_byte, 0, prm->dst_y_pitch_byte,
-                            prm->height, prm->dst_height, ithId, threadN, prm->crop);
-                    }
-                    SetEvent((HANDLE)heFin);
-                    WaitForSingleObject((HANDLE)heStart, INFINITE);
-                }
-            }));
-            m_heFinCopy.push_back(heFin.get());
-            m_heStart.push_back(std::move(heStart));
-            m_heFin.push_back(std::move(heFin));
-        }
+    if (m_threads > 1 && !m_pool) {
+        m_pool = RGYThreadPool::get(m_threadParam);
     }
-    m_prm.abort = false;
-    m_prm.interlaced = interlaced;
-    m_prm.dst = dst;
-    m_prm.src = src;
-    m_prm.width = width;
-    m_prm.src_y_pitch_byte = src_y_pitch_byte;
-    m_prm.src_uv_pitch_byte = src_uv_pitch_byte;
-    m_prm.dst_y_pitch_byte = dst_y_pitch_byte;
-    m_prm.height = height;
-    m_prm.dst_height = dst_height;
-    m_prm.crop = crop;
-    for (size_t i = 0; i < m_heStart.size(); i++) {
-        SetEvent(m_heStart[i].get());
-    }
-    if (m_threads == 1) {
+    const int tileCount = getTileCount(src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte, height);
+    // 各タイルではY成分とUV成分をまとめて処理するので、タイル内の読み書きはL2キャッシュ上で完結する
+    auto convertTile = [&](int tileId) {
         m_csp->func[interlaced](dst, src,
             width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte,
-            height, dst_height, 0, 1, crop);
+            height, dst_height, tileId, tileCount, crop);
         if (m_alpha) {
             const int dstPlaneOffset = RGY_CSP_PLANES[m_csp_from] - 1;
             const int srcPlaneOffset = RGY_CSP_PLANES[m_csp_to] - 1;
             m_alpha(dst + dstPlaneOffset, src + srcPlaneOffset,
                 width, src_y_pitch_byte, src_uv_pitch_byte, dst_y_pitch_byte,
-                height, dst_height, 0, 1, crop);
+                height, dst_height, tileId, tileCount, crop);
         }
+    };
+    // 各タイルはthread_y_rangeで4行単位に揃えた重ならない行の範囲を処理する (出力先の各平面の行数は4行単位に切り上げて確保されている前提)
+    // ただし、SIMD版の関数は幅をベクトル長に切り上げて書き込むので、出力のpitchが128の倍数でない場合は
+    // 行末の書き込みが次の行(=隣のタイル)にはみ出す可能性があり、タイルを並列に処理しない
+    // タイル分割の有無で結果が変わらないことは--check-convert-cspで確認できる
+    const bool parallelTiles = m_threads > 1 && m_pool && (dst_y_pitch_byte % 128 == 0);
+    if (!parallelTiles) {
+        for (int tileId = 0; tileId < tileCount; tileId++) {
+            convertTile(tileId);
+        }
+        return 0;
     }
-    if (m_th.size() > 0) {
-        WaitForMultipleObjects((uint32_t)m_heFinCopy.size(), m_heFinCopy.data(), TRUE, INFINITE);
-    }
+    m_pool->parallel_for(tileCount, convertTile, m_threads);
     return 0;
 }
 
@@ -398,6 +357,7 @@ static RGY_ERR initOtherReaders(
         inputInfoAVAudioReader.inputRetry = common->inputRetry;
         inputInfoAVAudioReader.analyzeSec = common->demuxAnalyzeSec;
         inputInfoAVAudioReader.probesize = common->demuxProbesize;
+        inputInfoAVAudioReader.readAheadDepth = common->inputReadAhead;
         inputInfoAVAudioReader.nTrimCount = common->nTrimCount;
         inputInfoAVAudioReader.pTrimList = common->pTrimList;
         inputInfoAVAudioReader.trackStartAudio = sourceAudioTrackIdStart;
@@ -569,6 +529,7 @@ RGY_ERR initReaders(
 
     RGYInputPrmRaw inputPrmRaw(inputPrm);
     inputPrmRaw.inputCsp = inputCspOfRawReader;
+    inputPrmRaw.threadParamInput = ctrl->threadParams.get(RGYThreadType::INPUT);
 #if ENABLE_AVISYNTH_READER
     RGYInputAvsPrm inputPrmAvs(inputPrm);
 #endif
@@ -629,6 +590,7 @@ RGY_ERR initReaders(
         inputInfoAVCuvid.videoAvgFramerate = rgy_rational<int>(input->fpsN, input->fpsD);
         inputInfoAVCuvid.analyzeSec = common->demuxAnalyzeSec;
         inputInfoAVCuvid.probesize = common->demuxProbesize;
+        inputInfoAVCuvid.readAheadDepth = common->inputReadAhead;
         inputInfoAVCuvid.pixFmtStr = common->inputPixFmtStr;
         inputInfoAVCuvid.inputRetry = common->inputRetry;
         inputInfoAVCuvid.nTrimCount = common->nTrimCount;
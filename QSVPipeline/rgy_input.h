@@ -43,6 +43,7 @@
 #include "rgy_prm.h"
 #include "rgy_avutil.h"
 #include "rgy_frame.h"
+#include "rgy_thread_pool.h"
 #if ENCODER_NVENC
 #include "NVEncUtil.h"
 #endif //#if ENCODER_NVENC
@@ -120,21 +121,8 @@ static const char *trackMediaTypeStr(int trackID) {
 }
 #endif //#if ENABLE_AVSW_READER
 
-struct RGYConvertCSPPrm {
-    bool abort;
-    void **dst;
-    const void **src;
-    int interlaced;
-    int width;
-    int src_y_pitch_byte;
-    int src_uv_pitch_byte;
-    int dst_y_pitch_byte;
-    int height;
-    int dst_height;
-    int *crop;
-
-    RGYConvertCSPPrm();
-};
+static const int CONVERT_CSP_TILE_BYTES_DEFAULT = 512 * 1024; // L2キャッシュのサイズが取得できない場合のタイルの作業領域のサイズ
+static const int CONVERT_CSP_TILE_ROWS_MIN = 16; // タイルの最小の行数
 
 class RGYConvertCSP {
 private:
@@ -144,12 +132,11 @@ private:
     bool m_uv_only;
     funcConvertCSP m_alpha;
     int m_threads;
-    std::vector<std::thread> m_th;
-    std::vector<std::unique_ptr<void, handle_deleter>> m_heStart;
-    std::vector<std::unique_ptr<void, handle_deleter>> m_heFin;
-    std::vector<HANDLE> m_heFinCopy;
+    std::shared_ptr<RGYThreadPool> m_pool; // プロセス全体で共有するスレッドプール
+    int64_t m_tileBytes; // ひとつのタイルで読み書きする量の目安 (L2キャッシュのサイズから決める)
     RGYParamThread m_threadParam;
-    RGYConvertCSPPrm m_prm;
+
+    int getTileCount(int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height);
 public:
     RGYConvertCSP();
     RGYConvertCSP(int threads, RGYParamThread threadParam);
@@ -161,6 +148,13 @@ public:
     int run(int interlaced, void **dst, const void **src, int width, int src_y_pitch_byte, int src_uv_pitch_byte, int dst_y_pitch_byte, int height, int dst_height, int *crop);
 };
 
+//並列エンコードのチャンク分割に使用するキーフレームごとの情報
+struct RGYInputKeyframeInfo {
+    double sec;      //最初のキーフレームからの時刻 (秒)
+    double duration; //次のキーフレームまでの長さ (秒)
+    int64_t bytes;   //次のキーフレームまでのパケットサイズの合計
+};
+
 class RGYInputPrm {
 public:
     int threadCsp;
@@ -239,6 +233,11 @@ public:
     virtual int64_t GetVideoFirstKeyPts() const {
         return -1;
     }
+    //demuxerのインデックスから、キーフレームごとの位置とサイズを取得する
+    //インデックスがない場合は空を返す
+    virtual std::vector<RGYInputKeyframeInfo> GetKeyframeIndex() const {
+        return std::vector<RGYInputKeyframeInfo>();
+    }
     virtual bool rffAware() const {
         return false;
     }
@@ -54,6 +54,15 @@ static inline void extend_array_size(VideoFrameData *dataset) {
     memset(dataset->frame + current_cap, 0, sizeof(dataset->frame[0]) * (dataset->capacity - current_cap));
 }
 
+static int funcReadPacket(void *opaque, uint8_t *buf, int buf_size) {
+    RGYInputAvcodec *reader = reinterpret_cast<RGYInputAvcodec *>(opaque);
+    return reader->readPacket(buf, buf_size);
+}
+static int64_t funcSeek(void *opaque, int64_t offset, int whence) {
+    RGYInputAvcodec *reader = reinterpret_cast<RGYInputAvcodec *>(opaque);
+    return reader->seek(offset, whence);
+}
+
 #define CLOSE_LOG_DEBUG(x) { if (log) log->write(RGY_LOG_DEBUG, RGY_LOGT_IN, (x)); }
 
 AVDemuxFormat::AVDemuxFormat() :
@@ -69,40 +78,40 @@ AVDemuxFormat::AVDemuxFormat() :
     attachmentTracks(0),
     AVSyncMode(RGY_AVSYNC_AUTO),
     formatOptions(nullptr),
-    fpInput(nullptr),
-    inputBuffer(nullptr),
-    inputBufferSize(0),
-    inputFilesize(0),
+    readAhead(),
+    readAheadIO(nullptr),
     subPacketTemporalBufferIntervalCount(-1),
     inputError(RGY_ERR_NONE) {
 }
 
 void AVDemuxFormat::close(RGYLog *log) {
     //close video file
-    if (fpInput) {
-        CLOSE_LOG_DEBUG(_T("Closing file pointer...\n"));
-        if (formatCtx) {
-            if (formatCtx->pb) {
-                if (formatCtx->pb->buffer) {
-                    CLOSE_LOG_DEBUG(_T("Closing pb->buffer...\n"));
-                    av_freep(&formatCtx->pb->buffer);
-                    CLOSE_LOG_DEBUG(_T("Closed pb->buffer.\n"));
-                }
-                CLOSE_LOG_DEBUG(_T("Closing avio context...\n"));
-                avio_context_free(&formatCtx->pb);
-                CLOSE_LOG_DEBUG(_T("Closed avio context.\n"));
-            }
-        }
-        fclose(fpInput);
-        CLOSE_LOG_DEBUG(_T("Closed file pointer.\n"));
-        fpInput = nullptr;
-    }
     if (formatCtx) {
         CLOSE_LOG_DEBUG(_T("Closing avformat context...\n"));
         avformat_close_input(&formatCtx);
         CLOSE_LOG_DEBUG(_T("Closed avformat context.\n"));
         formatCtx = nullptr;
     }
+    //AVFMT_FLAG_CUSTOM_IOの場合、avformat_close_inputはpbを解放しない
+    //avformat_open_inputに失敗した場合もここで解放する
+    if (readAheadIO) {
+        CLOSE_LOG_DEBUG(_T("Closing read-ahead avio context...\n"));
+        av_freep(&readAheadIO->buffer);
+        avio_context_free(&readAheadIO);
+        CLOSE_LOG_DEBUG(_T("Closed read-ahead avio context.\n"));
+    }
+    if (readAhead) {
+        if (log && log->getLogLevel(RGY_LOGT_IN) <= RGY_LOG_DEBUG) {
+            const auto stats = readAhead->stats();
+            log->write(RGY_LOG_DEBUG, RGY_LOGT_IN, _T("read-ahead (%s): read %.1f MB in %llu reads, avg latency %.2f ms, waited %.2f ms in %llu reads.\n"),
+                readAhead->engine(), stats.bytesRead / (double)(1024 * 1024), (unsigned long long)stats.readCount,
+                (stats.readCount > 0) ? stats.latencyMicroSec * 1e-3 / stats.readCount : 0.0,
+                stats.waitMicroSec * 1e-3, (unsigned long long)stats.waitCount);
+        }
+        CLOSE_LOG_DEBUG(_T("Closing read-ahead reader...\n"));
+        readAhead.reset();
+        CLOSE_LOG_DEBUG(_T("Closed read-ahead reader.\n"));
+    }
     if (formatOptions) {
         CLOSE_LOG_DEBUG(_T("Free formatOptions...\n"));
         av_dict_free(&formatOptions);
@@ -218,6 +227,7 @@ void AVDemuxThread::close(RGYLog *log) {
 RGYInputAvcodecPrm::RGYInputAvcodecPrm(RGYInputPrm base) :
     RGYInputPrm(base),
     inputRetry(0),
+    readAheadDepth(0),
     memType(0),
     pInputFormat(nullptr),
     readVideo(false),
@@ -1571,6 +1581,32 @@ RGY_ERR RGYInputAvcodec::initFormatCtx(const TCHAR *strFileName, const RGYInputA
             m_Demux.format.formatCtx->video_codec = codec;
         }
     }
+    //ローカルファイルは先読みを行うリーダーを介して読み込む
+    if (input_prm->readAheadDepth > 0
+        && !m_Demux.format.isPipe
+        && strstr(filename_char.c_str(), "://") == nullptr
+        && (inFormat == nullptr || (inFormat->flags & AVFMT_NOFILE) == 0)) {
+        auto readAhead = std::make_unique<RGYFileReadAhead>();
+        auto err = readAhead->open(strFileName, input_prm->readAheadDepth, RGYFileReadAhead::DEFAULT_BLOCK_SIZE);
+        if (err != RGY_ERR_NONE) {
+            //パイプやデバイスなど、通常のファイルでない場合はlibavformatに任せる
+            AddMessage(RGY_LOG_DEBUG, _T("read-ahead disabled for \"%s\": %s.\n"), strFileName, get_err_mes(err));
+        } else {
+            const int ioBufferSize = 256 * 1024;
+            auto ioBuffer = (uint8_t *)av_malloc(ioBufferSize);
+            if (ioBuffer == nullptr
+                || nullptr == (m_Demux.format.readAheadIO = avio_alloc_context(ioBuffer, ioBufferSize, 0, this, funcReadPacket, nullptr, funcSeek))) {
+                av_free(ioBuffer);
+                AddMessage(RGY_LOG_ERROR, _T("failed to allocate avio context for read-ahead.\n"));
+                return RGY_ERR_NULL_PTR;
+            }
+            m_Demux.format.readAhead = std::move(readAhead);
+            m_Demux.format.formatCtx->pb = m_Demux.format.readAheadIO;
+            m_Demux.format.formatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+            AddMessage(RGY_LOG_DEBUG, _T("read-ahead enabled (%s): %d x %d MB.\n"),
+                m_Demux.format.readAhead->engine(), m_Demux.format.readAhead->depth(), (int)(m_Demux.format.readAhead->blockSize() >> 20));
+        }
+    }
     //ファイルのオープン
     if ((ret = avformat_open_input(&(m_Demux.format.formatCtx), filename_char.c_str(), inFormat, &m_Demux.format.formatOptions)) != 0) {
         AddMessage(RGY_LOG_ERROR, _T("error opening file \"%s\": %s\n"), char_to_tstring(filename_char, CP_UTF8).c_str(), qsv_av_err2str(ret).c_str());
@@ -2292,8 +2328,7 @@ RGY_ERR RGYInputAvcodec::Init(const TCHAR *strFileName, VideoInfo *inputInfo, co
                 AddMessage(RGY_LOG_ERROR, _T("failed to set codec param to context for decoder: %s.\n"), qsv_av_err2str(ret).c_str());
                 return RGY_ERR_UNKNOWN;
             }
-            cpu_info_t cpu_info;
-            if (get_cpu_info(&cpu_info)) {
+            if (const auto& cpu_info = get_cpu_info(); cpu_info.logical_cores > 0) {
                 AVDictionary *pDict = nullptr;
                 av_dict_set_int(&pDict, "threads", std::min(cpu_info.logical_cores, 16), 0);
                 if (0 > (ret = av_opt_set_dict(m_Demux.video.codecCtxDecode, &pDict))) {
@@ -2515,6 +2550,52 @@ int64_t RGYInputAvcodec::GetVideoFirstKeyPts() const {
     return m_Demux.video.streamFirstKeyPts;
 }
 
+std::vector<RGYInputKeyframeInfo> RGYInputAvcodec::GetKeyframeIndex() const {
+    std::vector<RGYInputKeyframeInfo> keyframes;
+    //avformat_index_get_entryは非constのAVStreamを要求するが、インデックスの参照のみ
+    AVStream *stream = const_cast<AVStream *>(m_Demux.video.stream);
+    if (stream == nullptr || m_Demux.format.formatCtx == nullptr) {
+        return keyframes;
+    }
+    const double duration = GetInputVideoDuration();
+    const double timebase = av_q2d(stream->time_base);
+    std::vector<int64_t> keyframePos;
+    int64_t totalBytes = 0;
+    const int entries = avformat_index_get_entries_count(stream);
+    for (int i = 0; i < entries; i++) {
+        const AVIndexEntry *entry = avformat_index_get_entry(stream, i);
+        if (entry == nullptr || entry->timestamp == AV_NOPTS_VALUE) {
+            continue;
+        }
+        const double sec = std::max(0.0, (entry->timestamp - m_Demux.video.streamFirstKeyPts) * timebase);
+        //時刻の戻るキーフレームは直前のキーフレームの一部として扱う
+        if ((entry->flags & AVINDEX_KEYFRAME) && (keyframes.size() == 0 || sec > keyframes.back().sec)) {
+            keyframes.push_back({ sec, 0.0, 0 });
+            keyframePos.push_back(entry->pos);
+        }
+        if (keyframes.size() > 0) {
+            keyframes.back().bytes += entry->size;
+            totalBytes += entry->size;
+        }
+    }
+    if (keyframes.size() == 0) {
+        return keyframes;
+    }
+    //キーフレームのみのインデックス (mkvのCuesなど) ではサイズが入っていないので、ファイル上の位置の差で代用する
+    if (totalBytes == 0) {
+        const int64_t fileSize = (m_Demux.format.formatCtx->pb) ? avio_size(m_Demux.format.formatCtx->pb) : -1;
+        for (size_t i = 0; i < keyframes.size(); i++) {
+            const int64_t nextPos = (i + 1 < keyframes.size()) ? keyframePos[i + 1] : fileSize;
+            keyframes[i].bytes = std::max<int64_t>(0, nextPos - keyframePos[i]);
+        }
+    }
+    for (size_t i = 0; i < keyframes.size(); i++) {
+        const double nextSec = (i + 1 < keyframes.size()) ? keyframes[i + 1].sec : duration;
+        keyframes[i].duration = std::max(0.0, nextSec - keyframes[i].sec);
+    }
+    return keyframes;
+}
+
 FramePosList *RGYInputAvcodec::GetFramePosList() {
     return &m_Demux.frames;
 }
@@ -3126,7 +3207,7 @@ const AVStream *RGYInputAvcodec::GetInputVideoStream() const {
     return m_Demux.video.stream;
 }
 
-double RGYInputAvcodec::GetInputVideoDuration() {
+double RGYInputAvcodec::GetInputVideoDuration() const {
     double duration = m_Demux.format.formatCtx->duration * (1.0 / (double)AV_TIME_BASE);
     if (m_seek.second > 0.0f) {
         duration = std::min<double>(duration, m_seek.second);
@@ -3164,6 +3245,29 @@ bool RGYInputAvcodec::isPipe() const {
     return m_Demux.format.isPipe;
 }
 
+int RGYInputAvcodec::readPacket(uint8_t *buf, int buf_size) {
+    const auto ret = m_Demux.format.readAhead->read(buf, buf_size);
+    if (m_Demux.thread.queueInfo) {
+        const auto stats = m_Demux.format.readAhead->stats();
+        m_Demux.thread.queueInfo->readahead_read = stats.bytesRead;
+        m_Demux.thread.queueInfo->readahead_count = stats.readCount;
+        m_Demux.thread.queueInfo->readahead_latency_us = stats.latencyMicroSec;
+        m_Demux.thread.queueInfo->readahead_wait_us = stats.waitMicroSec;
+    }
+    if (ret < 0) {
+        AddMessage(RGY_LOG_ERROR, _T("failed to read input file at %lld: %s.\n"), (long long)m_Demux.format.readAhead->pos(), qsv_av_err2str((int)ret).c_str());
+        return (int)ret; //-errnoはそのままAVERROR(errno)となる
+    }
+    return (ret == 0) ? AVERROR_EOF : (int)ret;
+}
+
+int64_t RGYInputAvcodec::seek(int64_t offset, int whence) {
+    if (whence & AVSEEK_SIZE) {
+        return m_Demux.format.readAhead->size();
+    }
+    return m_Demux.format.readAhead->seek(offset, whence & ~AVSEEK_FORCE);
+}
+
 //qStreamPktL1をチェックし、framePosListから必要な音声パケットかどうかを判定し、
 //必要ならqStreamPktL2に移し、不要ならパケットを開放する
 void RGYInputAvcodec::CheckAndMoveStreamPacketList() {
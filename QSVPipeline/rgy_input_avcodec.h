@@ -37,6 +37,7 @@
 #include "rgy_queue.h"
 #include "rgy_perf_monitor.h"
 #include "rgy_bitstream.h"
+#include "rgy_async_io.h"
 #include "convert_csp.h"
 #include <deque>
 #include <set>
@@ -716,10 +717,8 @@ struct AVDemuxFormat {
     RGYAVSync                 AVSyncMode;            //音声・映像同期モード
     AVDictionary             *formatOptions;         //avformat_open_inputに渡すオプション
 
-    FILE                     *fpInput;               //入力ファイルポインタ
-    char                     *inputBuffer;           //入力バッファ
-    int                       inputBufferSize;       //入力バッファサイズ
-    uint64_t                  inputFilesize;         //入力ファイルサイズ
+    std::unique_ptr<RGYFileReadAhead> readAhead;     //ローカルファイルの先読みを行うリーダー
+    AVIOContext              *readAheadIO;           //readAheadから読み込むAVIOContext
 
     int64_t                   subPacketTemporalBufferIntervalCount; //字幕のタイムスタンプが入れ違いになっているのを解決する一時的なキューに登録を行ってから他のパケットを取得した数
     RGY_ERR                   inputError;
@@ -807,6 +806,7 @@ struct AVDemuxer {
 class RGYInputAvcodecPrm : public RGYInputPrm {
 public:
     int            inputRetry;              //ファイルオープンを再試行する回数
+    int            readAheadDepth;          //ローカルファイルの先読みで同時に発行する読み込みの数 (0で無効)
     uint8_t        memType;                 //使用するメモリの種類
     const TCHAR   *pInputFormat;            //入力フォーマット
     bool           readVideo;               //映像の読み込みを行うかどうか
@@ -887,7 +887,7 @@ public:
     const AVStream *GetInputVideoStream() const;
 
     //動画の長さを取得する
-    double GetInputVideoDuration();
+    double GetInputVideoDuration() const;
 
     //音声・字幕パケットの配列を取得する
     virtual std::vector<AVPacket*> GetStreamDataPackets(int inputFrame) override;
@@ -928,6 +928,9 @@ public:
     //動画の最初のフレームのptsを取得する
     virtual int64_t GetVideoFirstKeyPts() const override;
 
+    //demuxerのインデックスから、キーフレームごとの位置とサイズを取得する
+    virtual std::vector<RGYInputKeyframeInfo> GetKeyframeIndex() const override;
+
     //入力に使用可能なdeviceIDを取得する
     const std::set<int>& GetHWDecDeviceID() const;
 
@@ -949,11 +952,9 @@ public:
     //並列エンコードの親側で不要なデコーダを終了させる
     void CloseVideoDecoder();
 
-#if USE_CUSTOM_INPUT
+    //readAheadIOのコールバック
     int readPacket(uint8_t *buf, int buf_size);
-    int writePacket(uint8_t *buf, int buf_size);
     int64_t seek(int64_t offset, int whence);
-#endif //USE_CUSTOM_INPUT
 protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, VideoInfo *inputInfo, const RGYInputPrm *prm) override;
 
@@ -27,7 +27,13 @@
 
 #include <sstream>
 #include <fcntl.h>
+#if !(defined(_WIN32) || defined(_WIN64))
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
 #include "rgy_input_raw.h"
+#include "rgy_frame_pool.h"
 
 #if ENABLE_RAW_READER
 
@@ -116,7 +122,21 @@ RGYInputRaw::RGYInputRaw() :
     m_fSource(NULL),
     m_nBufSize(0),
     m_pBuffer(),
-    m_isPipe(false) {
+    m_isPipe(false),
+    m_frameSize(0),
+    m_overread(0),
+    m_mapPtr(nullptr),
+    m_mapSize(0),
+    m_mapPos(0),
+#if defined(_WIN32) || defined(_WIN64)
+    m_mapHandle(NULL),
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_threadParam(),
+    m_thRead(),
+    m_thReadAbort(false),
+    m_qFrameBufRead(),
+    m_qFrameBufFree(),
+    m_frameBufAllocated(0) {
     m_readerName = _T("raw");
 }
 
@@ -125,6 +145,26 @@ RGYInputRaw::~RGYInputRaw() {
 }
 
 void RGYInputRaw::Close() {
+    if (m_thRead.joinable()) {
+        m_thReadAbort = true;
+        m_thRead.join();
+        AddMessage(RGY_LOG_DEBUG, _T("Closed read thread.\n"));
+        //スレッド終了後は、すべてのバッファがいずれかのキューに戻っている
+        for (auto queue : { &m_qFrameBufRead, &m_qFrameBufFree }) {
+            RGYInputRawFrameBuf buf;
+            while (m_frameBufAllocated > 0 && queue->front_copy_and_pop_no_lock(&buf)) {
+                if (buf.ptr) {
+                    RGYSysFramePool::get().release(buf.ptr);
+                    m_frameBufAllocated--;
+                }
+            }
+        }
+    }
+    m_qFrameBufRead.close();
+    m_qFrameBufFree.close();
+    m_frameBufAllocated = 0;
+    m_thReadAbort = false;
+    closeMap();
     if (m_fSource) {
         fclose(m_fSource);
         m_fSource = NULL;
@@ -134,9 +174,262 @@ void RGYInputRaw::Close() {
     RGYInput::Close();
 }
 
+uint32_t RGYInputRaw::calcFrameSize(const RGY_CSP csp) const {
+    uint32_t frameSize = 0;
+    switch (csp) {
+    case RGY_CSP_NV12:
+    case RGY_CSP_YV12:
+        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3 / 2; break;
+    case RGY_CSP_P010:
+        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3; break;
+    case RGY_CSP_YUV422:
+        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 2; break;
+    case RGY_CSP_YUV444:
+        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3; break;
+    case RGY_CSP_YV12_09:
+    case RGY_CSP_YV12_10:
+    case RGY_CSP_YV12_12:
+    case RGY_CSP_YV12_14:
+    case RGY_CSP_YV12_16:
+        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3; break;
+    case RGY_CSP_YUV422_09:
+    case RGY_CSP_YUV422_10:
+    case RGY_CSP_YUV422_12:
+    case RGY_CSP_YUV422_14:
+    case RGY_CSP_YUV422_16:
+        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 4; break;
+    case RGY_CSP_YUV444_09:
+    case RGY_CSP_YUV444_10:
+    case RGY_CSP_YUV444_12:
+    case RGY_CSP_YUV444_14:
+    case RGY_CSP_YUV444_16:
+        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 6; break;
+    default:
+        return 0;
+    }
+    if (rgy_csp_has_alpha(csp)) {
+        frameSize += m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight;
+    }
+    return frameSize;
+}
+
+//trimで使用しないフレームかどうか (使用しないフレームは後段で破棄されるので、色変換を省略できる)
+bool RGYInputRaw::isFrameRequired(const int iframe) const {
+    return m_trimParam.list.size() == 0 || frame_inside_range(iframe, m_trimParam.list).first;
+}
+
+RGY_ERR RGYInputRaw::initMap() {
+    //32bit環境ではアドレス空間が足りなくなるので使用しない
+    if (m_isPipe || sizeof(void *) < 8) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    const int64_t pos = _ftelli64(m_fSource);
+    if (pos < 0) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE hFile = (HANDLE)_get_osfhandle(_fileno(m_fSource));
+    LARGE_INTEGER fileSize = { 0 };
+    if (hFile == INVALID_HANDLE_VALUE
+        || GetFileType(hFile) != FILE_TYPE_DISK
+        || !GetFileSizeEx(hFile, &fileSize)
+        || fileSize.QuadPart <= 0) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    m_mapHandle = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mapHandle == NULL) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    m_mapPtr = (uint8_t *)MapViewOfFile(m_mapHandle, FILE_MAP_READ, 0, 0, 0);
+    if (m_mapPtr == nullptr) {
+        closeMap();
+        return RGY_ERR_UNSUPPORTED;
+    }
+    m_mapSize = fileSize.QuadPart;
+#else
+    struct stat st;
+    const int fd = fileno(m_fSource);
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    void *ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        return RGY_ERR_UNSUPPORTED;
+    }
+    //先頭から順に読むので、先読みを積極的に行い、読み終わったページは早めに解放させる
+    madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+    m_mapPtr = (uint8_t *)ptr;
+    m_mapSize = st.st_size;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_mapPos = pos;
+    return RGY_ERR_NONE;
+}
+
+void RGYInputRaw::closeMap() {
+#if defined(_WIN32) || defined(_WIN64)
+    if (m_mapPtr) {
+        UnmapViewOfFile(m_mapPtr);
+    }
+    if (m_mapHandle) {
+        CloseHandle(m_mapHandle);
+        m_mapHandle = NULL;
+    }
+#else
+    if (m_mapPtr) {
+        munmap(m_mapPtr, m_mapSize);
+    }
+#endif //#if defined(_WIN32) || defined(_WIN64)
+    m_mapPtr = nullptr;
+    m_mapSize = 0;
+    m_mapPos = 0;
+}
+
+RGY_ERR RGYInputRaw::LoadNextFrameMap(const uint8_t **ptrFrame) {
+    *ptrFrame = nullptr;
+    if (m_inputVideoInfo.type == RGY_INPUT_FMT_Y4M) {
+        const char *header = (const char *)m_mapPtr + m_mapPos;
+        const int64_t remain = m_mapSize - m_mapPos;
+        if (remain < (int64_t)strlen("FRAME")
+            || memcmp(header, "FRAME", strlen("FRAME")) != 0) {
+            AddMessage(RGY_LOG_DEBUG, _T("header1: finish.\n"));
+            return RGY_ERR_MORE_DATA;
+        }
+        int64_t i = strlen("FRAME");
+        // header[i]を読む前に、マップした範囲内かを確認する
+        for (; i < remain && i < (int64_t)strlen("FRAME") + 64 && header[i] != '\n'; i++) {
+        }
+        if (i >= remain || header[i] != '\n') {
+            AddMessage(RGY_LOG_DEBUG, _T("header3: finish.\n"));
+            return RGY_ERR_MORE_DATA;
+        }
+        m_mapPos += i + 1;
+    }
+    if (m_mapPos + m_frameSize > m_mapSize) {
+        AddMessage(RGY_LOG_DEBUG, _T("mmap: finish: %d.\n"), m_frameSize);
+        return RGY_ERR_MORE_DATA;
+    }
+    const uint8_t *ptr = m_mapPtr + m_mapPos;
+    m_mapPos += m_frameSize;
+    const int iframe = (int)m_encSatusInfo->m_sData.frameIn;
+    if (!isFrameRequired(iframe)) {
+        return RGY_ERR_NONE; //ファイル上の位置を進めるだけで、データには触れない
+    }
+    if (m_mapPos + m_overread > m_mapSize) {
+        //ファイル末尾では、色変換時の読みすぎでマップ外にアクセスしないようコピーしてから渡す
+        memcpy(m_pBuffer.get(), ptr, m_frameSize);
+        ptr = m_pBuffer.get();
+    }
+    *ptrFrame = ptr;
+#if !(defined(_WIN32) || defined(_WIN64))
+    //色変換の間に次のフレームの読み込みを開始させる
+    if (isFrameRequired(iframe + 1)) {
+        static const int64_t pageSize = sysconf(_SC_PAGESIZE);
+        const int64_t prefetchStart = m_mapPos & ~(pageSize - 1);
+        const int64_t prefetchEnd = std::min<int64_t>(m_mapPos + m_frameSize + 64, m_mapSize);
+        if (prefetchStart < prefetchEnd) {
+            madvise(m_mapPtr + prefetchStart, prefetchEnd - prefetchStart, MADV_WILLNEED);
+        }
+    }
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYInputRaw::ReadThreadFunc(RGYParamThread threadParam) {
+    threadParam.apply(GetCurrentThread());
+    AddMessage(RGY_LOG_DEBUG, _T("Set input thread param: %s.\n"), threadParam.desc().c_str());
+    RGY_ERR err = RGY_ERR_NONE;
+    for (int iframe = 0; !m_thReadAbort; iframe++) {
+        if ((m_inputVideoInfo.frames > 0 && iframe >= m_inputVideoInfo.frames)
+            || getVideoTrimMaxFramIdx() < iframe - TRIM_OVERREAD_FRAMES) {
+            break;
+        }
+        RGYInputRawFrameBuf buf;
+        if (m_frameBufAllocated < FRAME_BUF_COUNT) {
+            //まだ確保数に達していなければ、新たに確保する
+            buf.ptr = (uint8_t *)RGYSysFramePool::get().alloc(m_frameSize + m_overread);
+            if (!buf.ptr) {
+                AddMessage(RGY_LOG_ERROR, _T("Failed to allocate input buffer.\n"));
+                err = RGY_ERR_NULL_PTR;
+                break;
+            }
+            m_frameBufAllocated++;
+        } else {
+            while (!m_qFrameBufFree.front_copy_and_pop_no_lock(&buf)) {
+                if (m_thReadAbort) {
+                    break;
+                }
+                m_qFrameBufFree.wait_for_push();
+            }
+            if (!buf.ptr) {
+                break;
+            }
+        }
+        if (m_inputVideoInfo.type == RGY_INPUT_FMT_Y4M) {
+            uint8_t y4m_buf[8] = { 0 };
+            if (_fread_nolock(y4m_buf, 1, strlen("FRAME"), m_fSource) != strlen("FRAME")) {
+                AddMessage(RGY_LOG_DEBUG, _T("header1: finish.\n"));
+                m_qFrameBufFree.push(buf);
+                break;
+            }
+            if (memcmp(y4m_buf, "FRAME", strlen("FRAME")) != 0) {
+                AddMessage(RGY_LOG_DEBUG, _T("header2: finish.\n"));
+                m_qFrameBufFree.push(buf);
+                break;
+            }
+            int i, c;
+            for (i = 0; (c = _fgetc_nolock(m_fSource)) != '\n'; i++) {
+                if (i >= 64 || c == EOF) {
+                    break;
+                }
+            }
+            if (c != '\n') {
+                AddMessage(RGY_LOG_DEBUG, _T("header3: finish.\n"));
+                m_qFrameBufFree.push(buf);
+                break;
+            }
+        }
+        //trimで使用しないフレームは、パイプでなければシークして読み飛ばす
+        if (!isFrameRequired(iframe) && !m_isPipe
+            && _fseeki64(m_fSource, m_frameSize, SEEK_CUR) == 0) {
+            buf.size = 0;
+        } else if (m_frameSize != _fread_nolock(buf.ptr, 1, m_frameSize, m_fSource)) {
+            AddMessage(RGY_LOG_DEBUG, _T("fread: finish: %d.\n"), m_frameSize);
+            m_qFrameBufFree.push(buf);
+            break;
+        } else {
+            buf.size = (isFrameRequired(iframe)) ? m_frameSize : 0;
+        }
+        m_qFrameBufRead.push(buf);
+    }
+    m_qFrameBufRead.push(RGYInputRawFrameBuf()); // 終了の合図
+    return err;
+}
+
+RGY_ERR RGYInputRaw::LoadNextFrameThread(RGYInputRawFrameBuf& buf) {
+    //trimの設定が反映された後に開始する
+    if (!m_thRead.joinable()) {
+        m_qFrameBufRead.init(FRAME_BUF_COUNT + 1);
+        m_qFrameBufFree.init(FRAME_BUF_COUNT + 1);
+        m_thReadAbort = false;
+        m_thRead = std::thread(&RGYInputRaw::ReadThreadFunc, this, m_threadParam);
+        AddMessage(RGY_LOG_DEBUG, _T("started read thread, %d frame buffers.\n"), FRAME_BUF_COUNT);
+    }
+    buf = RGYInputRawFrameBuf();
+    while (!m_qFrameBufRead.front_copy_and_pop_no_lock(&buf)) {
+        m_qFrameBufRead.wait_for_push();
+    }
+    if (buf.ptr == nullptr) {
+        m_qFrameBufRead.push(buf); //再度呼ばれた場合も終了を返せるよう、終了の合図を戻しておく
+        return RGY_ERR_MORE_DATA;
+    }
+    return RGY_ERR_NONE;
+}
+
 RGY_ERR RGYInputRaw::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const RGYInputPrm *prm) {
     m_inputVideoInfo = *pInputInfo;
     m_readerName = (m_inputVideoInfo.type == RGY_INPUT_FMT_Y4M) ? _T("y4m") : _T("raw");
+    auto rawprm = reinterpret_cast<const RGYInputPrmRaw *>(prm);
+    m_threadParam = rawprm->threadParamInput;
 
     m_convert = std::make_unique<RGYConvertCSP>(prm->threadCsp, prm->threadParamCsp);
 
@@ -178,21 +471,17 @@ RGY_ERR RGYInputRaw::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
         }
         m_inputCsp = m_inputVideoInfo.csp;
     } else {
-        auto rawprm = reinterpret_cast<const RGYInputPrmRaw *>(prm);
         m_inputCsp = (rawprm->inputCsp == RGY_CSP_NA) ? RGY_CSP_YV12 : rawprm->inputCsp; //input-cspで指定されたraw読み込みの値
         m_inputVideoInfo.srcPitch = m_inputVideoInfo.srcWidth * (RGY_CSP_BIT_DEPTH[m_inputCsp] > 8 ? 2 : 1);
     }
 
     RGY_CSP output_csp_if_lossless = RGY_CSP_NA;
-    uint32_t bufferSize = 0;
     switch (m_inputCsp) {
     case RGY_CSP_NV12:
     case RGY_CSP_YV12:
-        bufferSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3 / 2;
         output_csp_if_lossless = RGY_CSP_NV12;
         break;
     case RGY_CSP_P010:
-        bufferSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3;
         output_csp_if_lossless = RGY_CSP_P010;
         break;
     case RGY_CSP_YV12_09:
@@ -200,11 +489,9 @@ RGY_ERR RGYInputRaw::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
     case RGY_CSP_YV12_12:
     case RGY_CSP_YV12_14:
     case RGY_CSP_YV12_16:
-        bufferSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3;
         output_csp_if_lossless = RGY_CSP_P010;
         break;
     case RGY_CSP_YUV422:
-        bufferSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 2;
         if constexpr (ENCODER_QSV || ENCODER_VCEENC) {
             nOutputCSP = RGY_CSP_NV12;
             output_csp_if_lossless = RGY_CSP_NV12;
@@ -219,7 +506,6 @@ RGY_ERR RGYInputRaw::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
     case RGY_CSP_YUV422_12:
     case RGY_CSP_YUV422_14:
     case RGY_CSP_YUV422_16:
-        bufferSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 4;
         if constexpr (ENCODER_QSV || ENCODER_VCEENC) {
             //yuv422読み込みは、出力フォーマットへの直接変換を持たないのでP010に変換する
             nOutputCSP = RGY_CSP_P010;
@@ -231,7 +517,6 @@ RGY_ERR RGYInputRaw::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
         }
         break;
     case RGY_CSP_YUV444:
-        bufferSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3;
         output_csp_if_lossless = RGY_CSP_YUV444;
         break;
     case RGY_CSP_YUV444_09:
@@ -239,17 +524,12 @@ RGY_ERR RGYInputRaw::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
     case RGY_CSP_YUV444_12:
     case RGY_CSP_YUV444_14:
     case RGY_CSP_YUV444_16:
-        bufferSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 6;
         output_csp_if_lossless = RGY_CSP_YUV444_16;
         break;
     default:
         AddMessage(RGY_LOG_ERROR, _T("Unknown color foramt.\n"));
         return RGY_ERR_INVALID_COLOR_FORMAT;
     }
-    // 幅が割り切れない場合に備え、変換時にAVX2等で読みすぎて異常終了しないようにあらかじめ多めに確保する
-    bufferSize += (ALIGN(m_inputVideoInfo.srcWidth, 128) - m_inputVideoInfo.srcWidth) * bytesPerPix(m_inputCsp);
-    AddMessage(RGY_LOG_DEBUG, _T("%dx%d, pitch:%d, bufferSize:%d.\n"), m_inputVideoInfo.srcWidth, m_inputVideoInfo.srcHeight, m_inputVideoInfo.srcPitch, bufferSize);
-
     if (nOutputCSP != RGY_CSP_NA) {
         m_inputVideoInfo.csp =
             (ENCODER_NVENC
@@ -264,18 +544,36 @@ RGY_ERR RGYInputRaw::Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const
     if (cspShiftUsed(m_inputVideoInfo.csp) && RGY_CSP_BIT_DEPTH[m_inputVideoInfo.csp] > RGY_CSP_BIT_DEPTH[m_inputCsp]) {
         m_inputVideoInfo.bitdepth = RGY_CSP_BIT_DEPTH[m_inputCsp];
     }
-    m_pBuffer = std::shared_ptr<uint8_t>((uint8_t *)_aligned_malloc(bufferSize, 32), aligned_malloc_deleter());
-    if (!m_pBuffer) {
-        AddMessage(RGY_LOG_ERROR, _T("Failed to allocate input buffer.\n"));
-        return RGY_ERR_NULL_PTR;
-    }
-
     if (m_convert->getFunc(m_inputCsp, m_inputVideoInfo.csp, false, prm->simdCsp) == nullptr) {
         AddMessage(RGY_LOG_ERROR, _T("raw/y4m: color conversion not supported: %s -> %s.\n"),
             RGY_CSP_NAMES[m_inputCsp], RGY_CSP_NAMES[m_inputVideoInfo.csp]);
         return RGY_ERR_INVALID_COLOR_FORMAT;
     }
 
+    m_frameSize = calcFrameSize(m_convert->getFunc()->csp_from);
+    if (m_frameSize == 0) {
+        AddMessage(RGY_LOG_ERROR, _T("Unknown color foramt.\n"));
+        return RGY_ERR_INVALID_COLOR_FORMAT;
+    }
+    // 幅が割り切れない場合に備え、変換時にAVX2等で読みすぎて異常終了しないようにあらかじめ多めに確保する
+    m_overread = (ALIGN(m_inputVideoInfo.srcWidth, 128) - m_inputVideoInfo.srcWidth) * bytesPerPix(m_inputCsp);
+    m_nBufSize = m_frameSize + m_overread;
+    AddMessage(RGY_LOG_DEBUG, _T("%dx%d, pitch:%d, bufferSize:%d.\n"), m_inputVideoInfo.srcWidth, m_inputVideoInfo.srcHeight, m_inputVideoInfo.srcPitch, m_nBufSize);
+
+    //通常のファイルはメモリマップし、ファイルのデータを直接色変換に渡す
+    //パイプ等の場合は、先読みスレッドで読み込む
+    if (initMap() == RGY_ERR_NONE) {
+        AddMessage(RGY_LOG_DEBUG, _T("mapped input file: %lld bytes.\n"), (long long)m_mapSize);
+        //ファイル末尾のフレームのみ、コピーしてから色変換する
+        m_pBuffer = std::shared_ptr<uint8_t>((uint8_t *)_aligned_malloc(m_nBufSize, 32), aligned_malloc_deleter());
+        if (!m_pBuffer) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to allocate input buffer.\n"));
+            return RGY_ERR_NULL_PTR;
+        }
+    } else {
+        AddMessage(RGY_LOG_DEBUG, _T("input file not mapped, using read thread.\n"));
+    }
+
     CreateInputInfo(m_readerName.c_str(), RGY_CSP_NAMES[m_convert->getFunc()->csp_from], RGY_CSP_NAMES[m_convert->getFunc()->csp_to], get_simd_str(m_convert->getFunc()->simd), &m_inputVideoInfo);
     AddMessage(RGY_LOG_DEBUG, m_inputInfo);
     *pInputInfo = m_inputVideoInfo;
@@ -291,122 +589,83 @@ RGY_ERR RGYInputRaw::LoadNextFrameInternal(RGYFrame *pSurface) {
         return RGY_ERR_MORE_DATA;
     }
 
-    if (m_inputVideoInfo.type == RGY_INPUT_FMT_Y4M) {
-        uint8_t y4m_buf[8] = { 0 };
-        if (_fread_nolock(y4m_buf, 1, strlen("FRAME"), m_fSource) != strlen("FRAME")) {
-            AddMessage(RGY_LOG_DEBUG, _T("header1: finish.\n"));
-            return RGY_ERR_MORE_DATA;
+    //ptrFrameがnullptrの場合は、trimで使用しないフレームなので色変換を省略する
+    const uint8_t *ptrFrame = nullptr;
+    RGYInputRawFrameBuf buf;
+    if (m_mapPtr) {
+        auto err = LoadNextFrameMap(&ptrFrame);
+        if (err != RGY_ERR_NONE) {
+            return err;
         }
-        if (memcmp(y4m_buf, "FRAME", strlen("FRAME")) != 0) {
-            AddMessage(RGY_LOG_DEBUG, _T("header2: finish.\n"));
-            return RGY_ERR_MORE_DATA;
-        }
-        int i;
-        for (i = 0; _fgetc_nolock(m_fSource) != '\n'; i++) {
-            if (i >= 64) {
-                AddMessage(RGY_LOG_DEBUG, _T("header3: finish.\n"));
-                return RGY_ERR_MORE_DATA;
-            }
+    } else {
+        auto err = LoadNextFrameThread(buf);
+        if (err != RGY_ERR_NONE) {
+            return err;
         }
+        ptrFrame = (buf.size > 0) ? buf.ptr : nullptr;
     }
 
-    uint32_t frameSize = 0;
-    switch (m_convert->getFunc()->csp_from) {
-    case RGY_CSP_NV12:
-    case RGY_CSP_YV12:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3 / 2; break;
-    case RGY_CSP_P010:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3; break;
-    case RGY_CSP_YUV422:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 2; break;
-    case RGY_CSP_YUV444:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3; break;
-    case RGY_CSP_YV12_09:
-    case RGY_CSP_YV12_10:
-    case RGY_CSP_YV12_12:
-    case RGY_CSP_YV12_14:
-    case RGY_CSP_YV12_16:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 3; break;
-    case RGY_CSP_YUV422_09:
-    case RGY_CSP_YUV422_10:
-    case RGY_CSP_YUV422_12:
-    case RGY_CSP_YUV422_14:
-    case RGY_CSP_YUV422_16:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 4; break;
-    case RGY_CSP_YUV444_09:
-    case RGY_CSP_YUV444_10:
-    case RGY_CSP_YUV444_12:
-    case RGY_CSP_YUV444_14:
-    case RGY_CSP_YUV444_16:
-        frameSize = m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight * 6; break;
-    default:
-        AddMessage(RGY_LOG_ERROR, _T("Unknown color foramt.\n"));
-        return RGY_ERR_INVALID_COLOR_FORMAT;
-    }
-    if (rgy_csp_has_alpha(m_convert->getFunc()->csp_from)) {
-        frameSize += m_inputVideoInfo.srcWidth * m_inputVideoInfo.srcHeight;
-    }
-    if (frameSize != _fread_nolock(m_pBuffer.get(), 1, frameSize, m_fSource)) {
-        AddMessage(RGY_LOG_DEBUG, _T("fread: finish: %d.\n"), frameSize);
-        return RGY_ERR_MORE_DATA;
-    }
+    if (ptrFrame) {
+        void *dst_array[RGY_MAX_PLANES];
+        pSurface->ptrArray(dst_array);
 
-    void *dst_array[RGY_MAX_PLANES];
-    pSurface->ptrArray(dst_array);
+        const void *src_array[RGY_MAX_PLANES];
+        src_array[0] = ptrFrame;
+        src_array[1] = (uint8_t *)src_array[0] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight;
+        switch (m_convert->getFunc()->csp_from) {
+        case RGY_CSP_YV12:
+        case RGY_CSP_YV12_09:
+        case RGY_CSP_YV12_10:
+        case RGY_CSP_YV12_12:
+        case RGY_CSP_YV12_14:
+        case RGY_CSP_YV12_16:
+            src_array[2] = (uint8_t *)src_array[1] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight / 4;
+            break;
+        case RGY_CSP_YUV422:
+        case RGY_CSP_YUV422_09:
+        case RGY_CSP_YUV422_10:
+        case RGY_CSP_YUV422_12:
+        case RGY_CSP_YUV422_14:
+        case RGY_CSP_YUV422_16:
+            src_array[2] = (uint8_t *)src_array[1] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight / 2;
+            break;
+        case RGY_CSP_YUV444:
+        case RGY_CSP_YUV444_09:
+        case RGY_CSP_YUV444_10:
+        case RGY_CSP_YUV444_12:
+        case RGY_CSP_YUV444_14:
+        case RGY_CSP_YUV444_16:
+            src_array[2] = (uint8_t *)src_array[1] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight;
+            break;
+        case RGY_CSP_NV12:
+        case RGY_CSP_P010:
+        default:
+            break;
+        }
+        src_array[3] = (rgy_csp_has_alpha(m_convert->getFunc()->csp_from)) ? (uint8_t *)src_array[2] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight : nullptr;
 
-    const void *src_array[RGY_MAX_PLANES];
-    src_array[0] = m_pBuffer.get();
-    src_array[1] = (uint8_t *)src_array[0] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight;
-    switch (m_convert->getFunc()->csp_from) {
-    case RGY_CSP_YV12:
-    case RGY_CSP_YV12_09:
-    case RGY_CSP_YV12_10:
-    case RGY_CSP_YV12_12:
-    case RGY_CSP_YV12_14:
-    case RGY_CSP_YV12_16:
-        src_array[2] = (uint8_t *)src_array[1] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight / 4;
-        break;
-    case RGY_CSP_YUV422:
-    case RGY_CSP_YUV422_09:
-    case RGY_CSP_YUV422_10:
-    case RGY_CSP_YUV422_12:
-    case RGY_CSP_YUV422_14:
-    case RGY_CSP_YUV422_16:
-        src_array[2] = (uint8_t *)src_array[1] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight / 2;
-        break;
-    case RGY_CSP_YUV444:
-    case RGY_CSP_YUV444_09:
-    case RGY_CSP_YUV444_10:
-    case RGY_CSP_YUV444_12:
-    case RGY_CSP_YUV444_14:
-    case RGY_CSP_YUV444_16:
-        src_array[2] = (uint8_t *)src_array[1] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight;
-        break;
-    case RGY_CSP_NV12:
-    case RGY_CSP_P010:
-    default:
-        break;
+        int src_uv_pitch = m_inputVideoInfo.srcPitch;
+        switch (RGY_CSP_CHROMA_FORMAT[m_convert->getFunc()->csp_from]) {
+        case RGY_CHROMAFMT_YUV422:
+            src_uv_pitch >>= 1;
+            break;
+        case RGY_CHROMAFMT_YUV444:
+            break;
+        case RGY_CHROMAFMT_RGB:
+        case RGY_CHROMAFMT_RGB_PACKED:
+            break;
+        case RGY_CHROMAFMT_YUV420:
+        default:
+            src_uv_pitch >>= 1;
+            break;
+        }
+        m_convert->run((m_inputVideoInfo.picstruct & RGY_PICSTRUCT_INTERLACED) ? 1 : 0,
+            dst_array, src_array, m_inputVideoInfo.srcWidth, m_inputVideoInfo.srcPitch,
+            src_uv_pitch, pSurface->pitch(), m_inputVideoInfo.srcHeight, m_inputVideoInfo.srcHeight, m_inputVideoInfo.crop.c);
     }
-    src_array[3] = (rgy_csp_has_alpha(m_convert->getFunc()->csp_from)) ? (uint8_t *)src_array[2] + m_inputVideoInfo.srcPitch * m_inputVideoInfo.srcHeight : nullptr;
-
-    int src_uv_pitch = m_inputVideoInfo.srcPitch;
-    switch (RGY_CSP_CHROMA_FORMAT[m_convert->getFunc()->csp_from]) {
-    case RGY_CHROMAFMT_YUV422:
-        src_uv_pitch >>= 1;
-        break;
-    case RGY_CHROMAFMT_YUV444:
-        break;
-    case RGY_CHROMAFMT_RGB:
-    case RGY_CHROMAFMT_RGB_PACKED:
-        break;
-    case RGY_CHROMAFMT_YUV420:
-    default:
-        src_uv_pitch >>= 1;
-        break;
+    if (buf.ptr) {
+        m_qFrameBufFree.push(buf);
     }
-    m_convert->run((m_inputVideoInfo.picstruct & RGY_PICSTRUCT_INTERLACED) ? 1 : 0,
-        dst_array, src_array, m_inputVideoInfo.srcWidth, m_inputVideoInfo.srcPitch,
-        src_uv_pitch, pSurface->pitch(), m_inputVideoInfo.srcHeight, m_inputVideoInfo.srcHeight, m_inputVideoInfo.crop.c);
 
     m_encSatusInfo->m_sData.frameIn++;
     return m_encSatusInfo->UpdateDisplay();
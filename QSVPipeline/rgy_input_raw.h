@@ -29,7 +29,10 @@
 #ifndef __RGY_INPUT_RAW_H__
 #define __RGY_INPUT_RAW_H__
 
+#include <thread>
+#include <atomic>
 #include "rgy_input.h"
+#include "rgy_queue.h"
 
 #if ENABLE_RAW_READER
 
@@ -38,11 +41,20 @@
 class RGYInputPrmRaw : public RGYInputPrm {
 public:
     RGY_CSP inputCsp;
+    RGYParamThread threadParamInput; //先読みスレッドのスレッドアフィニティ
 
-    RGYInputPrmRaw(RGYInputPrm base) : RGYInputPrm(base), inputCsp(RGY_CSP_YV12) {};
+    RGYInputPrmRaw(RGYInputPrm base) : RGYInputPrm(base), inputCsp(RGY_CSP_YV12), threadParamInput() {};
     virtual ~RGYInputPrmRaw() {};
 };
 
+//先読みスレッドで読み込んだ1フレーム分のデータ
+struct RGYInputRawFrameBuf {
+    uint8_t *ptr;  // RGYSysFramePoolから確保したバッファ (nullptrなら読み込み終了の合図)
+    uint32_t size; // 読み込んだデータのサイズ (trimで不要なフレームは読み飛ばし、0となる)
+
+    RGYInputRawFrameBuf() : ptr(nullptr), size(0) {};
+};
+
 class RGYInputRaw : public RGYInput {
 public:
     RGYInputRaw();
@@ -58,12 +70,42 @@ protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, VideoInfo *pInputInfo, const RGYInputPrm *prm) override;
     virtual RGY_ERR LoadNextFrameInternal(RGYFrame *pSurface) override;
     RGY_ERR ParseY4MHeader(char *buf, VideoInfo *pInfo);
+    uint32_t calcFrameSize(const RGY_CSP csp) const;
+    bool isFrameRequired(const int iframe) const;
+
+    //通常のファイルの場合は、ファイル全体をメモリマップして直接色変換に渡す
+    RGY_ERR initMap();
+    void closeMap();
+    RGY_ERR LoadNextFrameMap(const uint8_t **ptrFrame);
+
+    //パイプ等マップできない場合は、先読みスレッドで読み込む
+    RGY_ERR ReadThreadFunc(RGYParamThread threadParam);
+    RGY_ERR LoadNextFrameThread(RGYInputRawFrameBuf& buf);
+
+    //先読みスレッドで使用するバッファ数
+    static const int FRAME_BUF_COUNT = 3;
 
     FILE *m_fSource;
 
     uint32_t m_nBufSize;
     shared_ptr<uint8_t> m_pBuffer;
     bool m_isPipe;
+    uint32_t m_frameSize;   // y4mのフレームヘッダを除く1フレームのサイズ
+    uint32_t m_overread;    // 色変換時に読みすぎる可能性のあるサイズ
+
+    uint8_t *m_mapPtr;      // メモリマップしたファイルの先頭
+    int64_t m_mapSize;      // メモリマップしたファイルのサイズ
+    int64_t m_mapPos;       // 次に読み込むフレームの位置
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE m_mapHandle;
+#endif //#if defined(_WIN32) || defined(_WIN64)
+
+    RGYParamThread m_threadParam;
+    std::thread m_thRead;                             // 先読みスレッド
+    std::atomic<bool> m_thReadAbort;                  // 先読みスレッドの中断
+    RGYQueueMPMP<RGYInputRawFrameBuf> m_qFrameBufRead; // 読み込み済みのバッファ
+    RGYQueueMPMP<RGYInputRawFrameBuf> m_qFrameBufFree; // 色変換が終わり、再利用可能なバッファ
+    int m_frameBufAllocated;                          // 確保したバッファの数
 };
 
 #endif //ENABLE_RAW_READER
@@ -28,7 +28,10 @@
 #include <algorithm>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <chrono>
+#include <map>
+#include <vector>
 #include "rgy_log.h"
 #include "rgy_version.h"
 #include "rgy_util.h"
@@ -79,6 +82,168 @@ int rgy_print_stderr(int log_level, const TCHAR *mes, void *handle_) {
 
 const char *RGYLog::HTML_FOOTER = "</body>\n</html>\n";
 
+static const size_t RGY_LOG_WRITER_FLUSH_BYTES = 64 * 1024;               // これ以上たまったら、すぐに書き出す
+static const int    RGY_LOG_WRITER_FLUSH_INTERVAL_MS = 100;               // 書き出しの間隔
+static const size_t RGY_LOG_WRITER_MAX_PENDING_BYTES = 32 * 1024 * 1024;  // これを超えてたまっている場合、infoより下のログは捨てる
+
+// ログファイルへの書き込みを別スレッドでまとめて行う
+// ファイルは開いたままにし、一定間隔あるいは一定量たまったところで書き出す
+// 同じファイルに出力するRGYLog (並列エンコードの子など) は、同じRGYLogFileWriterを共有する
+class RGYLogFileWriter {
+public:
+    static std::shared_ptr<RGYLogFileWriter> get(const tstring& filename, const bool html);
+    RGYLogFileWriter(const tstring& filename, const bool html);
+    ~RGYLogFileWriter();
+    void write(std::string&& str, const RGYLogLevel log_level);
+    void flush();
+protected:
+    void run();
+    void writeBatch(const std::vector<std::string>& batch);
+
+    tstring m_filename;
+    bool m_html;
+    std::unique_ptr<FILE, fp_deleter> m_fp;
+    std::mutex m_mtx;
+    std::condition_variable m_cvPushed;
+    std::condition_variable m_cvWritten;
+    std::vector<std::string> m_pending;
+    size_t m_pendingBytes;
+    uint64_t m_pushedCount;
+    uint64_t m_writtenCount;
+    uint64_t m_dropped;
+    bool m_flushRequest;
+    bool m_fin;
+    std::thread m_thread;
+};
+
+std::shared_ptr<RGYLogFileWriter> RGYLogFileWriter::get(const tstring& filename, const bool html) {
+    static std::mutex mtx;
+    static std::map<tstring, std::weak_ptr<RGYLogFileWriter>> writers;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto writer = writers[filename].lock();
+    if (!writer) {
+        writer = std::make_shared<RGYLogFileWriter>(filename, html);
+        writers[filename] = writer;
+    }
+    return writer;
+}
+
+RGYLogFileWriter::RGYLogFileWriter(const tstring& filename, const bool html) :
+    m_filename(filename),
+    m_html(html),
+    m_fp(),
+    m_mtx(),
+    m_cvPushed(),
+    m_cvWritten(),
+    m_pending(),
+    m_pendingBytes(0),
+    m_pushedCount(0),
+    m_writtenCount(0),
+    m_dropped(0),
+    m_flushRequest(false),
+    m_fin(false),
+    m_thread() {
+    m_thread = std::thread(&RGYLogFileWriter::run, this);
+}
+
+RGYLogFileWriter::~RGYLogFileWriter() {
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_fin = true;
+    }
+    m_cvPushed.notify_one();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    m_fp.reset();
+}
+
+void RGYLogFileWriter::write(std::string&& str, const RGYLogLevel log_level) {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    if (log_level < RGY_LOG_INFO && m_pendingBytes + str.length() > RGY_LOG_WRITER_MAX_PENDING_BYTES) {
+        m_dropped++;
+        return;
+    }
+    m_pendingBytes += str.length();
+    m_pending.push_back(std::move(str));
+    m_pushedCount++;
+    const bool wakeUp = m_pendingBytes >= RGY_LOG_WRITER_FLUSH_BYTES || log_level >= RGY_LOG_WARN;
+    lock.unlock();
+    if (wakeUp) {
+        m_cvPushed.notify_one();
+    }
+}
+
+void RGYLogFileWriter::flush() {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    const auto target = m_pushedCount;
+    m_flushRequest = true;
+    m_cvPushed.notify_one();
+    m_cvWritten.wait(lock, [&]() { return m_writtenCount >= target || m_fin; });
+}
+
+void RGYLogFileWriter::run() {
+    std::vector<std::string> batch;
+    std::unique_lock<std::mutex> lock(m_mtx);
+    for (;;) {
+        m_cvPushed.wait_for(lock, std::chrono::milliseconds(RGY_LOG_WRITER_FLUSH_INTERVAL_MS), [&]() {
+            return m_fin || m_flushRequest || m_pendingBytes >= RGY_LOG_WRITER_FLUSH_BYTES;
+        });
+        if (m_pending.empty() && m_dropped == 0) {
+            m_flushRequest = false;
+            m_cvWritten.notify_all();
+            if (m_fin) {
+                break;
+            }
+            continue;
+        }
+        batch.swap(m_pending);
+        const auto count = m_pushedCount;
+        const auto dropped = m_dropped;
+        m_pendingBytes = 0;
+        m_dropped = 0;
+        m_flushRequest = false;
+        lock.unlock();
+        if (dropped > 0) {
+            const auto mes = strsprintf("%llu log messages were dropped, as the log file writing was too slow.\n", (unsigned long long)dropped);
+            batch.push_back((m_html) ? "<div class=\"warn\">" + mes.substr(0, mes.length() - 1) + "</div>\n" : mes);
+        }
+        writeBatch(batch);
+        batch.clear();
+        lock.lock();
+        m_writtenCount = count;
+        m_cvWritten.notify_all();
+    }
+}
+
+void RGYLogFileWriter::writeBatch(const std::vector<std::string>& batch) {
+    if (!m_fp) {
+        //logはANSI(まあようはShift-JIS)で保存する
+        FILE *fp = _tfopen(m_filename.c_str(), (m_html) ? _T("rb+") : _T("a"));
+        if (fp == nullptr) {
+            return;
+        }
+        m_fp.reset(fp);
+        if (m_html) {
+            // フッタの直前から書き込む
+            _fseeki64(m_fp.get(), 0, SEEK_END);
+            const int64_t pos = _ftelli64(m_fp.get());
+            _fseeki64(m_fp.get(), std::max<int64_t>(pos - (int64_t)strlen(RGYLog::HTML_FOOTER), 0), SEEK_SET);
+        }
+    }
+    for (const auto& str : batch) {
+        fwrite(str.c_str(), 1, str.length(), m_fp.get());
+    }
+    if (m_html) {
+        // フッタを書き込んだ後、次回はフッタの直前から書き込めるよう戻しておく
+        fwrite(RGYLog::HTML_FOOTER, 1, strlen(RGYLog::HTML_FOOTER), m_fp.get());
+        fflush(m_fp.get());
+        _fseeki64(m_fp.get(), -(int64_t)strlen(RGYLog::HTML_FOOTER), SEEK_CUR);
+    } else {
+        fflush(m_fp.get());
+    }
+}
+
 const TCHAR *rgy_log_level_to_str(RGYLogLevel level) {
     for (const auto& p : RGY_LOG_LEVEL_STR) {
         if (p.first == level) return p.second;
@@ -253,10 +418,18 @@ RGYLog::RGYLog(const TCHAR *pLogFile, const RGYParamLogLevel& log_level, bool sh
 }
 
 RGYLog::~RGYLog() {
+    m_fileWriter.reset();
+}
+
+void RGYLog::flush() {
+    if (m_fileWriter) {
+        m_fileWriter->flush();
+    }
 }
 
 void RGYLog::init(const TCHAR *pLogFile, const RGYParamLogLevel& log_level) {
     m_nLogLevel = log_level;
+    m_fileWriter.reset(); // 以前のログファイルへの書き込みは、ほかに共有していなければここで書き出して閉じる
     if (!m_mtx) {
         m_mtx = std::make_shared<std::mutex>();
     }
@@ -454,20 +627,14 @@ void RGYLog::write_log(RGYLogLevel log_level, const RGYLogType logtype, const TC
 #endif
     std::lock_guard<std::mutex> lock(*m_mtx.get());
     if (m_pStrLog.length() > 0) {
-        FILE *fp_log = NULL;
-        //logはANSI(まあようはShift-JIS)で保存する
-        if (0 == _tfopen_s(&fp_log, m_pStrLog.c_str(), (m_bHtml) ? _T("rb+") : _T("a")) && fp_log) {
-            if (m_bHtml) {
-                _fseeki64(fp_log, 0, SEEK_END);
-                int64_t pos = _ftelli64(fp_log);
-                _fseeki64(fp_log, 0, SEEK_SET);
-                _fseeki64(fp_log, pos -1 * strlen(HTML_FOOTER), SEEK_CUR);
-            }
-            fwrite(buffer_ptr, 1, strlen(buffer_ptr), fp_log);
-            if (m_bHtml) {
-                fwrite(HTML_FOOTER, 1, strlen(HTML_FOOTER), fp_log);
-            }
-            fclose(fp_log);
+        // ファイルへの書き込みは別スレッドで行う
+        if (!m_fileWriter) {
+            m_fileWriter = RGYLogFileWriter::get(m_pStrLog, m_bHtml);
+        }
+        m_fileWriter->write(std::string(buffer_ptr), log_level);
+        if (log_level >= RGY_LOG_ERROR) {
+            // エラーの直後に異常終了してもログが残るよう、書き込みが終わるまで待つ
+            m_fileWriter->flush();
         }
     }
     if (!file_only) {
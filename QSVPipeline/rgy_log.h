@@ -154,6 +154,8 @@ public:
 
 int rgy_print_stderr(int log_level, const TCHAR *mes, void *handle = NULL);
 
+class RGYLogFileWriter;
+
 class RGYLog {
 protected:
     RGYParamLogLevel m_nLogLevel;
@@ -162,7 +164,9 @@ protected:
     bool m_showTime;
     bool m_addLogLevel;
     std::shared_ptr<std::mutex> m_mtx;
+    std::shared_ptr<RGYLogFileWriter> m_fileWriter; // ログファイルへの書き込みを行うスレッド
     static const char *HTML_FOOTER;
+    friend class RGYLogFileWriter;
 public:
     RGYLog(const TCHAR *pLogFile, const RGYLogLevel log_level = RGY_LOG_INFO, bool showTime = false, bool addLogLevel = false);
     RGYLog(const TCHAR *pLogFile, const RGYParamLogLevel& log_level, bool showTime = false, bool addLogLevel = false);
@@ -190,8 +194,10 @@ public:
     }
     void setLogFile(const TCHAR *pLogFile) {
         m_pStrLog.clear();
+        m_fileWriter.reset();
         if (pLogFile) m_pStrLog = pLogFile;
     }
+    void flush(); // ログファイルへの書き込みが終わるまで待機する
     void setLock(std::shared_ptr<std::mutex> mtx) { m_mtx = mtx; }
     std::shared_ptr<std::mutex> getLock() { return m_mtx; }
     virtual void write_log(RGYLogLevel log_level, const RGYLogType logtype, const TCHAR *buffer, bool file_only = false);
@@ -30,11 +30,14 @@
 #include <vector>
 #include <atomic>
 #include <fstream>
+#include <filesystem>
+#include <thread>
 #include "rgy_osdep.h"
 #define CL_EXTERN
 #include "rgy_opencl.h"
 #include "rgy_resource.h"
 #include "rgy_filesystem.h"
+#include "rgy_version.h"
 
 #if ENABLE_OPENCL
 
@@ -323,6 +326,7 @@ int initOpenCLGlobal() {
     LOAD(clGetSupportedImageFormats);
 
     LOAD(clCreateProgramWithSource);
+    LOAD(clCreateProgramWithBinary);
     LOAD(clBuildProgram);
     LOAD(clGetProgramBuildInfo);
     LOAD(clGetProgramInfo);
@@ -1341,7 +1345,9 @@ RGYOpenCLContext::RGYOpenCLContext(shared_ptr<RGYOpenCLPlatform> platform, share
     m_queue(),
     m_log(pLog),
     m_copy(),
-    m_hmodule(NULL) {
+    m_hmodule(NULL),
+    m_programCacheDir(),
+    m_programCacheDev() {
 
 }
 
@@ -1555,20 +1561,33 @@ std::vector<uint8_t> RGYOpenCLProgram::getBinary() {
     std::vector<uint8_t> binary;
     if (!m_program) return binary;
 
-    size_t binary_size = 0;
-    cl_int err = clGetProgramInfo(m_program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binary_size, nullptr);
+    cl_uint num_devices = 0;
+    cl_int err = clGetProgramInfo(m_program, CL_PROGRAM_NUM_DEVICES, sizeof(num_devices), &num_devices, nullptr);
+    if (err != CL_SUCCESS || num_devices == 0) {
+        CL_LOG(RGY_LOG_ERROR, _T("Failed to get program device count: %s\n"), cl_errmes(err));
+        return binary;
+    }
+    std::vector<size_t> binary_sizes(num_devices, 0);
+    err = clGetProgramInfo(m_program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t) * num_devices, binary_sizes.data(), nullptr);
     if (err != CL_SUCCESS) {
         CL_LOG(RGY_LOG_ERROR, _T("Failed to get program binary size: %s\n"), cl_errmes(err));
         return binary;
     }
 
-    binary.resize(binary_size + 1, 0);
-    err = clGetProgramInfo(m_program, CL_PROGRAM_BINARIES, binary_size, binary.data(), &binary_size);
+    //CL_PROGRAM_BINARIESにはデバイスごとのバッファへのポインタの配列を渡す (先頭のデバイスのものを返す)
+    std::vector<std::vector<uint8_t>> binaries(num_devices);
+    std::vector<uint8_t *> binary_ptrs(num_devices, nullptr);
+    for (cl_uint i = 0; i < num_devices; i++) {
+        binaries[i].resize(binary_sizes[i] + 1, 0);
+        binary_ptrs[i] = binaries[i].data();
+    }
+    err = clGetProgramInfo(m_program, CL_PROGRAM_BINARIES, sizeof(uint8_t *) * num_devices, binary_ptrs.data(), nullptr);
     if (err != CL_SUCCESS) {
         CL_LOG(RGY_LOG_ERROR, _T("Failed to get program binary: %s\n"), cl_errmes(err));
-        binary.clear();
+        return binary;
     }
-    binary.resize(binary_size);
+    binary = std::move(binaries[0]);
+    binary.resize(binary_sizes[0]);
     return binary;
 }
 
@@ -2519,6 +2538,178 @@ RGY_ERR RGYOpenCLContext::setBuf(const void *pattern, size_t pattern_size, size_
     return RGY_ERR_NONE;
 }
 
+#define RGY_CL_PROGRAM_CACHE_HEADER "RGYCLBIN"
+static const uint32_t RGY_CL_PROGRAM_CACHE_VERSION = 1;
+
+static uint64_t rgy_cl_cache_hash(const void *data, size_t size, uint64_t hash) {
+    //FNV-1a
+    const uint8_t *ptr = (const uint8_t *)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= ptr[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static std::string rgy_cl_cache_hash_str(const void *data, size_t size) {
+    //異なる初期値で2回計算して128bitとする
+    return strsprintf("%016llx%016llx",
+        (unsigned long long)rgy_cl_cache_hash(data, size, 0xcbf29ce484222325ull),
+        (unsigned long long)rgy_cl_cache_hash(data, size, 0x84222325cbf29ce4ull));
+}
+
+tstring getOpenCLProgramCacheDefaultDir() {
+#if defined(_WIN32) || defined(_WIN64)
+    TCHAR tempPath[4096];
+    GetTempPath(_countof(tempPath), tempPath);
+    return tstring(tempPath) + _T(ENCODER_NAME) _T("_opencl_cache");
+#else
+    const char *cacheHome = getenv("XDG_CACHE_HOME");
+    if (cacheHome && strlen(cacheHome) > 0) {
+        return std::string(cacheHome) + "/" ENCODER_NAME "/opencl";
+    }
+    const char *home = getenv("HOME");
+    if (home && strlen(home) > 0) {
+        return std::string(home) + "/.cache/" ENCODER_NAME "/opencl";
+    }
+    return std::string("/tmp/") + ENCODER_NAME "_opencl_cache";
+#endif
+}
+
+void RGYOpenCLContext::setProgramCacheDir(const tstring& dir) {
+    m_programCacheDir = dir;
+    m_programCacheDev.clear();
+    if (m_programCacheDir.length() == 0 || m_platform->devs().size() != 1) {
+        m_programCacheDir.clear();
+        return;
+    }
+    //ドライバが更新された場合には別のキャッシュとなるようにする
+    const auto platformInfo = m_platform->info();
+    const auto devInfo = RGYOpenCLDevice(m_platform->devs()[0]).info();
+    m_programCacheDev = "platform=" + platformInfo.name + " " + platformInfo.version + "\n"
+        + "device=" + devInfo.name + " " + devInfo.version + "\n"
+        + "driver=" + devInfo.driver_version + "\n";
+    CL_LOG(RGY_LOG_DEBUG, _T("OpenCL program cache: %s\n"), m_programCacheDir.c_str());
+}
+
+std::string RGYOpenCLContext::programCacheKey(const char *data, size_t datalen, const std::string& options) const {
+    return strsprintf("source=%s:%llu\n", rgy_cl_cache_hash_str(data, datalen).c_str(), (unsigned long long)datalen)
+        + "options=" + options + "\n"
+        + m_programCacheDev;
+}
+
+tstring RGYOpenCLContext::programCachePath(const std::string& key) const {
+    return m_programCacheDir + _T("/") + char_to_tstring(rgy_cl_cache_hash_str(key.data(), key.length())) + _T(".clbin");
+}
+
+//キャッシュファイルの構成
+// "RGYCLBIN" | version (uint32) | key size (uint32) | key | binary size (uint64) | binary | binary hash (uint64)
+std::unique_ptr<RGYOpenCLProgram> RGYOpenCLContext::loadProgramCache(const tstring& path, const std::string& key, const std::string& options) {
+    std::ifstream cacheFile(path, std::ios::in | std::ios::binary);
+    if (!cacheFile.is_open()) {
+        return nullptr;
+    }
+    const std::vector<uint8_t> cache((std::istreambuf_iterator<char>(cacheFile)), std::istreambuf_iterator<char>());
+    cacheFile.close();
+
+    const size_t headerSize = strlen(RGY_CL_PROGRAM_CACHE_HEADER);
+    size_t pos = 0;
+    auto readValue = [&](void *dst, size_t size) {
+        if (pos + size > cache.size()) return false;
+        memcpy(dst, cache.data() + pos, size);
+        pos += size;
+        return true;
+    };
+    uint32_t version = 0, keySize = 0;
+    uint64_t binarySize = 0, binaryHash = 0;
+    if (cache.size() < headerSize || memcmp(cache.data(), RGY_CL_PROGRAM_CACHE_HEADER, headerSize) != 0) {
+        CL_LOG(RGY_LOG_DEBUG, _T("Invalid OpenCL program cache %s: invalid header.\n"), path.c_str());
+        return nullptr;
+    }
+    pos += headerSize;
+    if (!readValue(&version, sizeof(version)) || version != RGY_CL_PROGRAM_CACHE_VERSION
+        || !readValue(&keySize, sizeof(keySize)) || pos + keySize > cache.size()
+        || memcmp(cache.data() + pos, key.data(), (std::min)((size_t)keySize, key.length())) != 0 || keySize != key.length()) {
+        CL_LOG(RGY_LOG_DEBUG, _T("OpenCL program cache %s does not match.\n"), path.c_str());
+        return nullptr;
+    }
+    pos += keySize;
+    if (!readValue(&binarySize, sizeof(binarySize)) || binarySize == 0 || pos + binarySize + sizeof(binaryHash) > cache.size()) {
+        CL_LOG(RGY_LOG_DEBUG, _T("Invalid OpenCL program cache %s: broken data.\n"), path.c_str());
+        return nullptr;
+    }
+    const uint8_t *binary = cache.data() + pos;
+    pos += (size_t)binarySize;
+    readValue(&binaryHash, sizeof(binaryHash));
+    if (binaryHash != rgy_cl_cache_hash(binary, (size_t)binarySize, 0xcbf29ce484222325ull)) {
+        CL_LOG(RGY_LOG_DEBUG, _T("Invalid OpenCL program cache %s: hash mismatch.\n"), path.c_str());
+        return nullptr;
+    }
+
+    cl_device_id device = m_platform->devs()[0];
+    const size_t binaryLength = (size_t)binarySize;
+    cl_int binaryStatus = CL_SUCCESS;
+    cl_int err = CL_SUCCESS;
+    cl_program program = clCreateProgramWithBinary(m_context.get(), 1, &device, &binaryLength, &binary, &binaryStatus, &err);
+    if (err != CL_SUCCESS || binaryStatus != CL_SUCCESS) {
+        CL_LOG(RGY_LOG_DEBUG, _T("Failed to load OpenCL program cache %s: %s.\n"), path.c_str(), cl_errmes((err != CL_SUCCESS) ? err : binaryStatus));
+        if (program) {
+            clReleaseProgram(program);
+        }
+        return nullptr;
+    }
+    err = clBuildProgram(program, 1, &device, options.c_str(), NULL, NULL);
+    if (err != CL_SUCCESS) {
+        CL_LOG(RGY_LOG_DEBUG, _T("Failed to build OpenCL program from cache %s: %s.\n"), path.c_str(), cl_errmes(err));
+        clReleaseProgram(program);
+        return nullptr;
+    }
+    return std::make_unique<RGYOpenCLProgram>(program, m_log);
+}
+
+void RGYOpenCLContext::saveProgramCache(const tstring& path, const std::string& key, RGYOpenCLProgram *program) {
+    const auto binary = program->getBinary();
+    if (binary.size() == 0) {
+        return;
+    }
+    if (!rgy_directory_exists(m_programCacheDir)) {
+        CreateDirectoryRecursive(m_programCacheDir.c_str());
+    }
+    //複数のプロセス・スレッドから同時に書き込まれても壊れたファイルが読まれないよう、一時ファイルに書いてから置き換える
+    const auto tmpPath = path + strsprintf(_T(".%d.%llx.tmp"), (int)GetCurrentProcessId(),
+        (unsigned long long)std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream cacheFile(tmpPath, std::ios::out | std::ios::binary);
+        if (!cacheFile.is_open()) {
+            CL_LOG(RGY_LOG_DEBUG, _T("Failed to open OpenCL program cache %s.\n"), tmpPath.c_str());
+            return;
+        }
+        const uint32_t version = RGY_CL_PROGRAM_CACHE_VERSION;
+        const uint32_t keySize = (uint32_t)key.length();
+        const uint64_t binarySize = binary.size();
+        const uint64_t binaryHash = rgy_cl_cache_hash(binary.data(), binary.size(), 0xcbf29ce484222325ull);
+        cacheFile.write(RGY_CL_PROGRAM_CACHE_HEADER, strlen(RGY_CL_PROGRAM_CACHE_HEADER));
+        cacheFile.write((const char *)&version, sizeof(version));
+        cacheFile.write((const char *)&keySize, sizeof(keySize));
+        cacheFile.write(key.data(), key.length());
+        cacheFile.write((const char *)&binarySize, sizeof(binarySize));
+        cacheFile.write((const char *)binary.data(), binary.size());
+        cacheFile.write((const char *)&binaryHash, sizeof(binaryHash));
+        if (!cacheFile.good()) {
+            cacheFile.close();
+            rgy_file_remove(tmpPath.c_str());
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(std::filesystem::path(tmpPath), std::filesystem::path(path), ec);
+    if (ec) {
+        rgy_file_remove(tmpPath.c_str());
+        return;
+    }
+    CL_LOG(RGY_LOG_DEBUG, _T("Saved OpenCL program cache %s (%llu bytes).\n"), path.c_str(), (unsigned long long)binary.size());
+}
+
 std::unique_ptr<RGYOpenCLProgram> RGYOpenCLContext::buildProgram(const std::string datacopy, const std::string options) {
     auto datalen = datacopy.length();
     if (datacopy.size() == 0) {
@@ -2532,6 +2723,19 @@ std::unique_ptr<RGYOpenCLProgram> RGYOpenCLContext::buildProgram(const std::stri
             datalen -= 3;
         }
     }
+    //ビルドログを出力する場合はキャッシュを使用しない
+    const bool useCache = m_programCacheDir.length() > 0 && m_programCacheDev.length() > 0
+        && m_log->getLogLevel(RGY_LOGT_VPP_BUILD) > RGY_LOG_DEBUG;
+    std::string cacheKey;
+    tstring cachePath;
+    if (useCache) {
+        cacheKey = programCacheKey(data, datalen, options);
+        cachePath = programCachePath(cacheKey);
+        if (auto cacheProgram = loadProgramCache(cachePath, cacheKey, options); cacheProgram) {
+            CL_LOG(RGY_LOG_DEBUG, _T("loaded OpenCL program from cache %s.\n"), cachePath.c_str());
+            return cacheProgram;
+        }
+    }
     CL_LOG(RGY_LOG_DEBUG, _T("building OpenCL source: size %u.\n"), datalen);
 
     bool buildCrush = false;
@@ -2578,7 +2782,11 @@ std::unique_ptr<RGYOpenCLProgram> RGYOpenCLContext::buildProgram(const std::stri
         }
     }
     CL_LOG(RGY_LOG_DEBUG, _T("clBuildProgram success!\n"));
-    return std::make_unique<RGYOpenCLProgram>(program, m_log);
+    auto clprogram = std::make_unique<RGYOpenCLProgram>(program, m_log);
+    if (useCache) {
+        saveProgramCache(cachePath, cacheKey, clprogram.get());
+    }
+    return clprogram;
 }
 
 std::unique_ptr<RGYOpenCLProgram> RGYOpenCLContext::build(const std::string &source, const char *options) {
@@ -206,6 +206,7 @@ CL_EXTERN cl_int (CL_API_CALL* f_clReleaseCommandQueue) (cl_command_queue comman
 CL_EXTERN cl_int (CL_API_CALL* f_clGetSupportedImageFormats)(cl_context context, cl_mem_flags flags, cl_mem_object_type image_type, cl_uint num_entries, cl_image_format * image_formats, cl_uint * num_image_formats);
 
 CL_EXTERN cl_program(CL_API_CALL* f_clCreateProgramWithSource) (cl_context context, cl_uint count, const char **strings, const size_t *lengths, cl_int *errcode_ret);
+CL_EXTERN cl_program(CL_API_CALL* f_clCreateProgramWithBinary) (cl_context context, cl_uint num_devices, const cl_device_id *device_list, const size_t *lengths, const unsigned char **binaries, cl_int *binary_status, cl_int *errcode_ret);
 CL_EXTERN cl_int (CL_API_CALL* f_clBuildProgram) (cl_program program, cl_uint num_devices, const cl_device_id *device_list, const char *options, void (CL_CALLBACK *pfn_notify)(cl_program program, void *user_data), void* user_data);
 CL_EXTERN cl_int (CL_API_CALL* f_clGetProgramBuildInfo) (cl_program program, cl_device_id device, cl_program_build_info param_name, size_t param_value_size, void *param_value, size_t *param_value_size_ret);
 CL_EXTERN cl_int (CL_API_CALL* f_clGetProgramInfo)(cl_program program, cl_program_info param_name, size_t param_value_size, void *param_value, size_t *param_value_size_ret);
@@ -305,6 +306,7 @@ CL_EXTERN cl_int(CL_API_CALL* f_clEnqueueReleaseVA_APIMediaSurfacesINTEL)(cl_com
 #define clGetSupportedImageFormats f_clGetSupportedImageFormats
 
 #define clCreateProgramWithSource f_clCreateProgramWithSource
+#define clCreateProgramWithBinary f_clCreateProgramWithBinary
 #define clBuildProgram f_clBuildProgram
 #define clGetProgramBuildInfo f_clGetProgramBuildInfo
 #define clGetProgramInfo f_clGetProgramInfo
@@ -1208,8 +1210,17 @@ public:
 
     std::vector<cl_image_format> getSupportedImageFormats(const cl_mem_object_type image_type = CL_MEM_OBJECT_IMAGE2D) const;
     tstring getSupportedImageFormatsStr(const cl_mem_object_type image_type = CL_MEM_OBJECT_IMAGE2D) const;
+
+    //ビルドしたプログラムのバイナリをキャッシュするディレクトリを設定する (空文字列でキャッシュを使用しない)
+    //ビルドの前に設定すること
+    void setProgramCacheDir(const tstring& dir);
+    const tstring& programCacheDir() const { return m_programCacheDir; }
 protected:
     std::unique_ptr<RGYOpenCLProgram> buildProgram(std::string datacopy, const std::string options);
+    std::string programCacheKey(const char *data, size_t datalen, const std::string& options) const;
+    tstring programCachePath(const std::string& key) const;
+    std::unique_ptr<RGYOpenCLProgram> loadProgramCache(const tstring& path, const std::string& key, const std::string& options);
+    void saveProgramCache(const tstring& path, const std::string& key, RGYOpenCLProgram *program);
 
     shared_ptr<RGYOpenCLPlatform> m_platform;
     unique_context m_context;
@@ -1217,6 +1228,8 @@ protected:
     std::shared_ptr<RGYLog> m_log;
     std::unordered_map<std::string, RGYOpenCLProgramAsync> m_copy;
     HMODULE m_hmodule;
+    tstring m_programCacheDir;      //プログラムのバイナリのキャッシュの保存先
+    std::string m_programCacheDev;  //キャッシュのキーに含めるプラットフォーム・デバイス・ドライバの情報
 };
 
 class RGYOpenCL {
@@ -1235,6 +1248,8 @@ protected:
 };
 
 int initOpenCLGlobal();
+//OpenCLのプログラムのバイナリキャッシュのデフォルトの保存先
+tstring getOpenCLProgramCacheDefaultDir();
 tstring getOpenCLInfo(const cl_device_type device_type);
 
 #endif //ENABLE_OPENCL
@@ -31,6 +31,7 @@
 #include "rgy_language.h"
 #include "convert_csp.h"
 #include "rgy_parallel_enc.h"
+#include "rgy_frame_pool.h"
 #include <filesystem>
 #if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
 #include <smmintrin.h>
@@ -94,7 +95,7 @@ RGYOutput::RGYOutput() :
     m_readBuffer(),
     m_UVBuffer(),
     m_bsf(),
-    m_parse_nal_hevc(get_parse_nal_unit_hevc_func()) {
+    m_unitIndex() {
 }
 
 RGYOutput::~RGYOutput() {
@@ -116,6 +117,11 @@ void RGYOutput::Close() {
     m_readBuffer.reset();
     m_UVBuffer.reset();
     m_bsf.reset();
+    if (m_unitIndex.parseCount() > 0) {
+        AddMessage(RGY_LOG_DEBUG, _T("NAL/OBU index: parsed %llu, reused %llu.\n"),
+            (unsigned long long)m_unitIndex.parseCount(), (unsigned long long)m_unitIndex.reuseCount());
+    }
+    m_unitIndex.invalidate();
 
     m_noOutput = false;
     m_inited = false;
@@ -362,17 +368,22 @@ RGY_ERR RGYOutput::OverwriteHEVCAlphaChannelInfoSEI(RGYBitstream *bitstream) {
     if (m_VideoOutputInfo.codec != RGY_CODEC_HEVC || !m_enableHEVCAlphaChannelInfoSEIOverwrite) {
         return RGY_ERR_NONE;
     }
-    RGYBitstream bsCopy = RGYBitstreamInit();
-    bsCopy.copy(bitstream);
-    const auto nal_list = m_parse_nal_hevc(bsCopy.data(), bsCopy.size());
-    const bool has_prefix_sei = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.nuh_layer_id == 0 && info.type == NALU_HEVC_PREFIX_SEI; }) != nal_list.end();
+    const auto& bs_nal_list = m_unitIndex.get(bitstream, m_VideoOutputInfo.codec);
+    const bool has_prefix_sei = std::find_if(bs_nal_list.begin(), bs_nal_list.end(), [](const nal_info& info) { return info.nuh_layer_id == 0 && info.type == NALU_HEVC_PREFIX_SEI; }) != bs_nal_list.end();
     if (!has_prefix_sei) {
         return RGY_ERR_NONE;
     }
+    //bitstreamを書き換えるので、分割結果はコピーしたデータを参照するように付け替える
+    RGYBitstream bsCopy = RGYBitstreamInit();
+    bsCopy.copy(bitstream);
+    std::vector<nal_info> nal_list = bs_nal_list;
+    for (auto& nal : nal_list) {
+        nal.ptr = bsCopy.data() + (nal.ptr - bitstream->data());
+    }
 
     bitstream->setSize(0);
     bitstream->setOffset(0);
-    for (const auto& nal : nal_list) {
+    for (auto& nal : nal_list) {
         if (nal.nuh_layer_id == 0 && nal.type == NALU_HEVC_PREFIX_SEI) {
             auto ptr = nal.ptr;
             int nal_header_size = 0;
@@ -389,6 +400,7 @@ RGY_ERR RGYOutput::OverwriteHEVCAlphaChannelInfoSEI(RGYBitstream *bitstream) {
             if (sei_type == ALPHA_CHANNEL_INFO) { // alpha_channel_information
                 const auto nalbuf = gen_hevc_alpha_channel_info_sei(m_HEVCAlphaChannelMode);
                 bitstream->append(nalbuf.data(), nalbuf.size());
+                nal.size = nalbuf.size();
             } else {
                 bitstream->append(nal.ptr, nal.size);
             }
@@ -396,17 +408,28 @@ RGY_ERR RGYOutput::OverwriteHEVCAlphaChannelInfoSEI(RGYBitstream *bitstream) {
             bitstream->append(nal.ptr, nal.size);
         }
     }
+    bsCopy.clear();
+    m_unitIndex.update(bitstream, m_VideoOutputInfo.codec, std::move(nal_list));
     return RGY_ERR_NONE;
 }
 
-RGY_ERR RGYOutput::InsertMetadata(RGYBitstream *bitstream, std::vector<std::unique_ptr<RGYOutputInsertMetadata>>& metadataList) {
+RGY_ERR RGYOutput::InsertMetadata(RGYBitstreamView& bsView, const RGYBitstream *bitstream, std::vector<std::unique_ptr<RGYOutputInsertMetadata>>& metadataList) {
+    bsView.clear();
     if (metadataList.size() == 0) {
+        bsView.append(bitstream->data(), bitstream->size());
         return RGY_ERR_NONE;
     }
+    //bitstreamのデータはコピーせず、メタデータとともに出力順に並べていく
+    auto appendMetadata = [&bsView, &metadataList](const RGYOutputInsertMetadataPosition pos) {
+        for (auto& metadata : metadataList) {
+            if (!metadata->written && metadata->pos == pos) {
+                bsView.append(metadata->mdata.data(), metadata->mdata.size());
+                metadata->written = true;
+            }
+        }
+    };
     if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC) {
-        RGYBitstream bsCopy = RGYBitstreamInit();
-        bsCopy.copy(bitstream);
-        const auto nal_list = m_parse_nal_hevc(bsCopy.data(), bsCopy.size());
+        const auto& nal_list = m_unitIndex.get(bitstream, m_VideoOutputInfo.codec);
         const auto hevc_vps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_VPS; });
         const auto hevc_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_SPS; });
         const auto hevc_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_PPS; });
@@ -419,37 +442,19 @@ RGY_ERR RGYOutput::InsertMetadata(RGYBitstream *bitstream, std::vector<std::uniq
             }
         }
 
-        bitstream->setSize(0);
-        bitstream->setOffset(0);
         if (!header_check) {
-            for (auto& metadata : metadataList) {
-                if (!metadata->written && metadata->pos == RGYOutputInsertMetadataPosition::Prefix) {
-                    bitstream->append(metadata->mdata.data(), metadata->mdata.size());
-                    metadata->written = true;
-                }
-            }
+            appendMetadata(RGYOutputInsertMetadataPosition::Prefix);
         }
         for (int i = 0; i < (int)nal_list.size(); i++) {
-            bitstream->append(nal_list[i].ptr, nal_list[i].size);
+            bsView.append(nal_list[i].ptr, nal_list[i].size);
             if (nal_list[i].type == NALU_HEVC_VPS || nal_list[i].type == NALU_HEVC_SPS || nal_list[i].type == NALU_HEVC_PPS) {
                 if (i + 1 < (int)nal_list.size()
                     && (nal_list[i + 1].type != NALU_HEVC_VPS && nal_list[i + 1].type != NALU_HEVC_SPS && nal_list[i + 1].type != NALU_HEVC_PPS)) {
-                    for (auto& metadata : metadataList) {
-                        if (!metadata->written && metadata->pos == RGYOutputInsertMetadataPosition::Prefix) {
-                            bitstream->append(metadata->mdata.data(), metadata->mdata.size());
-                            metadata->written = true;
-                        }
-                    }
+                    appendMetadata(RGYOutputInsertMetadataPosition::Prefix);
                 }
             }
         }
-        for (auto& metadata : metadataList) {
-            if (!metadata->written && metadata->pos == RGYOutputInsertMetadataPosition::Appendix) {
-                bitstream->append(metadata->mdata.data(), metadata->mdata.size());
-                metadata->written = true;
-            }
-        }
-        bsCopy.clear();
+        appendMetadata(RGYOutputInsertMetadataPosition::Appendix);
         for (auto& metadata : metadataList) {
             if (!metadata->written) {
                 AddMessage(RGY_LOG_ERROR, _T("metadata not written, unexpected HEVC header.\n"));
@@ -457,12 +462,10 @@ RGY_ERR RGYOutput::InsertMetadata(RGYBitstream *bitstream, std::vector<std::uniq
             }
         }
     } else if (m_VideoOutputInfo.codec == RGY_CODEC_AV1) {
-        const auto av1_units = parse_unit_av1(bitstream->data(), bitstream->size());
-        bitstream->setSize(0);
-        bitstream->setOffset(0);
+        const auto& av1_units = m_unitIndex.get(bitstream, m_VideoOutputInfo.codec);
 
-        const auto has_seq_header = std::find_if(av1_units.begin(), av1_units.end(), [](const std::unique_ptr<unit_info>& info) { return info->type == OBU_SEQUENCE_HEADER; }) != av1_units.end();
-        const auto has_td = std::find_if(av1_units.begin(), av1_units.end(), [](const std::unique_ptr<unit_info>& info) { return info->type == OBU_TEMPORAL_DELIMITER; }) != av1_units.end();
+        const auto has_seq_header = std::find_if(av1_units.begin(), av1_units.end(), [](const nal_info& info) { return info.type == OBU_SEQUENCE_HEADER; }) != av1_units.end();
+        const auto has_td = std::find_if(av1_units.begin(), av1_units.end(), [](const nal_info& info) { return info.type == OBU_TEMPORAL_DELIMITER; }) != av1_units.end();
 
         // onSequenceHeader = trueの場合、ヘッダーがない場合は、written=trueにして書き込まないようにする
         for (auto& metadata : metadataList) {
@@ -472,18 +475,13 @@ RGY_ERR RGYOutput::InsertMetadata(RGYBitstream *bitstream, std::vector<std::uniq
         }
 
         if (!has_seq_header && !has_td) {
-            for (auto& metadata : metadataList) {
-                if (!metadata->written && metadata->pos == RGYOutputInsertMetadataPosition::Prefix) {
-                    bitstream->append(metadata->mdata.data(), metadata->mdata.size());
-                    metadata->written = true;
-                }
-            }
+            appendMetadata(RGYOutputInsertMetadataPosition::Prefix);
         }
 
         //最後のFRAME/FRAME_HEADER OBUの位置
         int lastFrameIdx = -1;
         for (int i = (int)av1_units.size()-1; i >= 0; i--) {
-            if (av1_units[i]->type == OBU_FRAME || av1_units[i]->type == OBU_FRAME_HEADER) {
+            if (av1_units[i].type == OBU_FRAME || av1_units[i].type == OBU_FRAME_HEADER) {
                 lastFrameIdx = i;
                 break;
             }
@@ -491,32 +489,17 @@ RGY_ERR RGYOutput::InsertMetadata(RGYBitstream *bitstream, std::vector<std::uniq
 
         for (int i = 0; i < (int)av1_units.size(); i++) {
             if (i == lastFrameIdx) {
-                for (auto& metadata : metadataList) {
-                    if (!metadata->written && metadata->pos == RGYOutputInsertMetadataPosition::FrontOfLastFrame) {
-                        bitstream->append(metadata->mdata.data(), metadata->mdata.size());
-                        metadata->written = true;
-                    }
-                }
+                appendMetadata(RGYOutputInsertMetadataPosition::FrontOfLastFrame);
             }
-            bitstream->append(av1_units[i]->unit_data.data(), av1_units[i]->unit_data.size());
-            if (av1_units[i]->type == OBU_TEMPORAL_DELIMITER || av1_units[i]->type == OBU_SEQUENCE_HEADER) {
+            bsView.append(av1_units[i].ptr, av1_units[i].size);
+            if (av1_units[i].type == OBU_TEMPORAL_DELIMITER || av1_units[i].type == OBU_SEQUENCE_HEADER) {
                 if (i + 1 < (int)av1_units.size()
-                    && (av1_units[i + 1]->type != OBU_TEMPORAL_DELIMITER && av1_units[i + 1]->type != OBU_SEQUENCE_HEADER)) {
-                    for (auto& metadata : metadataList) {
-                        if (!metadata->written && metadata->pos == RGYOutputInsertMetadataPosition::Prefix) {
-                            bitstream->append(metadata->mdata.data(), metadata->mdata.size());
-                            metadata->written = true;
-                        }
-                    }
+                    && (av1_units[i + 1].type != OBU_TEMPORAL_DELIMITER && av1_units[i + 1].type != OBU_SEQUENCE_HEADER)) {
+                    appendMetadata(RGYOutputInsertMetadataPosition::Prefix);
                 }
             }
         }
-        for (auto& metadata : metadataList) {
-            if (!metadata->written && metadata->pos == RGYOutputInsertMetadataPosition::Appendix) {
-                bitstream->append(metadata->mdata.data(), metadata->mdata.size());
-                metadata->written = true;
-            }
-        }
+        appendMetadata(RGYOutputInsertMetadataPosition::Appendix);
         for (auto& metadata : metadataList) {
             if (!metadata->written) {
                 AddMessage(RGY_LOG_ERROR, _T("metadata not written, unexpected AV1 frame.\n"));
@@ -530,6 +513,66 @@ RGY_ERR RGYOutput::InsertMetadata(RGYBitstream *bitstream, std::vector<std::uniq
     return RGY_ERR_NONE;
 }
 
+RGYBitstreamUnitIndex::RGYBitstreamUnitIndex() :
+    m_codec(RGY_CODEC_UNKNOWN),
+    m_data(nullptr),
+    m_size(0),
+    m_pts(0),
+    m_valid(false),
+    m_list(),
+    m_parse_nal_h264(get_parse_nal_unit_h264_func()),
+    m_parse_nal_hevc(get_parse_nal_unit_hevc_func()),
+    m_parseCount(0),
+    m_reuseCount(0) {
+}
+
+RGYBitstreamUnitIndex::~RGYBitstreamUnitIndex() { }
+
+const std::vector<nal_info>& RGYBitstreamUnitIndex::get(const RGYBitstream *bitstream, const RGY_CODEC codec) {
+    if (m_valid && m_codec == codec && m_data == bitstream->data() && m_size == bitstream->size() && m_pts == bitstream->pts()) {
+        m_reuseCount++;
+        return m_list;
+    }
+    switch (codec) {
+    case RGY_CODEC_H264: m_list = m_parse_nal_h264(bitstream->data(), bitstream->size()); break;
+    case RGY_CODEC_HEVC: m_list = m_parse_nal_hevc(bitstream->data(), bitstream->size()); break;
+    case RGY_CODEC_AV1:  m_list = parse_unit_av1_ref(bitstream->data(), bitstream->size()); break;
+    default: m_list.clear(); break;
+    }
+    m_parseCount++;
+    m_codec = codec;
+    m_data = bitstream->data();
+    m_size = bitstream->size();
+    m_pts = bitstream->pts();
+    m_valid = true;
+    return m_list;
+}
+
+void RGYBitstreamUnitIndex::update(const RGYBitstream *bitstream, const RGY_CODEC codec, std::vector<nal_info>&& list) {
+    m_list = std::move(list);
+    size_t offset = 0;
+    for (auto& unit : m_list) {
+        unit.ptr = bitstream->data() + offset;
+        offset += unit.size;
+    }
+    if (offset != bitstream->size()) {
+        invalidate();
+        return;
+    }
+    m_codec = codec;
+    m_data = bitstream->data();
+    m_size = bitstream->size();
+    m_pts = bitstream->pts();
+    m_valid = true;
+}
+
+void RGYBitstreamUnitIndex::invalidate() {
+    m_valid = false;
+    m_data = nullptr;
+    m_size = 0;
+    m_list.clear();
+}
+
 RGYOutputBSF::RGYOutputBSF(AVBSFContext *bsf, RGY_CODEC codec, tstring strWriterName, shared_ptr<RGYLog> log) :
     m_strWriterName(strWriterName),
     m_log(log),
@@ -544,13 +587,16 @@ RGYOutputBSF::RGYOutputBSF(AVBSFContext *bsf, RGY_CODEC codec, tstring strWriter
 
 RGYOutputBSF::~RGYOutputBSF() { }
 
-RGY_ERR RGYOutputBSF::applyBitstreamFilter(RGYBitstream *bitstream) {
+RGY_ERR RGYOutputBSF::applyBitstreamFilter(RGYBitstream *bitstream, RGYBitstreamUnitIndex *unitIndex) {
     if (m_codec == RGY_CODEC_H264 || m_codec == RGY_CODEC_HEVC) {
         int target_nal_start = -1;
         int target_nal_end = -1;
-        std::vector<nal_info> nal_list;
+        std::vector<nal_info> nal_list_parsed;
+        if (!unitIndex) {
+            nal_list_parsed = (m_codec == RGY_CODEC_HEVC) ? m_parse_nal_hevc(bitstream->data(), bitstream->size()) : m_parse_nal_h264(bitstream->data(), bitstream->size());
+        }
+        const auto& nal_list = (unitIndex) ? unitIndex->get(bitstream, m_codec) : nal_list_parsed;
         if (m_codec == RGY_CODEC_HEVC) {
-            nal_list = m_parse_nal_hevc(bitstream->data(), bitstream->size());
             for (int i = 0; i < (int)nal_list.size(); i++) {
                 if (nal_list[i].type == NALU_HEVC_VPS || nal_list[i].type == NALU_HEVC_SPS || nal_list[i].type == NALU_HEVC_PPS) {
                     if (target_nal_start < 0) target_nal_start = i;
@@ -560,7 +606,6 @@ RGY_ERR RGYOutputBSF::applyBitstreamFilter(RGYBitstream *bitstream) {
                 }
             }
         } else if (m_codec == RGY_CODEC_H264) {
-            nal_list = m_parse_nal_h264(bitstream->data(), bitstream->size());
             for (int i = 0; i < (int)nal_list.size(); i++) {
                 if (nal_list[i].type == NALU_H264_SPS || nal_list[i].type == NALU_H264_PPS) {
                     if (target_nal_start < 0) target_nal_start = i;
@@ -611,8 +656,20 @@ RGY_ERR RGYOutputBSF::applyBitstreamFilter(RGYBitstream *bitstream) {
                 AddMessage(RGY_LOG_ERROR, _T("Unexpected error occured after running bitstream filter.\n"));
                 return RGY_ERR_UNKNOWN;
             }
+            //分割結果は、置き換えたヘッダー部分のみ解析しなおして更新する
+            std::vector<nal_info> new_nal_list;
+            if (unitIndex) {
+                const auto header_nal_list = (m_codec == RGY_CODEC_HEVC) ? m_parse_nal_hevc(pkt->data, pkt->size) : m_parse_nal_h264(pkt->data, pkt->size);
+                new_nal_list.reserve(nal_list.size() - (target_nal_end - target_nal_start + 1) + header_nal_list.size());
+                new_nal_list.insert(new_nal_list.end(), nal_list.begin(), nal_list.begin() + target_nal_start);
+                new_nal_list.insert(new_nal_list.end(), header_nal_list.begin(), header_nal_list.end());
+                new_nal_list.insert(new_nal_list.end(), nal_list.begin() + target_nal_end + 1, nal_list.end());
+            }
             bitstream->copy(m_bsfBuffer.data(), new_data_size);
             av_packet_unref(pkt);
+            if (unitIndex) {
+                unitIndex->update(bitstream, m_codec, std::move(new_nal_list));
+            }
 
             av_bsf_flush(m_bsfc.get());
         }
@@ -639,6 +696,9 @@ RGY_ERR RGYOutputBSF::applyBitstreamFilter(RGYBitstream *bitstream) {
         bitstream->append(pkt->data, pkt->size);
         av_bsf_flush(m_bsfc.get());
         av_packet_unref(pkt);
+        if (unitIndex) {
+            unitIndex->invalidate();
+        }
     } else {
         AddMessage(RGY_LOG_ERROR, _T("bitstream filter not supported for %s.\n"), CodecToStr(m_codec).c_str());
         return RGY_ERR_UNSUPPORTED;
@@ -661,7 +721,11 @@ RGYOutputRaw::RGYOutputRaw() :
     m_debugDirectAV1Out(false),
     m_extPERaw(false),
     m_qFirstProcessData(nullptr),
-    m_qFirstProcessDataFree(nullptr) {
+    m_qFirstProcessDataFree(nullptr),
+    m_qFirstProcessDataFreeLarge(nullptr),
+    m_peCacheBudget(nullptr),
+    m_peChunkId(-1),
+    m_peSpillFile() {
     m_strWriterName = _T("bitstream");
     m_OutType = OUT_TYPE_BITSTREAM;
 }
@@ -738,6 +802,12 @@ RGY_ERR RGYOutputRaw::Init(const TCHAR *strFileName, const VideoInfo *pVideoOutp
         m_qFirstProcessData = rawPrm->qFirstProcessData;
         m_qFirstProcessDataFree = rawPrm->qFirstProcessDataFree;
         m_qFirstProcessDataFreeLarge = rawPrm->qFirstProcessDataFreeLarge;
+        if (m_qFirstProcessData && rawPrm->peCacheBudget) {
+            // hybridキャッシュモードでは、メモリの上限を超えた分は出力ファイルに退避する
+            m_peCacheBudget = rawPrm->peCacheBudget;
+            m_peChunkId = rawPrm->peChunkId;
+            m_peSpillFile = strFileName;
+        }
         m_hdr10plusMetadataCopy = rawPrm->hdr10plusMetadataCopy;
         m_hdr10plus = rawPrm->hdr10plus;
         m_doviProfileDst = rawPrm->doviProfile;
@@ -789,8 +859,10 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
 
     readRawDebug(pBitstream);
 
+    //NAL/OBUの分割結果は、このフレームの出力処理の間使いまわす
+    m_unitIndex.invalidate();
     if (m_bsf) {
-        auto sts = m_bsf->applyBitstreamFilter(pBitstream);
+        auto sts = m_bsf->applyBitstreamFilter(pBitstream, &m_unitIndex);
         if (sts != RGY_ERR_NONE) {
             return sts;
         }
@@ -798,20 +870,30 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYBitstream *pBitstream) {
     writeRawDebug(pBitstream);
 
     if (m_VideoOutputInfo.codec == RGY_CODEC_AV1) {
-        const auto av1_units = parse_unit_av1(pBitstream->data(), pBitstream->size());
-        const auto td_count = std::count_if(av1_units.begin(), av1_units.end(), [](const std::unique_ptr<unit_info>& info) { return info->type == OBU_TEMPORAL_DELIMITER; });
+        const auto& bs_av1_units = m_unitIndex.get(pBitstream, m_VideoOutputInfo.codec);
+        const auto td_count = std::count_if(bs_av1_units.begin(), bs_av1_units.end(), [](const nal_info& info) { return info.type == OBU_TEMPORAL_DELIMITER; });
         if (td_count > 1) {
+            //分割したフレームごとに分割結果を設定しなおすので、元の分割結果はコピーしておく
+            const std::vector<nal_info> av1_units = bs_av1_units;
             RGYBitstream bsCopy = RGYBitstreamInit();
+            std::vector<nal_info> frame_units;
             for (int i = 0; i < (int)av1_units.size(); i++) {
-                if (av1_units[i]->type == OBU_TEMPORAL_DELIMITER && bsCopy.size() > 0) {
+                if (av1_units[i].type == OBU_TEMPORAL_DELIMITER && bsCopy.size() > 0) {
+                    m_unitIndex.update(&bsCopy, m_VideoOutputInfo.codec, std::move(frame_units));
+                    frame_units.clear();
                     WriteNextOneFrame(&bsCopy);
                 }
-                bsCopy.append(av1_units[i]->unit_data.data(), av1_units[i]->unit_data.size());
+                bsCopy.append(av1_units[i].ptr, av1_units[i].size);
+                frame_units.push_back(av1_units[i]);
             }
+            RGY_ERR err = RGY_ERR_NONE;
             if (bsCopy.size() > 0) {
-                return WriteNextOneFrame(&bsCopy);
+                m_unitIndex.update(&bsCopy, m_VideoOutputInfo.codec, std::move(frame_units));
+                err = WriteNextOneFrame(&bsCopy);
             }
-            return RGY_ERR_NONE;
+            bsCopy.clear();
+            m_unitIndex.invalidate();
+            return err;
         }
     }
     return WriteNextOneFrame(pBitstream);
@@ -845,11 +927,11 @@ RGY_ERR RGYOutputRaw::WriteNextOneFrame(RGYBitstream *pBitstream) {
     std::vector<std::unique_ptr<RGYOutputInsertMetadata>> metadataList;
     if (m_hdrBitstream.size() > 0) {
         std::vector<uint8_t> data(m_hdrBitstream.data(), m_hdrBitstream.data() + m_hdrBitstream.size());
-        metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(data, true, RGYOutputInsertMetadataPosition::Prefix));
+        metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(std::move(data), true, RGYOutputInsertMetadataPosition::Prefix));
     }
     if (m_hdr10plus) {
         if (auto data = m_hdr10plus->getData(bs_framedata.inputFrameId, m_VideoOutputInfo.codec); data.size() > 0) {
-            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(data, false, RGYOutputInsertMetadata::dhdr10plus_pos(m_VideoOutputInfo.codec)));
+            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(std::move(data), false, RGYOutputInsertMetadata::dhdr10plus_pos(m_VideoOutputInfo.codec)));
         }
     } else if (m_hdr10plusMetadataCopy) {
         auto [err_hdr10plus, metadata_hdr10plus] = getMetadata<RGYFrameDataHDR10plus>(RGY_FRAME_DATA_HDR10PLUS, bs_framedata, nullptr);
@@ -857,7 +939,7 @@ RGY_ERR RGYOutputRaw::WriteNextOneFrame(RGYBitstream *pBitstream) {
             return err_hdr10plus;
         }
         if (metadata_hdr10plus.size() > 0) {
-            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(metadata_hdr10plus, false, RGYOutputInsertMetadata::dhdr10plus_pos(m_VideoOutputInfo.codec)));
+            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(std::move(metadata_hdr10plus), false, RGYOutputInsertMetadata::dhdr10plus_pos(m_VideoOutputInfo.codec)));
         }
     }
     if (m_doviRpu) {
@@ -866,7 +948,7 @@ RGY_ERR RGYOutputRaw::WriteNextOneFrame(RGYBitstream *pBitstream) {
             AddMessage(RGY_LOG_ERROR, _T("Failed to get dovi rpu for %lld.\n"), bs_framedata.inputFrameId);
         }
         if (dovi_nal.size() > 0) {
-            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(dovi_nal, false, RGYOutputInsertMetadata::dovirpu_pos(m_VideoOutputInfo.codec)));
+            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(std::move(dovi_nal), false, RGYOutputInsertMetadata::dovirpu_pos(m_VideoOutputInfo.codec)));
         }
     } else if (m_doviRpuMetadataCopy) {
         auto doviRpuConvPrm = std::make_unique<RGYFrameDataDOVIRpuConvertParam>(m_doviProfileDst, m_doviRpuConvertParam);
@@ -875,11 +957,13 @@ RGY_ERR RGYOutputRaw::WriteNextOneFrame(RGYBitstream *pBitstream) {
             return err_dovirpu;
         }
         if (metadata_dovi_rpu.size() > 0) {
-            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(metadata_dovi_rpu, false, RGYOutputInsertMetadata::dovirpu_pos(m_VideoOutputInfo.codec)));
+            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(std::move(metadata_dovi_rpu), false, RGYOutputInsertMetadata::dovirpu_pos(m_VideoOutputInfo.codec)));
         }
     }
 
-    err = InsertMetadata(pBitstream, metadataList);
+    //メタデータを挿入した出力データは、pBitstreamとmetadataListを参照する断片のリストとして受け取る
+    RGYBitstreamView bsView;
+    err = InsertMetadata(bsView, pBitstream, metadataList);
     if (err != RGY_ERR_NONE) {
         return err;
     }
@@ -895,40 +979,62 @@ RGY_ERR RGYOutputRaw::WriteNextOneFrame(RGYBitstream *pBitstream) {
         peHeader.inputFrameIdx = bs_framedata.inputFrameId;
         peHeader.encodeFrameIdx = bs_framedata.encodeFrameId;
         peHeader.flags = pBitstream->dataflag();
-        peHeader.size = pBitstream->size();
-        if (m_qFirstProcessData) { // 並列エンコード用のキューが指定されている場合は、ファイル出力せず、キューにデータを渡す
-            RGYOutputRawPEExtHeader *ptr = nullptr;
+        peHeader.size = bsView.size();
+        // 実際のサイズか、RGY_PE_EXT_HEADER_DATA_BUF_SIZEの大きい方のサイズで確保
+        const auto newAllocSize = std::max(sizeof(peHeader) + bsView.size(), RGY_PE_EXT_HEADER_DATA_NORMAL_BUF_SIZE);
+        RGYOutputRawPEExtHeader *ptr = nullptr;
+        size_t allocSize = 0;
+        if (m_qFirstProcessData) {
             //空きポインタを保持するキューから取得
-            RGYQueueMPMP<RGYOutputRawPEExtHeader*> *freeQueue = (sizeof(peHeader) + pBitstream->size() <= RGY_PE_EXT_HEADER_DATA_NORMAL_BUF_SIZE) ? m_qFirstProcessDataFree : m_qFirstProcessDataFreeLarge;
-            if (!freeQueue->front_copy_and_pop_no_lock(&ptr)) {
+            //hybridキャッシュモードでは、空きキューに保持しているバッファはすでにメモリ使用量に含まれている
+            auto freeQueue = (newAllocSize <= RGY_PE_EXT_HEADER_DATA_NORMAL_BUF_SIZE) ? m_qFirstProcessDataFree : m_qFirstProcessDataFreeLarge;
+            if (freeQueue->try_pop(&ptr) && ptr->allocSize < newAllocSize) {
+                //サイズが足りないバッファは返却する
+                if (m_peCacheBudget) m_peCacheBudget->release(ptr->allocSize);
+                RGYBitstreamBufPool::get().release(ptr);
                 ptr = nullptr;
             }
-            auto allocSize = (ptr) ? ptr->allocSize : 0;
-            // 実際のサイズか、RGY_PE_EXT_HEADER_DATA_BUF_SIZEの大きい方のサイズで確保
-            const auto newAllocSize = std::max(sizeof(peHeader) + pBitstream->size(), RGY_PE_EXT_HEADER_DATA_NORMAL_BUF_SIZE);
-            if (ptr == nullptr || ptr->allocSize < newAllocSize) {
-                if (ptr) free(ptr);
-                ptr = (RGYOutputRawPEExtHeader *)malloc(newAllocSize);
+            allocSize = (ptr) ? ptr->allocSize : RGYBitstreamBufPool::allocSize(newAllocSize);
+        }
+        // 新たに確保する場合は、プールから実際に確保されるサイズでメモリの上限を確認する
+        if (m_qFirstProcessData && ptr == nullptr && m_peCacheBudget && !m_peCacheBudget->reserve(m_peChunkId, allocSize)) {
+            // hybridキャッシュモードでメモリの上限を超える場合は、データをファイルに退避し、キューにはヘッダのみを渡す
+            if (auto sts = WritePESpill(&peHeader, bsView); sts != RGY_ERR_NONE) {
+                return sts;
+            }
+            nBytesWritten += bsView.size();
+        } else if (m_qFirstProcessData) { // 並列エンコード用のキューが指定されている場合は、ファイル出力せず、キューにデータを渡す
+            if (ptr == nullptr) {
+                const auto reservedSize = allocSize;
+                ptr = (RGYOutputRawPEExtHeader *)RGYBitstreamBufPool::get().alloc(newAllocSize, &allocSize);
                 if (ptr == nullptr) {
+                    if (m_peCacheBudget) m_peCacheBudget->release(reservedSize);
                     AddMessage(RGY_LOG_ERROR, _T("failed to allocate memory for parallel encoding header.\n"));
                     return RGY_ERR_NULL_PTR;
                 }
-                allocSize = newAllocSize;
             }
             memcpy(ptr, &peHeader, sizeof(peHeader));
-            memcpy(ptr + 1, pBitstream->data(), pBitstream->size());
+            bsView.copyTo((uint8_t *)(ptr + 1));
             ptr->allocSize = allocSize; // allocsizeはpeHeaderで上書きされているので、ここで再設定
-            m_qFirstProcessData->push(ptr);
-            nBytesWritten += pBitstream->size();
+            // キューがいっぱいなら親が読み出すまで待機する、closeされた場合は親が中断している
+            if (!m_qFirstProcessData->push(ptr)) {
+                if (m_peCacheBudget) m_peCacheBudget->release(ptr->allocSize);
+                RGYBitstreamBufPool::get().release(ptr);
+                AddMessage(RGY_LOG_DEBUG, _T("parallel encoding queue closed.\n"));
+                return RGY_ERR_ABORTED;
+            }
+            nBytesWritten += bsView.size();
         } else {
             auto ret = _fwrite_nolock(&peHeader, 1, sizeof(peHeader), m_fDest.get());
             WRITE_CHECK(ret, sizeof(peHeader));
         }
     }
     if (!m_qFirstProcessData) {
-        const auto dataSize = _fwrite_nolock(pBitstream->data(), 1, pBitstream->size(), m_fDest.get());
-        WRITE_CHECK(dataSize, pBitstream->size());
-        nBytesWritten += dataSize;
+        for (const auto& slice : bsView.slices()) {
+            const auto dataSize = _fwrite_nolock(slice.ptr, 1, slice.size, m_fDest.get());
+            WRITE_CHECK(dataSize, slice.size);
+            nBytesWritten += dataSize;
+        }
     }
 
     m_encSatusInfo->SetOutputData(pBitstream->frametype(), nBytesWritten, 0);
@@ -937,6 +1043,43 @@ RGY_ERR RGYOutputRaw::WriteNextOneFrame(RGYBitstream *pBitstream) {
     return RGY_ERR_NONE;
 }
 
+RGY_ERR RGYOutputRaw::WritePESpill(const RGYOutputRawPEExtHeader *peHeader, const RGYBitstreamView& bsView) {
+    if (!m_fDest) {
+        FILE *fp = NULL;
+        int error = _tfopen_s(&fp, m_peSpillFile.c_str(), _T("wb"));
+        if (error != 0 || fp == NULL) {
+            AddMessage(RGY_LOG_ERROR, _T("failed to open spill file \"%s\": %s\n"), m_peSpillFile.c_str(), _tcserror(error));
+            return RGY_ERR_FILE_OPEN;
+        }
+        m_fDest.reset(fp);
+        AddMessage(RGY_LOG_DEBUG, _T("Opened spill file \"%s\"\n"), m_peSpillFile.c_str());
+    }
+    // ファイルキャッシュモードと同じく、ヘッダ+データの形式で追記する
+    auto ret = _fwrite_nolock(peHeader, 1, sizeof(*peHeader), m_fDest.get());
+    WRITE_CHECK(ret, sizeof(*peHeader));
+    for (const auto& slice : bsView.slices()) {
+        ret = _fwrite_nolock(slice.ptr, 1, slice.size, m_fDest.get());
+        WRITE_CHECK(ret, slice.size);
+    }
+    // 親がキューからヘッダを受け取った時点でファイルから読めるよう、キューに渡す前に書き出しておく
+    fflush(m_fDest.get());
+
+    auto ptr = (RGYOutputRawPEExtHeader *)RGYBitstreamBufPool::get().alloc(sizeof(RGYOutputRawPEExtHeader), nullptr);
+    if (ptr == nullptr) {
+        AddMessage(RGY_LOG_ERROR, _T("failed to allocate memory for parallel encoding header.\n"));
+        return RGY_ERR_NULL_PTR;
+    }
+    memcpy(ptr, peHeader, sizeof(*peHeader));
+    ptr->allocSize = sizeof(RGYOutputRawPEExtHeader); // ヘッダのみでデータを持たないことを示す
+    m_peCacheBudget->addSpill(sizeof(*peHeader) + bsView.size());
+    if (!m_qFirstProcessData->push(ptr)) {
+        RGYBitstreamBufPool::get().release(ptr);
+        AddMessage(RGY_LOG_DEBUG, _T("parallel encoding queue closed.\n"));
+        return RGY_ERR_ABORTED;
+    }
+    return RGY_ERR_NONE;
+}
+
 RGY_ERR RGYOutputRaw::WriteNextFrame(RGYFrame *pSurface) {
     UNREFERENCED_PARAMETER(pSurface);
     return RGY_ERR_UNSUPPORTED;
@@ -944,12 +1087,20 @@ RGY_ERR RGYOutputRaw::WriteNextFrame(RGYFrame *pSurface) {
 
 #if ENCODER_QSV || ENCODER_NVENC
 
-RGYOutFrame::RGYOutFrame() : m_bY4m(true) {
+RGYOutFrame::RGYOutFrame() :
+    m_bY4m(true),
+    m_threadParam(),
+    m_thWrite(),
+    m_thWriteErr(RGY_ERR_NONE),
+    m_qFrameBufWrite(),
+    m_qFrameBufFree(),
+    m_frameBufAllocated(0) {
     m_strWriterName = _T("yuv writer");
     m_OutType = OUT_TYPE_SURFACE;
 };
 
 RGYOutFrame::~RGYOutFrame() {
+    Close();
 };
 
 RGY_ERR RGYOutFrame::Init(const TCHAR *strFileName, const VideoInfo *pVideoOutputInfo, const void *prm) {
@@ -971,12 +1122,100 @@ RGY_ERR RGYOutFrame::Init(const TCHAR *strFileName, const VideoInfo *pVideoOutpu
     YUVWriterParam *writerParam = (YUVWriterParam *)prm;
 
     m_bY4m = writerParam->bY4m;
+    m_threadParam = writerParam->threadParamOutput;
     m_sourceHWMem = true;
+
+    //フレーム単位にまとめたデータを書き込むスレッドを起動する
+    m_thWriteErr = RGY_ERR_NONE;
+    m_frameBufAllocated = 0;
+    m_qFrameBufWrite.init(FRAME_BUF_COUNT + 1);
+    m_qFrameBufFree.init(FRAME_BUF_COUNT + 1);
+    m_thWrite = std::thread(&RGYOutFrame::WriteThreadFunc, this, m_threadParam);
+    AddMessage(RGY_LOG_DEBUG, _T("started writer thread, %d frame buffers.\n"), FRAME_BUF_COUNT);
     m_inited = true;
 
     return RGY_ERR_NONE;
 }
 
+RGY_ERR RGYOutFrame::WriteThreadFunc(RGYParamThread threadParam) {
+    threadParam.apply(GetCurrentThread());
+    AddMessage(RGY_LOG_DEBUG, _T("Set output thread param: %s.\n"), threadParam.desc().c_str());
+    for (;;) {
+        RGYOutFrameBuf buf;
+        if (!m_qFrameBufWrite.front_copy_and_pop_no_lock(&buf)) {
+            m_qFrameBufWrite.wait_for_push();
+            continue;
+        }
+        if (buf.ptr == nullptr) { // 終了の合図
+            break;
+        }
+        //エラーが発生した後も、WriteNextFrame側が待機し続けないようバッファは返却する
+        if (m_thWriteErr == RGY_ERR_NONE
+            && fwrite(buf.ptr, 1, buf.size, m_fDest.get()) != buf.size) {
+            AddMessage(RGY_LOG_ERROR, _T("Error writing file.\nNot enough disk space!\n"));
+            m_thWriteErr = RGY_ERR_UNDEFINED_BEHAVIOR;
+        }
+        m_qFrameBufFree.push(buf);
+    }
+    return m_thWriteErr;
+}
+
+RGY_ERR RGYOutFrame::getFrameBuf(RGYOutFrameBuf& buf, const size_t size) {
+    buf = RGYOutFrameBuf();
+    if (m_frameBufAllocated < FRAME_BUF_COUNT) {
+        m_frameBufAllocated++; // まだ確保数に達していなければ、新たに確保する
+    } else {
+        while (!m_qFrameBufFree.front_copy_and_pop_no_lock(&buf)) {
+            if (m_thWriteErr != RGY_ERR_NONE) {
+                return m_thWriteErr;
+            }
+            m_qFrameBufFree.wait_for_push();
+        }
+    }
+    if (buf.capacity < size) {
+        if (buf.ptr) {
+            RGYSysFramePool::get().release(buf.ptr);
+        }
+        //SIMDでの書き込みがはみ出してもよいよう、余裕を持たせる
+        buf.capacity = size;
+        buf.ptr = (uint8_t *)RGYSysFramePool::get().alloc(buf.capacity + 64);
+        if (!buf.ptr) {
+            buf.capacity = 0;
+            m_frameBufAllocated--;
+            AddMessage(RGY_LOG_ERROR, _T("Failed to allocate frame buffer.\n"));
+            return RGY_ERR_NULL_PTR;
+        }
+    }
+    buf.size = size;
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYOutFrame::WaitFin() {
+    if (m_thWrite.joinable()) {
+        m_qFrameBufWrite.push(RGYOutFrameBuf()); // 終了の合図
+        m_thWrite.join();
+        AddMessage(RGY_LOG_DEBUG, _T("Closed writer thread.\n"));
+    }
+    //最後の数フレームの書き込みエラーはWriteNextFrameでは検出できないので、ここで返す
+    return m_thWriteErr;
+}
+
+void RGYOutFrame::Close() {
+    WaitFin();
+    //スレッド終了後はすべてのバッファが空きキューに戻っている
+    RGYOutFrameBuf buf;
+    while (m_frameBufAllocated > 0 && m_qFrameBufFree.front_copy_and_pop_no_lock(&buf)) {
+        if (buf.ptr) {
+            RGYSysFramePool::get().release(buf.ptr);
+        }
+        m_frameBufAllocated--;
+    }
+    m_qFrameBufFree.close();
+    m_qFrameBufWrite.close();
+    m_frameBufAllocated = 0;
+    RGYOutput::Close();
+}
+
 RGY_ERR RGYOutFrame::WriteNextFrame(RGYBitstream *pBitstream) {
     UNREFERENCED_PARAMETER(pBitstream);
     return RGY_ERR_UNSUPPORTED;
@@ -986,6 +1225,14 @@ RGY_ERR RGYOutFrame::WriteNextFrame(RGYFrame *pSurface) {
     if (!m_fDest) {
         return RGY_ERR_NULL_PTR;
     }
+    if (m_thWriteErr != RGY_ERR_NONE) {
+        return m_thWriteErr;
+    }
+    if (   RGY_CSP_CHROMA_FORMAT[pSurface->csp()] != RGY_CHROMAFMT_YUV420
+        && RGY_CSP_CHROMA_FORMAT[pSurface->csp()] != RGY_CHROMAFMT_YUV444) {
+        AddMessage(RGY_LOG_ERROR, _T("Unsupported colorspace %s.\n"), RGY_CSP_NAMES[pSurface->csp()]);
+        return RGY_ERR_INVALID_COLOR_FORMAT;
+    }
 
     if (m_sourceHWMem) {
         if (m_readBuffer.get() == nullptr) {
@@ -995,6 +1242,7 @@ RGY_ERR RGYOutFrame::WriteNextFrame(RGYFrame *pSurface) {
 
     if (m_bY4m) {
         if (!m_y4mHeaderWritten) {
+            //最初のフレームの前なので、書き込みスレッドとは競合しない
             auto csp = pSurface->csp();
             if (csp == RGY_CSP_NV12) {
                 csp = RGY_CSP_YV12;
@@ -1004,7 +1252,6 @@ RGY_ERR RGYOutFrame::WriteNextFrame(RGYFrame *pSurface) {
             WriteY4MHeader(m_fDest.get(), &m_VideoOutputInfo, csp);
             m_y4mHeaderWritten = true;
         }
-        WRITE_CHECK(fwrite("FRAME\n", 1, strlen("FRAME\n"), m_fDest.get()), strlen("FRAME\n"));
     }
 
     auto loadLineToBuffer = [](uint8_t *ptrBuf, uint8_t *ptrSrc, const int pitch) {
@@ -1038,69 +1285,76 @@ RGY_ERR RGYOutFrame::WriteNextFrame(RGYFrame *pSurface) {
         crop = mfxsurf->crop();
     }
 #endif
+    const bool srcNV12 = pSurface->csp() == RGY_CSP_NV12 || pSurface->csp() == RGY_CSP_P010;
     const int pixSize = RGY_CSP_BIT_DEPTH[pSurface->csp()] > 8 ? 2 : 1;
-    if (   RGY_CSP_CHROMA_FORMAT[pSurface->csp()] == RGY_CHROMAFMT_YUV420
-        || RGY_CSP_CHROMA_FORMAT[pSurface->csp()] == RGY_CHROMAFMT_YUV444) {
-        const uint32_t lumaWidthBytes = pSurface->width() * pixSize;
-        const uint32_t cropOffset = crop.e.up * pSurface->pitch() + crop.e.left * pixSize;
-        if (m_sourceHWMem) {
-            for (decltype(pSurface->height()) j = 0; j < pSurface->height(); j++) {
-                uint8_t *ptrBuf = m_readBuffer.get();
-                uint8_t *ptrSrc = pSurface->ptrY() + (crop.e.up + j) * pSurface->pitch();
-                loadLineToBuffer(ptrBuf, ptrSrc, pSurface->pitch());
-                WRITE_CHECK(fwrite(ptrBuf + crop.e.left * pixSize, 1, lumaWidthBytes, m_fDest.get()), lumaWidthBytes);
-            }
-        } else {
-            for (decltype(pSurface->height()) j = 0; j < pSurface->height(); j++) {
-                WRITE_CHECK(fwrite(pSurface->ptrY() + cropOffset + j * pSurface->pitch(), 1, lumaWidthBytes, m_fDest.get()), lumaWidthBytes);
-            }
-        }
-    } else {
-        AddMessage(RGY_LOG_ERROR, _T("Unsupported colorspace %s.\n"), RGY_CSP_NAMES[pSurface->csp()]);
-        return RGY_ERR_INVALID_COLOR_FORMAT;
+    const int chromaShift = (RGY_CSP_CHROMA_FORMAT[pSurface->csp()] == RGY_CHROMAFMT_YUV420) ? 1 : 0;
+    const uint32_t lumaWidthBytes = pSurface->width() * pixSize;
+    const uint32_t widthUV = pSurface->width() >> chromaShift;
+    const uint32_t heightUV = pSurface->height() >> chromaShift;
+    const uint32_t chromaWidthBytes = widthUV * pixSize;
+    const int chromaPlanes = (srcNV12) ? 2 : RGY_CSP_PLANES[pSurface->csp()] - 1;
+    const size_t frameHeaderSize = (m_bY4m) ? strlen("FRAME\n") : 0;
+    const size_t frameBytes = frameHeaderSize
+        + (size_t)lumaWidthBytes * pSurface->height()
+        + (size_t)chromaWidthBytes * heightUV * chromaPlanes;
+
+    //1フレーム分のデータをひとつのバッファにまとめ、書き込みは書き込みスレッドでまとめて行う
+    RGYOutFrameBuf buf;
+    auto err = getFrameBuf(buf, frameBytes);
+    if (err != RGY_ERR_NONE) {
+        return err;
+    }
+    uint8_t *ptrDst = buf.ptr;
+    if (m_bY4m) {
+        memcpy(ptrDst, "FRAME\n", frameHeaderSize);
+        ptrDst += frameHeaderSize;
     }
 
-    uint32_t frameSize = 0;
-    if (   pSurface->csp() == RGY_CSP_NV12
-        || pSurface->csp() == RGY_CSP_P010) {
-        const uint32_t widthUV = pSurface->width() >> 1;
-        const uint32_t heightUV = pSurface->height() >> 1;
-        const uint32_t planeOffsetUV = ALIGN32((widthUV * heightUV + 32) * pixSize);
-        if (!m_UVBuffer) {
-            m_UVBuffer.reset((uint8_t *)_aligned_malloc(planeOffsetUV * 2, 32));
+    //Y
+    for (decltype(pSurface->height()) j = 0; j < pSurface->height(); j++, ptrDst += lumaWidthBytes) {
+        uint8_t *ptrSrc = pSurface->ptrY() + (crop.e.up + j) * pSurface->pitch();
+        if (m_sourceHWMem) {
+            loadLineToBuffer(m_readBuffer.get(), ptrSrc, pSurface->pitch());
+            ptrSrc = m_readBuffer.get();
         }
+        memcpy(ptrDst, ptrSrc + crop.e.left * pixSize, lumaWidthBytes);
+    }
 
+    //UV
+    if (srcNV12) {
+        uint8_t *const ptrDstU = ptrDst;
+        uint8_t *const ptrDstV = ptrDst + (size_t)chromaWidthBytes * heightUV;
         for (uint32_t j = 0; j < heightUV; j++) {
-            uint8_t *ptrSrc = pSurface->ptrUV() + (crop.e.up + j) * pSurface->pitch();
-            uint8_t *ptrBuf = ptrSrc;
+            uint8_t *ptrSrc = pSurface->ptrUV() + ((crop.e.up >> 1) + j) * pSurface->pitch();
             if (m_sourceHWMem) {
                 loadLineToBuffer(m_readBuffer.get(), ptrSrc, pSurface->pitch());
-                ptrBuf = m_readBuffer.get();
+                ptrSrc = m_readBuffer.get();
             }
 
-            const void *ptrLineUV = ptrBuf + crop.e.left * pixSize;
-            void *ptrLineU = m_UVBuffer.get() + j * widthUV * pixSize;
-            void *ptrLineV = m_UVBuffer.get() + j * widthUV * pixSize + planeOffsetUV;
+            const void *ptrLineUV = ptrSrc + crop.e.left * pixSize;
+            void *ptrLineU = ptrDstU + j * chromaWidthBytes;
+            void *ptrLineV = ptrDstV + j * chromaWidthBytes;
             if (pSurface->csp() == RGY_CSP_NV12) {
                 const uint8_t *ptrUV = (const uint8_t *)ptrLineUV;
                 uint8_t *ptrU = (uint8_t *)ptrLineU;
                 uint8_t *ptrV = (uint8_t *)ptrLineV;
+                uint32_t i = 0;
 #if defined(_M_IX86) || defined(_M_X64) || defined(__x86_64)
                 alignas(16) static const uint16_t MASK_LOW8[] = {
                     0x00ff, 0x00ff, 0x00ff, 0x00ff, 0x00ff, 0x00ff, 0x00ff, 0x00ff
                 };
                 const __m128i xMaskLow8 = _mm_load_si128((__m128i *)MASK_LOW8);
 
-                for (uint32_t i = 0; i < widthUV; i += 16, ptrUV += 32, ptrU += 16, ptrV += 16) {
+                //出力先は行間に隙間がないので、行末をはみ出さないよう16画素単位で処理できる範囲のみSIMDで処理する
+                for (; i + 16 <= widthUV; i += 16, ptrUV += 32, ptrU += 16, ptrV += 16) {
                     __m128i x0 = _mm_loadu_si128((const __m128i *)(ptrUV + 0));
                     __m128i x1 = _mm_loadu_si128((const __m128i *)(ptrUV + 16));
                     _mm_storeu_si128((__m128i *)ptrU, _mm_packus_epi16(_mm_and_si128(x0, xMaskLow8), _mm_and_si128(x1, xMaskLow8)));
                     _mm_storeu_si128((__m128i *)ptrV, _mm_packus_epi16(_mm_srli_epi16(x0, 8), _mm_srli_epi16(x1, 8)));
                 }
-#else
-                convert_nv12_to_yv12_line_c<uint8_t, uint8_t, 8, 8>(ptrU, ptrV, ptrUV, widthUV);
 #endif
-            } else if (pSurface->csp() == RGY_CSP_P010) {
+                convert_nv12_to_yv12_line_c<uint8_t, 8, uint8_t, 8>(ptrU, ptrV, ptrUV, (int)(widthUV - i));
+            } else {
                 const uint16_t *ptrUV = (const uint16_t *)ptrLineUV;
                 uint16_t *ptrU = (uint16_t *)ptrLineU;
                 uint16_t *ptrV = (uint16_t *)ptrLineV;
@@ -1111,28 +1365,24 @@ RGY_ERR RGYOutFrame::WriteNextFrame(RGYFrame *pSurface) {
                 case 16:
                 default: convert_nv12_to_yv12_line_c<uint16_t, 16, uint16_t, 16>(ptrU, ptrV, ptrUV, widthUV); break;
                 }
-            } else {
-                return RGY_ERR_INVALID_COLOR_FORMAT;
             }
         }
-        WRITE_CHECK(fwrite(m_UVBuffer.get(),                 1, widthUV * heightUV, m_fDest.get()), widthUV * heightUV);
-        WRITE_CHECK(fwrite(m_UVBuffer.get() + planeOffsetUV, 1, widthUV * heightUV, m_fDest.get()), widthUV * heightUV);
-    } else if (RGY_CSP_CHROMA_FORMAT[pSurface->csp()] == RGY_CHROMAFMT_YUV420
-            || RGY_CSP_CHROMA_FORMAT[pSurface->csp()] == RGY_CHROMAFMT_YUV444) {
-        uint8_t *const ptrBuf = m_readBuffer.get();
-
-        for (int iplane = 1; iplane < RGY_CSP_PLANES[pSurface->csp()]; iplane++) {
-            const uint32_t widthUV = pSurface->width() >> (RGY_CSP_CHROMA_FORMAT[pSurface->csp()] == RGY_CHROMAFMT_YUV420 ? 1 : 0);
-            const uint32_t heightUV = pSurface->height() >> (RGY_CSP_CHROMA_FORMAT[pSurface->csp()] == RGY_CHROMAFMT_YUV420 ? 1 : 0);
-            for (uint32_t i = 0; i < heightUV; i++) {
-                loadLineToBuffer(ptrBuf, pSurface->ptrPlane((RGY_PLANE)iplane) + (crop.e.up + i) * pSurface->pitch((RGY_PLANE)iplane), pSurface->pitch((RGY_PLANE)iplane));
-                WRITE_CHECK(fwrite(ptrBuf + (crop.e.left * pixSize >> 1), 1, widthUV * pixSize, m_fDest.get()), widthUV * pixSize);
+    } else {
+        for (int iplane = 1; iplane <= chromaPlanes; iplane++) {
+            for (uint32_t j = 0; j < heightUV; j++, ptrDst += chromaWidthBytes) {
+                uint8_t *ptrSrc = pSurface->ptrPlane((RGY_PLANE)iplane) + ((crop.e.up >> chromaShift) + j) * pSurface->pitch((RGY_PLANE)iplane);
+                if (m_sourceHWMem) {
+                    loadLineToBuffer(m_readBuffer.get(), ptrSrc, pSurface->pitch((RGY_PLANE)iplane));
+                    ptrSrc = m_readBuffer.get();
+                }
+                memcpy(ptrDst, ptrSrc + (crop.e.left >> chromaShift) * pixSize, chromaWidthBytes);
             }
         }
-    } else {
-        return RGY_ERR_INVALID_COLOR_FORMAT;
     }
 
+    m_qFrameBufWrite.push(buf);
+
+    uint32_t frameSize = 0;
     m_encSatusInfo->SetOutputData(RGY_FRAMETYPE_IDR, frameSize, 0);
     return RGY_ERR_NONE;
 }
@@ -1305,6 +1555,7 @@ RGY_ERR initWriters(
         writerPrm.threadParamOutput       = ctrl->threadParams.get(RGYThreadType::OUTPUT);
         writerPrm.threadParamAudio        = ctrl->threadParams.get(RGYThreadType::AUDIO);
         writerPrm.bufSizeMB               = ctrl->outputBufSizeMB;
+        writerPrm.asyncIO                 = ctrl->outputAsyncIO;
         writerPrm.audioResampler          = common->audioResampler;
         writerPrm.audioIgnoreDecodeError  = common->audioIgnoreDecodeError;
         writerPrm.queueInfo = (pPerfMonitor) ? pPerfMonitor->GetQueueInfoPtr() : nullptr;
@@ -1614,6 +1865,7 @@ RGY_ERR initWriters(
             pFileWriter = std::make_shared<RGYOutFrame>();
             YUVWriterParam param;
             param.bY4m = common->muxOutputFormat != _T("raw");
+            param.threadParamOutput = ctrl->threadParams.get(RGYThreadType::OUTPUT);
             auto sts = pFileWriter->Init(common->outputFilename.c_str(), &outputVideoInfo, &param, log, pStatus);
             if (sts != RGY_ERR_NONE) {
                 log->write(RGY_LOG_ERROR, RGY_LOGT_OUT, pFileWriter->GetOutputMessage());
@@ -1643,6 +1895,8 @@ RGY_ERR initWriters(
             rawPrm.qFirstProcessData = (ctrl->parallelEnc.sendData) ? ctrl->parallelEnc.sendData->qFirstProcessData : nullptr;
             rawPrm.qFirstProcessDataFree = (ctrl->parallelEnc.sendData) ? ctrl->parallelEnc.sendData->qFirstProcessDataFree : nullptr;
             rawPrm.qFirstProcessDataFreeLarge = (ctrl->parallelEnc.sendData) ? ctrl->parallelEnc.sendData->qFirstProcessDataFreeLarge : nullptr;
+            rawPrm.peCacheBudget = (ctrl->parallelEnc.sendData) ? ctrl->parallelEnc.sendData->cacheBudget : nullptr;
+            rawPrm.peChunkId = ctrl->parallelEnc.parallelId;
             rawPrm.extPERaw = ctrl->parallelEnc.isChild();
             rawPrm.debugRawOut = common->debugRawOut;
             rawPrm.outReplayFile = common->outReplayFile;
@@ -1718,6 +1972,7 @@ RGY_ERR initWriters(
                 writerAudioPrm.threadParamOutput = ctrl->threadParams.get(RGYThreadType::OUTPUT);
                 writerAudioPrm.threadParamAudio  = ctrl->threadParams.get(RGYThreadType::AUDIO);
                 writerAudioPrm.bufSizeMB      = ctrl->outputBufSizeMB;
+                writerAudioPrm.asyncIO        = ctrl->outputAsyncIO;
                 writerAudioPrm.outputFormat   = pAudioSelect->extractFormat;
                 writerAudioPrm.audioIgnoreDecodeError = common->audioIgnoreDecodeError;
                 writerAudioPrm.lowlatency = ctrl->lowLatency;
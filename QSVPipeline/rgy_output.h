@@ -32,7 +32,10 @@
 #include <memory>
 #include <vector>
 #include <unordered_map>
+#include <deque>
 #include <mutex>
+#include <thread>
+#include <atomic>
 #include "rgy_osdep.h"
 #include "rgy_tchar.h"
 #include "rgy_log.h"
@@ -40,6 +43,8 @@
 #include "rgy_avutil.h"
 #include "rgy_bitstream.h"
 #include "rgy_input.h"
+#include "rgy_queue.h"
+#include "rgy_thread_affinity.h"
 #if ENCODER_NVENC
 #include "NVEncUtil.h"
 #include "NVEncParam.h"
@@ -71,34 +76,80 @@ struct RGYTimestampMapVal {
     void addMetadata(std::vector<std::shared_ptr<RGYFrameData>>& list) { dataList.insert(dataList.end(), list.begin(), list.end()); }
 };
 
+// 出力フレームのタイムスタンプ等の情報を保持する
+// 追加順にm_frameに保持し、ptsとencodeFrameIdの両方から通し番号を引けるようにしておくことで、
+// 検索・古いフレームの削除をフレーム数によらない時間で行う
 class RGYTimestamp {
 private:
-    std::unordered_map<int64_t, RGYTimestampMapVal> m_frame;
+    static const int64_t CLEAN_FRAME_DELAY = 64; // inputFrameIdがこれ以上古いフレームは削除する
+    std::deque<RGYTimestampMapVal> m_frame; // 追加順
+    int64_t m_frameFirstIdx; // m_frame先頭の通し番号
+    std::unordered_map<int64_t, int64_t> m_ptsIndex; // pts -> 通し番号
+    std::unordered_map<int64_t, int64_t> m_encodeIdIndex; // encodeFrameId -> 通し番号
     std::mutex mtx;
     int64_t last_add_pts;
     int64_t last_check_pts;
     int64_t last_input_frame_id;
     int64_t offset;
-    int64_t last_clean_id;
     bool timestampPassThrough;
     bool noDurationFix; // durationの修正を行わない場合にtrue
+
+    RGYTimestampMapVal *findByPts(const int64_t pts) {
+        auto it = m_ptsIndex.find(pts);
+        return (it != m_ptsIndex.end()) ? &m_frame[(size_t)(it->second - m_frameFirstIdx)] : nullptr;
+    }
+    RGYTimestampMapVal *findByEncodeFrameID(const int64_t id) {
+        auto it = m_encodeIdIndex.find(id);
+        if (it == m_encodeIdIndex.end()) {
+            return nullptr;
+        }
+        auto ptr = &m_frame[(size_t)(it->second - m_frameFirstIdx)];
+        return (ptr->encodeFrameId == id) ? ptr : nullptr;
+    }
+    void eraseIndex(std::unordered_map<int64_t, int64_t>& index, const int64_t key, const int64_t idx) {
+        auto it = index.find(key);
+        if (it != index.end() && it->second == idx) {
+            index.erase(it);
+        }
+    }
+    // 同じptsがあれば上書きし、なければ末尾に追加する
+    RGYTimestampMapVal& push(RGYTimestampMapVal&& val) {
+        auto it = m_ptsIndex.find(val.timestamp);
+        if (it != m_ptsIndex.end()) {
+            auto& frame = m_frame[(size_t)(it->second - m_frameFirstIdx)];
+            eraseIndex(m_encodeIdIndex, frame.encodeFrameId, it->second);
+            m_encodeIdIndex.emplace(val.encodeFrameId, it->second);
+            frame = std::move(val);
+            return frame;
+        }
+        const int64_t idx = m_frameFirstIdx + (int64_t)m_frame.size();
+        m_ptsIndex[val.timestamp] = idx;
+        m_encodeIdIndex.emplace(val.encodeFrameId, idx); // 同じencodeFrameIdの場合は、先に追加されたほうを優先する
+        m_frame.push_back(std::move(val));
+        return m_frame.back();
+    }
 public:
-    RGYTimestamp(bool timestampPassThrough_, bool noDurationFix_) : m_frame(), mtx(), last_add_pts(-1), last_check_pts(-1), offset(0), last_clean_id(-1), timestampPassThrough(timestampPassThrough_), noDurationFix(noDurationFix_) {};
+    RGYTimestamp(bool timestampPassThrough_, bool noDurationFix_) : m_frame(), m_frameFirstIdx(0), m_ptsIndex(), m_encodeIdIndex(), mtx(), last_add_pts(-1), last_check_pts(-1), last_input_frame_id(-1), offset(0), timestampPassThrough(timestampPassThrough_), noDurationFix(noDurationFix_) {};
     ~RGYTimestamp() {};
     void clear() {
         std::lock_guard<std::mutex> lock(mtx);
+        m_frameFirstIdx += (int64_t)m_frame.size();
         m_frame.clear();
+        m_ptsIndex.clear();
+        m_encodeIdIndex.clear();
+        last_add_pts = -1;
         last_check_pts = -1;
         offset = 0;
     }
     void add(int64_t pts, int64_t inputFrameId, int64_t encodeFrameId, int64_t duration, std::vector<std::shared_ptr<RGYFrameData>> metadatalist) {
         std::lock_guard<std::mutex> lock(mtx);
         if (last_add_pts >= 0) { // 前のフレームのdurationの更新
-            auto& last_add_pos = m_frame.find(last_add_pts)->second;
-            if (!noDurationFix) last_add_pos.duration = pts - last_add_pos.timestamp;
-            if (duration == 0) duration = last_add_pos.duration;
+            if (auto last_add_pos = findByPts(last_add_pts); last_add_pos) {
+                if (!noDurationFix) last_add_pos->duration = pts - last_add_pos->timestamp;
+                if (duration == 0) duration = last_add_pos->duration;
+            }
         }
-        m_frame[pts] = RGYTimestampMapVal(pts, inputFrameId, encodeFrameId, duration, metadatalist);
+        push(RGYTimestampMapVal(pts, inputFrameId, encodeFrameId, duration, metadatalist));
         last_add_pts = pts;
     }
     RGYTimestampMapVal check(int64_t pts) {
@@ -107,54 +158,52 @@ public:
         }
         std::lock_guard<std::mutex> lock(mtx);
         pts += offset;
-        auto pos = m_frame.find(pts);
-        if (pos == m_frame.end()) {
-            auto& last_check_pos = m_frame.find(last_check_pts)->second;
-            pts = last_check_pos.timestamp + last_check_pos.duration / 2;
-            auto next_pts = last_check_pos.timestamp + last_check_pos.duration;
-            last_check_pos.duration = pts - last_check_pos.timestamp;
-            m_frame[pts] = RGYTimestampMapVal(pts, last_input_frame_id, last_check_pos.encodeFrameId, next_pts - pts, last_check_pos.dataList);
-            pos = m_frame.find(pts);
+        auto pos = findByPts(pts);
+        if (pos == nullptr) {
+            auto last_check_pos = findByPts(last_check_pts);
+            if (last_check_pos == nullptr) {
+                return RGYTimestampMapVal();
+            }
+            // 前のフレームを半分に分割し、後半を新たなフレームとして追加する
+            pts = last_check_pos->timestamp + last_check_pos->duration / 2;
+            auto next_pts = last_check_pos->timestamp + last_check_pos->duration;
+            last_check_pos->duration = pts - last_check_pos->timestamp;
+            pos = &push(RGYTimestampMapVal(pts, last_input_frame_id, last_check_pos->encodeFrameId, next_pts - pts, last_check_pos->dataList));
         }
-        last_input_frame_id = pos->second.inputFrameId;
-        last_check_pts = pos->second.timestamp;
-        return pos->second;
+        last_input_frame_id = pos->inputFrameId;
+        last_check_pts = pos->timestamp;
+        auto ret = *pos;
+        clean(ret.inputFrameId);
+        return ret;
     }
+    // 先頭から、inputFrameIdがcurrent_idよりCLEAN_FRAME_DELAY以上古いフレームを削除する
     void clean(const int64_t current_id) {
-        if (current_id >= last_clean_id + 64) {
-            for (auto it = m_frame.begin(); it != m_frame.end();) {
-                if (it->second.inputFrameId < current_id - 64) {
-                    it = m_frame.erase(it);
-                } else {
-                    it++;
-                }
-            }
-            last_clean_id = current_id;
+        while (m_frame.size() > 0 && m_frame.front().inputFrameId < current_id - CLEAN_FRAME_DELAY
+            && m_frame.front().timestamp != last_check_pts && m_frame.front().timestamp != last_add_pts) {
+            const auto& frame = m_frame.front();
+            eraseIndex(m_ptsIndex, frame.timestamp, m_frameFirstIdx);
+            eraseIndex(m_encodeIdIndex, frame.encodeFrameId, m_frameFirstIdx);
+            m_frame.pop_front();
+            m_frameFirstIdx++;
         }
     }
     RGYTimestampMapVal getByEncodeFrameID(const int64_t id) {
         std::lock_guard<std::mutex> lock(mtx);
-        auto pos = m_frame.end();
-        for (auto it = m_frame.begin(); it != m_frame.end(); it++) {
-            if (it->second.encodeFrameId == id) {
-                pos = it;
-                break;
-            }
-        }
-        if (pos == m_frame.end()) {
+        auto pos = findByEncodeFrameID(id);
+        if (pos == nullptr) {
             return RGYTimestampMapVal();
         }
-        auto ret = pos->second;
+        auto ret = *pos;
         clean(ret.inputFrameId);
         return ret;
     }
     RGYTimestampMapVal get(int64_t pts) {
         std::lock_guard<std::mutex> lock(mtx);
-        auto pos = m_frame.find(pts);
-        if (pos == m_frame.end()) {
+        auto pos = findByPts(pts);
+        if (pos == nullptr) {
             return RGYTimestampMapVal();
         }
-        auto ret = pos->second;
+        auto ret = *pos;
         clean(ret.inputFrameId);
         return ret;
     }
@@ -202,11 +251,41 @@ public:
     }
 };
 
+//RGYBitstreamをNAL/OBU単位に分割した結果を保持し、出力処理の各段階(bsf, SEIの置換, メタデータの挿入など)で使いまわす
+//同じデータ(先頭位置, サイズ, pts)に対しては再解析せず、前回の分割結果を返す
+//bitstreamを書き換えた場合は、update()で書き換え後の分割結果を設定するか、invalidate()を呼ぶこと
+class RGYBitstreamUnitIndex {
+public:
+    RGYBitstreamUnitIndex();
+    ~RGYBitstreamUnitIndex();
+    //bitstreamの分割結果を返す (H.264/HEVCはNAL、AV1はOBU単位、それ以外のコーデックでは空)
+    const std::vector<nal_info>& get(const RGYBitstream *bitstream, const RGY_CODEC codec);
+    //書き換え後のbitstreamの分割結果を設定する
+    //listはbitstreamの先頭から隙間なく並んでいる前提で、各ptrはbitstream上の位置に付け替える
+    //サイズの合計が一致しない場合は破棄し、次回のget()で再解析する
+    void update(const RGYBitstream *bitstream, const RGY_CODEC codec, std::vector<nal_info>&& list);
+    void invalidate();
+    uint64_t parseCount() const { return m_parseCount; }
+    uint64_t reuseCount() const { return m_reuseCount; }
+protected:
+    RGY_CODEC m_codec;
+    const uint8_t *m_data;
+    size_t m_size;
+    int64_t m_pts;
+    bool m_valid;
+    std::vector<nal_info> m_list;
+    decltype(parse_nal_unit_h264_c) *m_parse_nal_h264; // H.264用のnal unit分解関数へのポインタ
+    decltype(parse_nal_unit_hevc_c) *m_parse_nal_hevc; // HEVC用のnal unit分解関数へのポインタ
+    uint64_t m_parseCount; // 解析を行った回数
+    uint64_t m_reuseCount; // 前回の分割結果を再利用した回数
+};
+
 class RGYOutputBSF {
 public:
     RGYOutputBSF(AVBSFContext *bsf, RGY_CODEC codec, tstring strWriterName, shared_ptr<RGYLog> log);
     virtual ~RGYOutputBSF();
-    RGY_ERR applyBitstreamFilter(RGYBitstream *bitstream);
+    //unitIndexを指定した場合、分割結果を再利用し、bsf適用後のbitstreamに合わせて更新する
+    RGY_ERR applyBitstreamFilter(RGYBitstream *bitstream, RGYBitstreamUnitIndex *unitIndex = nullptr);
 protected:
     void AddMessage(RGYLogLevel log_level, const tstring& str) {
         if (m_log == nullptr || log_level < m_log->getLogLevel(RGY_LOGT_OUT)) {
@@ -262,7 +341,48 @@ struct RGYOutputInsertMetadata {
     static RGYOutputInsertMetadataPosition dovirpu_pos(const RGY_CODEC codec) {
         return codec == RGY_CODEC_HEVC ? RGYOutputInsertMetadataPosition::Appendix : RGYOutputInsertMetadataPosition::FrontOfLastFrame;
     };
-    RGYOutputInsertMetadata(std::vector<uint8_t>& data, bool onSeqHeader, RGYOutputInsertMetadataPosition pos_) : mdata(data), onSequenceHeader(onSeqHeader), pos(pos_), written(false) {};
+    RGYOutputInsertMetadata(std::vector<uint8_t> data, bool onSeqHeader, RGYOutputInsertMetadataPosition pos_) : mdata(std::move(data)), onSequenceHeader(onSeqHeader), pos(pos_), written(false) {};
+};
+
+//出力するデータの断片 (データは参照するのみでコピーしない)
+struct RGYBitstreamSlice {
+    const uint8_t *ptr;
+    size_t size;
+};
+
+//RGYBitstreamのデータと挿入するメタデータを、コピーせずに出力順に並べたもの
+//参照先のRGYBitstreamとメタデータは、出力が終わるまで保持しておくこと
+class RGYBitstreamView {
+public:
+    RGYBitstreamView() : m_slices(), m_size(0) {};
+    void clear() {
+        m_slices.clear();
+        m_size = 0;
+    }
+    //直前の断片とメモリ上で連続している場合は、ひとつの断片にまとめる
+    void append(const uint8_t *ptr, const size_t size) {
+        if (size == 0) {
+            return;
+        }
+        if (m_slices.size() > 0 && m_slices.back().ptr + m_slices.back().size == ptr) {
+            m_slices.back().size += size;
+        } else {
+            m_slices.push_back({ ptr, size });
+        }
+        m_size += size;
+    }
+    //連続したバッファにコピーする (dstにはsize()以上の領域が必要)
+    void copyTo(uint8_t *dst) const {
+        for (const auto& slice : m_slices) {
+            memcpy(dst, slice.ptr, slice.size);
+            dst += slice.size;
+        }
+    }
+    size_t size() const { return m_size; }
+    const std::vector<RGYBitstreamSlice>& slices() const { return m_slices; }
+protected:
+    std::vector<RGYBitstreamSlice> m_slices;
+    size_t m_size;
 };
 
 #pragma pack(push, 1)
@@ -283,6 +403,13 @@ struct RGYOutputRawPEExtHeader {
 static_assert(std::is_trivially_copyable<RGYOutputRawPEExtHeader>::value);
 
 static const size_t RGY_PE_EXT_HEADER_DATA_NORMAL_BUF_SIZE = 32 * 1024;
+// 子→親へエンコード結果を転送するキューの最大フレーム数
+// メモリキャッシュでは1フレームあたり最低でもRGY_PE_EXT_HEADER_DATA_NORMAL_BUF_SIZEを使用するので、これだけで2GB程度になる
+// これを超える場合は、親が読み出すまで子の出力が待機する
+static const size_t RGY_PE_DATA_QUEUE_CAPACITY = 65536;
+// 転送し終わったポインタを再利用のため保持する最大数 (これを超えた分は開放する)
+static const size_t RGY_PE_FREE_QUEUE_CAPACITY = 64;
+static const size_t RGY_PE_FREE_LARGE_QUEUE_CAPACITY = 16;
  
 class RGYOutput {
 public:
@@ -302,7 +429,7 @@ public:
 
     RGY_ERR InitVideoBsf(const VideoInfo *videoOutputInfo);
 
-    RGY_ERR InsertMetadata(RGYBitstream *bitstream, std::vector<std::unique_ptr<RGYOutputInsertMetadata>>& metadataList);
+    RGY_ERR InsertMetadata(RGYBitstreamView& bsView, const RGYBitstream *bitstream, std::vector<std::unique_ptr<RGYOutputInsertMetadata>>& metadataList);
 
     RGY_ERR OverwriteHEVCAlphaChannelInfoSEI(RGYBitstream *bitstream);
 
@@ -320,8 +447,9 @@ public:
     virtual OutputType getOutType() {
         return m_OutType;
     }
-    virtual void WaitFin() {
-        return;
+    //出力スレッドの終了を待機し、出力スレッドで発生したエラーを返す
+    virtual RGY_ERR WaitFin() {
+        return RGY_ERR_NONE;
     }
 
     const TCHAR *GetOutputMessage() {
@@ -382,10 +510,11 @@ protected:
     std::unique_ptr<uint8_t, aligned_malloc_deleter> m_readBuffer;
     std::unique_ptr<uint8_t, aligned_malloc_deleter> m_UVBuffer;
     std::unique_ptr<RGYOutputBSF> m_bsf;
-    decltype(parse_nal_unit_hevc_c) *m_parse_nal_hevc; // HEVC用のnal unit分解関数へのポインタ
+    RGYBitstreamUnitIndex m_unitIndex; // 出力するフレームのNAL/OBUの分割結果
 };
 
 struct RGYOutputRawPEExtHeader;
+class RGYParallelEncCacheBudget;
 
 struct RGYOutputRawPrm {
     bool benchmark;
@@ -406,9 +535,11 @@ struct RGYOutputRawPrm {
     bool doviRpuMetadataCopy;     //doviのmetadataのコピー
     RGYDOVIRpuConvertParam doviRpuConvertParam;
     RGYTimestamp *vidTimestamp;
-    RGYQueueMPMP<RGYOutputRawPEExtHeader*> *qFirstProcessData;
-    RGYQueueMPMP<RGYOutputRawPEExtHeader*> *qFirstProcessDataFree;
-    RGYQueueMPMP<RGYOutputRawPEExtHeader*> *qFirstProcessDataFreeLarge;
+    RGYQueueBoundedSPSC<RGYOutputRawPEExtHeader*> *qFirstProcessData;
+    RGYQueueBoundedMPMC<RGYOutputRawPEExtHeader*> *qFirstProcessDataFree;
+    RGYQueueBoundedMPMC<RGYOutputRawPEExtHeader*> *qFirstProcessDataFreeLarge;
+    RGYParallelEncCacheBudget *peCacheBudget;
+    int peChunkId;
 };
 
 class RGYOutputRaw : public RGYOutput {
@@ -422,6 +553,7 @@ public:
 protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, const VideoInfo *pOutputInfo, const void *prm) override;
     virtual RGY_ERR WriteNextOneFrame(RGYBitstream *pBitstream);
+    RGY_ERR WritePESpill(const RGYOutputRawPEExtHeader *peHeader, const RGYBitstreamView& bsView);
 
     vector<uint8_t> m_outputBuf2;
     vector<uint8_t> m_hdrBitstream;
@@ -436,9 +568,12 @@ protected:
     int64_t m_prevEncodeFrameId;
     bool m_debugDirectAV1Out;
     bool m_extPERaw;
-    RGYQueueMPMP<RGYOutputRawPEExtHeader*> *m_qFirstProcessData;
-    RGYQueueMPMP<RGYOutputRawPEExtHeader*> *m_qFirstProcessDataFree;
-    RGYQueueMPMP<RGYOutputRawPEExtHeader*> *m_qFirstProcessDataFreeLarge;
+    RGYQueueBoundedSPSC<RGYOutputRawPEExtHeader*> *m_qFirstProcessData;
+    RGYQueueBoundedMPMC<RGYOutputRawPEExtHeader*> *m_qFirstProcessDataFree;
+    RGYQueueBoundedMPMC<RGYOutputRawPEExtHeader*> *m_qFirstProcessDataFreeLarge;
+    RGYParallelEncCacheBudget *m_peCacheBudget; // hybridキャッシュモードのメモリ使用量の管理
+    int m_peChunkId;
+    tstring m_peSpillFile; // hybridキャッシュモードでメモリの上限を超えた場合の退避先
 };
 
 std::unique_ptr<RGYHDRMetadata> createHEVCHDRSei(const std::string &maxCll, const std::string &masterDisplay, CspTransfer atcSei, const RGYInput *reader);
@@ -476,6 +611,16 @@ RGY_ERR initWriters(
 
 struct YUVWriterParam {
     bool bY4m;
+    RGYParamThread threadParamOutput;
+};
+
+//1フレーム分の出力データ
+struct RGYOutFrameBuf {
+    uint8_t *ptr;    // RGYSysFramePoolから確保したバッファ (nullptrなら書き込みスレッドの終了の合図)
+    size_t capacity; // 確保済みのサイズ
+    size_t size;     // 書き込むデータのサイズ
+
+    RGYOutFrameBuf() : ptr(nullptr), capacity(0), size(0) {};
 };
 
 class RGYOutFrame : public RGYOutput {
@@ -486,10 +631,23 @@ public:
 
     virtual RGY_ERR WriteNextFrame(RGYBitstream *pBitstream) override;
     virtual RGY_ERR WriteNextFrame(RGYFrame *pSurface) override;
+    virtual RGY_ERR WaitFin() override;
+    virtual void Close() override;
 protected:
     virtual RGY_ERR Init(const TCHAR *strFileName, const VideoInfo *pOutputInfo, const void *prm) override;
+    RGY_ERR WriteThreadFunc(RGYParamThread threadParam);
+    RGY_ERR getFrameBuf(RGYOutFrameBuf& buf, const size_t size);
+
+    //フレームの組み立てと書き込みを並行して行うためのバッファ数
+    static const int FRAME_BUF_COUNT = 3;
 
     bool m_bY4m;
+    RGYParamThread m_threadParam;
+    std::thread m_thWrite;                       // 書き込みスレッド
+    std::atomic<RGY_ERR> m_thWriteErr;           // 書き込みスレッドで発生したエラー
+    RGYQueueMPMP<RGYOutFrameBuf> m_qFrameBufWrite; // 書き込み待ちのバッファ
+    RGYQueueMPMP<RGYOutFrameBuf> m_qFrameBufFree;  // 書き込みが終わり、再利用可能なバッファ
+    int m_frameBufAllocated;                     // 確保したバッファの数
 };
 
 #endif //#if ENCODER_QSV || ENCODER_NVENC
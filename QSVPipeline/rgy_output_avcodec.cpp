@@ -113,6 +113,7 @@ AVMuxFormat::AVMuxFormat() :
     fpOutput(nullptr),
     outputBuffer(nullptr),
     outputBufferSize(0),
+    writeAsync(),
 #endif
     streamError(false),
     isMatroska(false),
@@ -156,9 +157,7 @@ AVMuxVideo::AVMuxVideo() :
     parserCtx(nullptr),
     parserStreamPos(0),
     afs(false),
-    debugDirectAV1Out(false),
-    parse_nal_h264(get_parse_nal_unit_h264_func()),
-    parse_nal_hevc(get_parse_nal_unit_hevc_func()) {
+    debugDirectAV1Out(false) {
 }
 
 AVMuxAudio::AVMuxAudio() :
@@ -430,10 +429,17 @@ void RGYOutputAvcodec::CloseVideo(AVMuxVideo *muxVideo) {
 void RGYOutputAvcodec::CloseFormat(AVMuxFormat *muxFormat) {
     if (muxFormat->formatCtx) {
         if (!muxFormat->streamError && m_Mux.format.fileHeaderWritten) {
+#if USE_CUSTOM_IO
+            if (muxFormat->writeAsync) {
+                //"movflags:faststart"では書き込んだファイルを別途開き直して読み込むので、
+                //それまでの書き込みを完了させ、以降は同期で書き込む
+                muxFormat->writeAsync->setSync(true);
+            }
+#endif //USE_CUSTOM_IO
             av_write_trailer(muxFormat->formatCtx);
         }
 #if USE_CUSTOM_IO
-        if (!muxFormat->fpOutput) {
+        if (!muxFormat->fpOutput && !muxFormat->writeAsync) {
 #endif
             avio_close(muxFormat->formatCtx->pb);
             AddMessage(RGY_LOG_DEBUG, _T("Closed AVIO Context.\n"));
@@ -452,6 +458,20 @@ void RGYOutputAvcodec::CloseFormat(AVMuxFormat *muxFormat) {
         muxFormat->fpOutput = nullptr;
         AddMessage(RGY_LOG_DEBUG, _T("Closed File Pointer.\n"));
     }
+    if (muxFormat->writeAsync) {
+        //close()で残りのブロックの書き込みを完了させてから統計を取得する
+        const int err = muxFormat->writeAsync->close();
+        const auto stats = muxFormat->writeAsync->stats();
+        if (err < 0 && !muxFormat->streamError) {
+            AddMessage(RGY_LOG_ERROR, _T("Error writing file: %s.\n"), _tcserror(-err));
+            muxFormat->streamError = true;
+        }
+        AddMessage(RGY_LOG_DEBUG, _T("Closed async writer: %.1f MB written in %llu writes (%llu direct), avg latency %.2f ms, waited %llu times (%.2f ms).\n"),
+            stats.bytesWritten / (double)(1024 * 1024), (unsigned long long)stats.writeCount, (unsigned long long)stats.directCount,
+            (stats.writeCount > 0) ? stats.latencyMicroSec / (double)stats.writeCount * 1e-3 : 0.0,
+            (unsigned long long)stats.waitCount, stats.waitMicroSec * 1e-3);
+        muxFormat->writeAsync.reset();
+    }
 
     if (muxFormat->AVOutBuffer) {
         av_free(muxFormat->AVOutBuffer);
@@ -469,8 +489,10 @@ void RGYOutputAvcodec::CloseFormat(AVMuxFormat *muxFormat) {
 void RGYOutputAvcodec::CloseQueues() {
 #if ENABLE_AVCODEC_OUT_THREAD
     m_Mux.thread.qVideobitstream.close();
-    m_Mux.thread.qVideobitstreamFreeI.close([](RGYBitstream *pBitstream) { pBitstream->clear(); });
-    m_Mux.thread.qVideobitstreamFreePB.close([](RGYBitstream *pBitstream) { pBitstream->clear(); });
+    m_Mux.thread.qVideobitstreamFreeI.close();
+    m_Mux.thread.qVideobitstreamFreeI.clear([](RGYBitstream *pBitstream) { pBitstream->clear(); });
+    m_Mux.thread.qVideobitstreamFreePB.close();
+    m_Mux.thread.qVideobitstreamFreePB.clear([](RGYBitstream *pBitstream) { pBitstream->clear(); });
     AddMessage(RGY_LOG_DEBUG, _T("closed queues...\n"));
 #endif
 }
@@ -2193,16 +2215,37 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
         AddMessage(RGY_LOG_DEBUG, _T("allocated internal buffer %d MB.\n"), m_Mux.format.AVOutBufferSize / (1024 * 1024));
         CreateDirectoryRecursive(PathRemoveFileSpecFixed(strFileName).second.c_str());
 
-        //"movflags:faststart"にするには、共有モードで開けるようにする必要がある
-        m_Mux.format.fpOutput = _tfsopen(strFileName, _T("wb"), _SH_DENYWR);
-        if (m_Mux.format.fpOutput == NULL) {
-            errno_t error = errno;
-            AddMessage(RGY_LOG_ERROR, _T("failed to open %soutput file \"%s\": %s.\n"), (videoOutputInfo) ? _T("") : _T("audio "), strFileName, _tcserror(error));
-            return RGY_ERR_FILE_OPEN; // Couldn't open file
+        if (prm->asyncIO != RGYOutputAsyncIO::Off) {
+            //出力バッファの分をブロックに分け、埋まったブロックから書き込みを発行する
+            //ディスクが一時的に遅くなっても、空きブロックがある間はmuxを止めずに済む
+            const int depth = RGYFileWriteAsync::DEFAULT_DEPTH;
+            m_Mux.format.writeAsync = std::make_unique<RGYFileWriteAsync>();
+            const auto sts = m_Mux.format.writeAsync->open(strFileName, depth, m_Mux.format.outputBufferSize / depth, prm->asyncIO == RGYOutputAsyncIO::Direct);
+            if (sts != RGY_ERR_NONE) {
+                //パイプ等、通常のファイルでなければ従来の方法で書き込む
+                AddMessage(RGY_LOG_DEBUG, _T("async writer not available for \"%s\": %s, fallback to sync write.\n"), strFileName, get_err_mes(sts));
+                m_Mux.format.writeAsync.reset();
+            } else {
+                AddMessage(RGY_LOG_DEBUG, _T("opened async writer: %s, %d x %d KB blocks%s.\n"),
+                    m_Mux.format.writeAsync->engine(), m_Mux.format.writeAsync->depth(), (int)(m_Mux.format.writeAsync->blockSize() / 1024),
+                    (m_Mux.format.writeAsync->direct()) ? _T(", direct") : _T(""));
+                if (prm->asyncIO == RGYOutputAsyncIO::Direct && !m_Mux.format.writeAsync->direct()) {
+                    AddMessage(RGY_LOG_WARN, _T("direct io not supported for \"%s\", using buffered io.\n"), strFileName);
+                }
+            }
         }
-        if (0 < (m_Mux.format.outputBufferSize = (uint32_t)malloc_degeneracy((void **)&m_Mux.format.outputBuffer, m_Mux.format.outputBufferSize, 1024 * 1024))) {
-            setvbuf(m_Mux.format.fpOutput, m_Mux.format.outputBuffer, _IOFBF, m_Mux.format.outputBufferSize);
-            AddMessage(RGY_LOG_DEBUG, _T("set external output buffer %d MB.\n"), m_Mux.format.outputBufferSize / (1024 * 1024));
+        if (!m_Mux.format.writeAsync) {
+            //"movflags:faststart"にするには、共有モードで開けるようにする必要がある
+            m_Mux.format.fpOutput = _tfsopen(strFileName, _T("wb"), _SH_DENYWR);
+            if (m_Mux.format.fpOutput == NULL) {
+                errno_t error = errno;
+                AddMessage(RGY_LOG_ERROR, _T("failed to open %soutput file \"%s\": %s.\n"), (videoOutputInfo) ? _T("") : _T("audio "), strFileName, _tcserror(error));
+                return RGY_ERR_FILE_OPEN; // Couldn't open file
+            }
+            if (0 < (m_Mux.format.outputBufferSize = (uint32_t)malloc_degeneracy((void **)&m_Mux.format.outputBuffer, m_Mux.format.outputBufferSize, 1024 * 1024))) {
+                setvbuf(m_Mux.format.fpOutput, m_Mux.format.outputBuffer, _IOFBF, m_Mux.format.outputBufferSize);
+                AddMessage(RGY_LOG_DEBUG, _T("set external output buffer %d MB.\n"), m_Mux.format.outputBufferSize / (1024 * 1024));
+            }
         }
         if (NULL == (m_Mux.format.formatCtx->pb = avio_alloc_context(m_Mux.format.AVOutBuffer, m_Mux.format.AVOutBufferSize, 1, this, funcReadPacket, (RGYArgN<5U, decltype(avio_alloc_context)>::type)funcWritePacket, funcSeek))) {
             AddMessage(RGY_LOG_ERROR, _T("failed to alloc avio context.\n"));
@@ -2350,8 +2393,8 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
         AddMessage(RGY_LOG_DEBUG, _T("starting output thread...\n"));
         const int audioQueueCapacity = 4096;
         m_Mux.thread.qVideobitstream.init(4096, (std::max)(256, (m_Mux.video.outputFps.den) ? m_Mux.video.outputFps.num * 4 / m_Mux.video.outputFps.den : 0));
-        m_Mux.thread.qVideobitstreamFreeI.init(256);
-        m_Mux.thread.qVideobitstreamFreePB.init(3840);
+        m_Mux.thread.qVideobitstreamFreeI.init(VID_BITSTREAM_QUEUE_SIZE_I);
+        m_Mux.thread.qVideobitstreamFreePB.init(VID_BITSTREAM_QUEUE_SIZE_PB);
         m_Mux.thread.thOutput = std::make_unique<AVMuxThreadWorker>();
         m_Mux.thread.thOutput->thAbort = false;
         m_Mux.thread.thOutput->qPackets.init(16384, audioQueueCapacity * std::max(1, (int)m_Mux.audio.size())); //字幕のみコピーするときのため、最低でもある程度は確保する
@@ -2406,17 +2449,21 @@ RGY_ERR RGYOutputAvcodec::Init(const TCHAR *strFileName, const VideoInfo *videoO
 RGY_ERR RGYOutputAvcodec::AddHeaderToExtraDataH264(const RGYBitstream *bitstream) {
     const RGYBitstream *bs_target = bitstream;
     RGYBitstream bitstream_copy = RGYBitstreamInit();
+    //bsfを適用しない場合は、分割結果をそのままフレームの出力処理で再利用する
+    RGYBitstreamUnitIndex unitIndexCopy;
+    RGYBitstreamUnitIndex *unitIndex = &m_unitIndex;
     if (m_bsf) {
         bitstream_copy.copy(bitstream);
-        auto err = m_bsf->applyBitstreamFilter(&bitstream_copy);
+        auto err = m_bsf->applyBitstreamFilter(&bitstream_copy, &unitIndexCopy);
         if (err != RGY_ERR_NONE) {
             AddMessage(RGY_LOG_ERROR, _T("failed to apply bitstream filter to AV1 header.\n"));
             return err;
         }
         bs_target = &bitstream_copy;
+        unitIndex = &unitIndexCopy;
     }
 
-    std::vector<nal_info> nal_list = m_Mux.video.parse_nal_h264(bs_target->data(), bs_target->size());
+    const auto& nal_list = unitIndex->get(bs_target, m_VideoOutputInfo.codec);
     const auto h264_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_H264_SPS; });
     const auto h264_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_H264_PPS; });
     const bool header_check = (nal_list.end() != h264_sps_nal) && (nal_list.end() != h264_pps_nal);
@@ -2438,17 +2485,21 @@ RGY_ERR RGYOutputAvcodec::AddHeaderToExtraDataH264(const RGYBitstream *bitstream
 RGY_ERR RGYOutputAvcodec::AddHeaderToExtraDataHEVC(const RGYBitstream *bitstream) {
     const RGYBitstream *bs_target = bitstream;
     RGYBitstream bitstream_copy = RGYBitstreamInit();
+    //bsfを適用しない場合は、分割結果をそのままフレームの出力処理で再利用する
+    RGYBitstreamUnitIndex unitIndexCopy;
+    RGYBitstreamUnitIndex *unitIndex = &m_unitIndex;
     if (m_bsf) {
         bitstream_copy.copy(bitstream);
-        auto err = m_bsf->applyBitstreamFilter(&bitstream_copy);
+        auto err = m_bsf->applyBitstreamFilter(&bitstream_copy, &unitIndexCopy);
         if (err != RGY_ERR_NONE) {
             AddMessage(RGY_LOG_ERROR, _T("failed to apply bitstream filter to AV1 header.\n"));
             return err;
         }
         bs_target = &bitstream_copy;
+        unitIndex = &unitIndexCopy;
     }
 
-    const auto nal_list = m_Mux.video.parse_nal_hevc(bs_target->data(), bs_target->size());
+    const auto& nal_list = unitIndex->get(bs_target, m_VideoOutputInfo.codec);
     const auto hevc_vps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_VPS; });
     const auto hevc_sps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_SPS; });
     const auto hevc_pps_nal = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_HEVC_PPS; });
@@ -2497,25 +2548,28 @@ RGY_ERR RGYOutputAvcodec::AddHeaderToExtraDataHEVC(const RGYBitstream *bitstream
 RGY_ERR RGYOutputAvcodec::AddHeaderToExtraDataAV1(const RGYBitstream *bitstream) {
     const RGYBitstream *bs_target = bitstream;
     RGYBitstream bitstream_copy = RGYBitstreamInit();
+    //bsfを適用しない場合は、分割結果をそのままフレームの出力処理で再利用する
+    RGYBitstreamUnitIndex unitIndexCopy;
+    RGYBitstreamUnitIndex *unitIndex = &m_unitIndex;
     if (m_bsf) {
         bitstream_copy.copy(bitstream);
-        auto err = m_bsf->applyBitstreamFilter(&bitstream_copy);
+        auto err = m_bsf->applyBitstreamFilter(&bitstream_copy, &unitIndexCopy);
         if (err != RGY_ERR_NONE) {
             AddMessage(RGY_LOG_ERROR, _T("failed to apply bitstream filter to AV1 header.\n"));
             return err;
         }
         bs_target = &bitstream_copy;
+        unitIndex = &unitIndexCopy;
     }
 
-    const auto unit_list = parse_unit_av1(bs_target->data(), bs_target->size());
-    auto it_seq_header = std::find_if(unit_list.begin(), unit_list.end(), [](const std::unique_ptr<unit_info>& unit) {
-        return unit->type == OBU_SEQUENCE_HEADER;
+    const auto& unit_list = unitIndex->get(bs_target, m_VideoOutputInfo.codec);
+    auto it_seq_header = std::find_if(unit_list.begin(), unit_list.end(), [](const nal_info& unit) {
+        return unit.type == OBU_SEQUENCE_HEADER;
         });
     if (it_seq_header != unit_list.end()) {
-        const auto& seq_header = (it_seq_header->get())->unit_data;
-        m_Mux.video.streamOut->codecpar->extradata_size = (int)seq_header.size();
+        m_Mux.video.streamOut->codecpar->extradata_size = (int)it_seq_header->size;
         uint8_t *new_ptr = (uint8_t *)av_malloc(m_Mux.video.streamOut->codecpar->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE);
-        memcpy(new_ptr, seq_header.data(), m_Mux.video.streamOut->codecpar->extradata_size);
+        memcpy(new_ptr, it_seq_header->ptr, m_Mux.video.streamOut->codecpar->extradata_size);
         if (m_Mux.video.streamOut->codecpar->extradata) {
             av_free(m_Mux.video.streamOut->codecpar->extradata);
         }
@@ -2759,7 +2813,7 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrame(RGYBitstream *bitstream) {
         //IフレームかPBフレームかでサイズが大きく違うため、空きのmfxBistreamは異なるキューで管理する
         auto& qVideoQueueFree = (bFrameI) ? m_Mux.thread.qVideobitstreamFreeI : m_Mux.thread.qVideobitstreamFreePB;
         //空いているmfxBistreamを取り出す
-        if (!qVideoQueueFree.front_copy_and_pop_no_lock(&copyStream) || copyStream.bufsize() < bitstream->size()) {
+        if (!qVideoQueueFree.try_pop(&copyStream) || copyStream.bufsize() < bitstream->size()) {
             //空いているmfxBistreamがない、あるいはそのバッファサイズが小さい場合は、領域を取り直す
             const auto allocate_bytes = bitstream->size() * ((bFrameI | bFrameP) ? 2 : 8);
             if (RGY_ERR_NONE != copyStream.init(allocate_bytes)) {
@@ -2834,12 +2888,9 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameFinish(RGYBitstream *bitstream, const RG
         //確保したメモリ領域を使いまわすためにキューに格納
         const auto frameI = (frameType & (RGY_FRAMETYPE_IDR | RGY_FRAMETYPE_I)) != 0;
         auto& qVideoQueueFree = (frameI) ? m_Mux.thread.qVideobitstreamFreeI : m_Mux.thread.qVideobitstreamFreePB;
-        auto queueFavoredSize = (frameI) ? VID_BITSTREAM_QUEUE_SIZE_I : VID_BITSTREAM_QUEUE_SIZE_PB;
-        if ((int64_t)qVideoQueueFree.size() > queueFavoredSize) {
-            //あまり多すぎると無駄にメモリを使用するので減らす
+        if (!qVideoQueueFree.try_push(*bitstream)) {
+            //キューがいっぱい(あまり多すぎると無駄にメモリを使用する)か、closeされていれば開放する
             bitstream->clear();
-        } else {
-            qVideoQueueFree.push(*bitstream);
         }
     } else {
 #endif
@@ -2859,7 +2910,7 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
     VidCheckStreamAVParser(bitstream);
 
     if (m_bsf) {
-        auto sts = m_bsf->applyBitstreamFilter(bitstream);
+        auto sts = m_bsf->applyBitstreamFilter(bitstream, &m_unitIndex);
         if (sts != RGY_ERR_NONE) {
             return sts;
         }
@@ -2875,7 +2926,7 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
     bool isKey = (bitstream->frametype() & (RGY_FRAMETYPE_IDR | RGY_FRAMETYPE_xIDR | RGY_FRAMETYPE_I | RGY_FRAMETYPE_xI)) != 0; //Keyフレームかどうかのフラグ
     if (m_Mux.video.streamOut->codecpar->field_order != AV_FIELD_PROGRESSIVE) {
         if (m_VideoOutputInfo.codec == RGY_CODEC_H264) {
-            const auto nal_list = m_Mux.video.parse_nal_h264(bitstream->data(), bitstream->size());
+            const auto& nal_list = m_unitIndex.get(bitstream, m_VideoOutputInfo.codec);
             //インタレ保持の際、IDRかどうかのフラグが正しく設定されていないことがある
             //どちらかのフィールドがIDRならIDRのフラグを立てる
             isIDR = std::find_if(nal_list.begin(), nal_list.end(), [](nal_info info) { return info.type == NALU_H264_IDR; }) != nal_list.end();
@@ -2889,11 +2940,11 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
     std::vector<std::unique_ptr<RGYOutputInsertMetadata>> metadataList;
     if (m_Mux.video.hdrBitstream.size() > 0) {
         std::vector<uint8_t> data(m_Mux.video.hdrBitstream.data(), m_Mux.video.hdrBitstream.data() + m_Mux.video.hdrBitstream.size());
-        metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(data, true, RGYOutputInsertMetadataPosition::Prefix));
+        metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(std::move(data), true, RGYOutputInsertMetadataPosition::Prefix));
     }
     if (m_Mux.video.hdr10plus) {
         if (auto data = m_Mux.video.hdr10plus->getData(bs_framedata.inputFrameId, m_VideoOutputInfo.codec); data.size() > 0) {
-            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(data, false, RGYOutputInsertMetadata::dhdr10plus_pos(m_VideoOutputInfo.codec)));
+            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(std::move(data), false, RGYOutputInsertMetadata::dhdr10plus_pos(m_VideoOutputInfo.codec)));
         }
     } else if (m_Mux.video.hdr10plusMetadataCopy) {
         auto [err_hdr10plus, metadata_hdr10plus] = getMetadata<RGYFrameDataHDR10plus>(RGY_FRAME_DATA_HDR10PLUS, bs_framedata, nullptr);
@@ -2901,7 +2952,7 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
             return err_hdr10plus;
         }
         if (metadata_hdr10plus.size() > 0) {
-            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(metadata_hdr10plus, false, RGYOutputInsertMetadata::dhdr10plus_pos(m_VideoOutputInfo.codec)));
+            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(std::move(metadata_hdr10plus), false, RGYOutputInsertMetadata::dhdr10plus_pos(m_VideoOutputInfo.codec)));
         }
     }
     if (m_Mux.video.doviRpu) {
@@ -2910,7 +2961,7 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
             AddMessage(RGY_LOG_ERROR, _T("Failed to get dovi rpu for %lld.\n"), bs_framedata.inputFrameId);
         }
         if (dovi_nal.size() > 0) {
-            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(dovi_nal, false, RGYOutputInsertMetadata::dovirpu_pos(m_VideoOutputInfo.codec)));
+            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(std::move(dovi_nal), false, RGYOutputInsertMetadata::dovirpu_pos(m_VideoOutputInfo.codec)));
         }
     } else if (m_Mux.video.doviRpuMetadataCopy) {
         auto doviRpuConvPrm = std::make_unique<RGYFrameDataDOVIRpuConvertParam>(m_Mux.video.doviProfileDst, m_Mux.video.doviRpuConvertParam);
@@ -2919,19 +2970,22 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
             return err_dovirpu;
         }
         if (metadata_dovi_rpu.size() > 0) {
-            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(metadata_dovi_rpu, false, RGYOutputInsertMetadata::dovirpu_pos(m_VideoOutputInfo.codec)));
+            metadataList.push_back(std::make_unique<RGYOutputInsertMetadata>(std::move(metadata_dovi_rpu), false, RGYOutputInsertMetadata::dovirpu_pos(m_VideoOutputInfo.codec)));
         }
     }
 
-    err = InsertMetadata(bitstream, metadataList);
+    //メタデータを挿入した出力データは、bitstreamとmetadataListを参照する断片のリストとして受け取り、
+    //パケットへのコピーの際に連結する
+    RGYBitstreamView bsView;
+    err = InsertMetadata(bsView, bitstream, metadataList);
     if (err != RGY_ERR_NONE) {
         return err;
     }
 
     AVPacket *pkt = m_Mux.video.pktOut;
-    av_new_packet(pkt, (int)bitstream->size());
-    memcpy(pkt->data, bitstream->data(), bitstream->size());
-    pkt->size = (int)bitstream->size();
+    av_new_packet(pkt, (int)bsView.size());
+    bsView.copyTo(pkt->data);
+    pkt->size = (int)bsView.size();
 
     const AVRational streamTimebase = m_Mux.video.streamOut->time_base;
     pkt->stream_index = m_Mux.video.streamOut->index;
@@ -2977,17 +3031,19 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternalOneFrame(RGYBitstream *bitstream
     if (m_Mux.video.fpTsLogFile) {
         const TCHAR *pFrameTypeStr =
             (frameType & (RGY_FRAMETYPE_IDR | RGY_FRAMETYPE_I)) ? _T("I") : (((frameType & RGY_FRAMETYPE_B) == 0) ? _T("P") : _T("B"));
-        _ftprintf(m_Mux.video.fpTsLogFile.get(), _T("%s, %20lld, %20lld, %20lld, %20lld, %d, %7zd\n"), pFrameTypeStr, (lls)bitstream->pts(), (lls)bitstream->dts(), (lls)pts, (lls)dts, (int)duration, bitstream->size());
+        _ftprintf(m_Mux.video.fpTsLogFile.get(), _T("%s, %20lld, %20lld, %20lld, %20lld, %d, %7zd\n"), pFrameTypeStr, (lls)bitstream->pts(), (lls)bitstream->dts(), (lls)pts, (lls)dts, (int)duration, bsView.size());
         {
             std::lock_guard<std::mutex> lock(m_Mux.format.fpTsLogMtx);
-            _ftprintf(m_Mux.format.fpTsLogFile.get(), _T("v, %d, %s, %20lld, %20lld, %20lld, %20lld, %d, %7zd\n"), pkt->stream_index, pFrameTypeStr, (lls)bitstream->pts(), (lls)bitstream->dts(), (lls)pts, (lls)dts, (int)duration, bitstream->size());
+            _ftprintf(m_Mux.format.fpTsLogFile.get(), _T("v, %d, %s, %20lld, %20lld, %20lld, %20lld, %d, %7zd\n"), pkt->stream_index, pFrameTypeStr, (lls)bitstream->pts(), (lls)bitstream->dts(), (lls)pts, (lls)dts, (int)duration, bsView.size());
         }
     }
-    m_encSatusInfo->SetOutputData(frameType, bitstream->size(), bitstream->avgQP());
+    m_encSatusInfo->SetOutputData(frameType, bsView.size(), bitstream->avgQP());
     return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
 
 RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *bitstream, int64_t *writtenDts) {
+    //NAL/OBUの分割結果は、このフレームの出力処理の間使いまわす
+    m_unitIndex.invalidate();
     if (!m_Mux.format.fileHeaderWritten) {
 #if 0 && ENCODER_QSV //HEVCエンコードやFixed Funcでは、DecodeTimeStampが正しく設定されないので無効化
         if (m_VideoOutputInfo.codec == RGY_CODEC_HEVC && bitstream->dts() == MFX_TIMESTAMP_UNKNOWN) {
@@ -3101,11 +3157,15 @@ RGY_ERR RGYOutputAvcodec::WriteNextFrameInternal(RGYBitstream *bitstream, int64_
         bitstream->setDuration(bs_framedata.duration);
 
         size_t copy_size = 0; // コピーしたデータサイズ
+        std::vector<nal_info> unit_list; // 送出するデータの分割結果、後段で再解析しなくてよいように設定しておく
+        unit_list.reserve(next_delim);
         for (size_t iunit = 0; iunit < next_delim; iunit++) {
-            const auto& unit_data = m_Mux.videoAV1Merge[iunit]->unit_data;
-            memcpy(bitstream->data() + copy_size, unit_data.data(), unit_data.size());
-            copy_size += unit_data.size();
+            const auto& unit = m_Mux.videoAV1Merge[iunit];
+            memcpy(bitstream->data() + copy_size, unit->unit_data.data(), unit->unit_data.size());
+            copy_size += unit->unit_data.size();
+            unit_list.push_back(nal_info{ nullptr, unit->type, unit->unit_data.size(), unit->spatial_id, unit->temporal_id });
         }
+        m_unitIndex.update(bitstream, m_VideoOutputInfo.codec, std::move(unit_list));
         // コピーし終わったユニットを破棄
         for (size_t iunit = 0; iunit < next_delim; iunit++) {
             m_Mux.videoAV1Merge.pop_front();
@@ -4490,8 +4550,9 @@ RGY_ERR RGYOutputAvcodec::WriteThreadFunc(RGYParamThread threadParam) {
     return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
 
-void RGYOutputAvcodec::WaitFin() {
+RGY_ERR RGYOutputAvcodec::WaitFin() {
     CloseThread();
+    return (m_Mux.format.streamError) ? RGY_ERR_UNKNOWN : RGY_ERR_NONE;
 }
 
 HANDLE RGYOutputAvcodec::getThreadHandleOutput() {
@@ -4520,9 +4581,25 @@ HANDLE RGYOutputAvcodec::getThreadHandleAudEncode() {
 
 #if USE_CUSTOM_IO
 int RGYOutputAvcodec::readPacket(uint8_t *buf, int buf_size) {
+    if (m_Mux.format.writeAsync) {
+        const auto ret = m_Mux.format.writeAsync->read(buf, buf_size);
+        return (ret == 0) ? AVERROR_EOF : (int)ret;
+    }
     return (int)_fread_nolock(buf, 1, buf_size, m_Mux.format.fpOutput);
 }
 int RGYOutputAvcodec::writePacket(const uint8_t *buf, int buf_size) {
+    if (m_Mux.format.writeAsync) {
+        //発行済みの書き込みのエラーは、以降の書き込みの際に返される
+        const auto ret = m_Mux.format.writeAsync->write(buf, buf_size);
+        if (ret < 0) {
+            if (!m_Mux.format.streamError) {
+                AddMessage(RGY_LOG_ERROR, _T("Error writing file: %s.\n"), _tcserror((int)-ret));
+                m_Mux.format.streamError = true;
+            }
+            return AVERROR(-(int)ret);
+        }
+        return buf_size;
+    }
     int res = (int)_fwrite_nolock(buf, 1, buf_size, m_Mux.format.fpOutput);
     if (res < buf_size) {
         AddMessage(RGY_LOG_ERROR, _T("Error writing file.\nNot enough disk space!\""));
@@ -4531,6 +4608,12 @@ int RGYOutputAvcodec::writePacket(const uint8_t *buf, int buf_size) {
     return res;
 }
 int64_t RGYOutputAvcodec::seek(int64_t offset, int whence) {
+    if (m_Mux.format.writeAsync) {
+        if (whence & AVSEEK_SIZE) {
+            return m_Mux.format.writeAsync->size();
+        }
+        return m_Mux.format.writeAsync->seek(offset, whence & ~AVSEEK_FORCE);
+    }
     return _fseeki64(m_Mux.format.fpOutput, offset, whence);
 }
 #endif //USE_CUSTOM_IO
@@ -117,6 +117,7 @@ struct AVMuxFormat {
     FILE                 *fpOutput;             //出力ファイルポインタ
     char                 *outputBuffer;         //出力ファイルポインタ用のバッファ
     uint32_t              outputBufferSize;     //出力ファイルポインタ用のバッファサイズ
+    std::unique_ptr<RGYFileWriteAsync> writeAsync; //非同期書き込みを使用する場合のライター (fpOutputの代わり)
 #endif //USE_CUSTOM_IO
     bool                  streamError;          //エラーが発生
     bool                  isMatroska;           //mkvかどうか
@@ -164,8 +165,6 @@ struct AVMuxVideo {
     int64_t               parserStreamPos;      //動画ストリームのバイト数
     bool                  afs;                  //入力が自動フィールドシフト
     bool                  debugDirectAV1Out;    //AV1出力のデバッグ用
-    decltype(parse_nal_unit_h264_c) *parse_nal_h264; // H.264用のnal unit分解関数へのポインタ
-    decltype(parse_nal_unit_hevc_c) *parse_nal_hevc; // HEVC用のnal unit分解関数へのポインタ
 
     AVMuxVideo();
 };
@@ -309,8 +308,8 @@ struct AVMuxThread {
     bool                           enableAudProcessThread;    //音声処理スレッドを使用する
     bool                           enableAudEncodeThread;     //音声エンコードスレッドを使用する
     std::unique_ptr<AVMuxThreadWorker> thOutput;              //出力スレッド
-    RGYQueueMPMP<RGYBitstream, 64> qVideobitstreamFreeI;      //映像 Iフレーム用に空いているデータ領域を格納する
-    RGYQueueMPMP<RGYBitstream, 64> qVideobitstreamFreePB;     //映像 P/Bフレーム用に空いているデータ領域を格納する
+    RGYQueueBoundedMPMC<RGYBitstream> qVideobitstreamFreeI;   //映像 Iフレーム用に空いているデータ領域を格納する (VID_BITSTREAM_QUEUE_SIZE_Iまで)
+    RGYQueueBoundedMPMC<RGYBitstream> qVideobitstreamFreePB;  //映像 P/Bフレーム用に空いているデータ領域を格納する (VID_BITSTREAM_QUEUE_SIZE_PBまで)
     RGYQueueMPMP<RGYBitstream, 64> qVideobitstream;           //映像パケットを出力スレッドに渡すためのキュー
     std::unordered_map<const AVMuxAudio *, std::unique_ptr<AVMuxThreadAudio>> thAud; //音声スレッド
     std::atomic<int64_t>           streamOutMaxDts;           //音声・字幕キューの最後のdts (timebase = QUEUE_DTS_TIMEBASE) (キューの同期に使用)
@@ -394,6 +393,7 @@ struct AvcodecWriterPrm {
     int                          audioResampler;          //音声のresamplerの選択
     uint32_t                     audioIgnoreDecodeError;  //音声デコード時に発生したエラーを無視して、無音に置き換える
     int                          bufSizeMB;               //出力バッファサイズ
+    RGYOutputAsyncIO             asyncIO;                 //出力ファイルへの書き込みを非同期で行う
     int                          threadOutput;            //出力スレッド数
     int                          threadAudio;             //音声処理スレッド数
     RGYParamThread               threadParamOutput;       //出力スレッドのパラメータ
@@ -440,6 +440,7 @@ struct AvcodecWriterPrm {
         audioResampler(0),
         audioIgnoreDecodeError(0),
         bufSizeMB(0),
+        asyncIO(RGYOutputAsyncIO::Off),
         threadOutput(0),
         threadAudio(0),
         threadParamOutput(),
@@ -482,7 +483,7 @@ public:
 
     virtual vector<int> GetStreamTrackIdList();
 
-    virtual void WaitFin() override;
+    virtual RGY_ERR WaitFin() override;
 
     virtual void Close() override;
 
@@ -29,6 +29,7 @@
 #include "rgy_filesystem.h"
 #include "rgy_input.h"
 #include "rgy_output.h"
+#include "rgy_frame_pool.h"
 #if ENCODER_QSV
 #include "qsv_pipeline.h"
 #elif ENCODER_NVENC
@@ -40,6 +41,8 @@
 #endif
 
 static const int RGY_PARALLEL_ENC_TIMEOUT = 10000;
+static const double RGY_PARALLEL_ENC_COST_BYTES_WEIGHT = 0.5; // 推定エンコードコストのうち、パケットサイズに比例する部分の割合 (残りは時間に比例する)
+static const int RGY_PARALLEL_ENC_MIN_KEYFRAMES_PER_CHUNK = 2; // チャンクあたりのキーフレーム数がこれより少ない場合は均等に分割する
 
 static RGY_CODEC enc_codec(const encParams *prm) {
 #if ENCODER_NVENC
@@ -77,15 +80,74 @@ void RGYParallelEncodeStatusData::reset() {
     encStatusData.reset();
 }
 
-RGYParallelEncProcess::RGYParallelEncProcess(const int id, const tstring& tmpfile, std::shared_ptr<RGYLog> log) :
+// バッファをプールに返却し、hybridキャッシュモードではメモリ使用量から差し引く
+// ヘッダのみ(データはファイルに退避)のバッファはメモリ使用量に含めていない
+static void releasePEPacket(RGYOutputRawPEExtHeader *ptr, RGYParallelEncCacheBudget *cacheBudget) {
+    if (ptr == nullptr) {
+        return;
+    }
+    if (cacheBudget && ptr->allocSize != sizeof(RGYOutputRawPEExtHeader)) {
+        cacheBudget->release(ptr->allocSize);
+    }
+    RGYBitstreamBufPool::get().release(ptr);
+}
+
+RGYParallelEncCacheBudget::RGYParallelEncCacheBudget(const int64_t budgetBytes, const int chunks) :
+    m_budget(budgetBytes),
+    m_chunks(std::max(chunks, 1)),
+    m_currentChunk(0),
+    m_used(0),
+    m_peak(0),
+    m_spillBytes(0),
+    m_spillPackets(0) {
+}
+
+bool RGYParallelEncCacheBudget::reserve(const int ichunk, const size_t size) {
+    // 親が読み出し中のチャンクから遠いチャンクほど使用できる上限を小さくし、先にファイルに退避させる
+    // これにより、近いうちに親が必要とするデータのためにメモリを空けておく
+    const int chunkDiff = ichunk - m_currentChunk.load();
+    const int distance = clamp(chunkDiff, 0, m_chunks - 1);
+    const int64_t limit = m_budget * (m_chunks - distance) / m_chunks;
+    auto used = m_used.load();
+    do {
+        if (used + (int64_t)size > limit) {
+            return false;
+        }
+    } while (!m_used.compare_exchange_weak(used, used + (int64_t)size));
+    updatePeak(used + (int64_t)size);
+    return true;
+}
+
+void RGYParallelEncCacheBudget::add(const size_t size) {
+    updatePeak(m_used += (int64_t)size);
+}
+
+void RGYParallelEncCacheBudget::updatePeak(const int64_t used) {
+    auto peak = m_peak.load();
+    while (used > peak && !m_peak.compare_exchange_weak(peak, used)) {
+    }
+}
+
+void RGYParallelEncCacheBudget::release(const size_t size) {
+    m_used -= (int64_t)size;
+}
+
+void RGYParallelEncCacheBudget::addSpill(const size_t size) {
+    m_spillBytes += (int64_t)size;
+    m_spillPackets++;
+}
+
+RGYParallelEncProcess::RGYParallelEncProcess(const int id, const tstring& tmpfile, RGYParallelEncCacheBudget *cacheBudget, std::shared_ptr<RGYLog> log) :
     m_id(id),
     m_process(),
     m_qFirstProcessData(),
     m_qFirstProcessDataFree(),
     m_qFirstProcessDataFreeLarge(),
     m_cacheMode(RGYParamParallelEncCache::Mem),
+    m_cacheBudget(cacheBudget),
     m_sendData(),
     m_tmpfile(tmpfile),
+    m_fpSpill(),
     m_thRunProcess(),
     m_thRunProcessRet(),
     m_processFinished(unique_event(nullptr, nullptr)),
@@ -101,21 +163,29 @@ RGY_ERR RGYParallelEncProcess::close(const bool deleteTempFiles) {
     auto err = RGY_ERR_NONE;
     if (m_thRunProcess.joinable()) {
         m_thAbort = true;
+        if (m_qFirstProcessData) {
+            // キューがいっぱいで子の出力が待機している場合に備え、先にcloseして待機を解除する
+            m_qFirstProcessData->close();
+        }
         m_thRunProcess.join();
         m_sendData.processStatus = RGYParallelEncProcessStatus::Finished;
+        auto releasePacket = [cacheBudget = m_sendData.cacheBudget](RGYOutputRawPEExtHeader **ptr) { releasePEPacket(*ptr, cacheBudget); };
         if (m_qFirstProcessData) {
-            m_qFirstProcessData->close([](RGYOutputRawPEExtHeader **ptr) { if (*ptr) free(*ptr); });
+            m_qFirstProcessData->clear(releasePacket);
             m_qFirstProcessData.reset();
         }
         if (m_qFirstProcessDataFree) {
-            m_qFirstProcessDataFree->close([](RGYOutputRawPEExtHeader **ptr) { if (*ptr) free(*ptr); });
+            m_qFirstProcessDataFree->close();
+            m_qFirstProcessDataFree->clear(releasePacket);
             m_qFirstProcessDataFree.reset();
         }
         if (m_qFirstProcessDataFreeLarge) {
-            m_qFirstProcessDataFreeLarge->close([](RGYOutputRawPEExtHeader **ptr) { if (*ptr) free(*ptr); });
+            m_qFirstProcessDataFreeLarge->close();
+            m_qFirstProcessDataFreeLarge->clear(releasePacket);
             m_qFirstProcessDataFreeLarge.reset();
         }
     }
+    m_fpSpill.reset();
     if (deleteTempFiles && m_tmpfile.length() > 0 && rgy_file_exists(m_tmpfile)) {
         rgy_file_remove(m_tmpfile.c_str());
     }
@@ -167,17 +237,21 @@ RGY_ERR RGYParallelEncProcess::startThread(const encParams& peParams) {
     m_sendData.eventChildHasSentFirstKeyPts = CreateEventUnique(nullptr, FALSE, FALSE);
     m_sendData.eventParentHasSentFinKeyPts = CreateEventUnique(nullptr, FALSE, FALSE);
     m_processFinished = CreateEventUnique(nullptr, TRUE, FALSE); // 処理終了の通知用
-    if (peParams.ctrl.parallelEnc.parallelId == 0 || peParams.ctrl.parallelEnc.cacheMode == RGYParamParallelEncCache::Mem) {
-        // 最初のプロセスあるいはキャッシュメモリモードでは、キューを介してデータをやり取りする
-        m_qFirstProcessData = std::make_unique<RGYQueueMPMP<RGYOutputRawPEExtHeader*>>();
-        m_qFirstProcessDataFree = std::make_unique<RGYQueueMPMP<RGYOutputRawPEExtHeader*>>();
-        m_qFirstProcessDataFreeLarge = std::make_unique<RGYQueueMPMP<RGYOutputRawPEExtHeader*>>();
-        m_qFirstProcessData->init();
-        m_qFirstProcessDataFree->init();
-        m_qFirstProcessDataFreeLarge->init();
+    if (peParams.ctrl.parallelEnc.parallelId == 0 || peParams.ctrl.parallelEnc.cacheMode != RGYParamParallelEncCache::File) {
+        // 最初のプロセスあるいはキャッシュメモリ/hybridモードでは、キューを介してデータをやり取りする
+        // データの転送は子の出力→親の1対1なのでSPSC、空きポインタは子の出力と親(退避データの読み込み)の両方が取り出すのでMPMCとする
+        m_qFirstProcessData = std::make_unique<RGYQueueBoundedSPSC<RGYOutputRawPEExtHeader*>>();
+        m_qFirstProcessDataFree = std::make_unique<RGYQueueBoundedMPMC<RGYOutputRawPEExtHeader*>>();
+        m_qFirstProcessDataFreeLarge = std::make_unique<RGYQueueBoundedMPMC<RGYOutputRawPEExtHeader*>>();
+        m_qFirstProcessData->init(RGY_PE_DATA_QUEUE_CAPACITY);
+        m_qFirstProcessDataFree->init(RGY_PE_FREE_QUEUE_CAPACITY);
+        m_qFirstProcessDataFreeLarge->init(RGY_PE_FREE_LARGE_QUEUE_CAPACITY);
         m_sendData.qFirstProcessData = m_qFirstProcessData.get(); // キューのポインタを渡す
         m_sendData.qFirstProcessDataFree = m_qFirstProcessDataFree.get(); // キューのポインタを渡す
         m_sendData.qFirstProcessDataFreeLarge = m_qFirstProcessDataFreeLarge.get(); // キューのポインタを渡す
+        if (peParams.ctrl.parallelEnc.cacheMode == RGYParamParallelEncCache::Hybrid) {
+            m_sendData.cacheBudget = m_cacheBudget;
+        }
     }
     m_thRunProcess = std::thread([&]() {
         AddMessage(RGY_LOG_DEBUG, _T("\nPE%d[%d]: Start thread...\n"), m_id, GetCurrentThreadId());
@@ -193,6 +267,10 @@ RGY_ERR RGYParallelEncProcess::startThread(const encParams& peParams) {
             m_sendData.encStatus.set(encStatusData);
         }
         SetEvent(m_processFinished.get()); // 処理終了を通知するのを忘れないように
+        if (m_qFirstProcessData) {
+            // これ以上データは来ないので、getNextPacketで待機している親を起こす
+            m_qFirstProcessData->close();
+        }
         AddMessage(m_thRunProcessRet.value_or(RGY_ERR_UNKNOWN) == RGY_ERR_NONE ? RGY_LOG_DEBUG : RGY_LOG_ERROR,
             _T("\nPE%d[%d]: Processing finished: %s\n"), m_id, GetCurrentThreadId(), get_err_mes(m_thRunProcessRet.value()));
         m_sendData.processStatus = RGYParallelEncProcessStatus::Finished;
@@ -206,17 +284,69 @@ RGY_ERR RGYParallelEncProcess::getNextPacket(RGYOutputRawPEExtHeader **ptr) {
     if (!m_qFirstProcessData) {
         return RGY_ERR_NULL_PTR;
     }
-    size_t nSize = 0;
     *ptr = nullptr;
-    while (!m_qFirstProcessData->front_copy_and_pop_no_lock(ptr, &nSize)) {
-        if (nSize == 0 && m_thRunProcessRet.has_value()) { // キューにデータがなく、かつ処理が終了している
-            return m_thRunProcessRet.value() == RGY_ERR_NONE ? RGY_ERR_MORE_BITSTREAM : m_thRunProcessRet.value();
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    // データが来るまで待機する
+    // 子の処理が終了するとキューがcloseされるので、キューにデータがなく、かつ処理が終了している場合はfalseが返る
+    if (!m_qFirstProcessData->pop(ptr)) {
+        const auto ret = m_thRunProcessRet.value_or(RGY_ERR_ABORTED);
+        return ret == RGY_ERR_NONE ? RGY_ERR_MORE_BITSTREAM : ret;
     }
     if ((*ptr == nullptr)) {
         return RGY_ERR_MORE_BITSTREAM;
     }
+    if ((*ptr)->allocSize == sizeof(RGYOutputRawPEExtHeader) && (*ptr)->size > 0) {
+        // ヘッダのみでデータはファイルに退避されている
+        return readSpilledPacket(ptr);
+    }
+    // メモリ使用量はputFreePacketでバッファを返却するまで数える
+    return RGY_ERR_NONE;
+}
+
+RGY_ERR RGYParallelEncProcess::readSpilledPacket(RGYOutputRawPEExtHeader **ptr) {
+    if (!m_fpSpill) {
+        FILE *fp = nullptr;
+        if (_tfopen_s(&fp, m_tmpfile.c_str(), _T("rb")) != 0 || fp == nullptr) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to open spill file %s.\n"), m_tmpfile.c_str());
+            return RGY_ERR_FILE_OPEN;
+        }
+        m_fpSpill.reset(fp);
+    }
+    // 退避されたデータは、子がキューにヘッダを渡した順にファイルに追記されている
+    RGYOutputRawPEExtHeader header;
+    if (fread(&header, 1, sizeof(header), m_fpSpill.get()) != sizeof(header)
+        || header.size != (*ptr)->size || header.pts != (*ptr)->pts) {
+        AddMessage(RGY_LOG_ERROR, _T("Invalid data in spill file %s.\n"), m_tmpfile.c_str());
+        return RGY_ERR_INVALID_DATA_TYPE;
+    }
+    // 子の出力で再利用されるよう、空きポインタを保持するキューから取得する
+    const auto newAllocSize = std::max(sizeof(header) + header.size, RGY_PE_EXT_HEADER_DATA_NORMAL_BUF_SIZE);
+    auto freeQueue = (newAllocSize <= RGY_PE_EXT_HEADER_DATA_NORMAL_BUF_SIZE) ? m_qFirstProcessDataFree.get() : m_qFirstProcessDataFreeLarge.get();
+    RGYOutputRawPEExtHeader *packet = nullptr;
+    if (!freeQueue->try_pop(&packet)) {
+        packet = nullptr;
+    }
+    auto allocSize = (packet) ? packet->allocSize : 0;
+    if (packet == nullptr || packet->allocSize < newAllocSize) {
+        releasePEPacket(packet, m_sendData.cacheBudget);
+        packet = (RGYOutputRawPEExtHeader *)RGYBitstreamBufPool::get().alloc(newAllocSize, &allocSize);
+        if (packet == nullptr) {
+            AddMessage(RGY_LOG_ERROR, _T("Failed to allocate memory for spilled packet.\n"));
+            return RGY_ERR_NULL_PTR;
+        }
+        // 退避されたデータは読み込まないと先に進めないので、上限に関わらず確保する
+        if (m_sendData.cacheBudget) {
+            m_sendData.cacheBudget->add(allocSize);
+        }
+    }
+    memcpy(packet, &header, sizeof(header));
+    packet->allocSize = allocSize;
+    if (fread(packet + 1, 1, header.size, m_fpSpill.get()) != header.size) {
+        releasePEPacket(packet, m_sendData.cacheBudget);
+        AddMessage(RGY_LOG_ERROR, _T("Failed to read spill file %s.\n"), m_tmpfile.c_str());
+        return RGY_ERR_INVALID_DATA_TYPE;
+    }
+    RGYBitstreamBufPool::get().release(*ptr);
+    *ptr = packet;
     return RGY_ERR_NONE;
 }
 
@@ -229,11 +359,15 @@ RGY_ERR RGYParallelEncProcess::putFreePacket(RGYOutputRawPEExtHeader *ptr) {
     }
     // もう終了していた場合は再利用する必要はないのでメモリを解放する
     if (m_sendData.processStatus == RGYParallelEncProcessStatus::Finished) {
-        free(ptr);
+        releasePEPacket(ptr, m_sendData.cacheBudget);
         return RGY_ERR_NONE;
     }
-    RGYQueueMPMP<RGYOutputRawPEExtHeader*> *freeQueue = (ptr->allocSize <= RGY_PE_EXT_HEADER_DATA_NORMAL_BUF_SIZE) ? m_qFirstProcessDataFree.get() : m_qFirstProcessDataFreeLarge.get();
-    freeQueue->push(ptr);
+    auto freeQueue = (ptr->allocSize <= RGY_PE_EXT_HEADER_DATA_NORMAL_BUF_SIZE) ? m_qFirstProcessDataFree.get() : m_qFirstProcessDataFreeLarge.get();
+    if (!freeQueue->try_push(ptr)) {
+        // 再利用のため保持する数の上限に達している場合は開放する
+        // 保持する場合は、子の出力で再利用されるまでメモリ使用量に含めたままにする
+        releasePEPacket(ptr, m_sendData.cacheBudget);
+    }
     return RGY_ERR_NONE;
 }
 
@@ -272,6 +406,7 @@ int RGYParallelEncProcess::waitProcessFinished(const uint32_t timeout) {
 
 RGYParallelEnc::RGYParallelEnc(std::shared_ptr<RGYLog> log) :
     m_id(-1),
+    m_cacheBudget(),
     m_encProcess(),
     m_log(log),
     m_thParallelRun(),
@@ -279,7 +414,10 @@ RGYParallelEnc::RGYParallelEnc(std::shared_ptr<RGYLog> log) :
     m_videoEndKeyPts(-1),
     m_videoFinished(false),
     m_parallelCount(0),
-    m_chunks(0) {}
+    m_chunks(0),
+    m_chunkSeekRatio(),
+    m_chunkCost(),
+    m_chunkOrder() {}
 
 RGYParallelEnc::~RGYParallelEnc() {
     close(false);
@@ -293,7 +431,13 @@ void RGYParallelEnc::close(const bool deleteTempFiles) {
     for (auto &proc : m_encProcess) {
         proc->close(deleteTempFiles);
     }
+    if (m_cacheBudget && m_encProcess.size() > 0) {
+        AddMessage(RGY_LOG_INFO, _T("hybrid cache: peak memory %.1f MB (limit %.1f MB), spilled %lld packets, %.1f MB to temporary files.\n"),
+            m_cacheBudget->peak() / (double)(1024 * 1024), m_cacheBudget->budget() / (double)(1024 * 1024),
+            (long long)m_cacheBudget->spillPackets(), m_cacheBudget->spillBytes() / (double)(1024 * 1024));
+    }
     m_encProcess.clear();
+    m_cacheBudget.reset();
     m_videoEndKeyPts = -1;
 }
 
@@ -323,6 +467,9 @@ RGY_ERR RGYParallelEnc::getNextPacket(const int ichunk, RGYOutputRawPEExtHeader
         AddMessage(RGY_LOG_ERROR, _T("Invalid call for getNextPacketFromFirst.\n"));
         return RGY_ERR_UNKNOWN;
     }
+    if (m_cacheBudget) {
+        m_cacheBudget->setCurrentChunk(ichunk);
+    }
     return m_encProcess[ichunk]->getNextPacket(ptr);
 }
 
@@ -430,12 +577,92 @@ RGY_ERR RGYParallelEnc::parallelChild(const encParams *prm, const RGYInput *inpu
     return RGY_ERR_NONE;
 }
 
+void RGYParallelEnc::setChunkBoundaries(const encParams *prm, const RGYInput *input) {
+    const int chunks = prm->ctrl.parallelEnc.chunks;
+    // まずは時間で均等に分割し、開始は先頭のチャンクから順に行う
+    m_chunkSeekRatio.resize(chunks);
+    m_chunkCost.assign(chunks, 1.0 / chunks);
+    m_chunkOrder.resize(chunks);
+    for (int i = 0; i < chunks; i++) {
+        m_chunkSeekRatio[i] = i / (float)chunks;
+        m_chunkOrder[i] = i;
+    }
+    if (prm->common.seekSec > 0.0f || prm->common.seekToSec > 0.0f) {
+        // インデックスの時刻と子プロセスのseek位置とがずれるので、均等分割のままとする
+        return;
+    }
+    const auto keyframes = input->GetKeyframeIndex();
+    if ((int)keyframes.size() < chunks * RGY_PARALLEL_ENC_MIN_KEYFRAMES_PER_CHUNK) {
+        AddMessage(RGY_LOG_DEBUG, _T("Not enough keyframes in index (%d), split chunks uniformly.\n"), (int)keyframes.size());
+        return;
+    }
+    double totalDuration = 0.0;
+    int64_t totalBytes = 0;
+    for (const auto& key : keyframes) {
+        totalDuration += key.duration;
+        totalBytes += key.bytes;
+    }
+    const double inputDuration = keyframes.back().sec + keyframes.back().duration;
+    if (totalDuration <= 0.0 || inputDuration <= 0.0) {
+        return;
+    }
+    // GOPごとの推定コストを時間とパケットサイズから求め、その累積を計算する
+    // costSum[k] はキーフレームkより前の推定コストの合計
+    const double bytesWeight = (totalBytes > 0) ? RGY_PARALLEL_ENC_COST_BYTES_WEIGHT : 0.0;
+    std::vector<double> costSum(keyframes.size() + 1, 0.0);
+    for (size_t k = 0; k < keyframes.size(); k++) {
+        double cost = (1.0 - bytesWeight) * keyframes[k].duration / totalDuration;
+        if (bytesWeight > 0.0) {
+            cost += bytesWeight * keyframes[k].bytes / (double)totalBytes;
+        }
+        costSum[k + 1] = costSum[k] + cost;
+    }
+    const double totalCost = costSum.back();
+    if (totalCost <= 0.0) {
+        return;
+    }
+    // 累積コストが均等に分割されるキーフレームを各チャンクの開始位置とする
+    const int keyframeCount = (int)keyframes.size();
+    std::vector<int> chunkStartKey(chunks + 1, 0);
+    chunkStartKey[chunks] = keyframeCount;
+    for (int i = 1; i < chunks; i++) {
+        const double target = totalCost * i / chunks;
+        const int keyMin = chunkStartKey[i - 1] + 1;
+        const int keyMax = keyframeCount - (chunks - i);
+        int key = (int)(std::lower_bound(costSum.begin() + keyMin, costSum.begin() + keyMax + 1, target) - costSum.begin());
+        key = clamp(key, keyMin, keyMax);
+        if (key > keyMin && target - costSum[key - 1] < costSum[key] - target) {
+            key--;
+        }
+        chunkStartKey[i] = key;
+    }
+    for (int i = 0; i < chunks; i++) {
+        const auto& key = keyframes[chunkStartKey[i]];
+        // 子プロセスは指定位置の直前のキーフレームにseekするので、GOPの中央を指定しておく
+        m_chunkSeekRatio[i] = (i == 0) ? 0.0f : (float)std::min((key.sec + key.duration * 0.5) / inputDuration, 1.0);
+        m_chunkCost[i] = (costSum[chunkStartKey[i + 1]] - costSum[chunkStartKey[i]]) / totalCost;
+    }
+    // 並列数よりチャンク数が多い場合は、推定コストの大きいチャンクから開始する
+    if (prm->ctrl.parallelEnc.parallelCount < chunks) {
+        std::stable_sort(m_chunkOrder.begin(), m_chunkOrder.end(), [this](const int a, const int b) {
+            return m_chunkCost[a] > m_chunkCost[b];
+        });
+    }
+    for (int i = 0; i < chunks; i++) {
+        AddMessage(RGY_LOG_DEBUG, _T("chunk %d: start %.3f (%s), est. cost %.3f.\n"),
+            i, m_chunkSeekRatio[i], print_time(keyframes[chunkStartKey[i]].sec).c_str(), m_chunkCost[i]);
+    }
+}
+
 encParams RGYParallelEnc::genPEParam(const int ip, const encParams *prm, rgy_rational<int> outputTimebase, const tstring& tmpfile) {
     encParams prmParallel = *prm;
     prmParallel.ctrl.parallelEnc.parallelId = ip;
     prmParallel.ctrl.parentProcessID = GetCurrentProcessId();
     prmParallel.ctrl.loglevel = RGY_LOG_WARN;
-    prmParallel.ctrl.parallelEnc.cacheMode = (ip == 0) ? RGYParamParallelEncCache::Mem : prm->ctrl.parallelEnc.cacheMode; // parallelId = 0 は必ずMem キャッシュモード
+    prmParallel.ctrl.parallelEnc.cacheMode = prm->ctrl.parallelEnc.cacheMode;
+    if (ip == 0 && prmParallel.ctrl.parallelEnc.cacheMode == RGYParamParallelEncCache::File) {
+        prmParallel.ctrl.parallelEnc.cacheMode = RGYParamParallelEncCache::Mem; // parallelId = 0 はファイルキャッシュモードにしない
+    }
     prmParallel.common.muxOutputFormat = _T("raw");
     prmParallel.common.outputFilename = tmpfile; // ip==0の場合のみ、実際にはキューを介してデータをやり取りするがとりあえずファイル名はそのまま入れる
     prmParallel.common.AVMuxTarget = RGY_MUX_NONE;
@@ -452,7 +679,7 @@ encParams RGYParallelEnc::genPEParam(const int ip, const encParams *prm, rgy_rat
     prmParallel.common.ppAttachmentSelectList = nullptr;
     prmParallel.common.outReplayCodec = RGY_CODEC_UNKNOWN;
     prmParallel.common.outReplayFile.clear();
-    prmParallel.common.seekRatio = ip / (float)prmParallel.ctrl.parallelEnc.chunks;
+    prmParallel.common.seekRatio = (ip < (int)m_chunkSeekRatio.size()) ? m_chunkSeekRatio[ip] : ip / (float)prmParallel.ctrl.parallelEnc.chunks;
     prmParallel.common.timebase = outputTimebase; // timebaseがずれると致命的なので、強制的に上書きする
     prmParallel.common.dynamicHdr10plusJson.clear(); // hdr10plusのファイルからの読み込みは親プロセスでmux時に行う
     prmParallel.common.doviRpuFile.clear(); // doviRpuのファイルからの読み込みは親プロセスでmux時に行う
@@ -466,7 +693,7 @@ encParams RGYParallelEnc::genPEParam(const int ip, const encParams *prm, rgy_rat
 RGY_ERR RGYParallelEnc::startChunkProcess(const int ip, const encParams *prm, int64_t parentFirstKeyPts, rgy_rational<int> outputTimebase, EncodeStatus *encStatus) {
     const auto tmpfile = prm->common.outputFilename + _T(".pe") + std::to_tstring(ip);
     const auto peParam = genPEParam(ip, prm, outputTimebase, tmpfile);
-    auto process = std::make_unique<RGYParallelEncProcess>(ip, tmpfile, m_log);
+    auto process = std::make_unique<RGYParallelEncProcess>(ip, tmpfile, m_cacheBudget.get(), m_log);
     if (auto err = process->startThread(peParam); err != RGY_ERR_NONE) {
         AddMessage(RGY_LOG_ERROR, _T("Failed to run PE%d: %s.\n"), ip, get_err_mes(err));
         return err;
@@ -497,9 +724,26 @@ RGY_ERR RGYParallelEnc::startChunkProcess(const int ip, const encParams *prm, in
     return RGY_ERR_NONE;
 }
 
+RGY_ERR RGYParallelEnc::sendChunkEndPts(const int ichunk) {
+    // 次のチャンクの最初のキーフレームが、そのチャンクのエンコード終了時刻 (最後のチャンクは終わりまで)
+    const auto endPts = (ichunk < (int)m_encProcess.size() - 1) ? m_encProcess[ichunk + 1]->getVideoFirstKeyPts() : -1;
+    AddMessage(RGY_LOG_DEBUG, _T("Send PE%d end key pts %lld.\n"), ichunk, endPts);
+    auto err = m_encProcess[ichunk]->sendEndPts(endPts);
+    if (err != RGY_ERR_NONE) {
+        AddMessage(RGY_LOG_ERROR, _T("Failed to send end pts to PE%d: %s.\n"), ichunk, get_err_mes(err));
+    }
+    return err;
+}
+
 RGY_ERR RGYParallelEnc::startParallelThreads(const encParams *prm, const RGYInput *input, rgy_rational<int> outputTimebase, EncodeStatus *encStatus) {
     const auto parentFirstKeyPts = input->GetVideoFirstKeyPts();
     m_encProcess.clear();
+    // 先頭から順に開始する場合は、起動したものから開始できる
+    // そうでない場合は、開始順を守るため、すべてのチャンクの準備ができてから開始する
+    bool startInOrder = true;
+    for (int i = 0; i < (int)m_chunkOrder.size(); i++) {
+        startInOrder &= (m_chunkOrder[i] == i);
+    }
     // とりあえず、並列数分起動する
     int startId = 0;
     for (; startId < prm->ctrl.parallelEnc.parallelCount; startId++) {
@@ -508,13 +752,9 @@ RGY_ERR RGYParallelEnc::startParallelThreads(const encParams *prm, const RGYInpu
         }
 
         // 起動したプロセスの最初のキーフレームはひとつ前のプロセスのエンコード終了時刻
-        if (startId > 0) {
+        if (startId > 0 && startInOrder) {
             // ひとつ前のプロセスの終了時刻として転送
-            const auto firstKeyPts = m_encProcess[startId]->getVideoFirstKeyPts();
-            AddMessage(RGY_LOG_DEBUG, _T("Send PE%d end key pts %lld.\n"), startId - 1, firstKeyPts);
-            auto err = m_encProcess[startId-1]->sendEndPts(firstKeyPts);
-            if (err != RGY_ERR_NONE) {
-                AddMessage(RGY_LOG_ERROR, _T("Failed to send end pts to PE%d: %s.\n"), startId, get_err_mes(err));
+            if (auto err = sendChunkEndPts(startId - 1); err != RGY_ERR_NONE) {
                 return err;
             }
         }
@@ -522,48 +762,33 @@ RGY_ERR RGYParallelEnc::startParallelThreads(const encParams *prm, const RGYInpu
     // 並列数とチャック数が同じなら、これで起動は完了
     if (prm->ctrl.parallelEnc.parallelCount >= prm->ctrl.parallelEnc.chunks) {
         //最後のプロセスの終了時刻(=終わりまで)を転送
-        AddMessage(RGY_LOG_DEBUG, _T("Send PE%d end key pts -1.\n"), (int)m_encProcess.size() - 1);
-        auto err = m_encProcess.back()->sendEndPts(-1);
-        if (err != RGY_ERR_NONE) {
-            AddMessage(RGY_LOG_ERROR, _T("Failed to send end pts to encoder PE%d: %s.\n"), (int)m_encProcess.size() - 1, get_err_mes(err));
+        if (auto err = sendChunkEndPts((int)m_encProcess.size() - 1); err != RGY_ERR_NONE) {
             return err;
         }
     } else {
         // プロセス起動用のスレッドを開始する
-        m_thParallelRun = std::thread([this](int startId, const int parallelCount, const int chunkCount,
+        // 先頭から順に開始する場合は、startId-1 まで開始済み
+        const int startedCount = (startInOrder) ? startId - 1 : 0;
+        m_thParallelRun = std::thread([this](int startId, int runCount, const int parallelCount, const int chunkCount,
             encParams prm, rgy_rational<int> outputTimebase, EncodeStatus *encStatus) {
 
-            int runCount = startId-1; // 実行したチャック数
-
-            // とりあえず並列数分開始準備
+            // 残りのチャンクの開始準備
             for (; startId < chunkCount; startId++) {
                 if (auto err = startChunkProcess(startId, &prm, -1, outputTimebase, encStatus); err != RGY_ERR_NONE) {
                     return err;
                 }
             }
 
+            // runCount: 実行したチャック数
             while (!m_thParallelRunAbort && runCount < chunkCount) {
                 // 実行中のプロセス数を取得
                 const auto runningCount = std::count_if(m_encProcess.begin(), m_encProcess.end(), [](const auto& proc) {
                     return proc->processStatus() == RGYParallelEncProcessStatus::Running;
                 });
                 if (runningCount < parallelCount) {
-                    // 実行中のプロセス数が並列数より少ない場合、新しいプロセスを起動する
-                    if (runCount < chunkCount-1) {
-                        // ひとつ前のプロセスの終了時刻として転送
-                        const auto firstKeyPts = m_encProcess[runCount+1]->getVideoFirstKeyPts();
-                        AddMessage(RGY_LOG_DEBUG, _T("Send PE%d end key pts %lld.\n"), runCount, firstKeyPts);
-                        auto err = m_encProcess[runCount]->sendEndPts(firstKeyPts);
-                        if (err != RGY_ERR_NONE) {
-                            AddMessage(RGY_LOG_ERROR, _T("Failed to send end pts to PE%d: %s.\n"), startId, get_err_mes(err));
-                            return err;
-                        }
-                    } else {
-                        auto err = m_encProcess.back()->sendEndPts(-1);
-                        if (err != RGY_ERR_NONE) {
-                            AddMessage(RGY_LOG_ERROR, _T("Failed to send end pts to encoder PE%d: %s.\n"), (int)m_encProcess.size() - 1, get_err_mes(err));
-                            return err;
-                        }
+                    // 実行中のプロセス数が並列数より少ない場合、次のチャンクを開始する
+                    if (auto err = sendChunkEndPts(m_chunkOrder[runCount]); err != RGY_ERR_NONE) {
+                        return err;
                     }
                     runCount++; // 実行したチャック数をインクリメント
                 } else {
@@ -578,7 +803,7 @@ RGY_ERR RGYParallelEnc::startParallelThreads(const encParams *prm, const RGYInpu
                 }
             }
             return RGY_ERR_NONE;
-        }, startId, prm->ctrl.parallelEnc.parallelCount, prm->ctrl.parallelEnc.chunks, *prm, outputTimebase, encStatus);
+        }, startId, startedCount, prm->ctrl.parallelEnc.parallelCount, prm->ctrl.parallelEnc.chunks, *prm, outputTimebase, encStatus);
     }
     return RGY_ERR_NONE;
 }
@@ -596,6 +821,11 @@ RGY_ERR RGYParallelEnc::parallelRun(encParams *prm, const RGYInput *input, rgy_r
         prm->ctrl.parallelEnc.chunks = prm->ctrl.parallelEnc.parallelCount;
     }
     m_chunks = prm->ctrl.parallelEnc.chunks;
+    setChunkBoundaries(prm, input);
+    if (prm->ctrl.parallelEnc.cacheMode == RGYParamParallelEncCache::Hybrid) {
+        m_cacheBudget = std::make_unique<RGYParallelEncCacheBudget>((int64_t)prm->ctrl.parallelEnc.cacheMemMB * 1024 * 1024, m_chunks);
+        AddMessage(RGY_LOG_DEBUG, _T("hybrid cache: memory limit %d MB.\n"), prm->ctrl.parallelEnc.cacheMemMB);
+    }
     AddMessage(RGY_LOG_DEBUG, _T("parallelRun: parallel count %d, chunks %d\n"), prm->ctrl.parallelEnc.parallelCount, prm->ctrl.parallelEnc.chunks);
     auto [sts, errmes ] = isParallelEncPossible(prm, input);
     if (sts != RGY_ERR_NONE
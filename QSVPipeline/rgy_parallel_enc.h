@@ -32,6 +32,7 @@
 #include <thread>
 #include <optional>
 #include <mutex>
+#include <atomic>
 #include "rgy_osdep.h"
 #include "rgy_err.h"
 #include "rgy_event.h"
@@ -80,6 +81,38 @@ public:
     void reset();
 };
 
+// hybridキャッシュモードで、全チャンクで共有するメモリ使用量の上限を管理する
+// 上限を超える分は、親が必要とするのが遅いデータ (親が読み出し中のチャンクから遠いチャンクのデータ) から順にファイルに退避する
+// 使用量はRGYBitstreamBufPoolから実際に確保したサイズで数え、転送中のバッファに加え、再利用のため空きキューに保持しているバッファも含める
+class RGYParallelEncCacheBudget {
+public:
+    RGYParallelEncCacheBudget(const int64_t budgetBytes, const int chunks);
+    // ichunkのデータをsizeバイト分メモリに保持できる場合は確保してtrue、できない場合はfalse (ファイルに退避する)
+    bool reserve(const int ichunk, const size_t size);
+    // 上限に関わらずsizeバイト分確保する (親が退避されたデータを読み込む場合)
+    void add(const size_t size);
+    // バッファをRGYBitstreamBufPoolに返却した
+    void release(const size_t size);
+    // ファイルに退避した
+    void addSpill(const size_t size);
+    // 親が読み出し中のチャンク
+    void setCurrentChunk(const int ichunk) { m_currentChunk = ichunk; }
+    int64_t budget() const { return m_budget; }
+    int64_t peak() const { return m_peak; }
+    int64_t spillBytes() const { return m_spillBytes; }
+    int64_t spillPackets() const { return m_spillPackets; }
+protected:
+    void updatePeak(const int64_t used);
+
+    const int64_t m_budget;
+    const int m_chunks;
+    std::atomic<int> m_currentChunk;
+    std::atomic<int64_t> m_used;
+    std::atomic<int64_t> m_peak;
+    std::atomic<int64_t> m_spillBytes;
+    std::atomic<int64_t> m_spillPackets;
+};
+
 enum class RGYParallelEncProcessStatus {
     Init,
     Running,
@@ -99,9 +132,10 @@ struct RGYParallelEncSendData {
     unique_event eventParentHasSentFinKeyPts; // 親→子へ最後のptsを通知するためのイベント
     int64_t videoFinKeyPts;  // 子がエンコードすべき最後のpts(このptsを含まない)
     
-    RGYQueueMPMP<RGYOutputRawPEExtHeader*> *qFirstProcessData; // 最初の子エンコードから親へエンコード結果を転送するキュー
-    RGYQueueMPMP<RGYOutputRawPEExtHeader*> *qFirstProcessDataFree; // 転送し終わった(不要になった)ポインタを回収するキュー
-    RGYQueueMPMP<RGYOutputRawPEExtHeader*> *qFirstProcessDataFreeLarge; // 転送し終わった(不要になった)ポインタを回収するキュー(大きいサイズ用)
+    RGYQueueBoundedSPSC<RGYOutputRawPEExtHeader*> *qFirstProcessData; // 最初の子エンコードから親へエンコード結果を転送するキュー (子の出力→親)
+    RGYQueueBoundedMPMC<RGYOutputRawPEExtHeader*> *qFirstProcessDataFree; // 転送し終わった(不要になった)ポインタを回収するキュー
+    RGYQueueBoundedMPMC<RGYOutputRawPEExtHeader*> *qFirstProcessDataFreeLarge; // 転送し終わった(不要になった)ポインタを回収するキュー(大きいサイズ用)
+    RGYParallelEncCacheBudget *cacheBudget; // hybridキャッシュモードのメモリ使用量の管理 (hybrid以外ではnullptr)
 
     RGYParallelEncSendData() :
         processStatus(RGYParallelEncProcessStatus::Init),
@@ -113,12 +147,13 @@ struct RGYParallelEncSendData {
         videoFinKeyPts(-1),
         qFirstProcessData(nullptr),
         qFirstProcessDataFree(nullptr),
-        qFirstProcessDataFreeLarge(nullptr) {};
+        qFirstProcessDataFreeLarge(nullptr),
+        cacheBudget(nullptr) {};
 };
 
 class RGYParallelEncProcess {
 public:
-    RGYParallelEncProcess(const int id, const tstring& tmpfile, std::shared_ptr<RGYLog> log);
+    RGYParallelEncProcess(const int id, const tstring& tmpfile, RGYParallelEncCacheBudget *cacheBudget, std::shared_ptr<RGYLog> log);
     ~RGYParallelEncProcess();
     RGY_ERR startThread(const encParams& peParams);
     RGY_ERR run(const encParams& peParams);
@@ -164,14 +199,18 @@ protected:
         va_end(args);
         AddMessage(log_level, buffer);
     }
+    RGY_ERR readSpilledPacket(RGYOutputRawPEExtHeader **ptr);
+
     int m_id;
     std::unique_ptr<encCore> m_process;
-    std::unique_ptr<RGYQueueMPMP<RGYOutputRawPEExtHeader*>> m_qFirstProcessData;
-    std::unique_ptr<RGYQueueMPMP<RGYOutputRawPEExtHeader*>> m_qFirstProcessDataFree;
-    std::unique_ptr<RGYQueueMPMP<RGYOutputRawPEExtHeader*>> m_qFirstProcessDataFreeLarge;
+    std::unique_ptr<RGYQueueBoundedSPSC<RGYOutputRawPEExtHeader*>> m_qFirstProcessData;
+    std::unique_ptr<RGYQueueBoundedMPMC<RGYOutputRawPEExtHeader*>> m_qFirstProcessDataFree;
+    std::unique_ptr<RGYQueueBoundedMPMC<RGYOutputRawPEExtHeader*>> m_qFirstProcessDataFreeLarge;
     RGYParamParallelEncCache m_cacheMode;
+    RGYParallelEncCacheBudget *m_cacheBudget;
     RGYParallelEncSendData m_sendData;
     tstring m_tmpfile;
+    std::unique_ptr<FILE, fp_deleter> m_fpSpill; // hybridキャッシュモードで退避されたデータの読み込み用
     std::thread m_thRunProcess;
     std::optional<RGY_ERR> m_thRunProcessRet;
     unique_event m_processFinished;
@@ -204,6 +243,8 @@ public:
     int chunks() const { return m_chunks; }
 protected:
     encParams genPEParam(const int ip, const encParams *prm, rgy_rational<int> outputTimebase, const tstring& tmpfile);
+    void setChunkBoundaries(const encParams *prm, const RGYInput *input);
+    RGY_ERR sendChunkEndPts(const int ichunk);
     RGY_ERR startChunkProcess(int ichunk, const encParams *prm, int64_t parentFirstKeyPts, rgy_rational<int> outputTimebase, EncodeStatus *encStatus);
     RGY_ERR startParallelThreads(const encParams *prm, const RGYInput *input, rgy_rational<int> outputTimebase, EncodeStatus *encStatus);
     RGY_ERR parallelChild(const encParams *prm, const RGYInput *input);
@@ -235,6 +276,7 @@ protected:
     }
 
     int m_id;
+    std::unique_ptr<RGYParallelEncCacheBudget> m_cacheBudget;
     std::vector<std::unique_ptr<RGYParallelEncProcess>> m_encProcess;
     std::shared_ptr<RGYLog> m_log;
     std::thread m_thParallelRun;
@@ -243,6 +285,9 @@ protected:
     bool m_videoFinished;
     int m_parallelCount;
     int m_chunks;
+    std::vector<float> m_chunkSeekRatio; // 各チャンクの開始位置 (seekRatio)
+    std::vector<double> m_chunkCost;     // 各チャンクの推定エンコードコスト (合計1.0)
+    std::vector<int> m_chunkOrder;       // チャンクを開始する順番
 };
 
 
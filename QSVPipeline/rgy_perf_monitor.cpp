@@ -674,6 +674,9 @@ std::string CPerfMonitor::write_header(int nSelect) {
     if (nSelect & PERF_MONITOR_IO_WRITE) {
         str += ",write (MB/s)";
     }
+    if (nSelect & PERF_MONITOR_READAHEAD) {
+        str += ",readahead read (MB/s),readahead latency (ms),readahead wait (ms)";
+    }
     str += "\n";
     return str;
 }
@@ -685,7 +688,7 @@ void CPerfMonitor::runCounterThread() {
         getOSVersion(&osver);
         if (osver.dwMajorVersion > 6 || (osver.dwMajorVersion == 6 && osver.dwMinorVersion >= 4)) { //Windows10
             m_perfCounter = std::make_unique<RGYGPUCounterWin>();
-            m_perfCounter->thread_run(m_threadParam.affinity.getMask(), (int)m_threadParam.priority, m_threadParam.throttling == RGYThreadPowerThrottlingMode::Enabled);
+            m_perfCounter->thread_run(m_threadParam.affinity.getMask().mask64(), (int)m_threadParam.priority, m_threadParam.throttling == RGYThreadPowerThrottlingMode::Enabled);
         }
     }
 }
@@ -1104,6 +1107,16 @@ void CPerfMonitor::check() {
         pInfoNew->io_read_per_sec = (pInfoNew->io_total_read - pInfoOld->io_total_read) * time_diff_inv * 1e6;
         pInfoNew->io_write_per_sec = (pInfoNew->io_total_write - pInfoOld->io_total_write) * time_diff_inv * 1e6;
 
+        //入力の先読みの情報
+        pInfoNew->readahead_total_read = m_QueueInfo.readahead_read;
+        pInfoNew->readahead_total_count = m_QueueInfo.readahead_count;
+        pInfoNew->readahead_total_latency_us = m_QueueInfo.readahead_latency_us;
+        pInfoNew->readahead_total_wait_us = m_QueueInfo.readahead_wait_us;
+        pInfoNew->readahead_read_per_sec = (pInfoNew->readahead_total_read - pInfoOld->readahead_total_read) * time_diff_inv * 1e6;
+        const auto readaheadCount = pInfoNew->readahead_total_count - pInfoOld->readahead_total_count;
+        pInfoNew->readahead_latency_ms = (readaheadCount > 0) ? (pInfoNew->readahead_total_latency_us - pInfoOld->readahead_total_latency_us) * 1e-3 / readaheadCount : 0.0;
+        pInfoNew->readahead_wait_ms = (pInfoNew->readahead_total_wait_us - pInfoOld->readahead_total_wait_us) * 1e-3;
+
 #if defined(_WIN32) || defined(_WIN64)
         //スレッドCPU使用率
         if (m_thMainThread) {
@@ -1297,6 +1310,11 @@ std::string CPerfMonitor::write(int nSelect) {
     if (nSelect & PERF_MONITOR_IO_WRITE) {
         str += strsprintf(",%lf", pInfo->io_write_per_sec / (double)(1024 * 1024));
     }
+    if (nSelect & PERF_MONITOR_READAHEAD) {
+        str += strsprintf(",%lf", pInfo->readahead_read_per_sec / (double)(1024 * 1024));
+        str += strsprintf(",%lf", pInfo->readahead_latency_ms);
+        str += strsprintf(",%lf", pInfo->readahead_wait_ms);
+    }
     str += "\n";
     return str;
 }
@@ -101,6 +101,7 @@ enum : int {
     PERF_MONITOR_VEE_LOAD      = 0x04000000,
     PERF_MONITOR_VED_LOAD      = 0x08000000,
     PERF_MONITOR_PCIE_LOAD     = 0x10000000,
+    PERF_MONITOR_READAHEAD     = 0x20000000,
     PERF_MONITOR_ALL         = (int)UINT_MAX,
 };
 
@@ -138,6 +139,7 @@ static const CX_DESC list_pref_monitor[] = {
     { _T("pcie_load"),   PERF_MONITOR_PCIE_LOAD },
     { _T("ve_clock"),    PERF_MONITOR_VE_CLOCK },
     { _T("queue"),       PERF_MONITOR_QUEUE_VID_IN | PERF_MONITOR_QUEUE_VID_OUT | PERF_MONITOR_QUEUE_AUD_IN | PERF_MONITOR_QUEUE_AUD_OUT },
+    { _T("readahead"),   PERF_MONITOR_READAHEAD },
     { nullptr, 0 }
 };
 
@@ -159,6 +161,11 @@ struct PerfInfo {
     int64_t io_total_read;
     int64_t io_total_write;
 
+    int64_t readahead_total_read;
+    int64_t readahead_total_count;
+    int64_t readahead_total_latency_us;
+    int64_t readahead_total_wait_us;
+
     int64_t frames_in;
     int64_t frames_out;
     int64_t frames_out_byte;
@@ -172,6 +179,10 @@ struct PerfInfo {
     double  io_read_per_sec;
     double  io_write_per_sec;
 
+    double  readahead_read_per_sec;
+    double  readahead_latency_ms; //期間内に完了した読み込みの平均遅延
+    double  readahead_wait_ms;    //期間内に読み込みの完了を待った時間
+
     double  cpu_percent;
     double  cpu_kernel_percent;
 
@@ -211,6 +222,10 @@ struct PerfQueueInfo {
     size_t usage_aud_out;
     size_t usage_aud_enc;
     size_t usage_aud_proc;
+    uint64_t readahead_read;       //入力の先読みでストレージから読み込んだバイト数
+    uint64_t readahead_count;      //入力の先読みで完了した読み込みの数
+    uint64_t readahead_latency_us; //入力の先読みの読み込みの発行から完了までの時間の合計
+    uint64_t readahead_wait_us;    //入力の先読みの完了を待った時間の合計
 };
 
 #if ENABLE_METRIC_FRAMEWORK
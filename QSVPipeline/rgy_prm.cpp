@@ -2062,6 +2062,7 @@ RGYParamVpp::RGYParamVpp() :
     libplacebo_deband(),
     overlay(),
     fruc(),
+    fusion(false),
     checkPerformance(false) {
 
 }
@@ -2098,6 +2099,7 @@ bool RGYParamVpp::operator==(const RGYParamVpp& x) const {
         && deband == x.deband
         && libplacebo_deband == x.libplacebo_deband
         && overlay == x.overlay
+        && fusion == x.fusion
         && checkPerformance == x.checkPerformance;
 }
 bool RGYParamVpp::operator!=(const RGYParamVpp& x) const {
@@ -2292,6 +2294,7 @@ RGYParamCommon::RGYParamCommon() :
     inputRetry(0),
     demuxAnalyzeSec(-1),
     demuxProbesize(-1),
+    inputReadAhead(0),
     inputPixFmtStr(),
     AVMuxTarget(RGY_MUX_NONE),                       //RGY_MUX_xxx
     videoTrack(0),
@@ -2342,6 +2345,7 @@ RGYParamParallelEnc::RGYParamParallelEnc() :
     parallelId(-1),
     chunks(0),
     cacheMode(RGYParamParallelEncCache::Mem),
+    cacheMemMB(DEFAULT_PARALLEL_ENC_CACHE_MEM_MB),
     sendData(nullptr) {
 
 };
@@ -2349,7 +2353,8 @@ bool RGYParamParallelEnc::operator==(const RGYParamParallelEnc &x) const {
     return parallelCount == x.parallelCount
         && parallelId == x.parallelId
         && chunks == x.chunks
-        && cacheMode == x.cacheMode;
+        && cacheMode == x.cacheMode
+        && cacheMemMB == x.cacheMemMB;
 }
 bool RGYParamParallelEnc::operator!=(const RGYParamParallelEnc &x) const {
     return !(*this == x);
@@ -2369,9 +2374,15 @@ RGYParamControl::RGYParamControl() :
     threadOutput(RGY_OUTPUT_THREAD_AUTO),
     threadAudio(RGY_AUDIO_THREAD_AUTO),
     threadInput(RGY_INPUT_THREAD_AUTO),
+    threadPipeline(0),
+    threadPool(0),
     threadParams(),
+    numaNode(RGY_NUMA_NODE_DISABLED),
+    hugePages(RGYHugePageMode::Disabled),
+    framePoolCacheMB(-1),
     procSpeedLimit(0),      //処理速度制限 (0で制限なし)
     taskPerfMonitor(false),   //タスクの処理時間を計測する
+    taskPerfTraceFile(),
     perfMonitorSelect(0),
     perfMonitorSelectMatplot(0),
     perfMonitorInterval(RGY_DEFAULT_PERF_MONITOR_INTERVAL),
@@ -2383,11 +2394,14 @@ RGYParamControl::RGYParamControl() :
     avsdll(),
     vsdir(),
     enableOpenCL(true),
+    clProgramCache(true),
+    clProgramCacheDir(),
     enableVulkan(RGYParamInitVulkan::TargetVendor),
     avoidIdleClock(),
     processMonitorDevUsage(false),
     processMonitorDevUsageReset(false),
     outputBufSizeMB(RGY_OUTPUT_BUF_MB_DEFAULT),
+    outputAsyncIO(RGYOutputAsyncIO::Off),
     parallelEnc() {
 
 }
@@ -33,6 +33,7 @@
 #include "rgy_log.h"
 #include "rgy_util.h"
 #include "rgy_thread_affinity.h"
+#include "rgy_frame_pool.h"
 #include "rgy_simd.h"
 #include "rgy_hdr10plus.h"
 
@@ -47,6 +48,8 @@ static const float DEFAULT_DUMMY_LOAD_PERCENT = 0.01f;
 
 static const int RGY_AUDIO_QUALITY_DEFAULT = 0;
 
+static const int DEFAULT_PARALLEL_ENC_CACHE_MEM_MB = 1024;
+
 #if ENCODER_NVENC
 #define ENABLE_VPP_FILTER_COLORSPACE   (ENABLE_NVRTC)
 #else
@@ -2255,6 +2258,7 @@ struct RGYParamVpp {
     VppLibplaceboDeband libplacebo_deband;
     std::vector<VppOverlay> overlay;
     VppFruc fruc;
+    bool fusion;
     bool checkPerformance;
 
     RGYParamVpp();
@@ -2449,6 +2453,7 @@ struct RGYParamCommon {
     int inputRetry;
     double demuxAnalyzeSec;
     int64_t demuxProbesize;
+    int inputReadAhead;
     tstring inputPixFmtStr;
     int AVMuxTarget;                       //RGY_MUX_xxx
     int videoTrack;
@@ -2512,11 +2517,13 @@ struct RGYParallelEncSendData;
 enum class RGYParamParallelEncCache {
     Mem,
     File,
+    Hybrid,
 };
 
 const CX_DESC list_parallel_enc_cache[] = {
     { _T("mem"),  (int)RGYParamParallelEncCache::Mem  },
     { _T("file"), (int)RGYParamParallelEncCache::File },
+    { _T("hybrid"), (int)RGYParamParallelEncCache::Hybrid },
     { NULL, 0 }
 };
 
@@ -2525,6 +2532,7 @@ struct RGYParamParallelEnc {
     int parallelId; // 親=-1, 子=0～
     int chunks; // 分割数
     RGYParamParallelEncCache cacheMode;
+    int cacheMemMB; // hybridキャッシュモードで全チャンク合計で使用するメモリの上限 (MB)
     RGYParallelEncSendData *sendData; // 並列処理時に親-子間のデータやり取り用
     RGYParamParallelEnc();
     bool operator==(const RGYParamParallelEnc &x) const;
@@ -2540,6 +2548,26 @@ enum class RGYParamInitVulkan {
     All,
 };
 
+const CX_DESC list_huge_pages[] = {
+    { _T("off"),     (int)RGYHugePageMode::Disabled },
+    { _T("thp"),     (int)RGYHugePageMode::THP      },
+    { _T("hugetlb"), (int)RGYHugePageMode::HugeTLB  },
+    { NULL, 0 }
+};
+
+enum class RGYOutputAsyncIO {
+    Off,     //従来どおりFILE*に同期で書き込む
+    On,      //非同期に書き込む
+    Direct,  //非同期に書き込み、可能な範囲でO_DIRECTを使用する
+};
+
+const CX_DESC list_output_async_io[] = {
+    { _T("off"),    (int)RGYOutputAsyncIO::Off    },
+    { _T("on"),     (int)RGYOutputAsyncIO::On     },
+    { _T("direct"), (int)RGYOutputAsyncIO::Direct },
+    { NULL, 0 }
+};
+
 struct RGYParamControl {
     int threadCsp;
     RGY_SIMD simdCsp;
@@ -2552,9 +2580,15 @@ struct RGYParamControl {
     int threadOutput;
     int threadAudio;
     int threadInput;
+    int threadPipeline;
+    int threadPool;          //共有スレッドプールのスレッド数の上限 (0で論理コア数)
     RGYParamThreads threadParams;
+    int numaNode;            //スレッドとメモリを割り当てるNUMAノード (RGY_NUMA_NODE_DISABLED / RGY_NUMA_NODE_AUTO)
+    RGYHugePageMode hugePages; //フレーム・ビットストリームのバッファをhuge pageで確保する
+    int framePoolCacheMB;      //フレームバッファのプールに保持する未使用のバッファのサイズの上限 (MB, -1で既定値)
     int procSpeedLimit;      //処理速度制限 (0で制限なし)
     bool taskPerfMonitor;
+    tstring taskPerfTraceFile; // タスクの処理時間の記録をChrome trace形式で出力するファイル
     int64_t perfMonitorSelect;
     int64_t perfMonitorSelectMatplot;
     int     perfMonitorInterval;
@@ -2566,12 +2600,15 @@ struct RGYParamControl {
     tstring avsdll;
     tstring vsdir;
     bool enableOpenCL;
+    bool clProgramCache;          //OpenCLのプログラムのバイナリをキャッシュする
+    tstring clProgramCacheDir;    //OpenCLのプログラムのバイナリキャッシュの保存先 (空ならデフォルト)
     RGYParamInitVulkan enableVulkan;
     RGYParamAvoidIdleClock avoidIdleClock;
     bool processMonitorDevUsage;
     bool processMonitorDevUsageReset;
 
     int outputBufSizeMB;         //出力バッファサイズ
+    RGYOutputAsyncIO outputAsyncIO; //出力ファイルへの書き込みを非同期で行う
 
     RGYParamParallelEnc parallelEnc;
 
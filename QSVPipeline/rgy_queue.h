@@ -33,8 +33,10 @@
 #include <cstring>
 #include <atomic>
 #include <climits>
+#include <chrono>
 #include <memory>
 #include <mutex>
+#include <utility>
 #include "rgy_arch.h"
 #include "rgy_osdep.h"
 #include "rgy_util.h"
@@ -60,6 +62,353 @@ private:
     std::atomic<bool>& m_lock;
 };
 
+//ロックフリーキュー用の待機/通知を行うクラス
+//待機しているスレッドがいない場合、notify()はメモリフェンスとatomicの読み込みのみで完了する
+//待機はfutex (Windows: WaitOnAddress) で行うため、ポーリングによる遅延は発生しない
+class RGYQueueWaiter {
+public:
+    RGYQueueWaiter() : m_seq(0), m_waiters(0) {};
+    //状態を変更した後に呼び、待機中のスレッドを起こす
+    void notify() {
+        //状態の変更とm_waitersの読み込みの順序を保証する (wait()側のm_waitersの加算と対になる)
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) > 0) {
+            m_seq.fetch_add(1, std::memory_order_seq_cst);
+            RGYWakeByAddressAll(&m_seq);
+        }
+    }
+    //pred()がtrueになるまで待機する
+    //タイムアウトした場合はfalseを返す
+    template<typename Pred>
+    bool wait(Pred pred, uint32_t millisec = INFINITE) {
+        if (pred()) {
+            return true;
+        }
+        const auto timeStart = std::chrono::steady_clock::now();
+        bool ret = true;
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        for (;;) {
+            //条件の確認前にm_seqを読み込んでおくことで、確認後の通知を取りこぼさない
+            const uint32_t seq = m_seq.load(std::memory_order_seq_cst);
+            if (pred()) {
+                break;
+            }
+            uint32_t remain = INFINITE;
+            if (millisec != INFINITE) {
+                const auto elapsed = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - timeStart).count();
+                if (elapsed >= millisec) {
+                    ret = false;
+                    break;
+                }
+                remain = millisec - elapsed;
+            }
+            RGYWaitOnAddress(&m_seq, seq, remain);
+        }
+        m_waiters.fetch_sub(1, std::memory_order_relaxed);
+        return ret;
+    }
+protected:
+    std::atomic<uint32_t> m_seq;   //通知ごとに更新されるカウンタ (futexの待機対象)
+    std::atomic<int> m_waiters;    //待機中のスレッド数
+};
+
+#pragma warning (push)
+#pragma warning (disable: 4324) //アラインメント指定子のために構造体がパッドされました
+//固定長のロックフリーMPMCキュー (Vyukov方式)
+//各スロットにシーケンス番号を持たせ、push/popの位置をCASで確保するので、ロックをとらずに複数スレッドから押し込み/取り出しができる
+//容量はinit()で指定した値以上の2の累乗に切り上げられ、動的には拡張されない
+template<typename Type>
+class RGYQueueBoundedMPMC {
+    struct queueCell {
+        std::atomic<size_t> seq;
+        Type data;
+    };
+public:
+    RGYQueueBoundedMPMC() :
+        m_cells(), m_mask(0), m_closed(false),
+        m_waitPushed(), m_waitPopped(),
+        m_pushPos(0), m_popPos(0) {
+    }
+    ~RGYQueueBoundedMPMC() {
+        m_cells.reset();
+    }
+    RGYQueueBoundedMPMC(const RGYQueueBoundedMPMC&) = delete;
+    RGYQueueBoundedMPMC& operator=(const RGYQueueBoundedMPMC&) = delete;
+    //キューを初期化する (他スレッドからアクセスされていない状態で呼ぶこと)
+    void init(size_t capacity) {
+        size_t bufSize = 2;
+        while (bufSize < capacity) {
+            bufSize <<= 1;
+        }
+        m_cells = std::make_unique<queueCell[]>(bufSize);
+        for (size_t i = 0; i < bufSize; i++) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+        m_mask = bufSize - 1;
+        m_pushPos.store(0, std::memory_order_relaxed);
+        m_popPos.store(0, std::memory_order_relaxed);
+        m_closed.store(false, std::memory_order_release);
+    }
+    //キューの最大サイズを取得する
+    size_t capacity() const {
+        return m_mask + 1;
+    }
+    //キューのおおよそのsizeを取得する (他スレッドが操作中の場合は概算値)
+    size_t size() const {
+        const size_t popPos = m_popPos.load(std::memory_order_acquire);
+        const size_t pushPos = m_pushPos.load(std::memory_order_acquire);
+        return (pushPos > popPos) ? (std::min)(pushPos - popPos, capacity()) : 0;
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+    bool closed() const {
+        return m_closed.load(std::memory_order_acquire);
+    }
+    //これ以上データを追加しないことを通知し、待機中のスレッドを起こす
+    //close後、pushは失敗し、popはキューが空になった時点で失敗するようになる
+    void close() {
+        m_closed.store(true, std::memory_order_release);
+        m_waitPushed.notify();
+        m_waitPopped.notify();
+    }
+    //データを押し込む、キューがいっぱいならなにもせずfalseを返す
+    bool try_push(const Type& in) {
+        return push_impl(in);
+    }
+    bool try_push(Type&& in) {
+        return push_impl(std::move(in));
+    }
+    //キューの先頭のデータを取り出す、キューが空ならなにもせずfalseを返す
+    bool try_pop(Type *out) {
+        size_t pos = m_popPos.load(std::memory_order_relaxed);
+        queueCell *cell = nullptr;
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            const size_t seq = cell->seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (m_popPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; //空
+            } else {
+                pos = m_popPos.load(std::memory_order_relaxed);
+            }
+        }
+        *out = std::move(cell->data);
+        cell->data = Type();
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        m_waitPopped.notify();
+        return true;
+    }
+    //キューに空きができるまで待機してからデータを押し込む
+    //closeされたか、タイムアウトした場合はfalseを返す (この場合inは変更されない)
+    bool push(Type&& in, uint32_t millisec = INFINITE) {
+        bool pushed = false;
+        m_waitPopped.wait([&]() { return closed() || (pushed = push_impl(std::move(in))); }, millisec);
+        return pushed;
+    }
+    bool push(const Type& in, uint32_t millisec = INFINITE) {
+        bool pushed = false;
+        m_waitPopped.wait([&]() { return closed() || (pushed = push_impl(in)); }, millisec);
+        return pushed;
+    }
+    //データが来るまで待機して取り出す
+    //closeされていてキューが空か、タイムアウトした場合はfalseを返す
+    bool pop(Type *out, uint32_t millisec = INFINITE) {
+        bool popped = false;
+        m_waitPushed.wait([&]() { return (popped = try_pop(out)) || closed(); }, millisec);
+        //closeと同時にpushされたデータを取りこぼさないよう、もう一度確認する
+        return popped || try_pop(out);
+    }
+    //キューのデータをすべて取り出し、指定した関数で開放する
+    template<typename Func>
+    void clear(Func deleter) {
+        if (!m_cells) {
+            return; //init()されていない
+        }
+        Type data;
+        while (try_pop(&data)) {
+            deleter(&data);
+        }
+    }
+    void clear() {
+        clear([](Type *) {});
+    }
+protected:
+    template<typename T>
+    bool push_impl(T&& in) {
+        if (closed()) {
+            return false;
+        }
+        size_t pos = m_pushPos.load(std::memory_order_relaxed);
+        queueCell *cell = nullptr;
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            const size_t seq = cell->seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (m_pushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; //いっぱい
+            } else {
+                pos = m_pushPos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::forward<T>(in);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        m_waitPushed.notify();
+        return true;
+    }
+
+    std::unique_ptr<queueCell[]> m_cells; //データ領域
+    size_t m_mask;                        //容量-1 (容量は2の累乗)
+    std::atomic<bool> m_closed;           //これ以上データが追加されない
+    RGYQueueWaiter m_waitPushed;          //データが追加されたときに通知する
+    RGYQueueWaiter m_waitPopped;          //データが取り出されたときに通知する
+    alignas(64) std::atomic<size_t> m_pushPos; //次に押し込む位置
+    alignas(64) std::atomic<size_t> m_popPos;  //次に取り出す位置
+    char m_pad[64 - sizeof(std::atomic<size_t>)];
+};
+
+//固定長のロックフリーSPSCキュー
+//押し込むスレッドと取り出すスレッドがそれぞれひとつに限られる場合に使用する
+//push側/pop側がそれぞれ相手側の位置をキャッシュするので、キューに余裕がある間は共有変数へのアクセスが発生しない
+template<typename Type>
+class RGYQueueBoundedSPSC {
+public:
+    RGYQueueBoundedSPSC() :
+        m_buf(), m_capacity(0), m_mask(0), m_closed(false),
+        m_waitPushed(), m_waitPopped(),
+        m_pushPos(0), m_popPosCache(0),
+        m_popPos(0), m_pushPosCache(0) {
+    }
+    RGYQueueBoundedSPSC(const RGYQueueBoundedSPSC&) = delete;
+    RGYQueueBoundedSPSC& operator=(const RGYQueueBoundedSPSC&) = delete;
+    //キューを初期化する (他スレッドからアクセスされていない状態で呼ぶこと)
+    //SPSCではcapacityはそのまま最大サイズとなる (内部領域は2の累乗に切り上げる)
+    void init(size_t capacity) {
+        size_t bufSize = 2;
+        while (bufSize < capacity) {
+            bufSize <<= 1;
+        }
+        m_buf = std::make_unique<Type[]>(bufSize);
+        m_capacity = (std::max<size_t>)(capacity, 1);
+        m_mask = bufSize - 1;
+        m_pushPos.store(0, std::memory_order_relaxed);
+        m_popPos.store(0, std::memory_order_relaxed);
+        m_popPosCache = 0;
+        m_pushPosCache = 0;
+        m_closed.store(false, std::memory_order_release);
+    }
+    size_t capacity() const {
+        return m_capacity;
+    }
+    //キューのおおよそのsizeを取得する
+    size_t size() const {
+        const size_t popPos = m_popPos.load(std::memory_order_acquire);
+        const size_t pushPos = m_pushPos.load(std::memory_order_acquire);
+        return pushPos - popPos;
+    }
+    bool empty() const {
+        return size() == 0;
+    }
+    bool closed() const {
+        return m_closed.load(std::memory_order_acquire);
+    }
+    //これ以上データを追加しないことを通知し、待機中のスレッドを起こす
+    void close() {
+        m_closed.store(true, std::memory_order_release);
+        m_waitPushed.notify();
+        m_waitPopped.notify();
+    }
+    // !! push側のスレッドからのみ呼ぶこと !!
+    bool try_push(const Type& in) {
+        return push_impl(in);
+    }
+    bool try_push(Type&& in) {
+        return push_impl(std::move(in));
+    }
+    // !! pop側のスレッドからのみ呼ぶこと !!
+    bool try_pop(Type *out) {
+        const size_t pos = m_popPos.load(std::memory_order_relaxed);
+        if (pos == m_pushPosCache) {
+            m_pushPosCache = m_pushPos.load(std::memory_order_acquire);
+            if (pos == m_pushPosCache) {
+                return false; //空
+            }
+        }
+        Type& cell = m_buf[pos & m_mask];
+        *out = std::move(cell);
+        cell = Type();
+        m_popPos.store(pos + 1, std::memory_order_release);
+        m_waitPopped.notify();
+        return true;
+    }
+    //キューに空きができるまで待機してからデータを押し込む
+    //closeされたか、タイムアウトした場合はfalseを返す
+    bool push(Type&& in, uint32_t millisec = INFINITE) {
+        bool pushed = false;
+        m_waitPopped.wait([&]() { return closed() || (pushed = push_impl(std::move(in))); }, millisec);
+        return pushed;
+    }
+    bool push(const Type& in, uint32_t millisec = INFINITE) {
+        bool pushed = false;
+        m_waitPopped.wait([&]() { return closed() || (pushed = push_impl(in)); }, millisec);
+        return pushed;
+    }
+    //データが来るまで待機して取り出す
+    //closeされていてキューが空か、タイムアウトした場合はfalseを返す
+    bool pop(Type *out, uint32_t millisec = INFINITE) {
+        bool popped = false;
+        m_waitPushed.wait([&]() { return (popped = try_pop(out)) || closed(); }, millisec);
+        return popped || try_pop(out);
+    }
+    // !! pop側のスレッドからのみ呼ぶこと !!
+    template<typename Func>
+    void clear(Func deleter) {
+        Type data;
+        while (try_pop(&data)) {
+            deleter(&data);
+        }
+    }
+protected:
+    template<typename T>
+    bool push_impl(T&& in) {
+        if (closed()) {
+            return false;
+        }
+        const size_t pos = m_pushPos.load(std::memory_order_relaxed);
+        if (pos - m_popPosCache >= m_capacity) {
+            m_popPosCache = m_popPos.load(std::memory_order_acquire);
+            if (pos - m_popPosCache >= m_capacity) {
+                return false; //いっぱい
+            }
+        }
+        m_buf[pos & m_mask] = std::forward<T>(in);
+        m_pushPos.store(pos + 1, std::memory_order_release);
+        m_waitPushed.notify();
+        return true;
+    }
+
+    std::unique_ptr<Type[]> m_buf; //データ領域
+    size_t m_capacity;             //キューに詰められるデータの最大数
+    size_t m_mask;                 //内部領域のサイズ-1 (2の累乗)
+    std::atomic<bool> m_closed;    //これ以上データが追加されない
+    RGYQueueWaiter m_waitPushed;   //データが追加されたときに通知する
+    RGYQueueWaiter m_waitPopped;   //データが取り出されたときに通知する
+    alignas(64) std::atomic<size_t> m_pushPos; //次に押し込む位置 (push側が更新)
+                size_t m_popPosCache;          //push側から見たm_popPosのキャッシュ
+    alignas(64) std::atomic<size_t> m_popPos;  //次に取り出す位置 (pop側が更新)
+                size_t m_pushPosCache;         //pop側から見たm_pushPosのキャッシュ
+    char m_pad[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+};
+#pragma warning (pop)
+
 #pragma warning (push)
 #pragma warning (disable: 4324) //アラインメント指定子のために構造体がパッドされました
 template<typename Type, size_t align_byte = sizeof(Type)>
@@ -79,6 +428,7 @@ public:
         m_nMallocAlign(32),
         m_nMaxCapacity(SIZE_MAX),
         m_nKeepLength(0),
+        m_waitPushed(), m_waitPopped(),
         m_pBufIn(nullptr), m_pBufOut(nullptr),
         m_pBufStart(), m_pBufFin(nullptr),
         m_bUsingData(false), m_bPush(false) {
@@ -172,9 +522,9 @@ public:
     //キューのデータ量があらかじめ設定した上限に達した場合は、キューに空きができるまで待機する
     bool push(const Type& in) {
         //最初に決めた容量分までキューにデータがたまっていたら、キューに空きができるまで待機する
-        while (size() >= m_nMaxCapacity) {
-            ResetEvent(m_heEventPoped);
-            WaitForSingleObject(m_heEventPoped, 16);
+        //通常は取り出し側からの通知で起床する (nPushRestartによる通知の間引きがあるので、16msごとにも確認する)
+        while (!m_waitPopped.wait([this]() { return size() < m_nMaxCapacity; }, 16)) {
+            ;
         }
         // pushするスレッド同士が競合しないよう、下記領域にロックをかける
         RGYQueueLock pushLock(m_bPush);
@@ -223,6 +573,7 @@ public:
         m_pBufIn.load()->data = in;
         m_pBufIn++;
         SetEvent(m_heEventPushed);
+        m_waitPushed.notify();
         return true;
     }
     //キューのsizeを取得する
@@ -249,6 +600,7 @@ public:
     void set_capacity(size_t capacity) {
         m_nMaxCapacity = capacity;
         m_nPushRestartExtra = (std::min)(m_nPushRestartExtra, (int)std::min<size_t>(INT_MAX, m_nMaxCapacity) - 1);
+        m_waitPopped.notify();
     }
     //indexの位置のコピーを取得する
     bool copy(Type *out, uint32_t index, size_t *pnSize = nullptr) {
@@ -303,6 +655,7 @@ public:
                 m_pBufOut++;
                 if (nSize <= m_nMaxCapacity - m_nPushRestartExtra) {
                     SetEvent(m_heEventPoped);
+                    m_waitPopped.notify();
                 }
             }
         }
@@ -326,6 +679,7 @@ public:
                 m_pBufOut++;
                 if (nSize <= m_nMaxCapacity - m_nPushRestartExtra) {
                     SetEvent(m_heEventPoped);
+                    m_waitPopped.notify();
                 }
             }
         }
@@ -334,9 +688,9 @@ public:
         }
         return bCopy;
     }
-    //要素が追加されるまで待機する
+    //要素が追加されるまで待機する (最大16ms)
     void wait_for_push() {
-        WaitForSingleObject(m_heEventPushed, 16);
+        m_waitPushed.wait([this]() { return size() > m_nKeepLength; }, 16);
     }
     //要素が追加されるまで待機するイベントを取得
     HANDLE get_push_event() {
@@ -360,6 +714,8 @@ protected:
     int m_nMallocAlign; //メモリのアライメント
     size_t m_nMaxCapacity; //キューに詰められる有効なデータの最大数
     size_t m_nKeepLength; //ある一定の長さを常にキュー内に保持するようにする
+    RGYQueueWaiter m_waitPushed; //キューにデータが追加されたとき通知する
+    RGYQueueWaiter m_waitPopped; //キューからデータを取り出したとき通知する
     alignas(64) std::atomic<queueData*> m_pBufIn; //キューにデータを格納する位置へのポインタ
                 std::atomic<queueData*> m_pBufOut; //キューから取り出すべき先頭のデータへのポインタ
                 std::unique_ptr<queueData, aligned_malloc_deleter> m_pBufStart; //確保しているメモリ領域の先頭へのポインタ
@@ -369,29 +725,32 @@ protected:
 };
 #pragma warning (pop)
 
+#pragma warning (push)
+#pragma warning (disable: 4324) //アラインメント指定子のために構造体がパッドされました
+//パイプ転送用のバイト列のリングバッファ (SPSC)
+//内部領域は2の累乗のサイズで確保し、データの追加時にmemmoveや再確保を行わない
+//reserve/commit, peek/consumeを使うと、push側は内部領域に直接書き込み、pop側は内部領域から直接読み出すことができる
+//push側/pop側はそれぞれひとつのスレッドからのみ呼ぶこと
 class RGYQueueBuffer {
 public:
     RGYQueueBuffer() :
         m_ptr(nullptr),
-        m_size(0),
         m_capacity(0),
+        m_mask(0),
         m_maxCapacity(1 * 1024 * 1024),
-        m_offset(0),
-        m_heEventPushed(nullptr),
         m_EOF(false),
-        m_mutex() {
-        m_heEventPoped = CreateEvent(NULL, TRUE, TRUE, NULL);
-        m_heEventPushed = CreateEvent(NULL, TRUE, TRUE, NULL);
+        m_waitPushed(),
+        m_waitPopped(),
+        m_pushPos(0),
+        m_popPos(0) {
     }
     ~RGYQueueBuffer() {
         close();
-        if (m_heEventPoped) CloseEvent(m_heEventPoped);
-        if (m_heEventPushed) CloseEvent(m_heEventPushed);
     }
+    //データをクリアする (push側/pop側のスレッドが動作していない状態で呼ぶこと)
     void clear() {
-        m_size = 0;
-        m_capacity = 0;
-        m_offset = 0;
+        m_pushPos = 0;
+        m_popPos = 0;
     }
     void close() {
         clear();
@@ -399,93 +758,133 @@ public:
             free(m_ptr);
             m_ptr = nullptr;
         }
+        m_capacity = 0;
+        m_mask = 0;
     }
+    //bufSize以上の2の累乗のサイズでリングバッファを確保する
     void init(int64_t bufSize = 1 * 1024 * 1024) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_ptr = (uint8_t *)malloc((size_t)bufSize);
-        m_capacity = bufSize;
+        close();
+        int64_t capacity = 4096;
+        while (capacity < bufSize) {
+            capacity <<= 1;
+        }
+        m_ptr = (uint8_t *)malloc((size_t)capacity);
+        m_capacity = (m_ptr) ? capacity : 0;
+        m_mask = (m_ptr) ? capacity - 1 : 0;
     }
     int64_t size() const {
-        return m_size;
+        return m_pushPos.load(std::memory_order_acquire) - m_popPos.load(std::memory_order_acquire);
     }
     bool empty() const {
-        return m_size == 0;
+        return size() == 0;
     }
+    int64_t capacity() const {
+        return m_capacity;
+    }
+    //書き込み可能な連続領域を取得する (push側のスレッドから呼ぶ)
+    //リングバッファの終端で折り返すため、返す領域のサイズは要求より小さいことがある (空きがなければ0)
+    int64_t reserve(uint8_t **ptr, const int64_t maxSize) {
+        const int64_t pushPos = m_pushPos.load(std::memory_order_relaxed);
+        const int64_t freeSize = m_capacity - (pushPos - m_popPos.load(std::memory_order_acquire));
+        const int64_t offset = pushPos & m_mask;
+        *ptr = m_ptr + offset;
+        return (std::min)((std::min)(maxSize, freeSize), m_capacity - offset);
+    }
+    //reserveで取得した領域のうち、書き込んだサイズを確定する (push側のスレッドから呼ぶ)
+    void commit(const int64_t writeSize) {
+        m_pushPos.store(m_pushPos.load(std::memory_order_relaxed) + writeSize, std::memory_order_release);
+        m_waitPushed.notify();
+    }
+    //読み出し可能な連続領域を取得する (pop側のスレッドから呼ぶ)
+    //リングバッファの終端で折り返すため、返す領域のサイズはsize()より小さいことがある
+    int64_t peek(const uint8_t **ptr) const {
+        const int64_t popPos = m_popPos.load(std::memory_order_relaxed);
+        const int64_t dataSize = m_pushPos.load(std::memory_order_acquire) - popPos;
+        const int64_t offset = popPos & m_mask;
+        *ptr = m_ptr + offset;
+        return (std::min)(dataSize, m_capacity - offset);
+    }
+    //peekで取得した領域のうち、読み出したサイズを解放する (pop側のスレッドから呼ぶ)
+    void consume(const int64_t readSize) {
+        m_popPos.store(m_popPos.load(std::memory_order_relaxed) + readSize, std::memory_order_release);
+        m_waitPopped.notify();
+    }
+    //データをコピーして追加する
+    //データはすべて追加するか、まったく追加しないかのどちらかで、一部だけが追加されることはない
+    //追加後のデータ量がm_maxCapacity (0以下なら制限なし) を超える場合は、空きができるまでtimeout(ms)まで待機する
+    //ただし、キューが空ならm_maxCapacityより大きなデータも追加できる
+    //リングバッファのサイズより大きなデータは追加できないのでfalseを返す
     bool pushData(const uint8_t *data, int64_t addSize, int timeout) {
-        //最初に決めた容量分までキューにデータがたまっていたら、キューに空きができるまで待機する
-        int wait = 0;
-        while (m_size >= m_maxCapacity) {
-            ResetEvent(m_heEventPoped);
-            const int wait_time = 16;
-            WaitForSingleObject(m_heEventPoped, wait_time);
-            wait += wait_time;
-            if (wait > timeout) {
-                return false;
-            }
+        if (addSize <= 0) {
+            return true;
         }
-        std::lock_guard<std::mutex> lock(m_mutex);
-        if (m_size + addSize > m_capacity) {
-            m_capacity = (std::max)(m_capacity * 2, m_size + addSize);
-            auto tmp = (uint8_t *)malloc((size_t)m_capacity);
-            if (m_size > 0) {
-                memcpy(tmp, m_ptr + m_offset, (size_t)m_size);
-            }
-            free(m_ptr);
-            m_ptr = tmp;
-            m_offset = 0;
-        } else if (m_size + m_offset + addSize > m_capacity) {
-            if (m_size > 0) {
-                memmove(m_ptr, m_ptr + m_offset, (size_t)m_size);
-            }
-            m_offset = 0;
+        if (addSize > m_capacity) {
+            return false;
+        }
+        if (!m_waitPopped.wait([this, addSize]() {
+                const int64_t maxCapacity = m_maxCapacity.load();
+                const int64_t limit = (maxCapacity > 0) ? (std::min)(maxCapacity, m_capacity) : m_capacity;
+                const int64_t queueSize = size();
+                return queueSize == 0 || queueSize + addSize <= limit;
+            }, (uint32_t)timeout)) {
+            return false;
+        }
+        //必要な空きは確保できているので、折り返しがあっても最大2回で書き込める
+        while (addSize > 0) {
+            uint8_t *ptr = nullptr;
+            const int64_t writeSize = reserve(&ptr, addSize);
+            memcpy(ptr, data, (size_t)writeSize);
+            commit(writeSize);
+            data += writeSize;
+            addSize -= writeSize;
         }
-        memcpy(m_ptr + m_offset + m_size, data, (size_t)addSize);
-        m_size += addSize;
-        SetEvent(m_heEventPushed);
         return true;
     }
+    //データが来るまで待機してから、最大maxSizeまでコピーして取り出す
+    //EOFが設定されていてキューが空なら-1を返す
     int64_t popDataBlock(uint8_t *data, const int64_t maxSize) {
-        int64_t copy_size = popData(data, maxSize);
-        while (copy_size == 0) {
-            WaitForSingleObject(m_heEventPushed, 16);
-            copy_size = popData(data, maxSize);
-        }
-        return copy_size;
+        m_waitPushed.wait([this]() { return size() > 0 || m_EOF; });
+        return popData(data, maxSize);
     }
     void setEOF() {
         m_EOF = true;
+        m_waitPushed.notify();
     }
     void setMaxCapacity(int64_t maxCapacity) {
         m_maxCapacity = maxCapacity;
+        m_waitPopped.notify();
     }
     int64_t getMaxCapacity() const {
         return m_maxCapacity;
     }
 protected:
     int64_t popData(uint8_t *data, const int64_t maxSize) {
-        if (m_size == 0) return (m_EOF) ? -1 : 0;
-
-        std::lock_guard<std::mutex> lock(m_mutex);
-        int64_t copy_size = (std::min)(maxSize, m_size);
-        memcpy(data, m_ptr + m_offset, (size_t)copy_size);
-        m_offset += copy_size;
-        m_size -= copy_size;
-        if (m_size == 0) {
-            m_offset = 0;
-        }
-        SetEvent(m_heEventPoped);
-        ResetEvent(m_heEventPushed);
+        int64_t copy_size = 0;
+        while (copy_size < maxSize) {
+            const uint8_t *ptr = nullptr;
+            const int64_t readSize = (std::min)(peek(&ptr), maxSize - copy_size);
+            if (readSize <= 0) {
+                break;
+            }
+            memcpy(data + copy_size, ptr, (size_t)readSize);
+            consume(readSize);
+            copy_size += readSize;
+        }
+        if (copy_size == 0 && m_EOF) {
+            return -1;
+        }
         return copy_size;
     }
-    uint8_t *m_ptr;
-    int64_t m_size;
-    int64_t m_capacity;
-    int64_t m_maxCapacity;
-    int64_t m_offset;
-    HANDLE m_heEventPoped; //キューからデータを取り出したときセットする
-    HANDLE m_heEventPushed; //キューにデータが追加されたときセットする
-    bool m_EOF;
-    std::mutex m_mutex;
+    uint8_t *m_ptr;          //リングバッファ
+    int64_t m_capacity;      //リングバッファのサイズ (2の累乗)
+    int64_t m_mask;          //m_capacity-1
+    std::atomic<int64_t> m_maxCapacity; //これ以上データがたまる場合はpushDataで待機する (0以下なら制限なし)
+    std::atomic<bool> m_EOF;
+    RGYQueueWaiter m_waitPushed; //データが追加されたときに通知する
+    RGYQueueWaiter m_waitPopped; //データが取り出されたときに通知する
+    alignas(64) std::atomic<int64_t> m_pushPos; //これまでに追加したデータ量 (push側が更新)
+    alignas(64) std::atomic<int64_t> m_popPos;  //これまでに取り出したデータ量 (pop側が更新)
 };
+#pragma warning (pop)
 
 #endif //__RGY_QUEUE_H__
@@ -27,10 +27,19 @@
 
 #include <sstream>
 #include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <map>
 #include "rgy_thread_affinity.h"
 #include "rgy_osdep.h"
 #if defined(_WIN32) || defined(_WIN64)
 #include <tlhelp32.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 #endif //#if defined(_WIN32) || defined(_WIN64)
 #include "cpu_info.h"
 
@@ -63,25 +72,107 @@ RGYThreadPowerThrottlingMode rgy_str_to_thread_power_throttoling_mode(const TCHA
     return RGYThreadPowerThrottlingMode::END;
 }
 
-RGYThreadAffinity::RGYThreadAffinity() : mode(), custom(std::numeric_limits<decltype(custom)>::max()) {};
+int RGYCPUSet::count() const {
+    int count = 0;
+    for (auto w : bits) {
+        for (; w; w &= w - 1) {
+            count++;
+        }
+    }
+    return count;
+}
+
+int RGYCPUSet::next(int id) const {
+    for (int i = (std::max)(id + 1, 0); i < RGY_MAX_CPU_COUNT; ) {
+        const auto w = bits[i / WORD_BITS] >> (i % WORD_BITS);
+        if (w == 0) {
+            i = (i / WORD_BITS + 1) * WORD_BITS; // 次のwordへ
+            continue;
+        }
+        if (w & 1) {
+            return i;
+        }
+        i++;
+    }
+    return -1;
+}
 
-RGYThreadAffinity::RGYThreadAffinity(RGYThreadAffinityMode affinityMode) : mode(affinityMode), custom(std::numeric_limits<decltype(custom)>::max()) {};
+RGYCPUSet RGYCPUSet::selectNth(int idx) const {
+    auto ret = none();
+    int count = 0;
+    for (int i = next(-1); i >= 0; i = next(i), count++) {
+        if (count == idx) {
+            ret.set(i);
+            break;
+        }
+    }
+    return ret;
+}
 
-RGYThreadAffinity::RGYThreadAffinity(RGYThreadAffinityMode m, uint64_t customAffinity) : mode(m), custom(customAffinity) {};
+tstring RGYCPUSet::to_string() const {
+    int iw = WORD_COUNT - 1;
+    while (iw > 0 && bits[iw] == 0) {
+        iw--;
+    }
+    TCHAR buf[32];
+    _stprintf_s(buf, _T("0x%llx"), (unsigned long long)bits[iw]);
+    tstring str = buf;
+    for (iw--; iw >= 0; iw--) {
+        _stprintf_s(buf, _T("%016llx"), (unsigned long long)bits[iw]);
+        str += buf;
+    }
+    return str;
+}
+
+bool RGYCPUSet::fromString(RGYCPUSet& set, const tstring& hex) {
+    auto str = hex;
+    if (str.substr(0, 2) == _T("0x") || str.substr(0, 2) == _T("0X")) {
+        str = str.substr(2);
+    }
+    if (str.empty()) {
+        return false;
+    }
+    set.clear();
+    // 下位の桁から4bitずつ設定する
+    int ibit = 0;
+    for (auto it = str.rbegin(); it != str.rend(); it++, ibit += 4) {
+        int value = 0;
+        if (_T('0') <= *it && *it <= _T('9')) {
+            value = *it - _T('0');
+        } else if (_T('a') <= *it && *it <= _T('f')) {
+            value = *it - _T('a') + 10;
+        } else if (_T('A') <= *it && *it <= _T('F')) {
+            value = *it - _T('A') + 10;
+        } else {
+            return false;
+        }
+        if (value == 0) continue;
+        if (ibit >= RGY_MAX_CPU_COUNT) {
+            return false;
+        }
+        set.bits[ibit / WORD_BITS] |= (uint64_t)value << (ibit % WORD_BITS);
+    }
+    return true;
+}
+
+RGYThreadAffinity::RGYThreadAffinity() : mode(), custom(RGYCPUSet::all()) {};
+
+RGYThreadAffinity::RGYThreadAffinity(RGYThreadAffinityMode affinityMode) : mode(affinityMode), custom(RGYCPUSet::all()) {};
+
+RGYThreadAffinity::RGYThreadAffinity(RGYThreadAffinityMode m, const RGYCPUSet& customAffinity) : mode(m), custom(customAffinity) {};
 
 tstring RGYThreadAffinity::to_string() const {
     if (mode == RGYThreadAffinityMode::CUSTOM) {
-        TCHAR buf[64];
-        _stprintf_s(buf, _T("0x%llx"), custom);
-        return buf;
+        return custom.to_string();
     }
     auto modeStr = rgy_thread_affnity_mode_to_str(mode);
     if (   mode == RGYThreadAffinityMode::LOGICAL
         || mode == RGYThreadAffinityMode::PHYSICAL
         || mode == RGYThreadAffinityMode::CACHEL2
         || mode == RGYThreadAffinityMode::CACHEL3
+        || mode == RGYThreadAffinityMode::NUMA
     ) {
-        const auto cpu_info = get_cpu_info();
+        const auto& cpu_info = get_cpu_info();
         int targetCount = 0;
         if (mode == RGYThreadAffinityMode::LOGICAL) {
             targetCount = cpu_info.logical_cores;
@@ -91,11 +182,12 @@ tstring RGYThreadAffinity::to_string() const {
             targetCount = cpu_info.cache_count[1];
         } else if (mode == RGYThreadAffinityMode::CACHEL3) {
             targetCount = cpu_info.cache_count[2];
+        } else if (mode == RGYThreadAffinityMode::NUMA) {
+            targetCount = cpu_info.node_count;
         }
         std::basic_stringstream<TCHAR> tmp;
         for (int id = 0; id < targetCount; id++) {
-            const auto target = 1llu << id;
-            if (target & custom) {
+            if (custom.test(id)) {
                 tmp << _T(":") << id;
             }
         }
@@ -131,25 +223,24 @@ bool RGYThreadAffinity::operator!=(const RGYThreadAffinity &x) const {
     return !(*this == x);
 }
 
-uint64_t RGYThreadAffinity::getMask(int idx) const {
+RGYCPUSet RGYThreadAffinity::getMask(int idx) const {
     return selectMaskFromLowerBit(getMask(), idx);
 }
 
-uint64_t RGYThreadAffinity::getMask() const {
-    uint64_t mask = 0;
-    const auto cpu_info = get_cpu_info();
+RGYCPUSet RGYThreadAffinity::getMask() const {
+    auto mask = RGYCPUSet::none();
+    const auto& cpu_info = get_cpu_info();
     switch (mode) {
     case RGYThreadAffinityMode::PCORE:
     case RGYThreadAffinityMode::ECORE: {
         auto maskSelected = cpu_info.maskSystem;
-        if (mode == RGYThreadAffinityMode::PCORE && cpu_info.maskCoreP) maskSelected = cpu_info.maskCoreP;
-        if (mode == RGYThreadAffinityMode::ECORE && cpu_info.maskCoreE) maskSelected = cpu_info.maskCoreE;
+        if (mode == RGYThreadAffinityMode::PCORE && !cpu_info.maskCoreP.empty()) maskSelected = cpu_info.maskCoreP;
+        if (mode == RGYThreadAffinityMode::ECORE && !cpu_info.maskCoreE.empty()) maskSelected = cpu_info.maskCoreE;
         int targetCore = 0;
         for (int i = 0; i < cpu_info.physical_cores; i++) {
             const auto target_i = get_mask(&cpu_info, RGYUnitType::Core, (int)RGYCoreType::Physical, i);
-            if (maskSelected & target_i) { // PCoreであるか?
-                const auto target_core_mask = 1llu << targetCore;
-                if (target_core_mask & custom) { // customで指定のコアであるか?
+            if (maskSelected.intersects(target_i)) { // PCoreであるか?
+                if (custom.test(targetCore)) { // customで指定のコアであるか?
                     mask |= target_i;
                 }
                 targetCore++;
@@ -158,41 +249,44 @@ uint64_t RGYThreadAffinity::getMask() const {
     } break;
     case RGYThreadAffinityMode::LOGICAL:
         for (int i = 0; i < cpu_info.logical_cores; i++) {
-            const auto target = 1llu << i;
-            if (target & custom) {
+            if (custom.test(i)) {
                 mask |= get_mask(&cpu_info, RGYUnitType::Core, (int)RGYCoreType::Logical, i);
             }
         }
         break;
     case RGYThreadAffinityMode::PHYSICAL:
         for (int i = 0; i < cpu_info.physical_cores; i++) {
-            const auto target = 1llu << i;
-            if (target & custom) {
+            if (custom.test(i)) {
                 mask |= get_mask(&cpu_info, RGYUnitType::Core, (int)RGYCoreType::Physical, i);
             }
         }
         break;
     case RGYThreadAffinityMode::CACHEL2:
         for (int i = 0; i < cpu_info.cache_count[1]; i++) {
-            const auto target = 1llu << i;
-            if (target & custom) {
+            if (custom.test(i)) {
                 mask |= get_mask(&cpu_info, RGYUnitType::Cache, (int)RGYCacheLevel::L2, i);
             }
         }
         break;
     case RGYThreadAffinityMode::CACHEL3:
         for (int i = 0; i < cpu_info.cache_count[2]; i++) {
-            const auto target = 1llu << i;
-            if (target & custom) {
+            if (custom.test(i)) {
                 mask |= get_mask(&cpu_info, RGYUnitType::Cache, (int)RGYCacheLevel::L3, i);
             }
         }
         break;
-    case RGYThreadAffinityMode::CUSTOM: mask = (custom) ? custom & cpu_info.maskSystem : cpu_info.maskSystem; break;
+    case RGYThreadAffinityMode::NUMA:
+        for (int i = 0; i < cpu_info.node_count; i++) {
+            if (custom.test(i)) {
+                mask |= get_mask(&cpu_info, RGYUnitType::Node, 0, i);
+            }
+        }
+        break;
+    case RGYThreadAffinityMode::CUSTOM: mask = (!custom.empty()) ? custom & cpu_info.maskSystem : cpu_info.maskSystem; break;
     case RGYThreadAffinityMode::ALL:
     default: mask = cpu_info.maskSystem; break;
     }
-    return (mask) ? mask : std::numeric_limits<decltype(mask)>::max();
+    return (!mask.empty()) ? mask : RGYCPUSet::all();
 }
 
 RGYParamThread::RGYParamThread() :
@@ -241,10 +335,8 @@ tstring RGYParamThread::to_string(RGYParamThreadType type) const {
 tstring RGYParamThread::desc() const {
     tstring str;
     str += affinity.to_string();
-    str += _T(" (0x");
-    TCHAR buf[64];
-    _stprintf_s(buf, _T("0x%llx"), affinity.getMask());
-    str += buf;
+    str += _T(" (");
+    str += affinity.getMask().to_string();
     str += _T("), priority=");
     str += rgy_thread_priority_mode_to_str(priority);
     str += _T(", throttling=");
@@ -267,10 +359,24 @@ void RGYParamThread::set(RGYThreadAffinity affinity_, RGYThreadPriority priority
     throttling = throttling_;
 }
 
+#if !(defined(_WIN32) || defined(_WIN64))
+// --thread-affinityで個別にマスクを設定したスレッド (tid -> 設定後のマスク)
+// RGYSetProcessAffinityで上書きしないようにする
+static std::mutex s_explicitAffinityMtx;
+static std::map<pid_t, RGYCPUSet> s_explicitAffinity;
+static void rgy_register_explicit_affinity();
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+
 bool RGYParamThread::apply(RGYThreadHandle threadHandle) const {
     bool ret = true;
     if (affinity.mode != RGYThreadAffinityMode::ALL) {
-        SetThreadAffinityMask(threadHandle, affinity.getMask());
+        if (RGYSetThreadAffinity(threadHandle, affinity.getMask())) {
+#if !(defined(_WIN32) || defined(_WIN64))
+            if (pthread_equal(threadHandle, pthread_self())) {
+                rgy_register_explicit_affinity();
+            }
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+        }
     }
 #if defined(_WIN32) || defined(_WIN64)
     if (priority != RGYThreadPriority::Normal) {
@@ -419,19 +525,190 @@ bool RGYParamThreads::operator!=(const RGYParamThreads&x) const {
     return !(*this == x);
 }
 
-#pragma warning(push)
-#pragma warning(disable: 4146) //warning C4146: 符号付きの値を代入する変数は、符号付き型にキャストしなければなりません。
-uint64_t selectMaskFromLowerBit(uint64_t mask, const int idx) {
-    int count = 0;
-    uint64_t ret = 0;
-    do {
-        mask &= (~ret);
-        ret = (uint64_t)(mask & (-mask)); // select lowest bit
-        count++;
-    } while (count <= idx);
-    return ret;
+RGYCPUSet selectMaskFromLowerBit(const RGYCPUSet& mask, const int idx) {
+    return mask.selectNth(idx);
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+bool RGYSetThreadAffinity(RGYThreadHandle threadHandle, const RGYCPUSet& mask, RGYCPUSet *prevMask) {
+    // プロセッサグループをまたぐ指定はできないので、現在のグループ内(下位64論理コア)のみ
+    const auto ret = SetThreadAffinityMask(threadHandle, (DWORD_PTR)mask.mask64());
+    if (prevMask) {
+        *prevMask = RGYCPUSet::fromMask(ret);
+    }
+    return ret != 0;
+}
+
+bool RGYSetProcessAffinity(const RGYCPUSet& mask) {
+    return SetProcessAffinityMask(GetCurrentProcess(), (DWORD_PTR)mask.mask64()) != 0;
+}
+#else
+static void rgy_cpu_set_free(cpu_set_t *cpuset) {
+    CPU_FREE(cpuset);
+}
+
+// cpu_set_tは1024CPUまでしか扱えないので、CPU_ALLOCで確保する
+class RGYCPUSetNative {
+public:
+    RGYCPUSetNative() : m_set(CPU_ALLOC(RGY_MAX_CPU_COUNT), rgy_cpu_set_free), m_size(CPU_ALLOC_SIZE(RGY_MAX_CPU_COUNT)) {
+        if (m_set) CPU_ZERO_S(m_size, m_set.get());
+    }
+    RGYCPUSetNative(const RGYCPUSet& mask) : RGYCPUSetNative() {
+        if (!m_set) return;
+        for (int i = mask.next(-1); i >= 0; i = mask.next(i)) {
+            CPU_SET_S(i, m_size, m_set.get());
+        }
+    }
+    RGYCPUSet get() const {
+        auto mask = RGYCPUSet::none();
+        if (m_set) {
+            for (int i = 0; i < RGY_MAX_CPU_COUNT; i++) {
+                if (CPU_ISSET_S(i, m_size, m_set.get())) {
+                    mask.set(i);
+                }
+            }
+        }
+        return mask;
+    }
+    cpu_set_t *ptr() { return m_set.get(); }
+    size_t size() const { return m_size; }
+protected:
+    std::unique_ptr<cpu_set_t, decltype(&rgy_cpu_set_free)> m_set;
+    size_t m_size;
+};
+
+bool RGYSetThreadAffinity(RGYThreadHandle threadHandle, const RGYCPUSet& mask, RGYCPUSet *prevMask) {
+    if (prevMask) {
+        RGYCPUSetNative cpusetOrg;
+        if (cpusetOrg.ptr() && pthread_getaffinity_np(threadHandle, cpusetOrg.size(), cpusetOrg.ptr()) == 0) {
+            *prevMask = cpusetOrg.get();
+        } else {
+            *prevMask = RGYCPUSet::none();
+        }
+    }
+    RGYCPUSetNative cpuset(mask);
+    return cpuset.ptr() && pthread_setaffinity_np(threadHandle, cpuset.size(), cpuset.ptr()) == 0;
+}
+
+// 呼び出したスレッドを個別にマスクを設定したスレッドとして登録する
+// オンラインでないCPUはカーネル側で除かれるので、実際に設定されたマスクを記録する
+static void rgy_register_explicit_affinity() {
+    RGYCPUSetNative cpuset;
+    if (cpuset.ptr() && sched_getaffinity(0, cpuset.size(), cpuset.ptr()) == 0) {
+        std::lock_guard<std::mutex> lock(s_explicitAffinityMtx);
+        s_explicitAffinity[(pid_t)syscall(SYS_gettid)] = cpuset.get();
+    }
+}
+
+bool RGYSetProcessAffinity(const RGYCPUSet& mask) {
+    RGYCPUSetNative cpuset(mask);
+    if (!cpuset.ptr() || sched_setaffinity(0, cpuset.size(), cpuset.ptr()) != 0) {
+        return false;
+    }
+    // sched_setaffinityはスレッド単位なので、すでに起動しているスレッドにも設定する
+    // ただし、--thread-affinityで個別にマスクを設定したスレッドはそのままにする
+    // (tidが再利用された場合に備え、設定したマスクのままのスレッドのみ対象外とする)
+    DIR *dir = opendir("/proc/self/task");
+    if (dir) {
+        std::lock_guard<std::mutex> lock(s_explicitAffinityMtx);
+        struct dirent *entry = nullptr;
+        while ((entry = readdir(dir)) != nullptr) {
+            const auto tid = (pid_t)atoi(entry->d_name);
+            if (tid <= 0) {
+                continue;
+            }
+            if (auto it = s_explicitAffinity.find(tid); it != s_explicitAffinity.end()) {
+                RGYCPUSetNative cpusetThread;
+                if (cpusetThread.ptr() && sched_getaffinity(tid, cpusetThread.size(), cpusetThread.ptr()) == 0
+                    && cpusetThread.get() == it->second) {
+                    continue;
+                }
+                s_explicitAffinity.erase(it);
+            }
+            sched_setaffinity(tid, cpuset.size(), cpuset.ptr());
+        }
+        closedir(dir);
+    }
+    return true;
+}
+#endif //#if defined(_WIN32) || defined(_WIN64)
+
+static std::atomic<int> s_numaNode(-1);
+static std::atomic<int> s_numaNodeOS(-1);
+
+#if !(defined(_WIN32) || defined(_WIN64))
+static const int RGY_MPOL_PREFERRED = 1; // linux/mempolicy.h
+static const int RGY_NUMA_NODEMASK_BITS = 1024;
+
+static long rgy_numa_set_policy(void *ptr, size_t size, const int nodeOS) {
+    unsigned long nodemask[RGY_NUMA_NODEMASK_BITS / (sizeof(unsigned long) * 8)] = { 0 };
+    if (nodeOS < 0 || nodeOS >= RGY_NUMA_NODEMASK_BITS) {
+        return -1;
+    }
+    nodemask[nodeOS / (sizeof(unsigned long) * 8)] |= 1ul << (nodeOS % (sizeof(unsigned long) * 8));
+    // maxnodeはカーネル側で-1して扱われるので+1しておく
+    return (ptr)
+        ? syscall(SYS_mbind, ptr, size, RGY_MPOL_PREFERRED, nodemask, RGY_NUMA_NODEMASK_BITS + 1, 0)
+        : syscall(SYS_set_mempolicy, RGY_MPOL_PREFERRED, nodemask, RGY_NUMA_NODEMASK_BITS + 1);
+}
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
+
+int RGYNumaSetProcessNode(int node) {
+    const auto& cpu_info = get_cpu_info();
+    if (node == RGY_NUMA_NODE_AUTO) {
+#if defined(_WIN32) || defined(_WIN64)
+        const int cpu = (int)GetCurrentProcessorNumber();
+#else
+        const int cpu = sched_getcpu();
+#endif
+        node = 0;
+        for (int i = 0; i < cpu_info.node_count; i++) {
+            if (cpu_info.nodes[i].mask.test(cpu)) {
+                node = i;
+                break;
+            }
+        }
+    }
+    if (node < 0 || node >= cpu_info.node_count) {
+        return -1;
+    }
+    if (!RGYSetProcessAffinity(cpu_info.nodes[node].mask)) {
+        return -1;
+    }
+#if !(defined(_WIN32) || defined(_WIN64))
+    // 以降に作成されるスレッドはメモリポリシーを引き継ぐ
+    // NUMAノードの情報がない(ソケット単位の)場合は、スレッドの割り当てのみ
+    if (cpu_info.nodes[node].id >= 0) {
+        rgy_numa_set_policy(nullptr, 0, cpu_info.nodes[node].id);
+    }
+#endif
+    s_numaNodeOS = cpu_info.nodes[node].id;
+    s_numaNode = node;
+    return node;
+}
+
+int RGYNumaGetProcessNode() {
+    return s_numaNode;
+}
+
+void RGYNumaBindMemory(void *ptr, size_t size) {
+#if !(defined(_WIN32) || defined(_WIN64))
+    const int nodeOS = s_numaNodeOS;
+    if (nodeOS < 0 || ptr == nullptr) {
+        return;
+    }
+    // mbindはページ単位なので、バッファ内に完全に含まれるページのみを対象とする
+    static const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    const auto start = ((size_t)ptr + pageSize - 1) & ~(pageSize - 1);
+    const auto fin = ((size_t)ptr + size) & ~(pageSize - 1);
+    if (fin > start) {
+        rgy_numa_set_policy((void *)start, fin - start, nodeOS);
+    }
+#else
+    UNREFERENCED_PARAMETER(ptr);
+    UNREFERENCED_PARAMETER(size);
+#endif //#if !(defined(_WIN32) || defined(_WIN64))
 }
-#pragma warning(pop)
 
 #if defined(_WIN32) || defined(_WIN64)
 static inline bool check_ptr_range(void *value, void *min, void *max) {
@@ -529,16 +806,16 @@ bool SetThreadPriorityForModule(const uint32_t TargetProcessId, const TCHAR *Tar
     return ret;
 }
 
-static bool SetThreadAffinityFromThreadId(const uint32_t TargetThreadId, const uint64_t ThreadAffinityMask) {
+static bool SetThreadAffinityFromThreadId(const uint32_t TargetThreadId, const RGYCPUSet& ThreadAffinityMask) {
     HANDLE hThread = OpenThread(THREAD_ALL_ACCESS, FALSE, TargetThreadId);
     if (hThread == NULL)
         return FALSE;
-    auto ret = SetThreadAffinityMask(hThread, ThreadAffinityMask);
+    auto ret = RGYSetThreadAffinity(hThread, ThreadAffinityMask);
     CloseHandle(hThread);
-    return (ret != 0);
+    return ret;
 }
 
-bool SetThreadAffinityForModule(const uint32_t TargetProcessId, const TCHAR *TargetModule, const uint64_t ThreadAffinityMask) {
+bool SetThreadAffinityForModule(const uint32_t TargetProcessId, const TCHAR *TargetModule, const RGYCPUSet& ThreadAffinityMask) {
     bool ret = TRUE;
     const auto thread_list = GetThreadList(TargetProcessId);
     const auto module_list = GetModuleList(TargetProcessId);
@@ -630,7 +907,7 @@ bool SetThreadPowerThrottolingModeForModule(const uint32_t TargetProcessId, cons
 bool SetThreadPriorityForModule(const uint32_t TargetProcessId, const TCHAR* TargetModule, const RGYThreadPriority ThreadPriority) {
     return false;
 }
-bool SetThreadAffinityForModule(const uint32_t TargetProcessId, const TCHAR* TargetModule, const uint64_t ThreadAffinityMask) {
+bool SetThreadAffinityForModule(const uint32_t TargetProcessId, const TCHAR* TargetModule, const RGYCPUSet& ThreadAffinityMask) {
     return false;
 }
 bool SetThreadPowerThrottolingMode(RGYThreadHandle threadHandle, const RGYThreadPowerThrottlingMode mode) {
@@ -95,6 +95,7 @@ enum class RGYThreadAffinityMode {
     PHYSICAL,
     CACHEL2,
     CACHEL3,
+    NUMA,
     CUSTOM,
     END
 };
@@ -107,27 +108,62 @@ static const std::array<std::pair<const TCHAR *, RGYThreadAffinityMode>, (int)RG
     std::pair<const TCHAR *, RGYThreadAffinityMode>{ _T("physical"), RGYThreadAffinityMode::PHYSICAL },
     std::pair<const TCHAR *, RGYThreadAffinityMode>{ _T("cachel2"),  RGYThreadAffinityMode::CACHEL2  },
     std::pair<const TCHAR *, RGYThreadAffinityMode>{ _T("cachel3"),  RGYThreadAffinityMode::CACHEL3  },
+    std::pair<const TCHAR *, RGYThreadAffinityMode>{ _T("numa"),     RGYThreadAffinityMode::NUMA     },
     std::pair<const TCHAR *, RGYThreadAffinityMode>{ _T("custom"),   RGYThreadAffinityMode::CUSTOM   }
 };
 
 const TCHAR *rgy_thread_affnity_mode_to_str(RGYThreadAffinityMode mode);
 RGYThreadAffinityMode rgy_str_to_thread_affnity_mode(const TCHAR *str);
 
+static const int RGY_MAX_CPU_COUNT = 1024;
+
+// 64論理コアを超えるシステムに対応するためのCPUマスク (最大RGY_MAX_CPU_COUNT)
+// cpu_info_tに含めてmemsetで初期化するので、trivialな型のままにしておくこと
+struct RGYCPUSet {
+    static const int WORD_BITS = 64;
+    static const int WORD_COUNT = RGY_MAX_CPU_COUNT / WORD_BITS;
+    uint64_t bits[WORD_COUNT];
+
+    static RGYCPUSet none() { RGYCPUSet set; set.clear(); return set; }
+    static RGYCPUSet all() { RGYCPUSet set; for (auto& w : set.bits) w = std::numeric_limits<uint64_t>::max(); return set; }
+    static RGYCPUSet fromMask(uint64_t mask) { auto set = none(); set.bits[0] = mask; return set; }
+
+    void clear() { for (auto& w : bits) w = 0; }
+    void set(int id) { if (0 <= id && id < RGY_MAX_CPU_COUNT) bits[id / WORD_BITS] |= 1llu << (id % WORD_BITS); }
+    void reset(int id) { if (0 <= id && id < RGY_MAX_CPU_COUNT) bits[id / WORD_BITS] &= ~(1llu << (id % WORD_BITS)); }
+    bool test(int id) const { return 0 <= id && id < RGY_MAX_CPU_COUNT && (bits[id / WORD_BITS] & (1llu << (id % WORD_BITS))) != 0; }
+    bool empty() const { for (const auto w : bits) { if (w) return false; } return true; }
+    bool intersects(const RGYCPUSet& x) const { for (int i = 0; i < WORD_COUNT; i++) { if (bits[i] & x.bits[i]) return true; } return false; }
+    int count() const;
+    int next(int id) const; // idより大きい最小のCPU番号、なければ-1 (next(-1)で先頭)
+    RGYCPUSet selectNth(int idx) const; // 下位からidx番目のCPUのみを残したマスク
+    uint64_t mask64() const { return bits[0]; } // 64bitのマスクしか扱えないAPI用
+    tstring to_string() const; // 0x<hex>
+    static bool fromString(RGYCPUSet& set, const tstring& hex); // 0x<hex>
+
+    RGYCPUSet& operator|=(const RGYCPUSet& x) { for (int i = 0; i < WORD_COUNT; i++) bits[i] |= x.bits[i]; return *this; }
+    RGYCPUSet& operator&=(const RGYCPUSet& x) { for (int i = 0; i < WORD_COUNT; i++) bits[i] &= x.bits[i]; return *this; }
+    RGYCPUSet operator|(const RGYCPUSet& x) const { auto ret = *this; ret |= x; return ret; }
+    RGYCPUSet operator&(const RGYCPUSet& x) const { auto ret = *this; ret &= x; return ret; }
+    bool operator==(const RGYCPUSet& x) const { for (int i = 0; i < WORD_COUNT; i++) { if (bits[i] != x.bits[i]) return false; } return true; }
+    bool operator!=(const RGYCPUSet& x) const { return !(*this == x); }
+};
+
 struct RGYThreadAffinity {
     RGYThreadAffinityMode mode;
-    uint64_t custom;
+    RGYCPUSet custom;
 
     RGYThreadAffinity();
     RGYThreadAffinity(RGYThreadAffinityMode m);
-    RGYThreadAffinity(RGYThreadAffinityMode m, uint64_t customAffinity);
-    uint64_t getMask() const;
-    uint64_t getMask(int idx) const;
+    RGYThreadAffinity(RGYThreadAffinityMode m, const RGYCPUSet& customAffinity);
+    RGYCPUSet getMask() const;
+    RGYCPUSet getMask(int idx) const;
     tstring to_string() const;
     bool operator==(const RGYThreadAffinity &x) const;
     bool operator!=(const RGYThreadAffinity &x) const;
 };
 
-uint64_t selectMaskFromLowerBit(uint64_t mask, const int idx);
+RGYCPUSet selectMaskFromLowerBit(const RGYCPUSet& mask, const int idx);
 
 enum class RGYThreadType {
     ALL,
@@ -210,8 +246,27 @@ struct RGYParamThreads {
     bool operator!=(const RGYParamThreads&x) const;
 };
 
+// 64論理コアを超えるマスクも扱えるアフィニティ設定 (Windowsではプロセッサグループ内の64論理コアまで)
+// prevMaskを指定すると変更前のマスクを返す
+bool RGYSetThreadAffinity(RGYThreadHandle threadHandle, const RGYCPUSet& mask, RGYCPUSet *prevMask = nullptr);
+bool RGYSetProcessAffinity(const RGYCPUSet& mask);
+
+static const int RGY_NUMA_NODE_DISABLED = -1;
+static const int RGY_NUMA_NODE_AUTO     = -2;
+
+// プロセス全体のスレッドとメモリ確保をNUMAノードに割り当てる (nodeはcpu_info_t::nodesのインデックス)
+// RGY_NUMA_NODE_AUTOの場合は、呼び出したスレッドが実行中のノードを選択する
+// Linuxでは呼び出したスレッドと、以降に作成されるスレッドのメモリポリシーも変更する
+// 戻り値は割り当てたノード (失敗時は-1)
+int RGYNumaSetProcessNode(int node);
+// RGYNumaSetProcessNodeで割り当てたノード (割り当てていなければ-1)
+int RGYNumaGetProcessNode();
+// 確保したばかりのバッファのメモリを割り当てたノードに配置する (Linuxのみ、ページ単位)
+// ほかのスレッドが最初に書き込んだ場合でも、割り当てたノードに配置されるようにする
+void RGYNumaBindMemory(void *ptr, size_t size);
+
 bool SetThreadPriorityForModule(const uint32_t TargetProcessId, const TCHAR *TargetModule, const RGYThreadPriority ThreadPriority);
-bool SetThreadAffinityForModule(const uint32_t TargetProcessId, const TCHAR *TargetModule, const uint64_t ThreadAffinityMask);
+bool SetThreadAffinityForModule(const uint32_t TargetProcessId, const TCHAR *TargetModule, const RGYCPUSet& ThreadAffinityMask);
 
 bool SetThreadPowerThrottolingMode(RGYThreadHandle threadHandle, const RGYThreadPowerThrottlingMode mode);
 bool SetThreadPowerThrottolingModeForModule(const uint32_t TargetProcessId, const TCHAR* TargetModule, const RGYThreadPowerThrottlingMode mode);
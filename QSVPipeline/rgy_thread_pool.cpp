@@ -0,0 +1,181 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// -------------------------------------------------------------------------------------------
+
+
+#include "rgy_thread_pool.h"
+#include "rgy_osdep.h"
+#include "cpu_info.h"
+
+static std::mutex s_poolMtx;
+static std::vector<std::weak_ptr<RGYThreadPool>> s_pools;
+static int s_poolMaxThreads = 0;
+
+//ワーカースレッドから呼ばれた場合に、自分のキューにタスクを積むための情報
+static thread_local RGYThreadPool *t_pool = nullptr;
+static thread_local int t_workerId = -1;
+
+RGYThreadPool::RGYThreadPool(int threads, const RGYParamThread& threadParam) :
+    m_workers(),
+    m_threadParam(threadParam),
+    m_pending(0),
+    m_abort(false),
+    m_submitIdx(0),
+    m_waitTask() {
+    threads = (std::max)(threads, 1);
+    for (int i = 0; i < threads; i++) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    for (int i = 0; i < threads; i++) {
+        m_workers[i]->thread = std::thread(&RGYThreadPool::workerFunc, this, i);
+    }
+}
+
+RGYThreadPool::~RGYThreadPool() {
+    m_abort = true;
+    m_waitTask.notify();
+    for (auto& worker : m_workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    m_workers.clear();
+}
+
+std::shared_ptr<RGYThreadPool> RGYThreadPool::get(const RGYParamThread& threadParam) {
+    std::lock_guard<std::mutex> lock(s_poolMtx);
+    for (auto it = s_pools.begin(); it != s_pools.end();) {
+        auto pool = it->lock();
+        if (!pool) {
+            it = s_pools.erase(it);
+            continue;
+        }
+        if (pool->threadParam() == threadParam) {
+            return pool;
+        }
+        it++;
+    }
+    const int threads = (s_poolMaxThreads > 0) ? s_poolMaxThreads : get_cpu_info().logical_cores;
+    auto pool = std::make_shared<RGYThreadPool>(threads, threadParam);
+    s_pools.push_back(pool);
+    return pool;
+}
+
+void RGYThreadPool::setMaxThreads(int threads) {
+    std::lock_guard<std::mutex> lock(s_poolMtx);
+    s_poolMaxThreads = (std::max)(threads, 0);
+}
+
+int RGYThreadPool::getMaxThreads() {
+    std::lock_guard<std::mutex> lock(s_poolMtx);
+    return s_poolMaxThreads;
+}
+
+void RGYThreadPool::submit(Task task) {
+    //ワーカースレッドからの追加なら自分のキューに、そうでなければ順番に割り当てる
+    const int workerId = (t_pool == this) ? t_workerId : (int)(m_submitIdx++ % (uint32_t)m_workers.size());
+    {
+        auto& worker = m_workers[workerId];
+        std::lock_guard<std::mutex> lock(worker->mtx);
+        worker->tasks.push_back(std::move(task));
+    }
+    m_pending++;
+    m_waitTask.notify();
+}
+
+bool RGYThreadPool::popTask(int workerId, Task& task) {
+    const int nWorkers = (int)m_workers.size();
+    for (int i = 0; i < nWorkers; i++) {
+        auto& worker = m_workers[(workerId + i) % nWorkers];
+        std::lock_guard<std::mutex> lock(worker->mtx);
+        if (worker->tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            //自分のキューは最後に積んだものから処理する (キャッシュに残っている可能性が高い)
+            task = std::move(worker->tasks.back());
+            worker->tasks.pop_back();
+        } else {
+            //他のワーカーからは古いものから奪う
+            task = std::move(worker->tasks.front());
+            worker->tasks.pop_front();
+        }
+        m_pending--;
+        return true;
+    }
+    return false;
+}
+
+void RGYThreadPool::workerFunc(int workerId) {
+    m_threadParam.apply(GetCurrentThread());
+    t_pool = this;
+    t_workerId = workerId;
+    while (!m_abort) {
+        Task task;
+        if (popTask(workerId, task)) {
+            task();
+            continue;
+        }
+        m_waitTask.wait([this]() { return m_pending > 0 || m_abort; });
+    }
+    t_pool = nullptr;
+    t_workerId = -1;
+}
+
+void RGYThreadPool::parallel_for(int n, const std::function<void(int)>& func, int maxParallel) {
+    if (n <= 1) {
+        for (int i = 0; i < n; i++) {
+            func(i);
+        }
+        return;
+    }
+    struct ParallelForState {
+        std::function<void(int)> func;
+        int n;
+        std::atomic<int> next;
+        std::atomic<int> done;
+        RGYQueueWaiter waitDone;
+        ParallelForState(const std::function<void(int)>& f, int count) : func(f), n(count), next(0), done(0), waitDone() {};
+    };
+    //呼び出し元が戻った後に起動したタスクも安全に終了できるよう、状態はshared_ptrで共有する
+    auto state = std::make_shared<ParallelForState>(func, n);
+    auto run = [state]() {
+        int i = 0;
+        while ((i = state->next++) < state->n) {
+            state->func(i);
+            if (++state->done == state->n) {
+                state->waitDone.notify();
+            }
+        }
+    };
+    const int nParallel = (maxParallel > 0) ? (std::min)(maxParallel, threads() + 1) : threads() + 1;
+    const int nTasks = (std::min)(n, nParallel) - 1;
+    for (int i = 0; i < nTasks; i++) {
+        submit(run);
+    }
+    run();
+    state->waitDone.wait([&state]() { return state->done == state->n; });
+}
@@ -0,0 +1,95 @@
+﻿// -----------------------------------------------------------------------------------------
+// QSVEnc/NVEnc by rigaya
+// -----------------------------------------------------------------------------------------
+// The MIT License
+//
+// Copyright (c) 2024 rigaya
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// -------------------------------------------------------------------------------------------
+
+
+#pragma once
+#ifndef __RGY_THREAD_POOL_H__
+#define __RGY_THREAD_POOL_H__
+
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include "rgy_thread_affinity.h"
+#include "rgy_queue.h"
+
+//プロセス内で共有するワークスティーリング方式のスレッドプール
+//複数のエンコードを同一プロセスで実行する場合 (並列エンコードなど) に、
+//色空間変換などのスレッドがそれぞれ生成されてコア数以上にスレッドが立ち上がるのを防ぐ
+//ワーカースレッドにはスレッドの設定(RGYParamThread)を適用するため、プールは設定ごとに1つずつ生成される
+//同じ設定を使用するエンコード同士 (--parallelの各エンコードなど) は同じプールを共有するが、
+//設定の異なるプールが複数ある場合、スレッド数の上限はプールごとに適用される
+//各ワーカーは自分のタスクキューの末尾から取り出し、空になったら他のワーカーのキューの先頭から奪って処理する
+class RGYThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    RGYThreadPool(int threads, const RGYParamThread& threadParam);
+    ~RGYThreadPool();
+    RGYThreadPool(const RGYThreadPool&) = delete;
+    RGYThreadPool& operator=(const RGYThreadPool&) = delete;
+
+    //threadParamごとにプロセス内で共有されるスレッドプールを取得する
+    //threadParamの異なる呼び出しには別のプールを生成する
+    //(使用しているものがなくなった時点でスレッドは終了する)
+    static std::shared_ptr<RGYThreadPool> get(const RGYParamThread& threadParam);
+    //以降に生成されるスレッドプールの、プールごとのワーカースレッド数の上限を設定する (0 = 論理コア数)
+    //すでに生成済みのプールのスレッド数は変更しない
+    static void setMaxThreads(int threads);
+    static int getMaxThreads();
+
+    int threads() const { return (int)m_workers.size(); }
+    const RGYParamThread& threadParam() const { return m_threadParam; }
+
+    //タスクを追加する (完了は待機しない)
+    void submit(Task task);
+    //func(0) ～ func(n-1) を並列に実行し、すべて終了するまで待機する
+    //呼び出し元のスレッドも処理に参加するので、ワーカーがすべて使用中でも処理が滞らない
+    //maxParallelで同時に処理するスレッド数 (呼び出し元を含む) を制限できる (0 = 制限なし)
+    void parallel_for(int n, const std::function<void(int)>& func, int maxParallel = 0);
+protected:
+    struct Worker {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+    bool popTask(int workerId, Task& task);
+    void workerFunc(int workerId);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    RGYParamThread m_threadParam;
+    std::atomic<int> m_pending;      //キューに積まれているタスク数
+    std::atomic<bool> m_abort;
+    std::atomic<uint32_t> m_submitIdx; //ワーカー外からのタスクの割り当て先
+    RGYQueueWaiter m_waitTask;       //タスクが追加されたときに通知する
+};
+
+#endif //__RGY_THREAD_POOL_H__
@@ -45,6 +45,7 @@
 #include <atomic>
 #include <functional>
 #include <type_traits>
+#include <mutex>
 #include "rgy_osdep.h"
 
 #ifndef UNREFERENCED_PARAMETER
@@ -1063,12 +1064,14 @@ class RGYListRef {
 private:
     std::vector<std::unique_ptr<T>> m_objs;
     std::unordered_map<T *, std::atomic<int>> m_refCounts;
+    std::mutex m_mtx; // 取得したshared_ptrは別スレッドで解放される場合があるので、m_refCountsの操作を保護する
 public:
-    RGYListRef() : m_objs(), m_refCounts() {};
+    RGYListRef() : m_objs(), m_refCounts(), m_mtx() {};
     ~RGYListRef() {
         clear();
     }
     void clear(std::function<void(T*)> deleteFunc = nullptr) {
+        std::lock_guard<std::mutex> lock(m_mtx);
         m_refCounts.clear();
         if (deleteFunc) {
             for (auto &obj : m_objs) {
@@ -1078,19 +1081,23 @@ public:
         m_objs.clear();
     }
     std::shared_ptr<T> get(T *ptr) {
+        std::lock_guard<std::mutex> lock(m_mtx);
         if (ptr == nullptr || m_refCounts.count(ptr) == 0) {
             return std::shared_ptr<T>();
         }
         m_refCounts[ptr]++;
         return std::shared_ptr<T>(ptr, [this](T *ptr) {
+            std::lock_guard<std::mutex> lock(m_mtx);
             m_refCounts[ptr]--;
         });
     }
     std::shared_ptr<T> get(std::function<int(T*)> initFunc = nullptr) {
+        std::lock_guard<std::mutex> lock(m_mtx);
         for (auto &count : m_refCounts) {
             if (count.second == 0) {
                 m_refCounts[count.first]++;
                 return std::shared_ptr<T>(count.first, [this](T *ptr) {
+                    std::lock_guard<std::mutex> lock(m_mtx);
                     m_refCounts[ptr]--;
                 });
             }
@@ -1104,6 +1111,7 @@ public:
         m_refCounts[ptr] = 1;
         m_objs.push_back(std::move(obj));
         return std::shared_ptr<T>(ptr, [this](T *ptr) {
+            std::lock_guard<std::mutex> lock(m_mtx);
             m_refCounts[ptr]--;
         });
     }
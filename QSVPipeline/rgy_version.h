@@ -106,6 +106,7 @@ const char *get_encoder_version();
 #define ENABLE_LIBDOVI 1
 #define ENABLE_LIBHDR10PLUS 1
 #define ENABLE_VULKAN 0
+#define ENABLE_IO_URING 0
 
 #ifdef BUILD_AUO
 #define ENCODER_NAME             "QSVEnc"